@@ -0,0 +1,863 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <errno.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include "benchmarks.h"
+#include "generator.h"
+#include "policy.h"
+#include "verdict_warmer.h"
+#include "upcase.h"
+#include "fast_path.h"
+
+#ifdef _WIN32
+  #include <direct.h>
+  #include "directory_change_feed.h"
+
+  // Visual Studio 2013 doesn't have snprintf().
+  #define snprintf(buf, size, ...) \
+          _snprintf_s(buf, size, _TRUNCATE, __VA_ARGS__)
+#else
+  #include <sys/stat.h>
+  #include <sys/types.h>
+  #include "inotify_change_feed.h"
+#endif
+
+// Maximum number of lookups per measurement.
+static const size_t MAX_LOOKUPS = 1000000;
+
+// Number of directories of the generated paths.
+static const size_t PATH_DEPTH = 8;
+
+// Maximum time to wait for the warmer to evaluate the files.
+static const unsigned WARM_TIMEOUT = 60; // Seconds.
+
+// Seeds of the generated entries (allowed and unknown).
+static const uint64_t SIGNERS_SEED = 0x9e3779b97f4a7c15ull;
+static const uint64_t UNKNOWN_SIGNERS_SEED = 0xbf58476d1ce4e5b9ull;
+static const uint64_t SHA1_SEED = 0x94d049bb133111ebull;
+static const uint64_t UNKNOWN_SHA1_SEED = 0x2545f4914f6cdd1dull;
+static const uint64_t SHA256_SEED = 0x853c49e6748fea9bull;
+static const uint64_t UNKNOWN_SHA256_SEED = 0xda3e39cb94b95bdbull;
+static const uint64_t PATHS_SEED = 0x5851f42d4c957f2dull;
+static const uint64_t UNKNOWN_PATHS_SEED = 0x14057b7ef767814full;
+
+// Milliseconds elapsed since `start`.
+static double elapsed(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration<double, std::milli>(
+           std::chrono::steady_clock::now() - start
+         ).count();
+}
+
+// Run `f` (which returns the milliseconds it measured, or a negative value
+// on error) `runs` times and return the best time.
+template<typename Function>
+static double best(size_t runs, Function f)
+{
+  double min = -1;
+
+  for (size_t i = 0; i < runs; i++) {
+    double t;
+    if ((t = f()) < 0) {
+      return -1;
+    }
+
+    if ((min < 0) || (t < min)) {
+      min = t;
+    }
+  }
+
+  return min;
+}
+
+// Number of lookups for `n` entries.
+static size_t lookups(size_t n)
+{
+  return (n < MAX_LOOKUPS) ? n : MAX_LOOKUPS;
+}
+
+// Nanoseconds per operation.
+static double per_op(double ms, size_t n)
+{
+  return (ms * 1000000.0) / static_cast<double>(n);
+}
+
+// Record and print result.
+static bool record(results& results,
+                   const char* name,
+                   size_t n,
+                   double value,
+                   const char* unit)
+{
+  if (value < 0) {
+    fprintf(stderr, "Error running benchmark '%s'.\n", name);
+    return false;
+  }
+
+  printf("%-28s %10llu %14.3f %s\n",
+         name,
+         static_cast<unsigned long long>(n),
+         value,
+         unit);
+
+  return results.add(name, n, value, unit);
+}
+
+// Build file name in the directory of the generated files.
+static bool build_filename(const benchmark_options& options,
+                           const char* name,
+                           char* filename,
+                           size_t size)
+{
+  int len = snprintf(filename, size, "%s/%s", options.directory, name);
+  return ((len > 0) && (static_cast<size_t>(len) < size));
+}
+
+// Convert file name to wide characters.
+static bool to_wide(const char* filename, wchar_t* wfilename, size_t size)
+{
+  size_t len = mbstowcs(wfilename, filename, size);
+  return ((len != static_cast<size_t>(-1)) && (len < size));
+}
+
+bool benchmark_signers(size_t n,
+                       const benchmark_options& options,
+                       results& results)
+{
+  string_entries signers;
+  string_entries unknown;
+  if ((!generate_signers(n, SIGNERS_SEED, signers)) ||
+      (!generate_signers(lookups(n), UNKNOWN_SIGNERS_SEED, unknown))) {
+    return false;
+  }
+
+  // add() (the list is kept sorted).
+  if (n <= options.max_add) {
+    double t = best(options.runs, [&]() -> double {
+      string_list<wchar_t> list;
+
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+      for (size_t i = 0; i < n; i++) {
+        size_t len;
+        const wchar_t* signer = signers.get(i, len);
+        if (!list.add(signer, len)) {
+          return -1;
+        }
+      }
+
+      return elapsed(start);
+    });
+
+    if (!record(results, "signers.add", n, per_op(t, n), "ns/entry")) {
+      return false;
+    }
+  }
+
+  // append() + build().
+  double t = best(options.runs, [&]() -> double {
+    string_list<wchar_t> list;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < n; i++) {
+      size_t len;
+      const wchar_t* signer = signers.get(i, len);
+      if (!list.append(signer, len)) {
+        return -1;
+      }
+    }
+
+    return list.build() ? elapsed(start) : -1;
+  });
+
+  if (!record(results, "signers.build", n, per_op(t, n), "ns/entry")) {
+    return false;
+  }
+
+  string_list<wchar_t> list;
+  for (size_t i = 0; i < n; i++) {
+    size_t len;
+    const wchar_t* signer = signers.get(i, len);
+    if (!list.append(signer, len)) {
+      return false;
+    }
+  }
+
+  if (!list.build()) {
+    return false;
+  }
+
+  // Perfect hash of the list (built when the policy is loaded).
+  perfect_hash<wchar_t> index;
+  t = best(options.runs, [&]() -> double {
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    return index.build(list) ? elapsed(start) : -1;
+  });
+
+  if (!record(results, "signers.index", n, per_op(t, n), "ns/entry")) {
+    return false;
+  }
+
+  // find() of allowed and unknown signers, in the list (binary search) and
+  // in the index.
+  const string_entries* const entries[] = {&signers, &unknown};
+  const char* const names[][2] = {
+    {"signers.find_hit", "signers.find_miss"},
+    {"signers.index_find_hit", "signers.index_find_miss"}
+  };
+
+  for (size_t k = 0; k < 2; k++) {
+    for (size_t i = 0; i < 2; i++) {
+      size_t nlookups = lookups(n);
+
+      t = best(options.runs, [&]() -> double {
+        std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+
+        size_t found = 0;
+        for (size_t j = 0; j < nlookups; j++) {
+          size_t len;
+          const wchar_t* signer = entries[i]->get(j, len);
+          found += (k == 0) ? list.find(signer, len) :
+                              index.find(list, signer, len);
+        }
+
+        double ms = elapsed(start);
+
+        return (found == ((i == 0) ? nlookups : 0)) ? ms : -1;
+      });
+
+      if (!record(results, names[k][i], n, per_op(t, nlookups), "ns/op")) {
+        return false;
+      }
+    }
+  }
+
+  if (!record(results,
+              "signers.memory",
+              n,
+              static_cast<double>(list.memory_usage()) / n,
+              "bytes/entry")) {
+    return false;
+  }
+
+  return record(results,
+                "signers.index_memory",
+                n,
+                static_cast<double>(index.memory_usage()) / n,
+                "bytes/entry");
+}
+
+// Benchmark digest set.
+template<size_t _Size>
+static bool benchmark_digests(const char* prefix,
+                              size_t n,
+                              uint64_t seed,
+                              uint64_t unknown_seed,
+                              const benchmark_options& options,
+                              results& results)
+{
+  uint8_t* hashes;
+  if ((hashes = generate_hashes(n, _Size, seed)) == nullptr) {
+    return false;
+  }
+
+  uint8_t* unknown;
+  if ((unknown = generate_hashes(lookups(n), _Size, unknown_seed)) == nullptr) {
+    free(hashes);
+    return false;
+  }
+
+  bool ret = false;
+
+  do {
+    char name[results::NAME_MAX_LEN];
+
+    // add().
+    double t = best(options.runs, [&]() -> double {
+      digest_set<_Size> set;
+
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+      for (size_t i = 0; i < n; i++) {
+        if (!set.add(hashes + (i * _Size))) {
+          return -1;
+        }
+      }
+
+      return elapsed(start);
+    });
+
+    snprintf(name, sizeof(name), "%s.add", prefix);
+    if (!record(results, name, n, per_op(t, n), "ns/entry")) {
+      break;
+    }
+
+    // append() + build().
+    t = best(options.runs, [&]() -> double {
+      digest_set<_Size> set;
+
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+      for (size_t i = 0; i < n; i++) {
+        if (!set.append(hashes + (i * _Size))) {
+          return -1;
+        }
+      }
+
+      return set.build() ? elapsed(start) : -1;
+    });
+
+    snprintf(name, sizeof(name), "%s.build", prefix);
+    if (!record(results, name, n, per_op(t, n), "ns/entry")) {
+      break;
+    }
+
+    digest_set<_Size> set;
+    size_t i;
+    for (i = 0; (i < n) && (set.append(hashes + (i * _Size))); i++);
+
+    if ((i < n) || (!set.build())) {
+      break;
+    }
+
+    // find() of allowed and unknown hashes.
+    const uint8_t* const entries[] = {hashes, unknown};
+    const char* const suffixes[] = {"find_hit", "find_miss"};
+
+    for (i = 0; i < 2; i++) {
+      size_t nlookups = lookups(n);
+
+      t = best(options.runs, [&]() -> double {
+        std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+
+        size_t found = 0;
+        for (size_t j = 0; j < nlookups; j++) {
+          found += set.find(entries[i] + (j * _Size));
+        }
+
+        double ms = elapsed(start);
+
+        return (found == ((i == 0) ? nlookups : 0)) ? ms : -1;
+      });
+
+      snprintf(name, sizeof(name), "%s.%s", prefix, suffixes[i]);
+      if (!record(results, name, n, per_op(t, nlookups), "ns/op")) {
+        break;
+      }
+    }
+
+    if (i < 2) {
+      break;
+    }
+
+    snprintf(name, sizeof(name), "%s.memory", prefix);
+    ret = record(results,
+                 name,
+                 n,
+                 static_cast<double>(set.memory_usage()) / n,
+                 "bytes/entry");
+  } while (false);
+
+  free(unknown);
+  free(hashes);
+
+  return ret;
+}
+
+bool benchmark_hashes(size_t n,
+                      const benchmark_options& options,
+                      results& results)
+{
+  return ((benchmark_digests<authenticode::SHA1_LEN>("sha1",
+                                                     n,
+                                                     SHA1_SEED,
+                                                     UNKNOWN_SHA1_SEED,
+                                                     options,
+                                                     results)) &&
+          (benchmark_digests<authenticode::SHA256_LEN>("sha256",
+                                                       n,
+                                                       SHA256_SEED,
+                                                       UNKNOWN_SHA256_SEED,
+                                                       options,
+                                                       results)));
+}
+
+bool benchmark_paths(size_t n,
+                     const benchmark_options& options,
+                     results& results)
+{
+  string_entries paths;
+  string_entries unknown;
+  if ((!generate_paths(n, PATH_DEPTH, PATHS_SEED, paths)) ||
+      (!generate_paths(lookups(n), PATH_DEPTH, UNKNOWN_PATHS_SEED, unknown))) {
+    return false;
+  }
+
+  // add().
+  double t = best(options.runs, [&]() -> double {
+    path_list list;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < n; i++) {
+      size_t len;
+      const wchar_t* path = paths.get(i, len);
+      if (!list.add(path, len, false)) {
+        return -1;
+      }
+    }
+
+    return elapsed(start);
+  });
+
+  if (!record(results, "paths.add", n, per_op(t, n), "ns/entry")) {
+    return false;
+  }
+
+  // append() + build().
+  t = best(options.runs, [&]() -> double {
+    path_list list;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < n; i++) {
+      size_t len;
+      const wchar_t* path = paths.get(i, len);
+      if (!list.append(path, len, false)) {
+        return -1;
+      }
+    }
+
+    return list.build() ? elapsed(start) : -1;
+  });
+
+  if (!record(results, "paths.build", n, per_op(t, n), "ns/entry")) {
+    return false;
+  }
+
+  path_list list;
+  for (size_t i = 0; i < n; i++) {
+    size_t len;
+    const wchar_t* path = paths.get(i, len);
+    if (!list.append(path, len, false)) {
+      return false;
+    }
+  }
+
+  if (!list.build()) {
+    return false;
+  }
+
+  // find() of allowed and unknown paths.
+  const string_entries* const entries[] = {&paths, &unknown};
+  const char* const names[] = {"paths.find_hit", "paths.find_miss"};
+
+  for (size_t i = 0; i < 2; i++) {
+    size_t nlookups = lookups(n);
+
+    t = best(options.runs, [&]() -> double {
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+      size_t found = 0;
+      for (size_t j = 0; j < nlookups; j++) {
+        size_t len;
+        const wchar_t* path = entries[i]->get(j, len);
+        found += list.find(path, len);
+      }
+
+      double ms = elapsed(start);
+
+      return (found == ((i == 0) ? nlookups : 0)) ? ms : -1;
+    });
+
+    if (!record(results, names[i], n, per_op(t, nlookups), "ns/op")) {
+      return false;
+    }
+  }
+
+  if (!record(results,
+              "paths.memory",
+              n,
+              static_cast<double>(list.memory_usage()) / n,
+              "bytes/entry")) {
+    return false;
+  }
+
+  // Fast path of the driver: compile and find() of allowed and unknown
+  // paths (skipped if the blob would be larger than FAST_PATH_MAX_SIZE).
+  void* blob;
+  size_t len;
+  if (!list.fast_path(blob, len)) {
+    return true;
+  }
+
+  free(blob);
+
+  t = best(options.runs, [&]() -> double {
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    if (!list.fast_path(blob, len)) {
+      return -1;
+    }
+
+    double ms = elapsed(start);
+
+    free(blob);
+
+    return ms;
+  });
+
+  if (!record(results, "paths.fast_path", n, per_op(t, n), "ns/entry")) {
+    return false;
+  }
+
+  if (!list.fast_path(blob, len)) {
+    return false;
+  }
+
+  if (!fast_path_validate(blob, len)) {
+    free(blob);
+    return false;
+  }
+
+  const char* const fast_path_names[] = {
+    "paths.fast_path_find_hit",
+    "paths.fast_path_find_miss"
+  };
+
+  for (size_t i = 0; i < 2; i++) {
+    size_t nlookups = lookups(n);
+
+    t = best(options.runs, [&]() -> double {
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+      size_t found = 0;
+      for (size_t j = 0; j < nlookups; j++) {
+        size_t pathlen;
+        const wchar_t* path = entries[i]->get(j, pathlen);
+        found += fast_path_find(blob, path, pathlen, upcase::convert);
+      }
+
+      double ms = elapsed(start);
+
+      return (found == ((i == 0) ? nlookups : 0)) ? ms : -1;
+    });
+
+    if (!record(results,
+                fast_path_names[i],
+                n,
+                per_op(t, nlookups),
+                "ns/op")) {
+      free(blob);
+      return false;
+    }
+  }
+
+  free(blob);
+
+  return record(results,
+                "paths.fast_path_size",
+                n,
+                static_cast<double>(len) / n,
+                "bytes/entry");
+}
+
+bool benchmark_policy(size_t n,
+                      const benchmark_options& options,
+                      results& results)
+{
+  char signers[MAX_PATH];
+  char hashes[MAX_PATH];
+  char paths[MAX_PATH];
+  char root[MAX_PATH];
+  char compiled[MAX_PATH];
+
+  wchar_t wsigners[MAX_PATH];
+  wchar_t whashes[MAX_PATH];
+  wchar_t wpaths[MAX_PATH];
+  wchar_t wcompiled[MAX_PATH];
+
+  if ((!build_filename(options, "signers.txt", signers, sizeof(signers))) ||
+      (!build_filename(options, "hashes.txt", hashes, sizeof(hashes))) ||
+      (!build_filename(options, "paths.txt", paths, sizeof(paths))) ||
+      (!build_filename(options, "paths", root, sizeof(root))) ||
+      (!build_filename(options, "policy.bin", compiled, sizeof(compiled))) ||
+      (!to_wide(signers, wsigners, _countof(wsigners))) ||
+      (!to_wide(hashes, whashes, _countof(whashes))) ||
+      (!to_wide(paths, wpaths, _countof(wpaths))) ||
+      (!to_wide(compiled, wcompiled, _countof(wcompiled)))) {
+    return false;
+  }
+
+  // Write the policy files: `n` signers, `n` hashes (half of them SHA-1)
+  // and up to `max_files` paths.
+  {
+    string_entries entries;
+    if ((!generate_signers(n, SIGNERS_SEED, entries)) ||
+        (!write_signers(signers, entries))) {
+      fprintf(stderr, "Error writing file '%s'.\n", signers);
+      return false;
+    }
+
+    uint8_t* sha1;
+    uint8_t* sha256 = nullptr;
+    bool ret = false;
+
+    if ((sha1 = generate_hashes(n / 2,
+                                authenticode::SHA1_LEN,
+                                SHA1_SEED)) != nullptr) {
+      if ((sha256 = generate_hashes(n - (n / 2),
+                                    authenticode::SHA256_LEN,
+                                    SHA256_SEED)) != nullptr) {
+        ret = ((write_hashes(hashes,
+                             sha1,
+                             n / 2,
+                             authenticode::SHA1_LEN,
+                             false)) &&
+               (write_hashes(hashes,
+                             sha256,
+                             n - (n / 2),
+                             authenticode::SHA256_LEN,
+                             true)));
+
+        free(sha256);
+      }
+
+      free(sha1);
+    }
+
+    if (!ret) {
+      fprintf(stderr, "Error writing file '%s'.\n", hashes);
+      return false;
+    }
+
+    if (!write_paths(paths,
+                     root,
+                     (n < options.max_files) ? n : options.max_files)) {
+      fprintf(stderr, "Error writing file '%s'.\n", paths);
+      return false;
+    }
+  }
+
+  // Load the text files.
+  double t = best(options.runs, [&]() -> double {
+    policy policy;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    return policy.load(wsigners, whashes, wpaths) ? elapsed(start) : -1;
+  });
+
+  if (!record(results, "policy.load_text", n, t, "ms")) {
+    return false;
+  }
+
+  // Compile.
+  size_t memory;
+  {
+    policy policy;
+    if (!policy.load(wsigners, whashes, wpaths)) {
+      return false;
+    }
+
+    memory = policy.memory_usage();
+
+    t = best(options.runs, [&]() -> double {
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+      return policy.compile(wcompiled) ? elapsed(start) : -1;
+    });
+  }
+
+  if ((!record(results, "policy.compile", n, t, "ms")) ||
+      (!record(results,
+               "policy.memory_text",
+               n,
+               static_cast<double>(memory),
+               "bytes"))) {
+    return false;
+  }
+
+  // Load the compiled policy (the startup time of the client).
+  t = best(options.runs, [&]() -> double {
+    policy policy;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    return policy.load(wcompiled) ? elapsed(start) : -1;
+  });
+
+  if (!record(results, "policy.load_compiled", n, t, "ms")) {
+    return false;
+  }
+
+  policy policy;
+  if (!policy.load(wcompiled)) {
+    return false;
+  }
+
+  return record(results,
+                "policy.memory_compiled",
+                n,
+                static_cast<double>(policy.memory_usage()),
+                "bytes");
+}
+
+// Evaluator which counts the files it is asked about.
+class counting_evaluator : public worker_pool::evaluator {
+  public:
+    // Constructor.
+    counting_evaluator()
+      : _M_count(0)
+    {
+    }
+
+    // Allow?
+    bool allow(const wchar_t* filename, size_t filenamelen)
+    {
+      _M_count++;
+      return true;
+    }
+
+    // Get number of files evaluated.
+    size_t count() const
+    {
+      return _M_count;
+    }
+
+  private:
+    std::atomic<size_t> _M_count;
+};
+
+// Build the file name of the executable `idx` of `directory`.
+static bool build_executable_filename(const char* directory,
+                                      size_t idx,
+                                      char* filename,
+                                      size_t size)
+{
+  int len = snprintf(filename,
+                     size,
+                     "%s/%08llu.exe",
+                     directory,
+                     static_cast<unsigned long long>(idx));
+
+  return ((len > 0) && (static_cast<size_t>(len) < size));
+}
+
+bool benchmark_warmer(size_t n,
+                      const benchmark_options& options,
+                      results& results)
+{
+  // The files must exist, so there are at most `max_files`.
+  if (n > options.max_files) {
+    n = options.max_files;
+  }
+
+  char directory[MAX_PATH];
+  wchar_t wdirectory[MAX_PATH];
+  if ((!build_filename(options, "warm", directory, sizeof(directory))) ||
+      (!to_wide(directory, wdirectory, _countof(wdirectory)))) {
+    return false;
+  }
+
+#ifdef _WIN32
+  if ((_mkdir(directory) != 0) && (errno != EEXIST)) {
+#else
+  if ((mkdir(directory, 0755) != 0) && (errno != EEXIST)) {
+#endif
+    fprintf(stderr, "Error creating directory '%s'.\n", directory);
+    return false;
+  }
+
+  // Time from the first file written until every file has been evaluated
+  // (without settle time).
+  double t = best(options.runs, [&]() -> double {
+#ifdef _WIN32
+    directory_change_feed feed;
+#else
+    inotify_change_feed feed;
+#endif
+
+    counting_evaluator evaluator;
+    verdict_warmer warmer;
+
+    if ((!feed.add(wdirectory)) || (!warmer.start(feed, evaluator, 0))) {
+      return -1;
+    }
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    // Write the files (a DOS header).
+    for (size_t i = 0; i < n; i++) {
+      char filename[MAX_PATH];
+      FILE* file;
+      if ((!build_executable_filename(directory,
+                                      i,
+                                      filename,
+                                      sizeof(filename))) ||
+          ((file = fopen(filename, "wb")) == nullptr)) {
+        return -1;
+      }
+
+      static const char header[64] = {'M', 'Z'};
+      size_t written = fwrite(header, 1, sizeof(header), file);
+
+      if ((fclose(file) != 0) || (written != sizeof(header))) {
+        return -1;
+      }
+    }
+
+    // Wait until every file has been evaluated (a file may be reported
+    // several times, each report is evaluated).
+    while (warmer.warmed() < n) {
+      if (elapsed(start) > WARM_TIMEOUT * 1000.0) {
+        return -1;
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    double ms = elapsed(start);
+
+    warmer.stop();
+
+    // Remove the files, so the next run starts with an empty directory.
+    for (size_t i = 0; i < n; i++) {
+      char filename[MAX_PATH];
+      if (build_executable_filename(directory,
+                                    i,
+                                    filename,
+                                    sizeof(filename))) {
+        remove(filename);
+      }
+    }
+
+    return ms;
+  });
+
+  return ((record(results, "warmer.files", n, t, "ms")) &&
+          (record(results, "warmer.per_file", n, per_op(t, n), "ns")));
+}
@@ -0,0 +1,54 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <stddef.h>
+#include "results.h"
+
+// Options of the benchmarks.
+struct benchmark_options {
+  // Every measurement is repeated `runs` times (the best one is taken).
+  size_t runs;
+
+  // Maximum number of entries inserted one by one (add() keeps the string
+  // lists sorted, inserting n strings is O(n^2)).
+  size_t max_add;
+
+  // Maximum number of paths of the policy files (they must exist, so they
+  // are created).
+  size_t max_files;
+
+  // Directory of the generated files.
+  const char* directory;
+};
+
+// Signers (string list and its perfect hash): add, append + build, index,
+// find and memory usage.
+bool benchmark_signers(size_t n,
+                       const benchmark_options& options,
+                       results& results);
+
+// SHA-1 and SHA-256 hashes (digest sets): add, append + build, find and
+// memory usage.
+bool benchmark_hashes(size_t n,
+                      const benchmark_options& options,
+                      results& results);
+
+// Paths (path list): add, append + build, find and memory usage, and the
+// fast path of the driver: compile, find and size.
+bool benchmark_paths(size_t n,
+                     const benchmark_options& options,
+                     results& results);
+
+// Policy files: load the text files, compile, load the compiled policy
+// (startup time) and memory usage.
+bool benchmark_policy(size_t n,
+                      const benchmark_options& options,
+                      results& results);
+
+// Pre-verification: time to report and evaluate up to `max_files` new
+// executables of a watched directory.
+bool benchmark_warmer(size_t n,
+                      const benchmark_options& options,
+                      results& results);
+
+#endif // BENCHMARKS_H
@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <errno.h>
+#include "generator.h"
+
+#ifdef _WIN32
+  #include <direct.h>
+#else
+  #include <sys/stat.h>
+  #include <sys/types.h>
+#endif
+
+// Pseudo-random number generator (xorshift64*).
+static uint64_t next(uint64_t& state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+
+  return state * 2685821657736338717ull;
+}
+
+// Create directory (it might exist already).
+static bool make_directory(const char* path)
+{
+#ifdef _WIN32
+  return ((_mkdir(path) == 0) || (errno == EEXIST));
+#else
+  return ((mkdir(path, 0755) == 0) || (errno == EEXIST));
+#endif
+}
+
+bool string_entries::add(const wchar_t* s, size_t len)
+{
+  // Grow buffer (if needed).
+  if (len > _M_size - _M_used) {
+    size_t size = (_M_size != 0) ? _M_size : 64 * 1024;
+    while (size - _M_used < len) {
+      size *= 2;
+    }
+
+    wchar_t* data;
+    if ((data = reinterpret_cast<wchar_t*>(
+                  realloc(_M_data, size * sizeof(wchar_t))
+                )) == nullptr) {
+      return false;
+    }
+
+    _M_data = data;
+    _M_size = size;
+  }
+
+  // Grow offsets (if needed).
+  if (_M_count + 2 > _M_noffsets) {
+    size_t noffsets = (_M_noffsets != 0) ? _M_noffsets * 2 : 1024;
+
+    size_t* offsets;
+    if ((offsets = reinterpret_cast<size_t*>(
+                     realloc(_M_offsets, noffsets * sizeof(size_t))
+                   )) == nullptr) {
+      return false;
+    }
+
+    _M_offsets = offsets;
+    _M_noffsets = noffsets;
+  }
+
+  memcpy(_M_data + _M_used, s, len * sizeof(wchar_t));
+
+  _M_offsets[_M_count] = _M_used;
+  _M_used += len;
+  _M_offsets[++_M_count] = _M_used;
+
+  return true;
+}
+
+bool generate_signers(size_t n, uint64_t seed, string_entries& signers)
+{
+  static const wchar_t* const companies[] = {
+    L"Contoso",
+    L"Fabrikam",
+    L"Northwind Traders",
+    L"Adventure Works Cycles",
+    L"Tailspin Toys",
+    L"Wide World Importers",
+    L"Woodgrove Bank",
+    L"Litware"
+  };
+
+  static const wchar_t* const suffixes[] = {
+    L"Corporation",
+    L"Incorporated",
+    L"Limited",
+    L"Software Development GmbH"
+  };
+
+  uint64_t state = seed;
+
+  for (size_t i = 0; i < n; i++) {
+    uint64_t v = next(state);
+
+    wchar_t name[256];
+    int len = swprintf(name,
+                       sizeof(name) / sizeof(wchar_t),
+                       L"%ls Subsidiary %016llx %ls",
+                       companies[v % 8],
+                       static_cast<unsigned long long>(v),
+                       suffixes[(v >> 8) % 4]);
+
+    if ((len < 0) || (!signers.add(name, static_cast<size_t>(len)))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint8_t* generate_hashes(size_t n, size_t hashlen, uint64_t seed)
+{
+  uint8_t* hashes;
+  if ((hashes = reinterpret_cast<uint8_t*>(malloc(n * hashlen))) != nullptr) {
+    uint64_t state = seed;
+
+    for (size_t i = 0; i < n * hashlen; i += sizeof(uint64_t)) {
+      uint64_t v = next(state);
+      size_t len = n * hashlen - i;
+      memcpy(hashes + i, &v, (len < sizeof(uint64_t)) ? len : sizeof(uint64_t));
+    }
+  }
+
+  return hashes;
+}
+
+bool generate_paths(size_t n,
+                    size_t depth,
+                    uint64_t seed,
+                    string_entries& paths)
+{
+  uint64_t state = seed;
+
+  for (size_t i = 0; i < n; i++) {
+    uint64_t v = next(state);
+
+    wchar_t path[1024];
+    int len = swprintf(path,
+                       sizeof(path) / sizeof(wchar_t),
+                       L"C:\\Program Files");
+
+    for (size_t j = 0; (j < depth) && (len > 0); j++) {
+      int ret = swprintf(path + len,
+                         (sizeof(path) / sizeof(wchar_t)) - len,
+                         L"\\Directory%u",
+                         static_cast<unsigned>((v >> (j * 4)) & 0x0f));
+
+      len = (ret > 0) ? len + ret : -1;
+    }
+
+    if (len > 0) {
+      int ret = swprintf(path + len,
+                         (sizeof(path) / sizeof(wchar_t)) - len,
+                         L"\\File%016llx.exe",
+                         static_cast<unsigned long long>(v));
+
+      len = (ret > 0) ? len + ret : -1;
+    }
+
+    if ((len < 0) || (!paths.add(path, static_cast<size_t>(len)))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool write_signers(const char* filename, const string_entries& signers)
+{
+  FILE* file;
+  if ((file = fopen(filename, "wb")) == nullptr) {
+    return false;
+  }
+
+  fprintf(file, "# Synthetic signers.\n");
+
+  for (size_t i = 0; i < signers.count(); i++) {
+    // The names are ASCII.
+    size_t len;
+    const wchar_t* signer = signers.get(i, len);
+    for (size_t j = 0; j < len; j++) {
+      fputc(static_cast<char>(signer[j]), file);
+    }
+
+    fputc('\n', file);
+  }
+
+  return (fclose(file) == 0);
+}
+
+bool write_hashes(const char* filename,
+                  const uint8_t* hashes,
+                  size_t n,
+                  size_t hashlen,
+                  bool append)
+{
+  FILE* file;
+  if ((file = fopen(filename, append ? "ab" : "wb")) == nullptr) {
+    return false;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    for (size_t j = 0; j < hashlen; j++) {
+      fprintf(file, "%02x", hashes[(i * hashlen) + j]);
+    }
+
+    fputc('\n', file);
+  }
+
+  return (fclose(file) == 0);
+}
+
+bool write_paths(const char* filename, const char* root, size_t n)
+{
+#ifdef _WIN32
+  static const char separator = '\\';
+#else
+  static const char separator = '/';
+#endif
+
+  if (!make_directory(root)) {
+    return false;
+  }
+
+  // Number of levels.
+  size_t depth = 1;
+  for (size_t m = n; m > 16; m = (m + 15) / 16) {
+    depth++;
+  }
+
+  FILE* file;
+  if ((file = fopen(filename, "wb")) == nullptr) {
+    return false;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    char path[1024];
+    size_t len = strlen(root);
+    if (len + (depth * 2) >= sizeof(path)) {
+      fclose(file);
+      return false;
+    }
+
+    memcpy(path, root, len);
+
+    // One level per hexadecimal digit of `i`, creating the directories.
+    for (size_t j = depth; j > 0; j--) {
+      path[len++] = separator;
+      path[len++] = "0123456789abcdef"[(i >> ((j - 1) * 4)) & 0x0f];
+      path[len] = 0;
+
+      if (!make_directory(path)) {
+        fclose(file);
+        return false;
+      }
+    }
+
+    fprintf(file, "%s\n", path);
+  }
+
+  return (fclose(file) == 0);
+}
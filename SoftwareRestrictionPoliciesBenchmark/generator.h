@@ -0,0 +1,99 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Synthetic policy entries. The pseudo-random generator is seeded with
+// constants, so every run generates the same entries.
+
+// List of strings of different lengths.
+class string_entries {
+  public:
+    // Constructor.
+    string_entries();
+
+    // Destructor.
+    ~string_entries();
+
+    // Add.
+    bool add(const wchar_t* s, size_t len);
+
+    // Get string.
+    const wchar_t* get(size_t idx, size_t& len) const;
+
+    // Get number of strings.
+    size_t count() const;
+
+  private:
+    wchar_t* _M_data;
+    size_t _M_size;
+    size_t _M_used;
+
+    // Offset of each string (and of the end of the last one).
+    size_t* _M_offsets;
+    size_t _M_noffsets;
+    size_t _M_count;
+};
+
+// Generate `n` signer names. The names are long and share prefixes, like
+// the names of the subsidiaries of a company.
+bool generate_signers(size_t n, uint64_t seed, string_entries& signers);
+
+// Generate `n` hashes (n * hashlen bytes, freed with free()).
+uint8_t* generate_hashes(size_t n, size_t hashlen, uint64_t seed);
+
+// Generate the paths of `n` files `depth` directories deep (16
+// subdirectories per level).
+bool generate_paths(size_t n,
+                    size_t depth,
+                    uint64_t seed,
+                    string_entries& paths);
+
+// Write file of signers.
+bool write_signers(const char* filename, const string_entries& signers);
+
+// Write file of hashes.
+bool write_hashes(const char* filename,
+                  const uint8_t* hashes,
+                  size_t n,
+                  size_t hashlen,
+                  bool append);
+
+// Create `n` directories under `root` (16 subdirectories per level) and
+// write their paths to `filename`.
+bool write_paths(const char* filename, const char* root, size_t n);
+
+inline string_entries::string_entries()
+  : _M_data(nullptr),
+    _M_size(0),
+    _M_used(0),
+    _M_offsets(nullptr),
+    _M_noffsets(0),
+    _M_count(0)
+{
+}
+
+inline string_entries::~string_entries()
+{
+  if (_M_data) {
+    free(_M_data);
+  }
+
+  if (_M_offsets) {
+    free(_M_offsets);
+  }
+}
+
+inline const wchar_t* string_entries::get(size_t idx, size_t& len) const
+{
+  len = _M_offsets[idx + 1] - _M_offsets[idx];
+  return _M_data + _M_offsets[idx];
+}
+
+inline size_t string_entries::count() const
+{
+  return _M_count;
+}
+
+#endif // GENERATOR_H
@@ -0,0 +1,85 @@
+#ifndef LINUX_TCHAR_H
+#define LINUX_TCHAR_H
+
+// Minimal replacement of <tchar.h> (Unicode: TCHAR is wchar_t).
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <sys/stat.h>
+#include "windows.h"
+
+#define _T(x) L ## x
+
+#define _TRUNCATE (static_cast<size_t>(-1))
+
+#define _S_IFDIR S_IFDIR
+#define _S_IFREG S_IFREG
+
+#define _stat stat
+
+// Open file (the encoding of the mode, e.g. "r, ccs=UTF-8", is ignored:
+// the locale decides).
+static inline int _tfopen_s(FILE** file,
+                            const wchar_t* filename,
+                            const wchar_t* mode)
+{
+  char path[PATH_MAX];
+  char m[8];
+  size_t i;
+  for (i = 0; (i + 1 < sizeof(m)) && (mode[i]) && (mode[i] != L','); i++) {
+    m[i] = static_cast<char>(mode[i]);
+  }
+
+  m[i] = 0;
+
+  if ((to_multibyte(filename, path, sizeof(path))) &&
+      ((*file = fopen(path, m)) != nullptr)) {
+    return 0;
+  }
+
+  return -1;
+}
+
+static inline int _tremove(const wchar_t* filename)
+{
+  char path[PATH_MAX];
+  return ((to_multibyte(filename, path, sizeof(path))) &&
+          (remove(path) == 0)) ? 0 : -1;
+}
+
+static inline int _wstat(const wchar_t* filename, struct stat* sbuf)
+{
+  char path[PATH_MAX];
+  return ((to_multibyte(filename, path, sizeof(path))) &&
+          (stat(path, sbuf) == 0)) ? 0 : -1;
+}
+
+// Format (in the format, "%s" is a wide string, like on Windows).
+static inline int _sntprintf_s(wchar_t* buf,
+                               size_t size,
+                               size_t,
+                               const wchar_t* format,
+                               ...)
+{
+  wchar_t fmt[256];
+  size_t len = 0;
+  for (; (*format) && (len + 2 < _countof(fmt)); format++) {
+    fmt[len++] = *format;
+    if ((*format == L'%') && (format[1] == L's')) {
+      fmt[len++] = L'l';
+    }
+  }
+
+  fmt[len] = 0;
+
+  va_list ap;
+  va_start(ap, format);
+  int ret = vswprintf(buf, size, fmt, ap);
+  va_end(ap);
+
+  return ret;
+}
+
+#endif // LINUX_TCHAR_H
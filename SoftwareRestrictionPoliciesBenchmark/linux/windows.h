@@ -0,0 +1,59 @@
+#ifndef LINUX_WINDOWS_H
+#define LINUX_WINDOWS_H
+
+// Minimal replacement of <windows.h>, so the portable parts of the client
+// (the policy and its data structures) can be built on Linux.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <wchar.h>
+
+typedef wchar_t TCHAR;
+typedef uint8_t BYTE;
+typedef uint32_t DWORD;
+typedef int BOOL;
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAX_PATH 260
+
+#define MOVEFILE_REPLACE_EXISTING 0x01
+
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+
+// Convert file name to multibyte.
+static inline bool to_multibyte(const wchar_t* filename,
+                                char* path,
+                                size_t size)
+{
+  size_t len = wcstombs(path, filename, size);
+  return ((len != static_cast<size_t>(-1)) && (len < size));
+}
+
+static inline BOOL MoveFileEx(const wchar_t* from,
+                              const wchar_t* to,
+                              DWORD)
+{
+  char oldpath[PATH_MAX];
+  char newpath[PATH_MAX];
+  return ((to_multibyte(from, oldpath, sizeof(oldpath))) &&
+          (to_multibyte(to, newpath, sizeof(newpath))) &&
+          (rename(oldpath, newpath) == 0));
+}
+
+static inline BOOL MoveFile(const wchar_t* from, const wchar_t* to)
+{
+  return MoveFileEx(from, to, 0);
+}
+
+static inline BOOL DeleteFile(const wchar_t* filename)
+{
+  char path[PATH_MAX];
+  return ((to_multibyte(filename, path, sizeof(path))) &&
+          (remove(path) == 0));
+}
+
+#endif // LINUX_WINDOWS_H
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <locale.h>
+#include "benchmarks.h"
+#include "results.h"
+
+#ifdef _WIN32
+  #include <direct.h>
+#else
+  #include <sys/stat.h>
+  #include <sys/types.h>
+#endif
+
+static const size_t MAX_ENTRIES = 10000000;
+static const size_t MAX_SIZES = 16;
+
+static void usage(const char* program);
+static bool parse_number(const char* s, size_t min, size_t max, size_t& n);
+static bool parse_sizes(const char* s, size_t* sizes, size_t& nsizes);
+
+int main(int argc, char** argv)
+{
+#ifndef _WIN32
+  // The text files are UTF-8 (on Windows, they are opened with
+  // "ccs=UTF-8").
+  setlocale(LC_ALL, "C.UTF-8");
+#endif
+
+  size_t sizes[MAX_SIZES] = {1000, 10000, 100000, 1000000};
+  size_t nsizes = 4;
+
+  benchmark_options options;
+  options.runs = 3;
+  options.max_add = 100000;
+  options.max_files = 10000;
+  options.directory = "srp-benchmark";
+
+  const char* output = nullptr;
+  const char* baseline = nullptr;
+  size_t threshold = 10;
+
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "--entries") == 0) && (i + 1 < argc)) {
+      if (!parse_sizes(argv[++i], sizes, nsizes)) {
+        fprintf(stderr, "Invalid number of entries '%s'.\n", argv[i]);
+        return -1;
+      }
+    } else if ((strcmp(argv[i], "--runs") == 0) && (i + 1 < argc)) {
+      if (!parse_number(argv[++i], 1, 1000, options.runs)) {
+        fprintf(stderr, "Invalid number of runs '%s'.\n", argv[i]);
+        return -1;
+      }
+    } else if ((strcmp(argv[i], "--max-add") == 0) && (i + 1 < argc)) {
+      if (!parse_number(argv[++i], 0, MAX_ENTRIES, options.max_add)) {
+        fprintf(stderr, "Invalid maximum number of entries '%s'.\n", argv[i]);
+        return -1;
+      }
+    } else if ((strcmp(argv[i], "--max-files") == 0) && (i + 1 < argc)) {
+      if (!parse_number(argv[++i], 1, MAX_ENTRIES, options.max_files)) {
+        fprintf(stderr, "Invalid maximum number of files '%s'.\n", argv[i]);
+        return -1;
+      }
+    } else if ((strcmp(argv[i], "--directory") == 0) && (i + 1 < argc)) {
+      options.directory = argv[++i];
+    } else if ((strcmp(argv[i], "--output") == 0) && (i + 1 < argc)) {
+      output = argv[++i];
+    } else if ((strcmp(argv[i], "--baseline") == 0) && (i + 1 < argc)) {
+      baseline = argv[++i];
+    } else if ((strcmp(argv[i], "--threshold") == 0) && (i + 1 < argc)) {
+      if (!parse_number(argv[++i], 0, 1000, threshold)) {
+        fprintf(stderr, "Invalid threshold '%s'.\n", argv[i]);
+        return -1;
+      }
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  // Load the baseline first (so a missing baseline fails fast).
+  results base;
+  if ((baseline) && (!base.load(baseline))) {
+    fprintf(stderr, "Error loading baseline '%s'.\n", baseline);
+    return -1;
+  }
+
+  // Create the directory of the generated files.
+#ifdef _WIN32
+  if ((_mkdir(options.directory) != 0) && (errno != EEXIST)) {
+#else
+  if ((mkdir(options.directory, 0755) != 0) && (errno != EEXIST)) {
+#endif
+    fprintf(stderr, "Error creating directory '%s'.\n", options.directory);
+    return -1;
+  }
+
+  results results;
+
+  printf("%-28s %10s %14s %s\n", "Name", "Entries", "Value", "Unit");
+
+  for (size_t i = 0; i < nsizes; i++) {
+    if ((!benchmark_signers(sizes[i], options, results)) ||
+        (!benchmark_hashes(sizes[i], options, results)) ||
+        (!benchmark_paths(sizes[i], options, results)) ||
+        (!benchmark_policy(sizes[i], options, results)) ||
+        (!benchmark_warmer(sizes[i], options, results))) {
+      return -1;
+    }
+  }
+
+  if ((output) && (!results.save(output))) {
+    fprintf(stderr, "Error saving results to '%s'.\n", output);
+    return -1;
+  }
+
+  if (baseline) {
+    printf("\n");
+
+    size_t nregressions;
+    if ((nregressions = results.compare(base,
+                                        static_cast<double>(threshold))) > 0) {
+      printf("\n%llu regression(s) (threshold: %llu%%).\n",
+             static_cast<unsigned long long>(nregressions),
+             static_cast<unsigned long long>(threshold));
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr, "Usage: %s [OPTIONS]\n", program);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr,
+          "  --entries <n>[,<n>...]  Number of entries (default: "
+          "1000,10000,100000,1000000,\n"
+          "                          maximum: %llu).\n",
+          static_cast<unsigned long long>(MAX_ENTRIES));
+  fprintf(stderr,
+          "  --runs <n>              Runs per measurement, the best one is "
+          "taken (default: 3).\n");
+  fprintf(stderr,
+          "  --max-add <n>           Maximum number of signers inserted one "
+          "by one\n"
+          "                          (default: 100000).\n");
+  fprintf(stderr,
+          "  --max-files <n>         Maximum number of paths of the policy "
+          "files and of\n"
+          "                          pre-verified executables "
+          "(default: 10000).\n");
+  fprintf(stderr,
+          "  --directory <dir>       Directory of the generated files "
+          "(default: srp-benchmark).\n");
+  fprintf(stderr,
+          "  --output <filename>     Save the results (JSON Lines).\n");
+  fprintf(stderr,
+          "  --baseline <filename>   Compare with the results of a previous "
+          "run.\n");
+  fprintf(stderr,
+          "  --threshold <percent>   Regression threshold (default: 10).\n");
+}
+
+bool parse_number(const char* s, size_t min, size_t max, size_t& n)
+{
+  char* end;
+  errno = 0;
+  unsigned long long v = strtoull(s, &end, 10);
+
+  if ((end == s) || (*end) || (errno != 0) || (v < min) || (v > max)) {
+    return false;
+  }
+
+  n = static_cast<size_t>(v);
+
+  return true;
+}
+
+bool parse_sizes(const char* s, size_t* sizes, size_t& nsizes)
+{
+  nsizes = 0;
+
+  do {
+    char number[32];
+    size_t len;
+    for (len = 0; (s[len]) && (s[len] != ','); len++);
+
+    if ((len == 0) || (len >= sizeof(number)) || (nsizes == MAX_SIZES)) {
+      return false;
+    }
+
+    memcpy(number, s, len);
+    number[len] = 0;
+
+    if (!parse_number(number, 1, MAX_ENTRIES, sizes[nsizes++])) {
+      return false;
+    }
+
+    s += len;
+  } while (*s++ == ',');
+
+  return true;
+}
@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "results.h"
+
+bool results::add(const char* name,
+                  uint64_t entries,
+                  double value,
+                  const char* unit)
+{
+  if ((strlen(name) >= NAME_MAX_LEN) || (strlen(unit) >= UNIT_MAX_LEN)) {
+    return false;
+  }
+
+  if (_M_used == _M_size) {
+    size_t size = (_M_size != 0) ? (_M_size * 2) : 64;
+
+    result* res;
+    if ((res = reinterpret_cast<result*>(
+                 realloc(_M_results, size * sizeof(result))
+               )) == nullptr) {
+      return false;
+    }
+
+    _M_results = res;
+    _M_size = size;
+  }
+
+  result* res = _M_results + _M_used++;
+
+  strcpy(res->name, name);
+  res->entries = entries;
+  res->value = value;
+  strcpy(res->unit, unit);
+
+  return true;
+}
+
+const results::result* results::find(const char* name, uint64_t entries) const
+{
+  for (size_t i = 0; i < _M_used; i++) {
+    if ((_M_results[i].entries == entries) &&
+        (strcmp(_M_results[i].name, name) == 0)) {
+      return _M_results + i;
+    }
+  }
+
+  return nullptr;
+}
+
+bool results::save(const char* filename) const
+{
+  FILE* file;
+  if ((file = fopen(filename, "w")) == nullptr) {
+    return false;
+  }
+
+  for (size_t i = 0; i < _M_used; i++) {
+    const result& res = _M_results[i];
+
+    fprintf(file,
+            "{\"name\": \"%s\", \"entries\": %llu, \"value\": %.3f, "
+            "\"unit\": \"%s\"}\n",
+            res.name,
+            static_cast<unsigned long long>(res.entries),
+            res.value,
+            res.unit);
+  }
+
+  return (fclose(file) == 0);
+}
+
+bool results::load(const char* filename)
+{
+  FILE* file;
+  if ((file = fopen(filename, "r")) == nullptr) {
+    return false;
+  }
+
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    // Skip blank lines.
+    const char* ptr = line;
+    while ((*ptr) && (*ptr <= ' ')) {
+      ptr++;
+    }
+
+    if (*ptr) {
+      result res;
+      if ((!parse(ptr, res)) ||
+          (!add(res.name, res.entries, res.value, res.unit))) {
+        fclose(file);
+        return false;
+      }
+    }
+  }
+
+  fclose(file);
+
+  return true;
+}
+
+size_t results::compare(const results& baseline, double threshold) const
+{
+  size_t nregressions = 0;
+
+  printf("%-28s %10s %14s %14s %9s\n",
+         "Name",
+         "Entries",
+         "Baseline",
+         "Current",
+         "Change");
+
+  for (size_t i = 0; i < _M_used; i++) {
+    const result& res = _M_results[i];
+
+    const result* base;
+    if ((base = baseline.find(res.name, res.entries)) != nullptr) {
+      double change = (base->value != 0) ?
+                        ((res.value - base->value) * 100.0) / base->value :
+                        0.0;
+
+      bool regression = (change > threshold);
+
+      printf("%-28s %10llu %14.3f %14.3f %+8.1f%% %s%s\n",
+             res.name,
+             static_cast<unsigned long long>(res.entries),
+             base->value,
+             res.value,
+             change,
+             res.unit,
+             regression ? " (REGRESSION)" : "");
+
+      if (regression) {
+        nregressions++;
+      }
+    }
+  }
+
+  return nregressions;
+}
+
+bool results::parse(const char* line, result& res)
+{
+  bool name = false;
+  bool entries = false;
+  bool value = false;
+  bool unit = false;
+
+  if (*line != '{') {
+    return false;
+  }
+
+  const char* ptr = line + 1;
+
+  do {
+    while (*ptr == ' ') {
+      ptr++;
+    }
+
+    // Key.
+    char key[16];
+    if (((ptr = parse_string(ptr, key, sizeof(key))) == nullptr) ||
+        (*ptr != ':')) {
+      return false;
+    }
+
+    do {
+      ptr++;
+    } while (*ptr == ' ');
+
+    // Value.
+    if (strcmp(key, "name") == 0) {
+      if ((ptr = parse_string(ptr, res.name, sizeof(res.name))) == nullptr) {
+        return false;
+      }
+
+      name = true;
+    } else if (strcmp(key, "unit") == 0) {
+      if ((ptr = parse_string(ptr, res.unit, sizeof(res.unit))) == nullptr) {
+        return false;
+      }
+
+      unit = true;
+    } else if (strcmp(key, "entries") == 0) {
+      char* end;
+      res.entries = strtoull(ptr, &end, 10);
+      if (end == ptr) {
+        return false;
+      }
+
+      ptr = end;
+      entries = true;
+    } else if (strcmp(key, "value") == 0) {
+      char* end;
+      res.value = strtod(ptr, &end);
+      if (end == ptr) {
+        return false;
+      }
+
+      ptr = end;
+      value = true;
+    } else {
+      return false;
+    }
+
+    while (*ptr == ' ') {
+      ptr++;
+    }
+  } while (*ptr++ == ',');
+
+  return ((ptr[-1] == '}') && (name) && (entries) && (value) && (unit));
+}
+
+const char* results::parse_string(const char* ptr, char* s, size_t size)
+{
+  if (*ptr++ != '"') {
+    return nullptr;
+  }
+
+  size_t len = 0;
+  while (*ptr != '"') {
+    if ((!*ptr) || (*ptr == '\\') || (len + 1 == size)) {
+      return nullptr;
+    }
+
+    s[len++] = *ptr++;
+  }
+
+  s[len] = 0;
+
+  return ptr + 1;
+}
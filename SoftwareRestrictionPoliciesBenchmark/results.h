@@ -0,0 +1,94 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+// Results of the benchmarks.
+// They are saved in JSON Lines (one object per line), e.g.:
+// {"name": "signers.find_hit", "entries": 1000, "value": 95.2, "unit": "ns/op"}
+class results {
+  public:
+    static const size_t NAME_MAX_LEN = 64;
+    static const size_t UNIT_MAX_LEN = 16;
+
+    struct result {
+      char name[NAME_MAX_LEN];
+      uint64_t entries;
+
+      // Lower is better.
+      double value;
+
+      char unit[UNIT_MAX_LEN];
+    };
+
+    // Constructor.
+    results();
+
+    // Destructor.
+    ~results();
+
+    // Add result.
+    bool add(const char* name,
+             uint64_t entries,
+             double value,
+             const char* unit);
+
+    // Find result.
+    const result* find(const char* name, uint64_t entries) const;
+
+    // Get number of results.
+    size_t count() const;
+
+    // Get result.
+    const result& get(size_t idx) const;
+
+    // Save.
+    bool save(const char* filename) const;
+
+    // Load.
+    bool load(const char* filename);
+
+    // Compare with a baseline. A result is a regression if it is more than
+    // `threshold` percent worse than in the baseline.
+    // Returns the number of regressions.
+    size_t compare(const results& baseline, double threshold) const;
+
+  private:
+    result* _M_results;
+    size_t _M_size;
+    size_t _M_used;
+
+    // Parse line.
+    static bool parse(const char* line, result& res);
+
+    // Parse string value.
+    static const char* parse_string(const char* ptr, char* s, size_t size);
+};
+
+inline results::results()
+  : _M_results(nullptr),
+    _M_size(0),
+    _M_used(0)
+{
+}
+
+inline results::~results()
+{
+  if (_M_results) {
+    free(_M_results);
+  }
+}
+
+inline size_t results::count() const
+{
+  return _M_used;
+}
+
+inline const results::result& results::get(size_t idx) const
+{
+  return _M_results[idx];
+}
+
+#endif // RESULTS_H
@@ -0,0 +1,270 @@
+#include "authenticode.h"
+#include "monotonic_clock.h"
+#include "sha1.h"
+#include "sha256.h"
+
+static inline uint16_t load_le16(const uint8_t* p)
+{
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t load_le32(const uint8_t* p)
+{
+  return static_cast<uint32_t>(p[0]) |
+         (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Source of the data of a file in memory.
+class memory_source : public authenticode::source {
+  public:
+    // Constructor.
+    memory_source(const void* data);
+
+    // Read.
+    const uint8_t* read(uint64_t offset, size_t len);
+
+  private:
+    const uint8_t* _M_data;
+};
+
+inline memory_source::memory_source(const void* data)
+  : _M_data(static_cast<const uint8_t*>(data))
+{
+}
+
+const uint8_t* memory_source::read(uint64_t offset, size_t len)
+{
+  return _M_data + offset;
+}
+
+bool authenticode::hash(const void* data,
+                        size_t len,
+                        uint8_t* sha1,
+                        uint8_t* sha256)
+{
+  layout layout;
+  if (parse(data, len, layout)) {
+    memory_source src(data);
+    return hash(layout, src, sha1, sha256);
+  }
+
+  return false;
+}
+
+bool authenticode::hash(const layout& layout,
+                        source& src,
+                        uint8_t* sha1,
+                        uint8_t* sha256,
+                        uint64_t deadline)
+{
+  ::sha1 sha1ctx;
+  ::sha256 sha256ctx;
+
+  for (size_t i = 0; i < layout.nranges; i++) {
+    uint64_t offset = layout.ranges[i].offset;
+    uint64_t left = layout.ranges[i].len;
+
+    while (left > 0) {
+      // Stop at the deadline (if any), checked once per chunk.
+      if ((deadline != UINT64_MAX) && (monotonic_clock::now() >= deadline)) {
+        return false;
+      }
+
+      size_t n = (left < CHUNK_SIZE) ? static_cast<size_t>(left) : CHUNK_SIZE;
+
+      const uint8_t* ptr;
+      if ((ptr = src.read(offset, n)) == nullptr) {
+        return false;
+      }
+
+      if (sha1) {
+        sha1ctx.update(ptr, n);
+      }
+
+      if (sha256) {
+        sha256ctx.update(ptr, n);
+      }
+
+      offset += n;
+      left -= n;
+    }
+  }
+
+  if (layout.padding > 0) {
+    static const uint8_t zeros[8] = {0};
+
+    if (sha1) {
+      sha1ctx.update(zeros, layout.padding);
+    }
+
+    if (sha256) {
+      sha256ctx.update(zeros, layout.padding);
+    }
+  }
+
+  if (sha1) {
+    sha1ctx.finish(sha1);
+  }
+
+  if (sha256) {
+    sha256ctx.finish(sha256);
+  }
+
+  return true;
+}
+
+bool authenticode::parse(const void* buf,
+                         size_t len,
+                         uint64_t size,
+                         layout& layout)
+{
+  static const size_t DOS_HEADER_LEN = 64;
+  static const size_t PE_LFANEW_OFFSET = 0x3c;
+  static const size_t FILE_HEADER_LEN = 20;
+  static const size_t CHECKSUM_OFFSET = 64;
+  static const size_t PE32_DATA_DIRECTORY_OFFSET = 96;
+  static const size_t PE32PLUS_DATA_DIRECTORY_OFFSET = 112;
+  static const size_t CERTIFICATE_TABLE_ENTRY = 4;
+  static const size_t DATA_DIRECTORY_ENTRY_LEN = 8;
+  static const uint16_t PE32_MAGIC = 0x10b;
+  static const uint16_t PE32PLUS_MAGIC = 0x20b;
+
+  const uint8_t* data = static_cast<const uint8_t*>(buf);
+  range* ranges = layout.ranges;
+
+  if (len > size) {
+    return false;
+  }
+
+  layout.pe = false;
+  layout.padding = 0;
+  layout.certificates.offset = 0;
+  layout.certificates.len = 0;
+
+  // The whole file is hashed if it is not a PE image.
+  ranges[0].offset = 0;
+  ranges[0].len = size;
+
+  layout.nranges = 1;
+
+  if (size < DOS_HEADER_LEN) {
+    return true;
+  }
+
+  // The headers have to be in the data.
+  if (len < DOS_HEADER_LEN) {
+    return false;
+  }
+
+  uint32_t pe;
+  if ((data[0] != 'M') ||
+      (data[1] != 'Z') ||
+      ((pe = load_le32(data + PE_LFANEW_OFFSET)) > size - 4)) {
+    return true;
+  }
+
+  if (pe > len - 4) {
+    return false;
+  }
+
+  if ((data[pe] != 'P') ||
+      (data[pe + 1] != 'E') ||
+      (data[pe + 2] != 0) ||
+      (data[pe + 3] != 0)) {
+    return true;
+  }
+
+  layout.pe = true;
+
+  // Optional header.
+  size_t optional = pe + 4 + FILE_HEADER_LEN;
+  if (optional + 2 > len) {
+    return false;
+  }
+
+  size_t directory;
+  switch (load_le16(data + optional)) {
+    case PE32_MAGIC:
+      directory = optional + PE32_DATA_DIRECTORY_OFFSET;
+      break;
+    case PE32PLUS_MAGIC:
+      directory = optional + PE32PLUS_DATA_DIRECTORY_OFFSET;
+      break;
+    default:
+      return false;
+  }
+
+  // The number of entries of the data directory precedes the directory.
+  size_t checksum = optional + CHECKSUM_OFFSET;
+  if (directory > len) {
+    return false;
+  }
+
+  uint32_t nentries = load_le32(data + directory - 4);
+
+  // Header up to the checksum.
+  ranges[0].offset = 0;
+  ranges[0].len = checksum;
+
+  // If there is no certificate table entry...
+  size_t entry = directory +
+                 (CERTIFICATE_TABLE_ENTRY * DATA_DIRECTORY_ENTRY_LEN);
+  if ((nentries <= CERTIFICATE_TABLE_ENTRY) ||
+      (entry + DATA_DIRECTORY_ENTRY_LEN > size)) {
+    // Rest of the file.
+    ranges[1].offset = checksum + 4;
+    ranges[1].len = size - (checksum + 4);
+
+    layout.nranges = 2;
+    layout.padding = static_cast<size_t>((8 - (size % 8)) % 8);
+
+    return true;
+  }
+
+  if (entry + DATA_DIRECTORY_ENTRY_LEN > len) {
+    return false;
+  }
+
+  // From the checksum to the certificate table entry.
+  ranges[1].offset = checksum + 4;
+  ranges[1].len = entry - (checksum + 4);
+
+  uint64_t certoff = load_le32(data + entry);
+  uint64_t certlen = load_le32(data + entry + 4);
+
+  // If the image is not signed...
+  if ((certoff == 0) || (certlen == 0)) {
+    // Rest of the file.
+    ranges[2].offset = entry + DATA_DIRECTORY_ENTRY_LEN;
+    ranges[2].len = size - (entry + DATA_DIRECTORY_ENTRY_LEN);
+
+    layout.nranges = 3;
+    layout.padding = static_cast<size_t>((8 - (size % 8)) % 8);
+
+    return true;
+  }
+
+  // The certificate table has to be after the headers and inside the file.
+  if ((certoff < entry + DATA_DIRECTORY_ENTRY_LEN) ||
+      (certoff > size) ||
+      (certlen > size - certoff)) {
+    return false;
+  }
+
+  // From the certificate table entry to the certificate table.
+  ranges[2].offset = entry + DATA_DIRECTORY_ENTRY_LEN;
+  ranges[2].len = certoff - (entry + DATA_DIRECTORY_ENTRY_LEN);
+
+  // Data after the certificate table (if any).
+  ranges[3].offset = certoff + certlen;
+  ranges[3].len = size - (certoff + certlen);
+
+  layout.nranges = 4;
+
+  layout.certificates.offset = certoff;
+  layout.certificates.len = certlen;
+
+  return true;
+}
@@ -0,0 +1,97 @@
+#ifndef AUTHENTICODE_H
+#define AUTHENTICODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Authenticode digests (the hashes the Windows catalog and the signatures
+// refer to).
+//
+// For a PE image, the whole file is hashed except the checksum field of the
+// optional header, the certificate table entry of the data directory and the
+// certificate table itself. An unsigned image is padded with zeros to a
+// multiple of 8 bytes (the size it will have once it is signed).
+// Any other file is hashed as is.
+class authenticode {
+  public:
+    static const size_t SHA1_LEN = 20;
+    static const size_t SHA256_LEN = 32;
+
+    // Maximum number of ranges of a file.
+    static const size_t MAX_RANGES = 4;
+
+    // Data is hashed in chunks of this size, first with one algorithm and
+    // then with the other, while the chunk is in the cache.
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    // Part of a file.
+    struct range {
+      uint64_t offset;
+      uint64_t len;
+    };
+
+    // Parts of a file.
+    struct layout {
+      // Is the file a PE image?
+      bool pe;
+
+      // Ranges which are hashed.
+      range ranges[MAX_RANGES];
+      size_t nranges;
+
+      // Number of zeros hashed after the ranges.
+      size_t padding;
+
+      // Certificate table (empty if the image is not signed).
+      range certificates;
+    };
+
+    // Source of the data of a file.
+    class source {
+      public:
+        // Destructor.
+        virtual ~source();
+
+        // Read `len` bytes (at most CHUNK_SIZE) at `offset`: the data is
+        // valid until the next read (nullptr on error).
+        virtual const uint8_t* read(uint64_t offset, size_t len) = 0;
+    };
+
+    // Parse file from its first `len` bytes (the file has `size` bytes).
+    // Fails if the file is a malformed PE image or if its headers are not in
+    // the first `len` bytes.
+    static bool parse(const void* data,
+                      size_t len,
+                      uint64_t size,
+                      layout& layout);
+
+    // Parse file in memory (fails if the file is a malformed PE image).
+    static bool parse(const void* data, size_t len, layout& layout);
+
+    // Calculate the digests of a parsed file, reading it from `src`
+    // (nullptr: don't calculate).
+    // The hashing stops at `deadline` (monotonic clock, nanoseconds; by
+    // default, none) or when a read fails: returns false if it did.
+    static bool hash(const layout& layout,
+                     source& src,
+                     uint8_t* sha1,
+                     uint8_t* sha256,
+                     uint64_t deadline = UINT64_MAX);
+
+    // Calculate the digests of a file in memory (nullptr: don't calculate).
+    static bool hash(const void* data,
+                     size_t len,
+                     uint8_t* sha1,
+                     uint8_t* sha256);
+};
+
+inline authenticode::source::~source()
+{
+}
+
+inline bool authenticode::parse(const void* data, size_t len, layout& layout)
+{
+  return parse(data, len, len, layout);
+}
+
+#endif // AUTHENTICODE_H
@@ -0,0 +1,65 @@
+#include "catalog.h"
+#include <softpub.h>
+#include <bcrypt.h>
+
+#pragma comment(lib, "wintrust.lib")
+
+const GUID catalog::driver_action_verify = DRIVER_ACTION_VERIFY;
+
+bool catalog::open()
+{
+  // Acquire handle to catalog.
+  if (CryptCATAdminAcquireContext2(&_M_catalog,
+                                   &driver_action_verify,
+                                   NULL,
+                                   NULL,
+                                   0)) {
+    // Acquire handle to SHA-256 catalog (optional).
+    if (!CryptCATAdminAcquireContext2(&_M_sha256_catalog,
+                                      &driver_action_verify,
+                                      BCRYPT_SHA256_ALGORITHM,
+                                      NULL,
+                                      0)) {
+      _M_sha256_catalog = nullptr;
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+void catalog::close()
+{
+  if (_M_catalog) {
+    CryptCATAdminReleaseContext(_M_catalog, 0);
+    _M_catalog = nullptr;
+  }
+
+  if (_M_sha256_catalog) {
+    CryptCATAdminReleaseContext(_M_sha256_catalog, 0);
+    _M_sha256_catalog = nullptr;
+  }
+}
+
+bool catalog::find(const BYTE* hash, DWORD hashlen) const
+{
+  HCATADMIN catalog;
+  if ((catalog = get((hashlen == SHA1_LEN) ? algorithm::sha1 :
+                                             algorithm::sha256)) == nullptr) {
+    return false;
+  }
+
+  HCATINFO info;
+  if ((info = CryptCATAdminEnumCatalogFromHash(catalog,
+                                               const_cast<BYTE*>(hash),
+                                               hashlen,
+                                               0,
+                                               NULL)) != NULL) {
+    CryptCATAdminReleaseCatalogContext(catalog, info, 0);
+
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,63 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <windows.h>
+#include <mscat.h>
+
+// Handle to the Windows catalog.
+// An HCATADMIN is not thread-safe, each thread must use its own catalog.
+class catalog {
+  public:
+    static const DWORD SHA1_LEN = 20;
+    static const DWORD SHA256_LEN = 32;
+    static const DWORD HASH_MAX_LEN = SHA256_LEN;
+
+    enum class algorithm {
+      sha1,
+      sha256
+    };
+
+    // Constructor.
+    catalog();
+
+    // Destructor.
+    ~catalog();
+
+    // Open.
+    bool open();
+
+    // Close.
+    void close();
+
+    // Find hash (SHA-1 or SHA-256).
+    bool find(const BYTE* hash, DWORD hashlen) const;
+
+  private:
+    static const GUID driver_action_verify;
+
+    HCATADMIN _M_catalog;
+
+    // SHA-256 catalog (nullptr if not supported by the system).
+    HCATADMIN _M_sha256_catalog;
+
+    // Get catalog.
+    HCATADMIN get(algorithm algorithm) const;
+};
+
+inline catalog::catalog()
+  : _M_catalog(nullptr),
+    _M_sha256_catalog(nullptr)
+{
+}
+
+inline HCATADMIN catalog::get(algorithm algorithm) const
+{
+  return (algorithm == algorithm::sha1) ? _M_catalog : _M_sha256_catalog;
+}
+
+inline catalog::~catalog()
+{
+  close();
+}
+
+#endif // CATALOG_H
@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+#include "catalog_benchmark.h"
+#include "catalog_index.h"
+
+#ifdef _WIN32
+  // Visual Studio 2013 doesn't have snprintf().
+  #define snprintf(buf, size, ...) \
+          _snprintf_s(buf, size, _TRUNCATE, __VA_ARGS__)
+#endif
+
+// Pseudo-random number generator (xorshift64*), so every run looks up the
+// same unknown hashes.
+static uint64_t next(uint64_t& state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+
+  return state * 2685821657736338717ull;
+}
+
+// Milliseconds elapsed since `start`.
+static double elapsed(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration<double, std::milli>(
+           std::chrono::steady_clock::now() - start
+         ).count();
+}
+
+// Build index and print the time.
+static bool build(const char* name,
+                  const wchar_t* directory,
+                  const catalog_index* previous,
+                  size_t nthreads,
+                  catalog_index& index)
+{
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+
+  if (!index.build(directory, previous, nthreads)) {
+    return false;
+  }
+
+  double t = elapsed(start);
+
+  // Size of the catalog files.
+  uint64_t size = 0;
+  for (size_t i = 0; i < index.files(); i++) {
+    size += index.get(i).id.size;
+  }
+
+  printf("%-16s %10.1f ms, %llu files (%llu parsed, %llu failed), "
+         "%llu hashes, %.1f MB\n",
+         name,
+         t,
+         static_cast<unsigned long long>(index.files()),
+         static_cast<unsigned long long>(index.parsed()),
+         static_cast<unsigned long long>(index.failed()),
+         static_cast<unsigned long long>(index.count()),
+         size / (1024.0 * 1024.0));
+
+  return true;
+}
+
+// Look up hashes and print the time per lookup.
+template<size_t _Size>
+static void lookup(const char* name,
+                   const catalog_index& index,
+                   const uint8_t* hashes,
+                   size_t count)
+{
+  if (count == 0) {
+    return;
+  }
+
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+
+  size_t found = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (index.find(hashes + (i * _Size), _Size)) {
+      found++;
+    }
+  }
+
+  double t = elapsed(start);
+
+  printf("%-16s %10.1f ns/lookup, %llu of %llu found\n",
+         name,
+         (t * 1000000.0) / count,
+         static_cast<unsigned long long>(found),
+         static_cast<unsigned long long>(count));
+}
+
+// Look up the member hashes of every catalog file and as many unknown
+// hashes.
+template<size_t _Size>
+static bool lookup(const char* known,
+                   const char* unknown,
+                   const catalog_index& index)
+{
+  catalog_index::hash_list hashes(_Size);
+  for (size_t i = 0; i < index.files(); i++) {
+    const catalog_index::file& f = index.get(i);
+    const catalog_index::hash_list& members =
+      (_Size == catalog_index::SHA1_LEN) ? f.sha1 : f.sha256;
+
+    if (!hashes.add(members.data(), members.count())) {
+      return false;
+    }
+  }
+
+  lookup<_Size>(known, index, hashes.data(), hashes.count());
+
+  // Unknown hashes.
+  catalog_index::hash_list random(_Size);
+  uint64_t state = 0x9e3779b97f4a7c15ull;
+  for (size_t i = 0; i < hashes.count(); i++) {
+    uint8_t hash[_Size];
+    for (size_t j = 0; j < _Size; j += sizeof(uint64_t)) {
+      uint64_t v = next(state);
+      memcpy(hash + j, &v, ((_Size - j) < sizeof(uint64_t)) ?
+                             _Size - j :
+                             sizeof(uint64_t));
+    }
+
+    if (!random.add(hash)) {
+      return false;
+    }
+  }
+
+  lookup<_Size>(unknown, index, random.data(), random.count());
+
+  return true;
+}
+
+bool catalog_benchmark(const wchar_t* directory, size_t nthreads)
+{
+  // Index the catalog files with one thread and with `nthreads` threads.
+  catalog_index index;
+  if (!build("Build (1)", directory, nullptr, 1, index)) {
+    return false;
+  }
+
+  if (nthreads > 1) {
+    catalog_index parallel;
+    char name[32];
+    snprintf(name,
+             sizeof(name),
+             "Build (%u)",
+             static_cast<unsigned>(nthreads));
+    if (!build(name, directory, nullptr, nthreads, parallel)) {
+      return false;
+    }
+  }
+
+  // Update the index (no catalog file has changed).
+  {
+    catalog_index updated;
+    if (!build("Update", directory, &index, nthreads, updated)) {
+      return false;
+    }
+  }
+
+  // Save and load the index.
+  {
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    image_writer writer;
+    if (!index.save(writer)) {
+      return false;
+    }
+
+    double save = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+
+    catalog_index loaded;
+    if ((!loaded.load(writer.buffer(), writer.length())) ||
+        (loaded.count() != index.count())) {
+      return false;
+    }
+
+    printf("%-16s %10.1f ms, load: %.1f ms, %.1f MB\n",
+           "Save",
+           save,
+           elapsed(start),
+           writer.length() / (1024.0 * 1024.0));
+  }
+
+  return ((lookup<catalog_index::SHA1_LEN>("SHA-1 known",
+                                           "SHA-1 unknown",
+                                           index)) &&
+          (lookup<catalog_index::SHA256_LEN>("SHA-256 known",
+                                             "SHA-256 unknown",
+                                             index)));
+}
@@ -0,0 +1,12 @@
+#ifndef CATALOG_BENCHMARK_H
+#define CATALOG_BENCHMARK_H
+
+#include <stddef.h>
+
+// Catalog benchmark: index the catalog files of `directory` with one thread
+// and with `nthreads` threads, update the index (nothing has changed), save
+// and load it, look up every member hash and as many unknown hashes, and
+// print the times.
+bool catalog_benchmark(const wchar_t* directory, size_t nthreads);
+
+#endif // CATALOG_BENCHMARK_H
@@ -0,0 +1,909 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include "catalog_index.h"
+#include "mapped_file.h"
+#include "der.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <limits.h>
+  #include <dirent.h>
+#endif
+
+// 1.2.840.113549.1.7.2 (signedData).
+static const uint8_t OID_SIGNED_DATA[] = {
+  0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x07, 0x02
+};
+
+// 1.3.6.1.4.1.311.10.1 (szOID_CTL).
+static const uint8_t OID_CTL[] = {
+  0x2b, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x0a, 0x01
+};
+
+// 1.3.6.1.4.1.311.2.1.4 (SPC_INDIRECT_DATA_OBJID).
+static const uint8_t OID_SPC_INDIRECT_DATA[] = {
+  0x2b, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x02, 0x01, 0x04
+};
+
+// Maximum length of the path of a catalog file.
+static const size_t FILENAME_MAX_LEN = 1024;
+
+static const uint8_t UTC_TIME = 0x17;
+static const uint8_t GENERALIZED_TIME = 0x18;
+
+const uint8_t catalog_index::magic[8] = {
+  'S', 'R', 'C', 'A', 'T', 'I', 'D', 'X'
+};
+
+// Is the element the OID?
+static bool is_oid(const der_element& element,
+                   const uint8_t* oid,
+                   size_t oidlen)
+{
+  return ((element.len == oidlen) && (memcmp(element.data, oid, oidlen) == 0));
+}
+
+// Get the digest of a member from its SpcIndirectDataContent:
+// SpcIndirectDataContent ::= SEQUENCE {
+//   data SpcAttributeTypeAndOptionalValue,
+//   messageDigest DigestInfo
+// }
+//
+// DigestInfo ::= SEQUENCE {
+//   digestAlgorithm AlgorithmIdentifier,
+//   digest OCTETSTRING
+// }
+static bool indirect_data_digest(const der_element& values,
+                                 der_element& digest)
+{
+  der_reader values_reader(values);
+  der_element indirect_data;
+  if (!values_reader.next(der_reader::SEQUENCE, indirect_data)) {
+    return false;
+  }
+
+  der_reader indirect_data_reader(indirect_data);
+  der_element element;
+  der_element digest_info;
+  if ((!indirect_data_reader.next(der_reader::SEQUENCE, element)) ||
+      (!indirect_data_reader.next(der_reader::SEQUENCE, digest_info))) {
+    return false;
+  }
+
+  der_reader digest_info_reader(digest_info);
+  return ((digest_info_reader.next(der_reader::SEQUENCE, element)) &&
+          (digest_info_reader.next(der_reader::OCTET_STRING, digest)));
+}
+
+// Decode the tag of a member which is the hash in hexadecimal (UTF-16LE).
+static bool decode_tag(const der_element& tag, uint8_t* hash, size_t hashlen)
+{
+  if (tag.len != hashlen * 4) {
+    return false;
+  }
+
+  for (size_t i = 0; i < hashlen * 2; i++) {
+    uint8_t c = tag.data[i * 2];
+    if (tag.data[(i * 2) + 1] != 0) {
+      return false;
+    }
+
+    uint8_t n;
+    if ((c >= '0') && (c <= '9')) {
+      n = c - '0';
+    } else if ((c >= 'A') && (c <= 'F')) {
+      n = c - 'A' + 10;
+    } else if ((c >= 'a') && (c <= 'f')) {
+      n = c - 'a' + 10;
+    } else {
+      return false;
+    }
+
+    if ((i % 2) == 0) {
+      hash[i / 2] = n << 4;
+    } else {
+      hash[i / 2] |= n;
+    }
+  }
+
+  return true;
+}
+
+// List the catalog files of a directory (file names relative to the
+// directory, separated by '\0').
+static bool list_files(const wchar_t* directory,
+                       std::vector<wchar_t>& filenames)
+{
+#ifdef _WIN32
+  wchar_t pattern[MAX_PATH];
+  if (_snwprintf_s(pattern,
+                   _countof(pattern),
+                   _TRUNCATE,
+                   L"%s\\*.cat",
+                   directory) < 0) {
+    return false;
+  }
+
+  WIN32_FIND_DATAW data;
+  HANDLE hFind;
+  if ((hFind = FindFirstFileW(pattern, &data)) == INVALID_HANDLE_VALUE) {
+    return (GetLastError() == ERROR_FILE_NOT_FOUND);
+  }
+
+  try {
+    do {
+      if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+        filenames.insert(filenames.end(),
+                         data.cFileName,
+                         data.cFileName + wcslen(data.cFileName) + 1);
+      }
+    } while (FindNextFileW(hFind, &data));
+  } catch (...) {
+    FindClose(hFind);
+    return false;
+  }
+
+  FindClose(hFind);
+
+  return true;
+#else
+  // Convert directory name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, directory, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return false;
+  }
+
+  DIR* dir;
+  if ((dir = opendir(path)) == nullptr) {
+    return false;
+  }
+
+  try {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      // If the extension is ".cat" (case insensitive)...
+      size_t namelen = strlen(entry->d_name);
+      if ((namelen > 4) &&
+          (strcasecmp(entry->d_name + namelen - 4, ".cat") == 0)) {
+        wchar_t name[NAME_MAX + 1];
+        size_t n = mbstowcs(name, entry->d_name, NAME_MAX + 1);
+        if ((n != static_cast<size_t>(-1)) && (n <= NAME_MAX)) {
+          filenames.insert(filenames.end(), name, name + n + 1);
+        }
+      }
+    }
+  } catch (...) {
+    closedir(dir);
+    return false;
+  }
+
+  closedir(dir);
+
+  return true;
+#endif
+}
+
+// Build the path of a file of a directory.
+static bool build_path(const wchar_t* directory,
+                       const wchar_t* filename,
+                       wchar_t* path,
+                       size_t size)
+{
+#ifdef _WIN32
+  static const wchar_t separator = L'\\';
+#else
+  static const wchar_t separator = L'/';
+#endif
+
+  size_t dirlen = wcslen(directory);
+  size_t filenamelen = wcslen(filename);
+  if (dirlen + 1 + filenamelen >= size) {
+    return false;
+  }
+
+  memcpy(path, directory, dirlen * sizeof(wchar_t));
+  path[dirlen] = separator;
+  memcpy(path + dirlen + 1, filename, (filenamelen + 1) * sizeof(wchar_t));
+
+  return true;
+}
+
+bool catalog_index::hash_list::add(const uint8_t* hashes, size_t count)
+{
+  if (count > _M_size - _M_count) {
+    size_t size = (_M_size != 0) ? _M_size : 64;
+    while (size - _M_count < count) {
+      size *= 2;
+    }
+
+    uint8_t* data;
+    if ((data = reinterpret_cast<uint8_t*>(
+                  realloc(_M_data, size * _M_hashlen)
+                )) == nullptr) {
+      return false;
+    }
+
+    _M_data = data;
+    _M_size = size;
+  }
+
+  memcpy(_M_data + (_M_count * _M_hashlen), hashes, count * _M_hashlen);
+  _M_count += count;
+
+  return true;
+}
+
+catalog_index::~catalog_index()
+{
+  if (_M_files) {
+    for (size_t i = 0; i < _M_nfiles; i++) {
+      delete _M_files[i];
+    }
+
+    free(_M_files);
+  }
+}
+
+bool catalog_index::build(const wchar_t* directory,
+                          const catalog_index* previous,
+                          size_t nthreads)
+{
+  if (_M_nfiles != 0) {
+    return false;
+  }
+
+  // List catalog files (sorted, so they can be found by name).
+  std::vector<wchar_t> names;
+  if (!list_files(directory, names)) {
+    return false;
+  }
+
+  std::vector<const wchar_t*> filenames;
+  try {
+    for (size_t i = 0; i < names.size(); i += wcslen(&names[i]) + 1) {
+      filenames.push_back(&names[i]);
+    }
+  } catch (...) {
+    return false;
+  }
+
+  std::sort(filenames.begin(),
+            filenames.end(),
+            [](const wchar_t* a, const wchar_t* b) {
+              return (wcscmp(a, b) < 0);
+            });
+
+  system_file_identity_probe probe;
+
+  // Files to parse.
+  std::vector<file*> pending;
+
+  for (size_t i = 0; i < filenames.size(); i++) {
+    wchar_t path[FILENAME_MAX_LEN];
+    file* f;
+    if ((!build_path(directory, filenames[i], path, FILENAME_MAX_LEN)) ||
+        ((f = add(filenames[i], wcslen(filenames[i]))) == nullptr)) {
+      return false;
+    }
+
+    // If the file has disappeared...
+    if (!probe.probe(path, wcslen(path), f->id)) {
+      delete f;
+      _M_nfiles--;
+
+      continue;
+    }
+
+    // If the file has not changed, copy its members.
+    const file* old;
+    if ((previous) &&
+        ((old = previous->find(filenames[i])) != nullptr) &&
+        (old->id == f->id)) {
+      if ((!f->sha1.add(old->sha1.data(), old->sha1.count())) ||
+          (!f->sha256.add(old->sha256.data(), old->sha256.count()))) {
+        return false;
+      }
+
+      f->parsed = old->parsed;
+      if (!f->parsed) {
+        _M_failed++;
+      }
+    } else {
+      try {
+        pending.push_back(f);
+      } catch (...) {
+        return false;
+      }
+    }
+  }
+
+  // Parse the new files and the files which have changed.
+  if (!pending.empty()) {
+    parse_files(directory, &pending[0], pending.size(), nthreads);
+  }
+
+  return build_sets();
+}
+
+bool catalog_index::load(const wchar_t* filename)
+{
+  mapped_file f;
+  return ((f.open(filename)) && (load(f.data(), f.size())));
+}
+
+bool catalog_index::load(const void* data, size_t len)
+{
+  if ((_M_nfiles != 0) || (len < sizeof(header))) {
+    return false;
+  }
+
+  // Validate image.
+  const header* hdr = reinterpret_cast<const header*>(data);
+  if ((memcmp(hdr->magic, magic, sizeof(magic)) != 0) ||
+      (hdr->version != version) ||
+      (hdr->layout != layout()) ||
+      (hdr->size != len) ||
+      (hdr->checksum !=
+       image_checksum(reinterpret_cast<const uint8_t*>(data) +
+                      sizeof(header),
+                      len - sizeof(header)))) {
+    return false;
+  }
+
+  image_reader reader(data, len);
+
+  const record* records;
+  if ((records = reinterpret_cast<const record*>(
+                   reader.get(hdr->files, sizeof(uint64_t), sizeof(record))
+                 )) == nullptr) {
+    return false;
+  }
+
+  size_t nrecords = static_cast<size_t>(hdr->files.len / sizeof(record));
+  for (size_t i = 0; i < nrecords; i++) {
+    const record* r = records + i;
+
+    const wchar_t* filename;
+    const uint8_t* sha1;
+    const uint8_t* sha256;
+    file* f;
+    if (((filename = reinterpret_cast<const wchar_t*>(
+                       reader.get(r->filename,
+                                  sizeof(wchar_t),
+                                  sizeof(wchar_t))
+                     )) == nullptr) ||
+        (r->filename.len == 0) ||
+        ((sha1 = reinterpret_cast<const uint8_t*>(
+                   reader.get(r->sha1, 1, SHA1_LEN)
+                 )) == nullptr) ||
+        ((sha256 = reinterpret_cast<const uint8_t*>(
+                     reader.get(r->sha256, 1, SHA256_LEN)
+                   )) == nullptr) ||
+        ((f = add(filename,
+                  static_cast<size_t>(r->filename.len / sizeof(wchar_t))))
+         == nullptr) ||
+        (!f->sha1.add(sha1, static_cast<size_t>(r->sha1.len / SHA1_LEN))) ||
+        (!f->sha256.add(sha256,
+                        static_cast<size_t>(r->sha256.len / SHA256_LEN)))) {
+      return false;
+    }
+
+    // The files must be sorted.
+    if ((_M_nfiles > 1) &&
+        (wcscmp(_M_files[_M_nfiles - 2]->filename, f->filename) >= 0)) {
+      return false;
+    }
+
+    f->id = r->id;
+    f->parsed = (r->parsed != 0);
+    if (!f->parsed) {
+      _M_failed++;
+    }
+  }
+
+  return build_sets();
+}
+
+bool catalog_index::save(const wchar_t* filename) const
+{
+  image_writer writer;
+  if (!save(writer)) {
+    return false;
+  }
+
+  // Write to a temporary file and rename it.
+  wchar_t tmpfilename[FILENAME_MAX_LEN];
+  if (swprintf(tmpfilename,
+               FILENAME_MAX_LEN,
+               L"%ls.tmp",
+               filename) < 0) {
+    return false;
+  }
+
+#ifdef _WIN32
+  FILE* file;
+  if (_wfopen_s(&file, tmpfilename, L"wb") != 0) {
+    return false;
+  }
+#else
+  // Convert file names to multibyte.
+  char path[PATH_MAX];
+  char tmppath[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  size_t tmplen = wcstombs(tmppath, tmpfilename, sizeof(tmppath));
+  if ((len == static_cast<size_t>(-1)) ||
+      (len == sizeof(path)) ||
+      (tmplen == static_cast<size_t>(-1)) ||
+      (tmplen == sizeof(tmppath))) {
+    return false;
+  }
+
+  FILE* file;
+  if ((file = fopen(tmppath, "wb")) == nullptr) {
+    return false;
+  }
+#endif
+
+  bool ret = (fwrite(writer.buffer(), 1, writer.length(), file) ==
+              writer.length());
+
+  if ((fclose(file) == 0) && (ret)) {
+#ifdef _WIN32
+    if (MoveFileExW(tmpfilename, filename, MOVEFILE_REPLACE_EXISTING)) {
+      return true;
+    }
+
+    _wremove(tmpfilename);
+#else
+    if (rename(tmppath, path) == 0) {
+      return true;
+    }
+
+    remove(tmppath);
+#endif
+  } else {
+#ifdef _WIN32
+    _wremove(tmpfilename);
+#else
+    remove(tmppath);
+#endif
+  }
+
+  return false;
+}
+
+bool catalog_index::save(image_writer& writer) const
+{
+  // Reserve header.
+  header hdr;
+  memset(&hdr, 0, sizeof(header));
+
+  image_block block;
+  if ((writer.length() != 0) ||
+      (!writer.add(&hdr, sizeof(header), 64, block))) {
+    return false;
+  }
+
+  record* records = nullptr;
+  if ((_M_nfiles > 0) &&
+      ((records = reinterpret_cast<record*>(
+                    calloc(_M_nfiles, sizeof(record))
+                  )) == nullptr)) {
+    return false;
+  }
+
+  // Add the file names and the members of each file.
+  for (size_t i = 0; i < _M_nfiles; i++) {
+    const file* f = _M_files[i];
+    record* r = records + i;
+
+    r->id = f->id;
+    r->parsed = f->parsed ? 1 : 0;
+
+    if ((!writer.add(f->filename,
+                     f->filenamelen * sizeof(wchar_t),
+                     sizeof(wchar_t),
+                     r->filename)) ||
+        (!writer.add(f->sha1.data(),
+                     f->sha1.count() * SHA1_LEN,
+                     1,
+                     r->sha1)) ||
+        (!writer.add(f->sha256.data(),
+                     f->sha256.count() * SHA256_LEN,
+                     1,
+                     r->sha256))) {
+      free(records);
+      return false;
+    }
+  }
+
+  bool ret = writer.add(records,
+                        _M_nfiles * sizeof(record),
+                        sizeof(uint64_t),
+                        hdr.files);
+
+  if (records) {
+    free(records);
+  }
+
+  if (ret) {
+    // Write header.
+    memcpy(hdr.magic, magic, sizeof(magic));
+    hdr.version = version;
+    hdr.layout = layout();
+    hdr.size = writer.length();
+    hdr.checksum = image_checksum(writer.buffer() + sizeof(header),
+                                  writer.length() - sizeof(header));
+
+    memcpy(writer.buffer(), &hdr, sizeof(header));
+  }
+
+  return ret;
+}
+
+bool catalog_index::find(const uint8_t* hash, size_t hashlen) const
+{
+  switch (hashlen) {
+    case SHA1_LEN:
+      return _M_sha1.find(hash);
+    case SHA256_LEN:
+      return _M_sha256.find(hash);
+    default:
+      return false;
+  }
+}
+
+size_t catalog_index::memory_usage() const
+{
+  size_t size = (_M_nfiles * (sizeof(file*) + sizeof(file))) +
+                _M_sha1.memory_usage() +
+                _M_sha256.memory_usage();
+
+  for (size_t i = 0; i < _M_nfiles; i++) {
+    size += ((_M_files[i]->filenamelen + 1) * sizeof(wchar_t)) +
+            _M_files[i]->sha1.memory_usage() +
+            _M_files[i]->sha256.memory_usage();
+  }
+
+  return size;
+}
+
+bool catalog_index::parse(const uint8_t* data,
+                          size_t len,
+                          hash_list& sha1,
+                          hash_list& sha256)
+{
+  // ContentInfo ::= SEQUENCE {
+  //   contentType ContentType,
+  //   content [0] EXPLICIT SignedData
+  // }
+  der_reader reader(data, len);
+  der_element content_info;
+  if (!reader.next(der_reader::SEQUENCE, content_info)) {
+    return false;
+  }
+
+  der_reader content_info_reader(content_info);
+  der_element element;
+  der_element content;
+  if ((!content_info_reader.next(der_reader::OID, element)) ||
+      (!is_oid(element, OID_SIGNED_DATA, sizeof(OID_SIGNED_DATA))) ||
+      (!content_info_reader.next(der_reader::CONTEXT_0, content))) {
+    return false;
+  }
+
+  // SignedData ::= SEQUENCE {
+  //   version CMSVersion,
+  //   digestAlgorithms DigestAlgorithmIdentifiers,
+  //   encapContentInfo EncapsulatedContentInfo,
+  //   ...
+  // }
+  //
+  // EncapsulatedContentInfo ::= SEQUENCE {
+  //   eContentType ContentType,
+  //   eContent [0] EXPLICIT CertificateTrustList
+  // }
+  der_reader content_reader(content);
+  der_element signed_data;
+  if (!content_reader.next(der_reader::SEQUENCE, signed_data)) {
+    return false;
+  }
+
+  der_reader signed_data_reader(signed_data);
+  der_element encap_content_info;
+  if ((!signed_data_reader.next(der_reader::INTEGER, element)) ||
+      (!signed_data_reader.next(der_reader::SET, element)) ||
+      (!signed_data_reader.next(der_reader::SEQUENCE, encap_content_info))) {
+    return false;
+  }
+
+  der_reader encap_content_info_reader(encap_content_info);
+  der_element econtent;
+  if ((!encap_content_info_reader.next(der_reader::OID, element)) ||
+      (!is_oid(element, OID_CTL, sizeof(OID_CTL))) ||
+      (!encap_content_info_reader.next(der_reader::CONTEXT_0, econtent))) {
+    return false;
+  }
+
+  // The list might be wrapped in an OCTET STRING.
+  der_reader econtent_reader(econtent);
+  if (econtent_reader.peek() == der_reader::OCTET_STRING) {
+    if (!econtent_reader.next(element)) {
+      return false;
+    }
+
+    econtent_reader = der_reader(element);
+  }
+
+  // CertificateTrustList ::= SEQUENCE {
+  //   version CTLVersion DEFAULT v1,
+  //   subjectUsage SubjectUsage,
+  //   listIdentifier ListIdentifier OPTIONAL,
+  //   sequenceNumber HUGEINTEGER OPTIONAL,
+  //   ctlThisUpdate ChoiceOfTime,
+  //   ctlNextUpdate ChoiceOfTime OPTIONAL,
+  //   subjectAlgorithm AlgorithmIdentifier,
+  //   trustedSubjects TrustedSubjects OPTIONAL,
+  //   ctlExtensions [0] EXPLICIT Extensions OPTIONAL
+  // }
+  der_element ctl;
+  if (!econtent_reader.next(der_reader::SEQUENCE, ctl)) {
+    return false;
+  }
+
+  der_reader ctl_reader(ctl);
+  if (((ctl_reader.peek() == der_reader::INTEGER) &&
+       (!ctl_reader.next(element))) ||
+      (!ctl_reader.next(der_reader::SEQUENCE, element)) ||
+      ((ctl_reader.peek() == der_reader::OCTET_STRING) &&
+       (!ctl_reader.next(element))) ||
+      ((ctl_reader.peek() == der_reader::INTEGER) &&
+       (!ctl_reader.next(element))) ||
+      ((ctl_reader.peek() != UTC_TIME) &&
+       (ctl_reader.peek() != GENERALIZED_TIME)) ||
+      (!ctl_reader.next(element)) ||
+      (((ctl_reader.peek() == UTC_TIME) ||
+        (ctl_reader.peek() == GENERALIZED_TIME)) &&
+       (!ctl_reader.next(element))) ||
+      (!ctl_reader.next(der_reader::SEQUENCE, element))) {
+    return false;
+  }
+
+  // No members?
+  der_element subjects;
+  if (!ctl_reader.next(der_reader::SEQUENCE, subjects)) {
+    return true;
+  }
+
+  // TrustedSubject ::= SEQUENCE {
+  //   subjectIdentifier SubjectIdentifier,
+  //   subjectAttributes Attributes OPTIONAL
+  // }
+  der_reader subjects_reader(subjects);
+  while (subjects_reader.more()) {
+    der_element subject;
+    der_element tag;
+    if ((!subjects_reader.next(der_reader::SEQUENCE, subject))) {
+      return false;
+    }
+
+    der_reader subject_reader(subject);
+    if (!subject_reader.next(der_reader::OCTET_STRING, tag)) {
+      return false;
+    }
+
+    // The digest is in the SpcIndirectDataContent attribute.
+    bool found = false;
+
+    der_element attributes;
+    if (subject_reader.next(der_reader::SET, attributes)) {
+      // Attribute ::= SEQUENCE {
+      //   type OBJECT IDENTIFIER,
+      //   values SET OF AttributeValue
+      // }
+      der_reader attributes_reader(attributes);
+      while (attributes_reader.more()) {
+        der_element attribute;
+        der_element type;
+        der_element values;
+        if (!attributes_reader.next(der_reader::SEQUENCE, attribute)) {
+          return false;
+        }
+
+        der_reader attribute_reader(attribute);
+        if ((!attribute_reader.next(der_reader::OID, type)) ||
+            (!attribute_reader.next(der_reader::SET, values))) {
+          return false;
+        }
+
+        if (is_oid(type,
+                   OID_SPC_INDIRECT_DATA,
+                   sizeof(OID_SPC_INDIRECT_DATA))) {
+          der_element digest;
+          if (!indirect_data_digest(values, digest)) {
+            return false;
+          }
+
+          if (digest.len == SHA1_LEN) {
+            if (!sha1.add(digest.data)) {
+              return false;
+            }
+
+            found = true;
+          } else if (digest.len == SHA256_LEN) {
+            if (!sha256.add(digest.data)) {
+              return false;
+            }
+
+            found = true;
+          }
+        }
+      }
+    }
+
+    // Otherwise, the tag might be the hash.
+    if (!found) {
+      uint8_t hash[SHA256_LEN];
+      if (decode_tag(tag, hash, SHA1_LEN)) {
+        if (!sha1.add(hash)) {
+          return false;
+        }
+      } else if (decode_tag(tag, hash, SHA256_LEN)) {
+        if (!sha256.add(hash)) {
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+const catalog_index::file* catalog_index::find(const wchar_t* filename) const
+{
+  // Binary search.
+  size_t i = 0;
+  size_t j = _M_nfiles;
+
+  while (i < j) {
+    size_t pivot = (i + j) / 2;
+
+    int ret;
+    if ((ret = wcscmp(filename, _M_files[pivot]->filename)) < 0) {
+      j = pivot;
+    } else if (ret > 0) {
+      i = pivot + 1;
+    } else {
+      return _M_files[pivot];
+    }
+  }
+
+  return nullptr;
+}
+
+catalog_index::file* catalog_index::add(const wchar_t* filename,
+                                        size_t filenamelen)
+{
+  file** files;
+  if ((files = reinterpret_cast<file**>(
+                 realloc(_M_files, (_M_nfiles + 1) * sizeof(file*))
+               )) == nullptr) {
+    return nullptr;
+  }
+
+  _M_files = files;
+
+  file* f;
+  if ((f = new (std::nothrow) file()) == nullptr) {
+    return nullptr;
+  }
+
+  if ((f->filename = reinterpret_cast<wchar_t*>(
+                       malloc((filenamelen + 1) * sizeof(wchar_t))
+                     )) == nullptr) {
+    delete f;
+    return nullptr;
+  }
+
+  memcpy(f->filename, filename, filenamelen * sizeof(wchar_t));
+  f->filename[filenamelen] = 0;
+  f->filenamelen = filenamelen;
+
+  _M_files[_M_nfiles++] = f;
+
+  return f;
+}
+
+bool catalog_index::build_sets()
+{
+  size_t nsha1 = 0;
+  size_t nsha256 = 0;
+  for (size_t i = 0; i < _M_nfiles; i++) {
+    nsha1 += _M_files[i]->sha1.count();
+    nsha256 += _M_files[i]->sha256.count();
+  }
+
+  // Allocate the buckets once.
+  if ((!_M_sha1.reserve(nsha1)) || (!_M_sha256.reserve(nsha256))) {
+    return false;
+  }
+
+  for (size_t i = 0; i < _M_nfiles; i++) {
+    const file* f = _M_files[i];
+
+    for (size_t j = 0; j < f->sha1.count(); j++) {
+      if (!_M_sha1.add(f->sha1.data() + (j * SHA1_LEN))) {
+        return false;
+      }
+    }
+
+    for (size_t j = 0; j < f->sha256.count(); j++) {
+      if (!_M_sha256.add(f->sha256.data() + (j * SHA256_LEN))) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void catalog_index::parse_files(const wchar_t* directory,
+                                file* const* files,
+                                size_t nfiles,
+                                size_t nthreads)
+{
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> failed(0);
+
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next++) < nfiles) {
+      file* f = files[i];
+
+      wchar_t path[FILENAME_MAX_LEN];
+      mapped_file mf;
+      if ((build_path(directory, f->filename, path, FILENAME_MAX_LEN)) &&
+          (mf.open(path)) &&
+          (parse(reinterpret_cast<const uint8_t*>(mf.data()),
+                 mf.size(),
+                 f->sha1,
+                 f->sha256))) {
+        f->parsed = true;
+      } else {
+        // Don't keep the members of a file which is not well-formed.
+        f->sha1.clear();
+        f->sha256.clear();
+
+        failed++;
+      }
+    }
+  };
+
+  // Start the threads (the calling thread is one of them).
+  std::vector<std::thread> threads;
+  try {
+    for (size_t i = 1; i < nthreads; i++) {
+      threads.push_back(std::thread(worker));
+    }
+  } catch (...) {
+    // Use the threads which could be started.
+  }
+
+  worker();
+
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+
+  _M_parsed += nfiles;
+  _M_failed += failed;
+}
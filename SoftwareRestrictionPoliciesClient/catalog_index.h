@@ -0,0 +1,286 @@
+#ifndef CATALOG_INDEX_H
+#define CATALOG_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "digest_set.h"
+#include "file_identity.h"
+#include "image.h"
+
+// Index of the member hashes of the catalog files (PKCS#7 certificate trust
+// lists) of a directory, so a hash can be looked up without the catalog API.
+//
+// An index is built from the previous one: the catalog files are parsed in
+// parallel, but only if they are new or have changed (different file
+// identity), the members of the others are copied. The index can be saved to
+// a file and loaded from it, so the catalogs are not parsed at every start.
+class catalog_index {
+  public:
+    static const size_t SHA1_LEN = 20;
+    static const size_t SHA256_LEN = 32;
+
+    static const uint32_t version = 1;
+
+    // List of hashes of the same length.
+    class hash_list {
+      public:
+        // Constructor.
+        explicit hash_list(size_t hashlen);
+
+        // Destructor.
+        ~hash_list();
+
+        // Add.
+        bool add(const uint8_t* hash);
+
+        // Add hashes.
+        bool add(const uint8_t* hashes, size_t count);
+
+        // Clear.
+        void clear();
+
+        // Get hashes.
+        const uint8_t* data() const;
+
+        // Get number of hashes.
+        size_t count() const;
+
+        // Get memory usage (bytes).
+        size_t memory_usage() const;
+
+      private:
+        size_t _M_hashlen;
+
+        uint8_t* _M_data;
+        size_t _M_size;
+        size_t _M_count;
+    };
+
+    // Catalog file.
+    struct file {
+      wchar_t* filename;
+      size_t filenamelen;
+
+      file_identity id;
+
+      // Could the file be parsed?
+      bool parsed;
+
+      // Members.
+      hash_list sha1;
+      hash_list sha256;
+
+      // Constructor.
+      file();
+
+      // Destructor.
+      ~file();
+    };
+
+    // Constructor.
+    catalog_index();
+
+    // Destructor.
+    ~catalog_index();
+
+    // Build from the catalog files (*.cat) of a directory, reusing the
+    // members of the files of `previous` (if not nullptr) which have not
+    // changed.
+    bool build(const wchar_t* directory,
+               const catalog_index* previous,
+               size_t nthreads);
+
+    // Load.
+    bool load(const wchar_t* filename);
+
+    // Load from memory.
+    bool load(const void* data, size_t len);
+
+    // Save.
+    bool save(const wchar_t* filename) const;
+
+    // Save to image.
+    bool save(image_writer& writer) const;
+
+    // Find hash (SHA-1 or SHA-256).
+    bool find(const uint8_t* hash, size_t hashlen) const;
+
+    // Get number of catalog files.
+    size_t files() const;
+
+    // Get catalog file.
+    const file& get(size_t idx) const;
+
+    // Get number of catalog files parsed by the last build.
+    size_t parsed() const;
+
+    // Get number of catalog files which could not be parsed (their members
+    // are not in the index).
+    size_t failed() const;
+
+    // Get number of hashes.
+    size_t count() const;
+
+    // Get memory usage (bytes, the catalog files and the sets of hashes).
+    size_t memory_usage() const;
+
+    // Parse catalog file.
+    static bool parse(const uint8_t* data,
+                      size_t len,
+                      hash_list& sha1,
+                      hash_list& sha256);
+
+  private:
+    // Image header.
+    struct header {
+      uint8_t magic[8];
+      uint32_t version;
+
+      // (sizeof(size_t) << 8) | sizeof(wchar_t).
+      uint32_t layout;
+
+      // Size of the image (including the header).
+      uint64_t size;
+
+      // Checksum of the image (excluding the header).
+      uint64_t checksum;
+
+      // Catalog files (array of `record`).
+      image_block files;
+    };
+
+    // Catalog file in an image.
+    struct record {
+      file_identity id;
+      image_block filename;
+      image_block sha1;
+      image_block sha256;
+      uint64_t parsed;
+    };
+
+    static const uint8_t magic[8];
+
+    // Catalog files (sorted by file name).
+    file** _M_files;
+    size_t _M_nfiles;
+
+    size_t _M_parsed;
+    size_t _M_failed;
+
+    digest_set<SHA1_LEN> _M_sha1;
+    digest_set<SHA256_LEN> _M_sha256;
+
+    // Find catalog file by file name.
+    const file* find(const wchar_t* filename) const;
+
+    // Add catalog file.
+    file* add(const wchar_t* filename, size_t filenamelen);
+
+    // Build the sets of hashes.
+    bool build_sets();
+
+    // Parse catalog files (in parallel).
+    void parse_files(const wchar_t* directory,
+                     file* const* files,
+                     size_t nfiles,
+                     size_t nthreads);
+
+    // Layout of the current architecture.
+    static uint32_t layout();
+};
+
+inline catalog_index::hash_list::hash_list(size_t hashlen)
+  : _M_hashlen(hashlen),
+    _M_data(nullptr),
+    _M_size(0),
+    _M_count(0)
+{
+}
+
+inline catalog_index::hash_list::~hash_list()
+{
+  if (_M_data) {
+    free(_M_data);
+  }
+}
+
+inline bool catalog_index::hash_list::add(const uint8_t* hash)
+{
+  return add(hash, 1);
+}
+
+inline void catalog_index::hash_list::clear()
+{
+  _M_count = 0;
+}
+
+inline const uint8_t* catalog_index::hash_list::data() const
+{
+  return _M_data;
+}
+
+inline size_t catalog_index::hash_list::count() const
+{
+  return _M_count;
+}
+
+inline size_t catalog_index::hash_list::memory_usage() const
+{
+  return _M_size * _M_hashlen;
+}
+
+inline catalog_index::file::file()
+  : filename(nullptr),
+    filenamelen(0),
+    parsed(false),
+    sha1(SHA1_LEN),
+    sha256(SHA256_LEN)
+{
+}
+
+inline catalog_index::file::~file()
+{
+  if (filename) {
+    free(filename);
+  }
+}
+
+inline catalog_index::catalog_index()
+  : _M_files(nullptr),
+    _M_nfiles(0),
+    _M_parsed(0),
+    _M_failed(0)
+{
+}
+
+inline size_t catalog_index::files() const
+{
+  return _M_nfiles;
+}
+
+inline const catalog_index::file& catalog_index::get(size_t idx) const
+{
+  return *_M_files[idx];
+}
+
+inline size_t catalog_index::parsed() const
+{
+  return _M_parsed;
+}
+
+inline size_t catalog_index::failed() const
+{
+  return _M_failed;
+}
+
+inline size_t catalog_index::count() const
+{
+  return _M_sha1.count() + _M_sha256.count();
+}
+
+inline uint32_t catalog_index::layout()
+{
+  return static_cast<uint32_t>((sizeof(size_t) << 8) | sizeof(wchar_t));
+}
+
+#endif // CATALOG_INDEX_H
@@ -0,0 +1,62 @@
+#include <string.h>
+#include <wchar.h>
+#include "change_feed.h"
+
+bool change_feed::queue::push(const wchar_t* filename, size_t len)
+{
+  if ((len == 0) || (len > FILENAME_MAX_LEN)) {
+    return false;
+  }
+
+  if (len + 1 > _M_size - _M_end) {
+    // Move the file names to the beginning of the buffer.
+    if (_M_begin > 0) {
+      memmove(_M_data,
+              _M_data + _M_begin,
+              (_M_end - _M_begin) * sizeof(wchar_t));
+
+      _M_end -= _M_begin;
+      _M_begin = 0;
+    }
+
+    if (len + 1 > _M_size - _M_end) {
+      size_t size = (_M_size != 0) ? _M_size : 4 * 1024;
+      while (len + 1 > size - _M_end) {
+        size *= 2;
+      }
+
+      wchar_t* data;
+      if ((data = reinterpret_cast<wchar_t*>(
+                    realloc(_M_data, size * sizeof(wchar_t))
+                  )) == nullptr) {
+        return false;
+      }
+
+      _M_data = data;
+      _M_size = size;
+    }
+  }
+
+  wmemcpy(_M_data + _M_end, filename, len);
+  _M_data[_M_end + len] = 0;
+  _M_end += len + 1;
+
+  return true;
+}
+
+bool change_feed::queue::pop(wchar_t* filename, size_t& len)
+{
+  if (_M_begin == _M_end) {
+    return false;
+  }
+
+  len = wcslen(_M_data + _M_begin);
+  wmemcpy(filename, _M_data + _M_begin, len + 1);
+
+  if ((_M_begin += len + 1) == _M_end) {
+    _M_begin = 0;
+    _M_end = 0;
+  }
+
+  return true;
+}
@@ -0,0 +1,82 @@
+#ifndef CHANGE_FEED_H
+#define CHANGE_FEED_H
+
+#include <stdlib.h>
+#include <stddef.h>
+
+// Source of the files which are created or modified under a set of
+// directories (and their subdirectories). The files which are already in a
+// directory when it is added are reported first.
+// A file may be reported several times (e.g. while it is being written).
+class change_feed {
+  public:
+    // Maximum length of a file name.
+    static const size_t FILENAME_MAX_LEN = 1024;
+
+    // Destructor.
+    virtual ~change_feed();
+
+    // Add directory (before the first call to next()).
+    virtual bool add(const wchar_t* directory) = 0;
+
+    // Get next file (waits up to `timeout` milliseconds, `filename` has
+    // FILENAME_MAX_LEN + 1 characters). Returns false on timeout or after
+    // shutdown().
+    virtual bool next(wchar_t* filename, size_t& len, unsigned timeout) = 0;
+
+    // Wake up the thread waiting in next().
+    virtual void shutdown() = 0;
+
+  protected:
+    // Files reported but not returned yet (FIFO).
+    class queue {
+      public:
+        // Constructor.
+        queue();
+
+        // Destructor.
+        ~queue();
+
+        // Push file name.
+        bool push(const wchar_t* filename, size_t len);
+
+        // Pop file name.
+        bool pop(wchar_t* filename, size_t& len);
+
+        // Is the queue empty?
+        bool empty() const;
+
+      private:
+        // Null-terminated file names.
+        wchar_t* _M_data;
+        size_t _M_size;
+        size_t _M_begin;
+        size_t _M_end;
+    };
+};
+
+inline change_feed::~change_feed()
+{
+}
+
+inline change_feed::queue::queue()
+  : _M_data(nullptr),
+    _M_size(0),
+    _M_begin(0),
+    _M_end(0)
+{
+}
+
+inline change_feed::queue::~queue()
+{
+  if (_M_data) {
+    free(_M_data);
+  }
+}
+
+inline bool change_feed::queue::empty() const
+{
+  return (_M_begin == _M_end);
+}
+
+#endif // CHANGE_FEED_H
@@ -0,0 +1,46 @@
+#include <chrono>
+#include "deferred_feed.h"
+
+bool deferred_feed::push(const wchar_t* filename, size_t len)
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  if ((_M_count == MAX_FILES) || (!_M_queue.push(filename, len))) {
+    return false;
+  }
+
+  _M_count++;
+
+  _M_cv.notify_one();
+
+  return true;
+}
+
+bool deferred_feed::next(wchar_t* filename, size_t& len, unsigned timeout)
+{
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  std::unique_lock<std::mutex> lock(_M_mutex);
+
+  while ((_M_queue.empty()) && (!_M_shutdown)) {
+    if (_M_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+      break;
+    }
+  }
+
+  if ((!_M_shutdown) && (_M_queue.pop(filename, len))) {
+    _M_count--;
+    return true;
+  }
+
+  return false;
+}
+
+void deferred_feed::shutdown()
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  _M_shutdown = true;
+  _M_cv.notify_all();
+}
@@ -0,0 +1,54 @@
+#ifndef DEFERRED_FEED_H
+#define DEFERRED_FEED_H
+
+#include <mutex>
+#include <condition_variable>
+#include "change_feed.h"
+
+// Feed of the files whose evaluation was abandoned by a worker, because the
+// verdict would have been late: a verdict warmer finishes them in the
+// background, so the next execution finds the verdict in the cache.
+// It watches no directories, the files are pushed by the workers.
+class deferred_feed : public change_feed {
+  public:
+    // Maximum number of files waiting (the rest are evaluated on their next
+    // execution).
+    static const size_t MAX_FILES = 4 * 1024;
+
+    // Constructor.
+    deferred_feed();
+
+    // Add directory (not supported).
+    bool add(const wchar_t* directory);
+
+    // Push file (called by the workers).
+    bool push(const wchar_t* filename, size_t len);
+
+    // Get next file.
+    bool next(wchar_t* filename, size_t& len, unsigned timeout);
+
+    // Wake up the thread waiting in next().
+    void shutdown();
+
+  private:
+    queue _M_queue;
+    size_t _M_count;
+
+    bool _M_shutdown;
+
+    std::mutex _M_mutex;
+    std::condition_variable _M_cv;
+};
+
+inline deferred_feed::deferred_feed()
+  : _M_count(0),
+    _M_shutdown(false)
+{
+}
+
+inline bool deferred_feed::add(const wchar_t* directory)
+{
+  return false;
+}
+
+#endif // DEFERRED_FEED_H
@@ -0,0 +1,135 @@
+#ifndef DER_H
+#define DER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// DER element (pointers into the encoded data).
+struct der_element {
+  uint8_t tag;
+
+  // Contents.
+  const uint8_t* data;
+  size_t len;
+
+  // Whole element (tag, length and contents).
+  const uint8_t* encoding;
+  size_t encodinglen;
+};
+
+// Reader of a sequence of DER elements. Every length is checked against the
+// enclosing element; nothing is copied or allocated.
+class der_reader {
+  public:
+    static const uint8_t INTEGER = 0x02;
+    static const uint8_t OCTET_STRING = 0x04;
+    static const uint8_t OID = 0x06;
+    static const uint8_t UTF8_STRING = 0x0c;
+    static const uint8_t PRINTABLE_STRING = 0x13;
+    static const uint8_t T61_STRING = 0x14;
+    static const uint8_t IA5_STRING = 0x16;
+    static const uint8_t VISIBLE_STRING = 0x1a;
+    static const uint8_t UNIVERSAL_STRING = 0x1c;
+    static const uint8_t BMP_STRING = 0x1e;
+    static const uint8_t SEQUENCE = 0x30;
+    static const uint8_t SET = 0x31;
+    static const uint8_t CONTEXT_0 = 0xa0;
+    static const uint8_t CONTEXT_1 = 0xa1;
+
+    // Constructor.
+    der_reader(const uint8_t* data, size_t len);
+
+    // Constructor (contents of an element).
+    explicit der_reader(const der_element& element);
+
+    // Read next element.
+    bool next(der_element& element);
+
+    // Read next element, which must have the tag `tag`.
+    bool next(uint8_t tag, der_element& element);
+
+    // Peek the tag of the next element (0 if none).
+    uint8_t peek() const;
+
+    // Are there more elements?
+    bool more() const;
+
+  private:
+    const uint8_t* _M_ptr;
+    const uint8_t* _M_end;
+};
+
+inline der_reader::der_reader(const uint8_t* data, size_t len)
+  : _M_ptr(data),
+    _M_end(data + len)
+{
+}
+
+inline der_reader::der_reader(const der_element& element)
+  : _M_ptr(element.data),
+    _M_end(element.data + element.len)
+{
+}
+
+inline bool der_reader::next(der_element& element)
+{
+  const uint8_t* ptr = _M_ptr;
+  size_t left = _M_end - ptr;
+
+  // Tag (only low tag numbers) and first byte of the length.
+  if ((left < 2) || ((ptr[0] & 0x1f) == 0x1f)) {
+    return false;
+  }
+
+  element.tag = ptr[0];
+
+  size_t len = ptr[1];
+  ptr += 2;
+  left -= 2;
+
+  // Long form (the indefinite form is not DER).
+  if (len & 0x80) {
+    size_t n = len & 0x7f;
+    if ((n == 0) || (n > sizeof(size_t)) || (n > left)) {
+      return false;
+    }
+
+    len = 0;
+    for (size_t i = 0; i < n; i++) {
+      len = (len << 8) | ptr[i];
+    }
+
+    ptr += n;
+    left -= n;
+  }
+
+  if (len > left) {
+    return false;
+  }
+
+  element.data = ptr;
+  element.len = len;
+  element.encoding = _M_ptr;
+  element.encodinglen = (ptr + len) - _M_ptr;
+
+  _M_ptr = ptr + len;
+
+  return true;
+}
+
+inline bool der_reader::next(uint8_t tag, der_element& element)
+{
+  return ((peek() == tag) && (next(element)));
+}
+
+inline uint8_t der_reader::peek() const
+{
+  return (_M_ptr < _M_end) ? *_M_ptr : 0;
+}
+
+inline bool der_reader::more() const
+{
+  return (_M_ptr < _M_end);
+}
+
+#endif // DER_H
@@ -0,0 +1,602 @@
+#ifndef DIGEST_SET_H
+#define DIGEST_SET_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "image.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || \
+    defined(__SSE2__)
+  #include <emmintrin.h>
+  #define DIGEST_SET_SSE2 1
+#endif
+
+// Set of fixed-width digests (e.g. SHA-1: 20 bytes, SHA-256: 32 bytes).
+//
+// Digests are uniformly distributed, so they are not hashed again: bytes 4-7
+// select the bucket and bytes 0-3 are the bucket's tag.
+// A bucket is one (SHA-1) or two (SHA-256) cache lines:
+//   - Tags: 4 x 32-bit (compared at once with SSE2, 0 = empty slot).
+//   - Remainder (bytes 4..N-1) of each digest, inline.
+// A lookup normally touches a single bucket. When a bucket is full, the next
+// bucket is used (linear probing).
+// Digests whose tag would be 0 are kept in a small separate list.
+template<size_t _Size>
+class digest_set {
+  public:
+    static const size_t digest_size = _Size;
+
+    // Location of the set in an image.
+    struct image {
+      image_block buckets;
+      image_block zero;
+      uint64_t count;
+    };
+
+    // Constructor.
+    digest_set();
+
+    // Destructor.
+    ~digest_set();
+
+    // Reserve space for `n` digests.
+    bool reserve(size_t n);
+
+    // Add.
+    bool add(const uint8_t* digest);
+
+    // Append (bulk load): the digest cannot be found until build() is
+    // called.
+    bool append(const uint8_t* digest);
+
+    // Append the digests appended to another set (bulk load).
+    bool append(const digest_set& other);
+
+    // Build: insert the appended digests, sizing the table only once.
+    bool build();
+
+    // Find.
+    bool find(const uint8_t* digest) const;
+
+    // Number of digests.
+    size_t count() const;
+
+    // Memory usage (bytes).
+    size_t memory_usage() const;
+
+    // Save to image.
+    bool save(image_writer& writer, image& img) const;
+
+    // Attach to image (the set becomes read-only and uses the image in
+    // place).
+    bool attach(const image_reader& reader, const image& img);
+
+  private:
+    static const size_t tag_size = 4;
+    static const size_t remainder_size = _Size - tag_size;
+
+    // Use 64-byte buckets if at least 3 digests fit, otherwise 128-byte ones.
+    static const size_t bucket_size =
+      ((64 - 16) / remainder_size >= 3) ? 64 : 128;
+
+    static const size_t slots =
+      ((bucket_size - 16) / remainder_size < 4) ?
+        (bucket_size - 16) / remainder_size :
+        4;
+
+    // Maximum load factor: 70%.
+    static const size_t max_load_num = 7;
+    static const size_t max_load_den = 10;
+
+    struct bucket {
+      uint32_t tags[4];
+      uint8_t remainders[slots][remainder_size];
+    };
+
+    static_assert(sizeof(bucket) == bucket_size, "Unexpected bucket size.");
+
+    bucket* _M_buckets;
+    size_t _M_nbuckets;
+    size_t _M_count;
+
+    // Digests with a tag of 0.
+    uint8_t* _M_zero;
+    size_t _M_nzero;
+
+    // Appended digests (bulk load).
+    struct pending {
+      uint8_t digest[_Size];
+    };
+
+    pending* _M_pending;
+    size_t _M_npending;
+    size_t _M_pending_size;
+
+    // Attached to an image?
+    bool _M_mapped;
+
+    // Get tag.
+    static uint32_t tag(const uint8_t* digest);
+
+    // Get bucket index.
+    size_t index(const uint8_t* digest) const;
+
+    // Find slot.
+    bool find(const uint8_t* digest, uint32_t t) const;
+
+    // Insert (the digest is not in the set).
+    void insert(bucket* buckets, size_t nbuckets, const uint8_t* digest);
+
+    // Rehash.
+    bool rehash(size_t nbuckets);
+
+    // Allocate buckets.
+    static bucket* allocate(size_t nbuckets);
+
+    // Free buckets.
+    static void deallocate(bucket* buckets);
+};
+
+template<size_t _Size>
+inline digest_set<_Size>::digest_set()
+  : _M_buckets(nullptr),
+    _M_nbuckets(0),
+    _M_count(0),
+    _M_zero(nullptr),
+    _M_nzero(0),
+    _M_pending(nullptr),
+    _M_npending(0),
+    _M_pending_size(0),
+    _M_mapped(false)
+{
+}
+
+template<size_t _Size>
+inline digest_set<_Size>::~digest_set()
+{
+  if (!_M_mapped) {
+    if (_M_buckets) {
+      deallocate(_M_buckets);
+    }
+
+    if (_M_zero) {
+      free(_M_zero);
+    }
+  }
+
+  if (_M_pending) {
+    free(_M_pending);
+  }
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::reserve(size_t n)
+{
+  if (_M_mapped) {
+    return false;
+  }
+
+  size_t nbuckets = ((n * max_load_den) / (max_load_num * slots)) + 1;
+  return ((nbuckets <= _M_nbuckets) || (rehash(nbuckets)));
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::add(const uint8_t* digest)
+{
+  if (_M_mapped) {
+    return false;
+  }
+
+  uint32_t t = tag(digest);
+
+  // If the digest has not been inserted yet...
+  if (!find(digest, t)) {
+    if (t != 0) {
+      // If the maximum load factor would be exceeded...
+      if ((_M_count + 1) * max_load_den >
+          _M_nbuckets * slots * max_load_num) {
+        if (!rehash((_M_nbuckets != 0) ? (_M_nbuckets * 2) : 16)) {
+          return false;
+        }
+      }
+
+      insert(_M_buckets, _M_nbuckets, digest);
+    } else {
+      uint8_t* zero;
+      if ((zero = reinterpret_cast<uint8_t*>(
+                    realloc(_M_zero, (_M_nzero + 1) * _Size)
+                  )) == nullptr) {
+        return false;
+      }
+
+      memcpy(zero + (_M_nzero * _Size), digest, _Size);
+
+      _M_zero = zero;
+      _M_nzero++;
+    }
+
+    _M_count++;
+  }
+
+  return true;
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::append(const uint8_t* digest)
+{
+  if (_M_mapped) {
+    return false;
+  }
+
+  if (_M_npending == _M_pending_size) {
+    size_t size = (_M_pending_size != 0) ? (_M_pending_size * 2) : 1024;
+
+    pending* p;
+    if ((p = reinterpret_cast<pending*>(
+               realloc(_M_pending, size * sizeof(pending))
+             )) == nullptr) {
+      return false;
+    }
+
+    _M_pending = p;
+    _M_pending_size = size;
+  }
+
+  memcpy(_M_pending[_M_npending++].digest, digest, _Size);
+
+  return true;
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::append(const digest_set& other)
+{
+  if (_M_mapped) {
+    return false;
+  }
+
+  if (other._M_npending > _M_pending_size - _M_npending) {
+    size_t size = (_M_pending_size != 0) ? _M_pending_size : 1024;
+    while (size - _M_npending < other._M_npending) {
+      size *= 2;
+    }
+
+    pending* p;
+    if ((p = reinterpret_cast<pending*>(
+               realloc(_M_pending, size * sizeof(pending))
+             )) == nullptr) {
+      return false;
+    }
+
+    _M_pending = p;
+    _M_pending_size = size;
+  }
+
+  if (other._M_npending > 0) {
+    memcpy(_M_pending + _M_npending,
+           other._M_pending,
+           other._M_npending * sizeof(pending));
+
+    _M_npending += other._M_npending;
+  }
+
+  return true;
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::build()
+{
+  if (_M_npending == 0) {
+    return true;
+  }
+
+  // Allocate the buckets once (duplicates are skipped by add()).
+  if (!reserve(_M_count + _M_npending)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < _M_npending; i++) {
+    if (!add(_M_pending[i].digest)) {
+      return false;
+    }
+  }
+
+  free(_M_pending);
+
+  _M_pending = nullptr;
+  _M_npending = 0;
+  _M_pending_size = 0;
+
+  return true;
+}
+
+template<size_t _Size>
+inline bool digest_set<_Size>::find(const uint8_t* digest) const
+{
+  return find(digest, tag(digest));
+}
+
+template<size_t _Size>
+inline size_t digest_set<_Size>::count() const
+{
+  return _M_count;
+}
+
+template<size_t _Size>
+inline size_t digest_set<_Size>::memory_usage() const
+{
+  return (_M_nbuckets * sizeof(bucket)) + (_M_nzero * _Size);
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::save(image_writer& writer, image& img) const
+{
+  // The appended digests must have been inserted.
+  if (_M_npending == 0) {
+    img.count = _M_count;
+
+    return ((writer.add(_M_buckets,
+                        _M_nbuckets * sizeof(bucket),
+                        64,
+                        img.buckets)) &&
+            (writer.add(_M_zero, _M_nzero * _Size, 1, img.zero)));
+  }
+
+  return false;
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::attach(const image_reader& reader, const image& img)
+{
+  const void* buckets;
+  const void* zero;
+  if ((_M_count == 0) &&
+      ((buckets = reader.get(img.buckets, 64, sizeof(bucket))) != nullptr) &&
+      ((zero = reader.get(img.zero, 1, _Size)) != nullptr)) {
+    size_t nbuckets = static_cast<size_t>(img.buckets.len / sizeof(bucket));
+    size_t nzero = static_cast<size_t>(img.zero.len / _Size);
+
+    // The load factor must leave empty slots (so lookups terminate).
+    if ((nbuckets > UINT32_MAX) ||
+        (img.count < nzero) ||
+        ((img.count - nzero) * max_load_den >
+         nbuckets * slots * max_load_num)) {
+      return false;
+    }
+
+    // The count must match the slots actually used.
+    const bucket* b = reinterpret_cast<const bucket*>(buckets);
+    uint64_t used = 0;
+    for (size_t i = 0; i < nbuckets; i++) {
+      for (size_t slot = 0; slot < slots; slot++) {
+        if (b[i].tags[slot] != 0) {
+          used++;
+        }
+      }
+    }
+
+    if (used != img.count - nzero) {
+      return false;
+    }
+
+    if (_M_buckets) {
+      deallocate(_M_buckets);
+    }
+
+    if (_M_zero) {
+      free(_M_zero);
+    }
+
+    _M_buckets = reinterpret_cast<bucket*>(const_cast<void*>(buckets));
+    _M_nbuckets = nbuckets;
+    _M_count = static_cast<size_t>(img.count);
+    _M_zero = reinterpret_cast<uint8_t*>(const_cast<void*>(zero));
+    _M_nzero = nzero;
+    _M_mapped = true;
+
+    return true;
+  }
+
+  return false;
+}
+
+template<size_t _Size>
+inline uint32_t digest_set<_Size>::tag(const uint8_t* digest)
+{
+  uint32_t t;
+  memcpy(&t, digest, sizeof(uint32_t));
+
+  return t;
+}
+
+template<size_t _Size>
+inline size_t digest_set<_Size>::index(const uint8_t* digest) const
+{
+  uint32_t h;
+  memcpy(&h, digest + tag_size, sizeof(uint32_t));
+
+  // Map h to [0, _M_nbuckets) without a division.
+  return static_cast<size_t>((static_cast<uint64_t>(h) * _M_nbuckets) >> 32);
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::find(const uint8_t* digest, uint32_t t) const
+{
+  if (t != 0) {
+    if (_M_nbuckets == 0) {
+      return false;
+    }
+
+    const uint8_t* remainder = digest + tag_size;
+
+    size_t i = index(digest);
+
+#if DIGEST_SET_SSE2
+    const __m128i needle = _mm_set1_epi32(static_cast<int>(t));
+    const __m128i zero = _mm_setzero_si128();
+#endif
+
+    do {
+      const bucket* b = _M_buckets + i;
+
+#if DIGEST_SET_SSE2
+      const __m128i tags =
+        _mm_load_si128(reinterpret_cast<const __m128i*>(b->tags));
+
+      // Compare the 4 tags at once.
+      unsigned matches = static_cast<unsigned>(
+                           _mm_movemask_ps(
+                             _mm_castsi128_ps(_mm_cmpeq_epi32(tags, needle))
+                           )
+                         ) & ((1u << slots) - 1);
+
+      while (matches) {
+        unsigned slot = 0;
+        while ((matches & (1u << slot)) == 0) {
+          slot++;
+        }
+
+        if (memcmp(b->remainders[slot], remainder, remainder_size) == 0) {
+          return true;
+        }
+
+        matches &= ~(1u << slot);
+      }
+
+      unsigned empty = static_cast<unsigned>(
+                         _mm_movemask_ps(
+                           _mm_castsi128_ps(_mm_cmpeq_epi32(tags, zero))
+                         )
+                       ) & ((1u << slots) - 1);
+
+      // If the bucket is not full, the digest is not in the set.
+      if (empty) {
+        return false;
+      }
+#else
+      for (size_t slot = 0; slot < slots; slot++) {
+        if (b->tags[slot] == t) {
+          if (memcmp(b->remainders[slot], remainder, remainder_size) == 0) {
+            return true;
+          }
+        } else if (b->tags[slot] == 0) {
+          return false;
+        }
+      }
+#endif
+
+      if (++i == _M_nbuckets) {
+        i = 0;
+      }
+    } while (true);
+  } else {
+    for (size_t i = 0; i < _M_nzero; i++) {
+      if (memcmp(_M_zero + (i * _Size), digest, _Size) == 0) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+}
+
+template<size_t _Size>
+void digest_set<_Size>::insert(bucket* buckets,
+                               size_t nbuckets,
+                               const uint8_t* digest)
+{
+  uint32_t h;
+  memcpy(&h, digest + tag_size, sizeof(uint32_t));
+
+  size_t i = static_cast<size_t>((static_cast<uint64_t>(h) * nbuckets) >> 32);
+
+  do {
+    bucket* b = buckets + i;
+
+    for (size_t slot = 0; slot < slots; slot++) {
+      if (b->tags[slot] == 0) {
+        b->tags[slot] = tag(digest);
+        memcpy(b->remainders[slot], digest + tag_size, remainder_size);
+
+        return;
+      }
+    }
+
+    if (++i == nbuckets) {
+      i = 0;
+    }
+  } while (true);
+}
+
+template<size_t _Size>
+bool digest_set<_Size>::rehash(size_t nbuckets)
+{
+  // The bucket index is computed from 32 bits.
+  if (nbuckets > UINT32_MAX) {
+    return false;
+  }
+
+  bucket* buckets;
+  if ((buckets = allocate(nbuckets)) == nullptr) {
+    return false;
+  }
+
+  // Move digests to the new buckets.
+  for (size_t i = 0; i < _M_nbuckets; i++) {
+    const bucket* b = _M_buckets + i;
+
+    for (size_t slot = 0; (slot < slots) && (b->tags[slot] != 0); slot++) {
+      uint8_t digest[_Size];
+      memcpy(digest, &b->tags[slot], tag_size);
+      memcpy(digest + tag_size, b->remainders[slot], remainder_size);
+
+      insert(buckets, nbuckets, digest);
+    }
+  }
+
+  if (_M_buckets) {
+    deallocate(_M_buckets);
+  }
+
+  _M_buckets = buckets;
+  _M_nbuckets = nbuckets;
+
+  return true;
+}
+
+template<size_t _Size>
+typename digest_set<_Size>::bucket*
+digest_set<_Size>::allocate(size_t nbuckets)
+{
+  if (nbuckets > SIZE_MAX / sizeof(bucket)) {
+    return nullptr;
+  }
+
+  void* p;
+
+#ifdef _WIN32
+  if ((p = _aligned_malloc(nbuckets * sizeof(bucket), 64)) == nullptr) {
+    return nullptr;
+  }
+#else
+  if (posix_memalign(&p, 64, nbuckets * sizeof(bucket)) != 0) {
+    return nullptr;
+  }
+#endif
+
+  memset(p, 0, nbuckets * sizeof(bucket));
+
+  return reinterpret_cast<bucket*>(p);
+}
+
+template<size_t _Size>
+inline void digest_set<_Size>::deallocate(bucket* buckets)
+{
+#ifdef _WIN32
+  _aligned_free(buckets);
+#else
+  free(buckets);
+#endif
+}
+
+#endif // DIGEST_SET_H
@@ -0,0 +1,253 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include "directory_change_feed.h"
+
+directory_change_feed::~directory_change_feed()
+{
+  for (size_t i = 0; i < _M_ndirectories; i++) {
+    watch& dir = _M_directories[i];
+
+    // Cancel the read (issued by any thread) and wait for it, the buffer is
+    // about to be freed.
+    DWORD len;
+    if ((CancelIoEx(dir.handle, &dir.overlapped)) ||
+        (GetLastError() != ERROR_NOT_FOUND)) {
+      GetOverlappedResult(dir.handle, &dir.overlapped, &len, TRUE);
+    }
+
+    CloseHandle(dir.handle);
+    CloseHandle(dir.overlapped.hEvent);
+
+    free(dir.buffer);
+    free(dir.path);
+  }
+
+  if (_M_shutdown) {
+    CloseHandle(_M_shutdown);
+  }
+}
+
+bool directory_change_feed::add(const wchar_t* directory)
+{
+  if (_M_ndirectories == MAX_DIRECTORIES) {
+    return false;
+  }
+
+  // Create shutdown event (first directory).
+  if ((!_M_shutdown) &&
+      ((_M_shutdown = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL)) {
+    return false;
+  }
+
+  // Remove the trailing backslashes (but not the one of a drive).
+  size_t pathlen = wcslen(directory);
+  while ((pathlen > 1) &&
+         (directory[pathlen - 1] == L'\\') &&
+         (directory[pathlen - 2] != L':')) {
+    pathlen--;
+  }
+
+  if ((pathlen == 0) || (pathlen >= FILENAME_MAX_LEN)) {
+    return false;
+  }
+
+  watch& dir = _M_directories[_M_ndirectories];
+  memset(&dir, 0, sizeof(watch));
+
+  if (((dir.path = reinterpret_cast<wchar_t*>(
+                     malloc((pathlen + 1) * sizeof(wchar_t))
+                   )) != nullptr) &&
+      ((dir.buffer = reinterpret_cast<DWORD*>(
+                       malloc(BUFFER_SIZE)
+                     )) != nullptr)) {
+    wmemcpy(dir.path, directory, pathlen);
+    dir.path[pathlen] = 0;
+    dir.pathlen = pathlen;
+
+    if ((dir.handle = CreateFileW(dir.path,
+                                  FILE_LIST_DIRECTORY,
+                                  FILE_SHARE_READ |
+                                  FILE_SHARE_WRITE |
+                                  FILE_SHARE_DELETE,
+                                  NULL,
+                                  OPEN_EXISTING,
+                                  FILE_FLAG_BACKUP_SEMANTICS |
+                                  FILE_FLAG_OVERLAPPED,
+                                  NULL)) != INVALID_HANDLE_VALUE) {
+      if ((dir.overlapped.hEvent = CreateEvent(NULL,
+                                               TRUE,
+                                               FALSE,
+                                               NULL)) != NULL) {
+        // Watch the directory before scanning it, so no file is missed.
+        if (read(dir)) {
+          _M_ndirectories++;
+
+          scan(dir.path, dir.pathlen);
+
+          return true;
+        }
+
+        CloseHandle(dir.overlapped.hEvent);
+      }
+
+      CloseHandle(dir.handle);
+    }
+  }
+
+  free(dir.buffer);
+  free(dir.path);
+
+  return false;
+}
+
+bool directory_change_feed::next(wchar_t* filename,
+                                 size_t& len,
+                                 unsigned timeout)
+{
+  if (_M_queue.pop(filename, len)) {
+    return true;
+  }
+
+  if (_M_ndirectories == 0) {
+    return false;
+  }
+
+  HANDLE handles[1 + MAX_DIRECTORIES];
+  handles[0] = _M_shutdown;
+
+  for (size_t i = 0; i < _M_ndirectories; i++) {
+    handles[1 + i] = _M_directories[i].overlapped.hEvent;
+  }
+
+  DWORD ret = WaitForMultipleObjects(static_cast<DWORD>(1 + _M_ndirectories),
+                                     handles,
+                                     FALSE,
+                                     timeout);
+
+  // If the changes of a directory have been read...
+  if ((ret > WAIT_OBJECT_0) && (ret <= WAIT_OBJECT_0 + _M_ndirectories)) {
+    watch& dir = _M_directories[ret - WAIT_OBJECT_0 - 1];
+
+    DWORD count;
+    if (GetOverlappedResult(dir.handle, &dir.overlapped, &count, FALSE)) {
+      if (count > 0) {
+        process(dir, count);
+      } else {
+        // The buffer overflowed: report every file again.
+        scan(dir.path, dir.pathlen);
+      }
+    }
+
+    read(dir);
+
+    return _M_queue.pop(filename, len);
+  }
+
+  return false;
+}
+
+void directory_change_feed::shutdown()
+{
+  if (_M_shutdown) {
+    SetEvent(_M_shutdown);
+  }
+}
+
+bool directory_change_feed::read(watch& dir)
+{
+  ResetEvent(dir.overlapped.hEvent);
+
+  return (ReadDirectoryChangesW(dir.handle,
+                                dir.buffer,
+                                BUFFER_SIZE,
+                                TRUE,
+                                FILE_NOTIFY_CHANGE_FILE_NAME |
+                                FILE_NOTIFY_CHANGE_SIZE |
+                                FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                NULL,
+                                &dir.overlapped,
+                                NULL) != FALSE);
+}
+
+void directory_change_feed::process(const watch& dir, DWORD len)
+{
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(dir.buffer);
+  const uint8_t* end = ptr + len;
+
+  while (ptr + sizeof(FILE_NOTIFY_INFORMATION) <= end) {
+    const FILE_NOTIFY_INFORMATION* info =
+      reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(ptr);
+
+    // The file name is relative to the directory.
+    if ((info->Action == FILE_ACTION_ADDED) ||
+        (info->Action == FILE_ACTION_MODIFIED) ||
+        (info->Action == FILE_ACTION_RENAMED_NEW_NAME)) {
+      push(dir.path,
+           dir.pathlen,
+           info->FileName,
+           info->FileNameLength / sizeof(wchar_t));
+    }
+
+    if (info->NextEntryOffset == 0) {
+      break;
+    }
+
+    ptr += info->NextEntryOffset;
+  }
+}
+
+void directory_change_feed::scan(const wchar_t* path, size_t pathlen)
+{
+  wchar_t pattern[FILENAME_MAX_LEN + 3];
+  if (pathlen + 2 > FILENAME_MAX_LEN) {
+    return;
+  }
+
+  wmemcpy(pattern, path, pathlen);
+  wmemcpy(pattern + pathlen, L"\\*", 3);
+
+  WIN32_FIND_DATAW data;
+  HANDLE hFind;
+  if ((hFind = FindFirstFileW(pattern, &data)) == INVALID_HANDLE_VALUE) {
+    return;
+  }
+
+  do {
+    size_t namelen = wcslen(data.cFileName);
+
+    if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+      push(path, pathlen, data.cFileName, namelen);
+    } else if ((wcscmp(data.cFileName, L".") != 0) &&
+               (wcscmp(data.cFileName, L"..") != 0) &&
+               ((data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ==
+                0) &&
+               (pathlen + 1 + namelen <= FILENAME_MAX_LEN)) {
+      // Scan subdirectory.
+      wchar_t subpath[FILENAME_MAX_LEN + 1];
+      wmemcpy(subpath, path, pathlen);
+      subpath[pathlen] = L'\\';
+      wmemcpy(subpath + pathlen + 1, data.cFileName, namelen + 1);
+
+      scan(subpath, pathlen + 1 + namelen);
+    }
+  } while (FindNextFileW(hFind, &data));
+
+  FindClose(hFind);
+}
+
+void directory_change_feed::push(const wchar_t* directory,
+                                 size_t directorylen,
+                                 const wchar_t* name,
+                                 size_t namelen)
+{
+  if (directorylen + 1 + namelen <= FILENAME_MAX_LEN) {
+    wchar_t filename[FILENAME_MAX_LEN + 1];
+    wmemcpy(filename, directory, directorylen);
+    filename[directorylen] = L'\\';
+    wmemcpy(filename + directorylen + 1, name, namelen);
+
+    _M_queue.push(filename, directorylen + 1 + namelen);
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef DIRECTORY_CHANGE_FEED_H
+#define DIRECTORY_CHANGE_FEED_H
+
+#include <windows.h>
+#include "change_feed.h"
+
+// Change feed of Windows (ReadDirectoryChangesW, one overlapped read per
+// directory, including its subdirectories).
+class directory_change_feed : public change_feed {
+  public:
+    // Maximum number of directories.
+    static const size_t MAX_DIRECTORIES = 16;
+
+    // Constructor.
+    directory_change_feed();
+
+    // Destructor.
+    ~directory_change_feed();
+
+    // Add directory.
+    bool add(const wchar_t* directory);
+
+    // Get next file.
+    bool next(wchar_t* filename, size_t& len, unsigned timeout);
+
+    // Wake up the thread waiting in next().
+    void shutdown();
+
+  private:
+    // Size of the buffer of the changes of a directory.
+    static const DWORD BUFFER_SIZE = 64 * 1024;
+
+    // Watched directory.
+    struct watch {
+      wchar_t* path;
+      size_t pathlen;
+
+      HANDLE handle;
+      OVERLAPPED overlapped;
+
+      // FILE_NOTIFY_INFORMATION records (DWORD aligned).
+      DWORD* buffer;
+    };
+
+    watch _M_directories[MAX_DIRECTORIES];
+    size_t _M_ndirectories;
+
+    // Shutdown event.
+    HANDLE _M_shutdown;
+
+    queue _M_queue;
+
+    // Read the changes of a directory (asynchronously).
+    bool read(watch& dir);
+
+    // Report the changed files of a directory.
+    void process(const watch& dir, DWORD len);
+
+    // Report the files of a directory and of its subdirectories.
+    void scan(const wchar_t* path, size_t pathlen);
+
+    // Report file.
+    void push(const wchar_t* directory,
+              size_t directorylen,
+              const wchar_t* name,
+              size_t namelen);
+};
+
+inline directory_change_feed::directory_change_feed()
+  : _M_ndirectories(0),
+    _M_shutdown(NULL)
+{
+}
+
+#endif // DIRECTORY_CHANGE_FEED_H
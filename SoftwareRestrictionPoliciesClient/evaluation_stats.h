@@ -0,0 +1,130 @@
+#ifndef EVALUATION_STATS_H
+#define EVALUATION_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "file_identity.h"
+#include "monotonic_clock.h"
+#include "event_trace.h"
+
+// What happened during the evaluation of an executable and how long each
+// stage took.
+struct evaluation_stats {
+  enum stage {
+    stage_cache,     // File identity and verdict cache.
+    stage_path,      // Lookup of the path.
+    stage_open,      // Open the file and parse its headers.
+    stage_signature, // Signature check.
+    stage_hash,      // Hashes of the file.
+    stage_catalog,   // Lookup of the hashes in the catalog.
+    stage_hashes,    // Lookup of the hashes in the policy.
+    NSTAGES
+  };
+
+  // Identity of the file (if `identified`).
+  file_identity id;
+  bool identified;
+
+  // Was the verdict looked up in the cache? Was it found?
+  bool cache_lookup;
+  bool cached;
+
+  // Was the verdict the one of a concurrent evaluation of the same file?
+  bool coalesced;
+
+  // Lookups in the cache of signer verdicts.
+  uint32_t signer_hits;
+  uint32_t signer_misses;
+
+  // Bytes of the file hashed.
+  uint64_t hashed;
+
+  // Stages which ran (bit 1 << stage).
+  uint32_t stages;
+
+  // Duration of each stage (nanoseconds, 0 if the stage didn't run).
+  uint64_t durations[NSTAGES];
+
+  // Constructor.
+  evaluation_stats();
+
+  // Get the name of a stage.
+  static const char* name(stage s);
+};
+
+// Measures the stages of an evaluation, one after the other (it does nothing
+// if there are no statistics to fill and the events are not traced).
+class stage_timer {
+  public:
+    // Constructor (the first stage starts now).
+    stage_timer(evaluation_stats* stats);
+
+    // The stage `s` ends now (and the next one starts).
+    void end(evaluation_stats::stage s);
+
+    // Get the statistics being filled (nullptr if none).
+    evaluation_stats* stats() const;
+
+  private:
+    evaluation_stats* _M_stats;
+    uint64_t _M_start;
+};
+
+inline evaluation_stats::evaluation_stats()
+  : identified(false),
+    cache_lookup(false),
+    cached(false),
+    coalesced(false),
+    signer_hits(0),
+    signer_misses(0),
+    hashed(0),
+    stages(0)
+{
+  for (size_t i = 0; i < NSTAGES; i++) {
+    durations[i] = 0;
+  }
+}
+
+inline const char* evaluation_stats::name(stage s)
+{
+  static const char* const names[] = {
+    "cache",
+    "path",
+    "open",
+    "signature",
+    "hash",
+    "catalog",
+    "hashes"
+  };
+
+  return (s < NSTAGES) ? names[s] : "unknown";
+}
+
+inline stage_timer::stage_timer(evaluation_stats* stats)
+  : _M_stats(stats),
+    _M_start(((stats) || (EVENT_TRACE)) ? monotonic_clock::now() : 0)
+{
+}
+
+inline void stage_timer::end(evaluation_stats::stage s)
+{
+  if ((_M_stats) || (EVENT_TRACE)) {
+    uint64_t now = monotonic_clock::now();
+
+    EVENT_TRACE_RECORD(static_cast<event_trace::event>(s), _M_start, now);
+
+    if (_M_stats) {
+      _M_stats->durations[s] += now - _M_start;
+      _M_stats->stages |= static_cast<uint32_t>(1) << s;
+    }
+
+    _M_start = now;
+  }
+}
+
+inline evaluation_stats* stage_timer::stats() const
+{
+  return _M_stats;
+}
+
+#endif // EVALUATION_STATS_H
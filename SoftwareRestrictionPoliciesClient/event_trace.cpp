@@ -0,0 +1,274 @@
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "event_trace.h"
+
+const wchar_t* const event_trace::section_name =
+  L"Global\\SoftwareRestrictionPoliciesEvents";
+
+static const uint8_t magic[8] = {'S', 'R', 'P', 'E', 'V', 'E', 'N', 'T'};
+static const uint32_t VERSION = 1;
+
+// Event in a ring.
+struct trace_entry {
+  uint64_t start;
+  uint32_t duration; // Nanoseconds (saturated).
+  uint32_t event;
+};
+
+// Events of a thread.
+struct trace_ring {
+  // Number of events written (the last RING_SIZE are in the ring).
+  std::atomic<uint64_t> head;
+
+  uint32_t thread;
+  uint32_t reserved;
+
+  trace_entry entries[event_trace::RING_SIZE];
+};
+
+// Layout of the section (zero-filled when it is created).
+struct trace_data {
+  uint8_t magic[8];
+  uint32_t version;
+  uint32_t size;
+
+  // Process writing the events.
+  uint32_t process;
+
+  // Number of rings taken by the threads.
+  std::atomic<uint32_t> nrings;
+
+  trace_ring rings[event_trace::MAX_THREADS];
+};
+
+static HANDLE trace_section = NULL;
+static trace_data* trace = nullptr;
+
+// Ring of the calling thread (nullptr: not taken yet or none left).
+static __declspec(thread) trace_ring* thread_ring = nullptr;
+static __declspec(thread) bool thread_has_ring = false;
+
+// Map the section.
+static trace_data* map(HANDLE h)
+{
+  // Write access: on 32-bit x86, the 64-bit atomic loads are locked
+  // compare-exchanges.
+  return reinterpret_cast<trace_data*>(
+           MapViewOfFile(h,
+                         FILE_MAP_READ | FILE_MAP_WRITE,
+                         0,
+                         0,
+                         sizeof(trace_data))
+         );
+}
+
+bool event_trace::create()
+{
+  if (trace_section) {
+    return false;
+  }
+
+  if (((trace_section = CreateFileMappingW(INVALID_HANDLE_VALUE,
+                                           NULL,
+                                           PAGE_READWRITE,
+                                           0,
+                                           sizeof(trace_data),
+                                           section_name)) == NULL) ||
+      ((trace = map(trace_section)) == nullptr)) {
+    close();
+    return false;
+  }
+
+  memset(trace, 0, sizeof(trace_data));
+
+  trace->version = VERSION;
+  trace->size = sizeof(trace_data);
+  trace->process = GetCurrentProcessId();
+  memcpy(trace->magic, magic, sizeof(magic));
+
+  return true;
+}
+
+void event_trace::close()
+{
+  if (trace) {
+    UnmapViewOfFile(trace);
+    trace = nullptr;
+  }
+
+  if (trace_section) {
+    CloseHandle(trace_section);
+    trace_section = NULL;
+  }
+}
+
+void event_trace::record(event ev, uint64_t start, uint64_t end)
+{
+  trace_ring* ring;
+  if ((ring = thread_ring) == nullptr) {
+    // Take a ring (once per thread).
+    if ((thread_has_ring) || (!trace)) {
+      return;
+    }
+
+    thread_has_ring = true;
+
+    uint32_t idx;
+    if ((idx = trace->nrings.fetch_add(1)) >= MAX_THREADS) {
+      return;
+    }
+
+    ring = &trace->rings[idx];
+    ring->thread = GetCurrentThreadId();
+
+    thread_ring = ring;
+  }
+
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+  trace_entry& entry = ring->entries[head & (RING_SIZE - 1)];
+  entry.start = start;
+  entry.duration = (end - start <= 0xffffffffu) ?
+                     static_cast<uint32_t>(end - start) :
+                     0xffffffffu;
+  entry.event = ev;
+
+  // Publish the event.
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool event_trace::dump(const wchar_t* filename)
+{
+  // Open the section of the running client.
+  HANDLE h;
+  if ((h = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE,
+                            FALSE,
+                            section_name)) == NULL) {
+    return false;
+  }
+
+  const trace_data* d;
+  if ((d = map(h)) == nullptr) {
+    CloseHandle(h);
+    return false;
+  }
+
+  bool ret = false;
+
+  trace_entry* entries;
+  FILE* file = nullptr;
+  if ((memcmp(d->magic, magic, sizeof(magic)) == 0) &&
+      (d->version == VERSION) &&
+      (d->size == sizeof(trace_data)) &&
+      ((entries = reinterpret_cast<trace_entry*>(
+                    malloc(RING_SIZE * sizeof(trace_entry))
+                  )) != nullptr)) {
+    if (_wfopen_s(&file, filename, L"w") == 0) {
+      // Timestamps are relative to the oldest event (microseconds).
+      uint32_t nrings = d->nrings.load();
+      if (nrings > MAX_THREADS) {
+        nrings = MAX_THREADS;
+      }
+
+      uint64_t origin = UINT64_MAX;
+      for (uint32_t i = 0; i < nrings; i++) {
+        const trace_ring& ring = d->rings[i];
+
+        uint64_t head = ring.head.load(std::memory_order_acquire);
+        uint64_t first = (head > RING_SIZE) ? head - RING_SIZE : 0;
+
+        for (uint64_t j = first; j < head; j++) {
+          const trace_entry& entry = ring.entries[j & (RING_SIZE - 1)];
+          if (entry.start < origin) {
+            origin = entry.start;
+          }
+        }
+      }
+
+      fprintf(file, "{\"traceEvents\": [\n");
+
+      bool first_event = true;
+      unsigned long pid = d->process;
+
+      for (uint32_t i = 0; i < nrings; i++) {
+        const trace_ring& ring = d->rings[i];
+
+        // Copy the events and discard the ones which were overwritten in
+        // the meantime (the writer doesn't wait for the reader).
+        uint64_t head = ring.head.load(std::memory_order_acquire);
+        uint64_t first = (head > RING_SIZE) ? head - RING_SIZE : 0;
+
+        memcpy(entries, ring.entries, RING_SIZE * sizeof(trace_entry));
+
+        uint64_t last = ring.head.load(std::memory_order_acquire);
+        if (last >= RING_SIZE) {
+          // The slot of the event being written is not valid either.
+          uint64_t oldest = last - RING_SIZE + 1;
+          if (first < oldest) {
+            first = oldest;
+          }
+        }
+
+        fprintf(file,
+                "%s{\"name\": \"thread_name\", \"ph\": \"M\", "
+                "\"pid\": %lu, \"tid\": %lu, "
+                "\"args\": {\"name\": \"Thread %lu\"}}",
+                first_event ? "" : ",\n",
+                pid,
+                static_cast<unsigned long>(ring.thread),
+                static_cast<unsigned long>(ring.thread));
+
+        first_event = false;
+
+        for (uint64_t j = first; j < head; j++) {
+          const trace_entry& entry = entries[j & (RING_SIZE - 1)];
+
+          fprintf(file,
+                  ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, "
+                  "\"dur\": %.3f, \"pid\": %lu, \"tid\": %lu}",
+                  name(static_cast<event>(entry.event)),
+                  (entry.start - origin) / 1000.0,
+                  entry.duration / 1000.0,
+                  pid,
+                  static_cast<unsigned long>(ring.thread));
+        }
+      }
+
+      fprintf(file, "\n], \"displayTimeUnit\": \"ns\"}\n");
+
+      ret = (fclose(file) == 0);
+    }
+
+    free(entries);
+  }
+
+  UnmapViewOfFile(d);
+  CloseHandle(h);
+
+  return ret;
+}
+
+const char* event_trace::name(event ev)
+{
+  static const char* const names[] = {
+    "cache",
+    "path",
+    "open",
+    "signature",
+    "hash",
+    "catalog",
+    "hashes",
+    "evaluate",
+    "reply",
+    "load signers",
+    "load hashes",
+    "load paths",
+    "load policy",
+    "index catalogs"
+  };
+
+  return (ev < NEVENTS) ? names[ev] : "unknown";
+}
@@ -0,0 +1,108 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "monotonic_clock.h"
+
+// Tracing of events, compiled in with EVENT_TRACE=1 (otherwise the tracing
+// points expand to nothing).
+#ifndef EVENT_TRACE
+  #define EVENT_TRACE 0
+#endif
+
+// Events of the running client, in a named section of shared memory: every
+// thread writes the events to its own ring (the oldest events are
+// overwritten) and the command `dump-events` writes the rings in Chrome trace
+// format (chrome://tracing, Perfetto).
+class event_trace {
+  public:
+    // Events (the stages of an evaluation come first, in the same order as
+    // evaluation_stats::stage).
+    enum event {
+      event_cache,
+      event_path,
+      event_open,
+      event_signature,
+      event_hash,
+      event_catalog,
+      event_hashes,
+      event_evaluate,
+      event_reply,
+      event_load_signers,
+      event_load_hashes,
+      event_load_paths,
+      event_load_policy,
+      event_index_catalogs,
+      NEVENTS
+    };
+
+    // Name of the section.
+    static const wchar_t* const section_name;
+
+    // Maximum number of threads (the events of the others are dropped).
+    static const size_t MAX_THREADS = 64;
+
+    // Number of events per thread (power of 2).
+    static const size_t RING_SIZE = 8 * 1024;
+
+    // Create the section (running client).
+    static bool create();
+
+    // Close the section.
+    static void close();
+
+    // Record an event of the calling thread (times from monotonic_clock).
+    static void record(event ev, uint64_t start, uint64_t end);
+
+    // Write the events of the running client to a file.
+    static bool dump(const wchar_t* filename);
+
+    // Get name of an event.
+    static const char* name(event ev);
+
+    // Event which lasts as long as the scope.
+    class scope {
+      public:
+        // Constructor.
+        explicit scope(event ev);
+
+        // Destructor.
+        ~scope();
+
+      private:
+        event _M_event;
+        uint64_t _M_start;
+    };
+};
+
+#if EVENT_TRACE
+  #define EVENT_TRACE_CONCAT_(x, y) x##y
+  #define EVENT_TRACE_CONCAT(x, y) EVENT_TRACE_CONCAT_(x, y)
+
+  // Trace the rest of the scope as the event `ev`.
+  #define EVENT_TRACE_SCOPE(ev) \
+    event_trace::scope EVENT_TRACE_CONCAT(event_trace_scope_, __LINE__)( \
+      event_trace::ev                                                   \
+    )
+
+  // Trace the event `ev` (from `start` to `end`).
+  #define EVENT_TRACE_RECORD(ev, start, end) \
+    event_trace::record(ev, start, end)
+#else
+  #define EVENT_TRACE_SCOPE(ev)
+  #define EVENT_TRACE_RECORD(ev, start, end)
+#endif
+
+inline event_trace::scope::scope(event ev)
+  : _M_event(ev),
+    _M_start(monotonic_clock::now())
+{
+}
+
+inline event_trace::scope::~scope()
+{
+  record(_M_event, _M_start, monotonic_clock::now());
+}
+
+#endif // EVENT_TRACE_H
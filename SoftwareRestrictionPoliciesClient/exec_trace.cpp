@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <algorithm>
+#include "exec_trace.h"
+#include "mapped_file.h"
+
+#ifndef _WIN32
+  #include <limits.h>
+#endif
+
+const uint8_t exec_trace::magic[8] = {'S', 'R', 'P', 'T', 'R', 'A', 'C', 'E'};
+
+bool exec_trace::writer::open(const wchar_t* filename)
+{
+  if (_M_file) {
+    return false;
+  }
+
+#ifdef _WIN32
+  if (_wfopen_s(&_M_file, filename, L"wb") != 0) {
+    _M_file = nullptr;
+    return false;
+  }
+#else
+  // Convert file name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return false;
+  }
+
+  if ((_M_file = fopen(path, "wb")) == nullptr) {
+    return false;
+  }
+#endif
+
+  // Buffer the records (they are small).
+  if ((_M_buffer = reinterpret_cast<char*>(malloc(BUFFER_SIZE))) != nullptr) {
+    setvbuf(_M_file, _M_buffer, _IOFBF, BUFFER_SIZE);
+  }
+
+  header hdr;
+  memcpy(hdr.magic, magic, sizeof(magic));
+  hdr.version = version;
+  hdr.record_size = sizeof(record);
+
+  if (fwrite(&hdr, sizeof(header), 1, _M_file) != 1) {
+    close();
+    return false;
+  }
+
+  _M_start = monotonic_clock::now();
+  _M_count = 0;
+
+  return true;
+}
+
+bool exec_trace::writer::close()
+{
+  bool ret = true;
+
+  if (_M_file) {
+    ret = (fclose(_M_file) == 0);
+    _M_file = nullptr;
+  }
+
+  if (_M_buffer) {
+    free(_M_buffer);
+    _M_buffer = nullptr;
+  }
+
+  return ret;
+}
+
+bool exec_trace::writer::write(uint64_t start,
+                               uint64_t latency,
+                               const wchar_t* filename,
+                               size_t filenamelen,
+                               const evaluation_stats& stats,
+                               bool allowed)
+{
+  if (filenamelen > FILENAME_MAX_LEN) {
+    filenamelen = FILENAME_MAX_LEN;
+  }
+
+  record rec;
+  rec.timestamp = (start > _M_start) ? start - _M_start : 0;
+
+  if (stats.identified) {
+    rec.id = stats.id;
+  } else {
+    memset(&rec.id, 0, sizeof(file_identity));
+  }
+
+  for (size_t i = 0; i < evaluation_stats::NSTAGES; i++) {
+    uint64_t us = stats.durations[i] / 1000;
+    rec.durations[i] = (us < UINT32_MAX) ? static_cast<uint32_t>(us) :
+                                           UINT32_MAX;
+  }
+
+  latency /= 1000;
+  rec.latency = (latency < UINT32_MAX) ? static_cast<uint32_t>(latency) :
+                                         UINT32_MAX;
+
+  rec.filenamelen = static_cast<uint16_t>(filenamelen);
+  rec.allowed = allowed ? 1 : 0;
+  rec.flags = (stats.identified ? flag_identified : 0) |
+              (stats.cached ? flag_cached : 0);
+  rec.reserved = 0;
+
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  if (!_M_file) {
+    return false;
+  }
+
+  if (fwrite(&rec, sizeof(record), 1, _M_file) != 1) {
+    return false;
+  }
+
+  // Write the file name in UTF-16 (wchar_t is 32 bits outside Windows).
+  static const size_t BUFLEN = 256;
+  uint16_t buf[BUFLEN];
+  for (size_t off = 0; off < filenamelen; off += BUFLEN) {
+    size_t n = (filenamelen - off < BUFLEN) ? filenamelen - off : BUFLEN;
+    for (size_t i = 0; i < n; i++) {
+      buf[i] = static_cast<uint16_t>(filename[off + i]);
+    }
+
+    if (fwrite(buf, sizeof(uint16_t), n, _M_file) != n) {
+      return false;
+    }
+  }
+
+  _M_count++;
+
+  return true;
+}
+
+bool exec_trace::load(const wchar_t* filename)
+{
+  if (_M_entries) {
+    return false;
+  }
+
+  mapped_file f;
+  if ((!f.open(filename)) || (f.size() < sizeof(header))) {
+    return false;
+  }
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(f.data());
+  size_t len = f.size();
+
+  header hdr;
+  memcpy(&hdr, data, sizeof(header));
+  if ((memcmp(hdr.magic, magic, sizeof(magic)) != 0) ||
+      (hdr.version != version) ||
+      (hdr.record_size != sizeof(record))) {
+    return false;
+  }
+
+  // Count the (complete) records and the length of the file names.
+  size_t count = 0;
+  size_t total = 0;
+  size_t off = sizeof(header);
+  while (len - off >= sizeof(record)) {
+    record rec;
+    memcpy(&rec, data + off, sizeof(record));
+
+    size_t size = sizeof(record) + (rec.filenamelen * sizeof(uint16_t));
+    if (len - off < size) {
+      break;
+    }
+
+    count++;
+    total += rec.filenamelen + 1;
+    off += size;
+  }
+
+  if (count == 0) {
+    return false;
+  }
+
+  if (((_M_entries = reinterpret_cast<entry*>(
+                       malloc(count * sizeof(entry))
+                     )) == nullptr) ||
+      ((_M_filenames = reinterpret_cast<wchar_t*>(
+                         malloc(total * sizeof(wchar_t))
+                       )) == nullptr)) {
+    free(_M_entries);
+    _M_entries = nullptr;
+
+    return false;
+  }
+
+  // Copy the records and the file names (null-terminated).
+  size_t pos = 0;
+  off = sizeof(header);
+  for (size_t i = 0; i < count; i++) {
+    entry* e = _M_entries + i;
+    memcpy(&e->rec, data + off, sizeof(record));
+    off += sizeof(record);
+
+    e->filename = pos;
+
+    for (size_t j = 0; j < e->rec.filenamelen; j++) {
+      uint16_t c;
+      memcpy(&c, data + off, sizeof(uint16_t));
+      off += sizeof(uint16_t);
+
+      _M_filenames[pos++] = static_cast<wchar_t>(c);
+    }
+
+    _M_filenames[pos++] = 0;
+  }
+
+  // The records were written when the evaluations finished: sort them by
+  // the time the requests were received.
+  std::stable_sort(_M_entries,
+                   _M_entries + count,
+                   [](const entry& a, const entry& b) {
+                     return (a.rec.timestamp < b.rec.timestamp);
+                   });
+
+  _M_count = count;
+
+  return true;
+}
@@ -0,0 +1,177 @@
+#ifndef EXEC_TRACE_H
+#define EXEC_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <mutex>
+#include "file_identity.h"
+#include "evaluation_stats.h"
+
+// Trace of the requests evaluated by the client: what was asked, when, what
+// was answered and how long each stage took. It is recorded by the command
+// `run` (option `--record`) and replayed by the command `replay`.
+//
+// The file is a header followed by the records, in the order the evaluations
+// finished. Each record is followed by the file name (UTF-16, not
+// null-terminated). If the client stops abruptly, the last record might be
+// incomplete: it is ignored.
+class exec_trace {
+  public:
+    static const uint32_t version = 1;
+
+    static const size_t FILENAME_MAX_LEN = 32 * 1024;
+
+    struct record {
+      // When the request was received (nanoseconds since the beginning of
+      // the recording).
+      uint64_t timestamp;
+
+      // Identity of the file (if flag_identified is set).
+      file_identity id;
+
+      // Duration of each stage (microseconds).
+      uint32_t durations[evaluation_stats::NSTAGES];
+
+      // Duration of the evaluation (microseconds).
+      uint32_t latency;
+
+      // Length of the file name (UTF-16 code units).
+      uint16_t filenamelen;
+
+      uint8_t allowed;
+      uint8_t flags;
+
+      uint32_t reserved;
+    };
+
+    static const uint8_t flag_identified = 0x01;
+    static const uint8_t flag_cached = 0x02;
+
+    // Writer (all the workers write to the same trace).
+    class writer {
+      public:
+        // Constructor.
+        writer();
+
+        // Destructor.
+        ~writer();
+
+        // Open (the file is truncated).
+        bool open(const wchar_t* filename);
+
+        // Close.
+        bool close();
+
+        // Write record (`start`: when the request was received, see
+        // monotonic_clock::now()).
+        bool write(uint64_t start,
+                   uint64_t latency,
+                   const wchar_t* filename,
+                   size_t filenamelen,
+                   const evaluation_stats& stats,
+                   bool allowed);
+
+        // Get number of records written.
+        uint64_t count() const;
+
+      private:
+        static const size_t BUFFER_SIZE = 1024 * 1024;
+
+        FILE* _M_file;
+        char* _M_buffer;
+
+        // Beginning of the recording.
+        uint64_t _M_start;
+
+        uint64_t _M_count;
+
+        // Records are not interleaved.
+        mutable std::mutex _M_mutex;
+    };
+
+    // Constructor.
+    exec_trace();
+
+    // Destructor.
+    ~exec_trace();
+
+    // Load (the records are sorted by timestamp).
+    bool load(const wchar_t* filename);
+
+    // Get number of records.
+    size_t count() const;
+
+    // Get record.
+    const record& get(size_t idx, const wchar_t*& filename) const;
+
+  private:
+    static const uint8_t magic[8];
+
+    struct header {
+      uint8_t magic[8];
+      uint32_t version;
+      uint32_t record_size;
+    };
+
+    struct entry {
+      record rec;
+
+      // Offset of the file name (null-terminated) in _M_filenames.
+      size_t filename;
+    };
+
+    entry* _M_entries;
+    size_t _M_count;
+
+    wchar_t* _M_filenames;
+};
+
+static_assert(sizeof(exec_trace::record) == 80, "Unexpected record size.");
+
+inline exec_trace::writer::writer()
+  : _M_file(nullptr),
+    _M_buffer(nullptr),
+    _M_start(0),
+    _M_count(0)
+{
+}
+
+inline exec_trace::writer::~writer()
+{
+  close();
+}
+
+inline uint64_t exec_trace::writer::count() const
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+  return _M_count;
+}
+
+inline exec_trace::exec_trace()
+  : _M_entries(nullptr),
+    _M_count(0),
+    _M_filenames(nullptr)
+{
+}
+
+inline exec_trace::~exec_trace()
+{
+  free(_M_entries);
+  free(_M_filenames);
+}
+
+inline size_t exec_trace::count() const
+{
+  return _M_count;
+}
+
+inline const exec_trace::record& exec_trace::get(size_t idx,
+                                                 const wchar_t*& filename) const
+{
+  filename = _M_filenames + _M_entries[idx].filename;
+  return _M_entries[idx].rec;
+}
+
+#endif // EXEC_TRACE_H
@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include "file_identity.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <limits.h>
+  #include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+bool system_file_identity_probe::probe(const wchar_t* filename,
+                                       size_t filenamelen,
+                                       file_identity& id) const
+{
+  // Open file for querying attributes (it doesn't read the file).
+  HANDLE hFile;
+  if ((hFile = CreateFileW(filename,
+                           FILE_READ_ATTRIBUTES,
+                           FILE_SHARE_READ |
+                           FILE_SHARE_WRITE |
+                           FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_BACKUP_SEMANTICS,
+                           NULL)) != INVALID_HANDLE_VALUE) {
+    BY_HANDLE_FILE_INFORMATION info;
+    if (GetFileInformationByHandle(hFile, &info)) {
+      CloseHandle(hFile);
+
+      id.volume = info.dwVolumeSerialNumber;
+
+      id.file_id = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) |
+                   info.nFileIndexLow;
+
+      id.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) |
+                info.nFileSizeLow;
+
+      id.mtime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime)
+                  << 32) |
+                 info.ftLastWriteTime.dwLowDateTime;
+
+      return true;
+    }
+
+    CloseHandle(hFile);
+  }
+
+  return false;
+}
+#else
+bool system_file_identity_probe::probe(const wchar_t* filename,
+                                       size_t filenamelen,
+                                       file_identity& id) const
+{
+  // Convert file name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return false;
+  }
+
+  struct stat sbuf;
+  if (stat(path, &sbuf) == 0) {
+    id.volume = static_cast<uint64_t>(sbuf.st_dev);
+    id.file_id = static_cast<uint64_t>(sbuf.st_ino);
+    id.size = static_cast<uint64_t>(sbuf.st_size);
+    id.mtime = (static_cast<uint64_t>(sbuf.st_mtim.tv_sec) * 1000000000ull) +
+               sbuf.st_mtim.tv_nsec;
+
+    return true;
+  }
+
+  return false;
+}
+#endif
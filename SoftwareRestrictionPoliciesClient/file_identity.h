@@ -0,0 +1,56 @@
+#ifndef FILE_IDENTITY_H
+#define FILE_IDENTITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Identity of a file: the volume and the file ID tell which file it is,
+// the size and the last-write time tell which version of it.
+struct file_identity {
+  uint64_t volume;
+  uint64_t file_id;
+  uint64_t size;
+  uint64_t mtime;
+};
+
+// Compare file identities.
+inline bool operator==(const file_identity& a, const file_identity& b)
+{
+  return ((a.volume == b.volume) &&
+          (a.file_id == b.file_id) &&
+          (a.size == b.size) &&
+          (a.mtime == b.mtime));
+}
+
+inline bool operator!=(const file_identity& a, const file_identity& b)
+{
+  return !(a == b);
+}
+
+class file_identity_probe {
+  public:
+    // Destructor.
+    virtual ~file_identity_probe();
+
+    // Probe.
+    virtual bool probe(const wchar_t* filename,
+                       size_t filenamelen,
+                       file_identity& id) const = 0;
+};
+
+// Probe backed by the file system:
+// * Windows: volume serial number, file index, size and last-write time.
+// * POSIX: (st_dev, st_ino, st_size, st_mtime).
+class system_file_identity_probe : public file_identity_probe {
+  public:
+    // Probe.
+    bool probe(const wchar_t* filename,
+               size_t filenamelen,
+               file_identity& id) const;
+};
+
+inline file_identity_probe::~file_identity_probe()
+{
+}
+
+#endif // FILE_IDENTITY_H
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include "filter_port_transport.h"
+#include "monotonic_clock.h"
+#include "fast_path.h"
+
+#pragma comment(lib, "fltlib.lib")
+
+bool filter_port_transport::open(size_t nreceives, size_t nthreads)
+{
+  if ((nreceives == 0) || (_M_port != INVALID_HANDLE_VALUE)) {
+    return false;
+  }
+
+  // Open connection to driver.
+  if (FilterConnectCommunicationPort(COMMUNICATION_PORT,
+                                     0,
+                                     NULL,
+                                     0,
+                                     NULL,
+                                     &_M_port) == S_OK) {
+    // Associate the port with a new I/O completion port.
+    if ((_M_completion_port = CreateIoCompletionPort(
+                                _M_port,
+                                NULL,
+                                0,
+                                static_cast<DWORD>(nthreads)
+                              )) != NULL) {
+      if ((_M_messages = reinterpret_cast<message*>(
+                           calloc(nreceives, sizeof(message))
+                         )) != nullptr) {
+        _M_nmessages = nreceives;
+
+        // Post receives.
+        for (size_t i = 0; i < nreceives; i++) {
+          if (!post(_M_messages + i)) {
+            close();
+            return false;
+          }
+        }
+
+        return true;
+      }
+
+      CloseHandle(_M_completion_port);
+      _M_completion_port = NULL;
+    }
+
+    CloseHandle(_M_port);
+    _M_port = INVALID_HANDLE_VALUE;
+  }
+
+  return false;
+}
+
+void filter_port_transport::close()
+{
+  if (_M_port != INVALID_HANDLE_VALUE) {
+    // Cancel the outstanding receives.
+    CancelIoEx(_M_port, NULL);
+
+    // Wait for the cancelled receives to complete.
+    while (_M_outstanding > 0) {
+      DWORD bytes;
+      ULONG_PTR key;
+      OVERLAPPED* overlapped;
+      if ((!GetQueuedCompletionStatus(_M_completion_port,
+                                      &bytes,
+                                      &key,
+                                      &overlapped,
+                                      DRAIN_TIMEOUT)) &&
+          (!overlapped)) {
+        break;
+      }
+
+      if (overlapped) {
+        InterlockedDecrement(&_M_outstanding);
+      }
+    }
+
+    CloseHandle(_M_port);
+    _M_port = INVALID_HANDLE_VALUE;
+
+    CloseHandle(_M_completion_port);
+    _M_completion_port = NULL;
+
+    // If all the receives have completed...
+    if (_M_outstanding == 0) {
+      free(_M_messages);
+    }
+
+    _M_messages = nullptr;
+    _M_nmessages = 0;
+  }
+}
+
+request* filter_port_transport::receive(unsigned timeout)
+{
+  DWORD bytes;
+  ULONG_PTR key;
+  OVERLAPPED* overlapped;
+  if (GetQueuedCompletionStatus(_M_completion_port,
+                                &bytes,
+                                &key,
+                                &overlapped,
+                                timeout)) {
+    // Shutdown?
+    if (!overlapped) {
+      // The other packets without OVERLAPPED (the completion of
+      // FilterSendMessage(), which is synchronous) are ignored.
+      if (key == SHUTDOWN_KEY) {
+        // Wake up the next thread.
+        PostQueuedCompletionStatus(_M_completion_port, 0, SHUTDOWN_KEY, NULL);
+      }
+
+      return nullptr;
+    }
+
+    InterlockedDecrement(&_M_outstanding);
+
+    message* msg = CONTAINING_RECORD(overlapped, message, overlapped);
+
+    static const DWORD HEADERS_SIZE = sizeof(FILTER_MESSAGE_HEADER) +
+                                      sizeof(request_header);
+
+    if ((bytes >= HEADERS_SIZE) && (bytes <= MESSAGE_MAX_SIZE)) {
+      msg->filenamelen = (bytes - HEADERS_SIZE) / sizeof(wchar_t);
+      msg->arrival = monotonic_clock::from_counter(
+                       static_cast<uint64_t>(msg->req.sent)
+                     );
+    } else {
+      msg->filenamelen = 0;
+      msg->arrival = monotonic_clock::now();
+    }
+
+    msg->data[msg->filenamelen] = 0;
+    msg->filename = msg->data;
+
+    return msg;
+  } else if (overlapped) {
+    InterlockedDecrement(&_M_outstanding);
+
+    message* msg = CONTAINING_RECORD(overlapped, message, overlapped);
+
+    // If the file name didn't fit in the buffer...
+    if (GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+      // Reply with "not allowed".
+      msg->data[0] = 0;
+      msg->filename = msg->data;
+      msg->filenamelen = 0;
+      msg->arrival = monotonic_clock::now();
+
+      return msg;
+    }
+
+    // Post the receive again.
+    post(msg);
+  }
+
+  return nullptr;
+}
+
+bool filter_port_transport::reply(request* req, bool allowed)
+{
+  message* msg = static_cast<message*>(req);
+
+  reply_message reply;
+  reply.hdr.Status = 0;
+  reply.hdr.MessageId = msg->hdr.MessageId;
+  reply.reply = allowed ? 1 : 0;
+
+  HRESULT hr = FilterReplyMessage(_M_port, &reply.hdr, REPLY_SIZE);
+
+  // Post the receive again.
+  post(msg);
+
+  return (hr == S_OK);
+}
+
+void filter_port_transport::shutdown()
+{
+  PostQueuedCompletionStatus(_M_completion_port, 0, SHUTDOWN_KEY, NULL);
+}
+
+bool filter_port_transport::set_fast_path(const void* blob, size_t len)
+{
+  if ((_M_port == INVALID_HANDLE_VALUE) || (len > FAST_PATH_MAX_SIZE)) {
+    return false;
+  }
+
+  // The driver validates the blob and replaces the previous one (an empty
+  // message removes it).
+  DWORD bytes;
+  return (FilterSendMessage(_M_port,
+                            const_cast<void*>(blob),
+                            blob ? static_cast<DWORD>(len) : 0,
+                            NULL,
+                            0,
+                            &bytes) == S_OK);
+}
+
+bool filter_port_transport::post(message* msg)
+{
+  memset(&msg->overlapped, 0, sizeof(OVERLAPPED));
+
+  InterlockedIncrement(&_M_outstanding);
+
+  if (FilterGetMessage(_M_port,
+                       &msg->hdr,
+                       MESSAGE_MAX_SIZE,
+                       &msg->overlapped) ==
+      HRESULT_FROM_WIN32(ERROR_IO_PENDING)) {
+    return true;
+  }
+
+  InterlockedDecrement(&_M_outstanding);
+
+  return false;
+}
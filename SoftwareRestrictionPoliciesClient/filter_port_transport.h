@@ -0,0 +1,91 @@
+#ifndef FILTER_PORT_TRANSPORT_H
+#define FILTER_PORT_TRANSPORT_H
+
+#include <windows.h>
+#include <fltuser.h>
+#include "transport.h"
+#include "communication_port.h"
+
+// Transport over the driver's communication port.
+// Several receives are kept outstanding on an I/O completion port, so several
+// requests can be evaluated at the same time.
+class filter_port_transport : public transport {
+  public:
+    // Constructor.
+    filter_port_transport();
+
+    // Destructor.
+    ~filter_port_transport();
+
+    // Open connection to driver.
+    bool open(size_t nreceives, size_t nthreads);
+
+    // Close connection.
+    void close();
+
+    // Receive request (waits up to `timeout` milliseconds).
+    request* receive(unsigned timeout);
+
+    // Reply to request.
+    bool reply(request* req, bool allowed);
+
+    // Wake up the threads waiting in receive().
+    void shutdown();
+
+    // Set the fast path of the policy.
+    bool set_fast_path(const void* blob, size_t len);
+
+  private:
+    static const DWORD DRAIN_TIMEOUT = 1000; // Milliseconds.
+
+    // Completion key of the shutdown.
+    static const ULONG_PTR SHUTDOWN_KEY = 1;
+
+    struct message : public request {
+      FILTER_MESSAGE_HEADER hdr;
+      request_header req;
+      wchar_t data[FILENAME_MAX_LEN + 1];
+
+      OVERLAPPED overlapped;
+    };
+
+    static const DWORD MESSAGE_MAX_SIZE =
+      sizeof(FILTER_MESSAGE_HEADER) +
+      sizeof(request_header) +
+      (request::FILENAME_MAX_LEN * sizeof(wchar_t));
+
+    struct reply_message {
+      FILTER_REPLY_HEADER hdr;
+      int reply;
+    };
+
+    static const DWORD REPLY_SIZE = sizeof(FILTER_REPLY_HEADER) + sizeof(int);
+
+    HANDLE _M_port;
+    HANDLE _M_completion_port;
+
+    message* _M_messages;
+    size_t _M_nmessages;
+
+    // Number of receives posted and not completed yet.
+    volatile LONG _M_outstanding;
+
+    // Post receive.
+    bool post(message* msg);
+};
+
+inline filter_port_transport::filter_port_transport()
+  : _M_port(INVALID_HANDLE_VALUE),
+    _M_completion_port(NULL),
+    _M_messages(nullptr),
+    _M_nmessages(0),
+    _M_outstanding(0)
+{
+}
+
+inline filter_port_transport::~filter_port_transport()
+{
+  close();
+}
+
+#endif // FILTER_PORT_TRANSPORT_H
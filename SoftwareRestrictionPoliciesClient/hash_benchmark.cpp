@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+#include "hash_benchmark.h"
+#include "sha1.h"
+#include "sha256.h"
+
+// Every kernel hashes the data this number of times (the best time is
+// taken).
+static const size_t RUNS = 3;
+
+// Pseudo-random number generator (xorshift64*), so every run uses the same
+// data.
+static uint64_t next(uint64_t& state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+
+  return state * 2685821657736338717ull;
+}
+
+// Seconds elapsed since `start`.
+static double elapsed(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration<double>(
+           std::chrono::steady_clock::now() - start
+         ).count();
+}
+
+template<typename Hash>
+static bool benchmark(const char* name, const uint8_t* data, size_t len)
+{
+  uint8_t reference[Hash::DIGEST_LEN];
+
+  for (size_t k = 0; k < SHA_KERNELS; k++) {
+    sha_kernel kernel = static_cast<sha_kernel>(k);
+    if (!sha_kernel_supported(kernel)) {
+      printf("%-8s %-8s not supported\n", name, sha_kernel_name(kernel));
+      continue;
+    }
+
+    uint8_t digest[Hash::DIGEST_LEN];
+    double best = 0;
+
+    for (size_t i = 0; i < RUNS; i++) {
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+      Hash hash(kernel);
+      hash.update(data, len);
+      hash.finish(digest);
+
+      double t = elapsed(start);
+      if ((i == 0) || (t < best)) {
+        best = t;
+      }
+    }
+
+    // The scalar kernel is the reference.
+    if (kernel == sha_kernel::scalar) {
+      memcpy(reference, digest, sizeof(digest));
+    } else if (memcmp(digest, reference, sizeof(digest)) != 0) {
+      printf("%-8s %-8s wrong digest\n", name, sha_kernel_name(kernel));
+      return false;
+    }
+
+    printf("%-8s %-8s %8.2f GB/s%s\n",
+           name,
+           sha_kernel_name(kernel),
+           (best > 0) ? len / best / 1e9 : 0.0,
+           (kernel == sha_kernel_best()) ? " (used)" : "");
+  }
+
+  return true;
+}
+
+bool hash_benchmark(size_t megabytes)
+{
+  size_t len = megabytes * 1024 * 1024;
+
+  uint8_t* data;
+  if ((data = reinterpret_cast<uint8_t*>(malloc(len))) == nullptr) {
+    return false;
+  }
+
+  uint64_t state = 0x9e3779b97f4a7c15ull;
+
+  for (size_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t v = next(state);
+    memcpy(data + i, &v, sizeof(uint64_t));
+  }
+
+  printf("Data: %llu MB\n", static_cast<unsigned long long>(megabytes));
+
+  bool ret = ((benchmark<sha1>("SHA-1", data, len)) &&
+              (benchmark<sha256>("SHA-256", data, len)));
+
+  free(data);
+
+  return ret;
+}
@@ -0,0 +1,11 @@
+#ifndef HASH_BENCHMARK_H
+#define HASH_BENCHMARK_H
+
+#include <stddef.h>
+
+// Hash benchmark: hash `megabytes` MB of synthetic data with every SHA-1 and
+// SHA-256 kernel supported by the processor, check that they all produce the
+// same digest and print the throughput.
+bool hash_benchmark(size_t megabytes);
+
+#endif // HASH_BENCHMARK_H
@@ -0,0 +1,99 @@
+#include <string.h>
+#include "image.h"
+
+bool image_writer::add(const void* data,
+                       size_t len,
+                       size_t align,
+                       image_block& block)
+{
+  // Padding.
+  size_t pad = (align - (_M_used % align)) % align;
+
+  if ((len > SIZE_MAX - pad) || (!allocate(pad + len))) {
+    return false;
+  }
+
+  memset(_M_data + _M_used, 0, pad);
+  _M_used += pad;
+
+  if (len > 0) {
+    memcpy(_M_data + _M_used, data, len);
+  }
+
+  block.off = _M_used;
+  block.len = len;
+
+  _M_used += len;
+
+  return true;
+}
+
+bool image_writer::allocate(size_t size)
+{
+  if (size > SIZE_MAX - _M_used) {
+    return false;
+  }
+
+  if ((size += _M_used) <= _M_size) {
+    return true;
+  }
+
+  size_t s = (_M_size > 0) ? _M_size : initial_alloc;
+  while (s < size) {
+    size_t tmp;
+    if ((tmp = s * 2) >= s) {
+      s = tmp;
+    } else {
+      // Overflow.
+      return false;
+    }
+  }
+
+  uint8_t* data;
+  if ((data = reinterpret_cast<uint8_t*>(realloc(_M_data, s))) != nullptr) {
+    _M_data = data;
+    _M_size = s;
+
+    return true;
+  }
+
+  return false;
+}
+
+const void* image_reader::get(const image_block& block,
+                              size_t align,
+                              size_t size) const
+{
+  if ((block.off <= _M_len) &&
+      (block.len <= _M_len - block.off) &&
+      ((block.off % align) == 0) &&
+      ((block.len % size) == 0)) {
+    return _M_data + block.off;
+  }
+
+  return nullptr;
+}
+
+uint64_t image_checksum(const void* data, size_t len)
+{
+  static const uint64_t prime = 0x9e3779b97f4a7c15ull;
+
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data);
+  uint64_t h = len * prime;
+
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, ptr, sizeof(uint64_t));
+
+    h = (h ^ w) * prime;
+    h ^= h >> 29;
+
+    ptr += sizeof(uint64_t);
+  }
+
+  for (; len > 0; len--) {
+    h = (h ^ *ptr++) * prime;
+  }
+
+  return h ^ (h >> 32);
+}
@@ -0,0 +1,99 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Block of an image (offset from the beginning of the image and length in
+// bytes).
+struct image_block {
+  uint64_t off;
+  uint64_t len;
+};
+
+// Writer of an in-memory image: blocks are appended at the requested
+// alignment and referenced by their offset, so the image can be written to a
+// file and used in place once it is mapped.
+class image_writer {
+  public:
+    // Constructor.
+    image_writer();
+
+    // Destructor.
+    ~image_writer();
+
+    // Add block.
+    bool add(const void* data, size_t len, size_t align, image_block& block);
+
+    // Get buffer.
+    uint8_t* buffer();
+    const uint8_t* buffer() const;
+
+    // Length.
+    size_t length() const;
+
+  private:
+    static const size_t initial_alloc = 64 * 1024;
+
+    uint8_t* _M_data;
+    size_t _M_size;
+    size_t _M_used;
+
+    // Allocate.
+    bool allocate(size_t size);
+};
+
+// Reader of an image (usually a mapped file).
+class image_reader {
+  public:
+    // Constructor.
+    image_reader(const void* data, size_t len);
+
+    // Get block (nullptr if it is out of bounds, misaligned or its length is
+    // not a multiple of `size`).
+    const void* get(const image_block& block, size_t align, size_t size) const;
+
+  private:
+    const uint8_t* _M_data;
+    size_t _M_len;
+};
+
+// Checksum of an image (64-bit, 8 bytes per multiplication).
+uint64_t image_checksum(const void* data, size_t len);
+
+inline image_writer::image_writer()
+  : _M_data(nullptr),
+    _M_size(0),
+    _M_used(0)
+{
+}
+
+inline image_writer::~image_writer()
+{
+  if (_M_data) {
+    free(_M_data);
+  }
+}
+
+inline uint8_t* image_writer::buffer()
+{
+  return _M_data;
+}
+
+inline const uint8_t* image_writer::buffer() const
+{
+  return _M_data;
+}
+
+inline size_t image_writer::length() const
+{
+  return _M_used;
+}
+
+inline image_reader::image_reader(const void* data, size_t len)
+  : _M_data(reinterpret_cast<const uint8_t*>(data)),
+    _M_len(len)
+{
+}
+
+#endif // IMAGE_H
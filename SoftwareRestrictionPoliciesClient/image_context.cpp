@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include "image_context.h"
+
+static inline uint16_t load_le16(const uint8_t* p)
+{
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t load_le32(const uint8_t* p)
+{
+  return static_cast<uint32_t>(p[0]) |
+         (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool image_context::open(const wchar_t* filename)
+{
+  _M_failed = true;
+
+  // Open file.
+  if (!_M_file.open(filename)) {
+    return false;
+  }
+
+  // Read the first bytes of the file.
+  uint64_t size = _M_file.size();
+  _M_headerlen = (size < HEADER_LEN) ? static_cast<size_t>(size) :
+                                       HEADER_LEN;
+
+  if (((_M_header = static_cast<uint8_t*>(malloc(HEADER_LEN))) != nullptr) &&
+      (_M_file.read(0, _M_header, _M_headerlen))) {
+    _M_failed = false;
+
+    // Parse file.
+    const uint8_t* certificates;
+    if ((authenticode::parse(_M_header, _M_headerlen, size, _M_layout)) &&
+        (read_certificates(certificates))) {
+      find_signature(certificates,
+                     static_cast<size_t>(_M_layout.certificates.len));
+
+      return true;
+    }
+  }
+
+  close();
+
+  return false;
+}
+
+void image_context::close()
+{
+  _M_file.close();
+
+  free(_M_header);
+  _M_header = nullptr;
+  _M_headerlen = 0;
+
+  free(_M_certificates);
+  _M_certificates = nullptr;
+
+  free(_M_chunk);
+  _M_chunk = nullptr;
+
+  _M_signature = nullptr;
+  _M_signaturelen = 0;
+
+  _M_has_sha1 = false;
+  _M_has_sha256 = false;
+}
+
+bool image_context::hash(bool sha256, uint64_t deadline)
+{
+  uint8_t* sha1digest = _M_has_sha1 ? nullptr : _M_sha1;
+  uint8_t* sha256digest = ((sha256) && (!_M_has_sha256)) ? _M_sha256 :
+                                                            nullptr;
+
+  _M_failed = false;
+
+  if ((sha1digest) || (sha256digest)) {
+    if (!authenticode::hash(_M_layout,
+                            *this,
+                            sha1digest,
+                            sha256digest,
+                            deadline)) {
+      return false;
+    }
+
+    _M_hashed += hash_size();
+
+    _M_has_sha1 = true;
+    _M_has_sha256 = (_M_has_sha256) || (sha256digest != nullptr);
+  }
+
+  return true;
+}
+
+uint64_t image_context::hash_size() const
+{
+  uint64_t size = _M_layout.padding;
+
+  for (size_t i = 0; i < _M_layout.nranges; i++) {
+    size += _M_layout.ranges[i].len;
+  }
+
+  return size;
+}
+
+bool image_context::read_certificates(const uint8_t*& data)
+{
+  uint64_t offset = _M_layout.certificates.offset;
+  uint64_t len = _M_layout.certificates.len;
+
+  // If the certificate table is in the first bytes...
+  if ((offset <= _M_headerlen) && (len <= _M_headerlen - offset)) {
+    data = _M_header + offset;
+    return true;
+  }
+
+  // A certificate table which is too large is ignored.
+  if (len > MAX_CERTIFICATES_LEN) {
+    _M_layout.certificates.len = 0;
+
+    data = nullptr;
+    return true;
+  }
+
+  size_t n = static_cast<size_t>(len);
+  if (((_M_certificates = static_cast<uint8_t*>(malloc(n))) != nullptr) &&
+      (_M_file.read(offset, _M_certificates, n))) {
+    data = _M_certificates;
+    return true;
+  }
+
+  _M_failed = true;
+
+  return false;
+}
+
+void image_context::find_signature(const uint8_t* data, size_t certlen)
+{
+  static const size_t WIN_CERTIFICATE_LEN = 8;
+
+  _M_signature = nullptr;
+  _M_signaturelen = 0;
+
+  const uint8_t* ptr = data;
+  size_t left = certlen;
+
+  // For each WIN_CERTIFICATE (dwLength, wRevision, wCertificateType,
+  // bCertificate), aligned on 8 bytes...
+  while (left >= WIN_CERTIFICATE_LEN) {
+    size_t len = load_le32(ptr);
+    if ((len < WIN_CERTIFICATE_LEN) || (len > left)) {
+      return;
+    }
+
+    if ((load_le16(ptr + 6) == WIN_CERT_TYPE_PKCS_SIGNED_DATA) &&
+        (len > WIN_CERTIFICATE_LEN)) {
+      _M_signature = ptr + WIN_CERTIFICATE_LEN;
+      _M_signaturelen = len - WIN_CERTIFICATE_LEN;
+
+      return;
+    }
+
+    len = (len + 7) & ~static_cast<size_t>(7);
+    if (len >= left) {
+      return;
+    }
+
+    ptr += len;
+    left -= len;
+  }
+}
+
+const uint8_t* image_context::read(uint64_t offset, size_t len)
+{
+  // If the chunk is in the first bytes...
+  if ((offset <= _M_headerlen) && (len <= _M_headerlen - offset)) {
+    return _M_header + offset;
+  }
+
+  if (!_M_chunk) {
+    _M_chunk = static_cast<uint8_t*>(malloc(authenticode::CHUNK_SIZE));
+  }
+
+  if ((_M_chunk) && (_M_file.read(offset, _M_chunk, len))) {
+    return _M_chunk;
+  }
+
+  _M_failed = true;
+
+  return nullptr;
+}
@@ -0,0 +1,158 @@
+#ifndef IMAGE_CONTEXT_H
+#define IMAGE_CONTEXT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "input_file.h"
+#include "authenticode.h"
+
+// Executable being evaluated. The file is opened once and its headers are
+// parsed once: the signature check, the hashes and the lookups of the hashes
+// all use the same context.
+// The file is not mapped: its headers and its certificate table are read
+// when it is opened, and the hashed ranges are read in chunks, so a read
+// error fails the call (see failed()) and the size of the file is not
+// limited by the address space.
+class image_context : private authenticode::source {
+  public:
+    // Constructor.
+    image_context();
+
+    // Destructor.
+    ~image_context();
+
+    // Open (read the headers and the certificate table and parse them).
+    bool open(const wchar_t* filename);
+
+    // Close.
+    void close();
+
+    // Is the file a PE image?
+    bool pe() const;
+
+    // Get signature: PKCS#7 SignedData of the first Authenticode certificate
+    // of the certificate table (nullptr if the image is not signed).
+    const uint8_t* signature(size_t& len) const;
+
+    // Calculate the hashes which haven't been calculated yet (SHA-1 and, if
+    // `sha256` is true, SHA-256), in a single pass over the file.
+    // The hashing stops at `deadline` (monotonic clock, nanoseconds; by
+    // default, none): returns false if it did (no hash is calculated).
+    bool hash(bool sha256, uint64_t deadline = UINT64_MAX);
+
+    // Get number of bytes a pass over the file hashes.
+    uint64_t hash_size() const;
+
+    // Get SHA-1 hash (nullptr if not calculated).
+    const uint8_t* sha1() const;
+
+    // Get SHA-256 hash (nullptr if not calculated).
+    const uint8_t* sha256() const;
+
+    // Get number of bytes hashed (every pass over the file counts).
+    uint64_t hashed() const;
+
+    // Did the last call to open() or hash() fail because the file couldn't
+    // be opened or read (rather than because it is malformed or the
+    // deadline passed)?
+    bool failed() const;
+
+  private:
+    // Type of certificate: PKCS#7 SignedData.
+    static const uint16_t WIN_CERT_TYPE_PKCS_SIGNED_DATA = 0x0002;
+
+    // Number of bytes read when the file is opened (the headers have to be
+    // in them).
+    static const size_t HEADER_LEN = authenticode::CHUNK_SIZE;
+
+    // Maximum size of a certificate table (a larger one is ignored, the
+    // image is evaluated as unsigned).
+    static const uint64_t MAX_CERTIFICATES_LEN = 16 * 1024 * 1024;
+
+    input_file _M_file;
+    authenticode::layout _M_layout;
+
+    // First bytes of the file.
+    uint8_t* _M_header;
+    size_t _M_headerlen;
+
+    // Certificate table, if it is not in the first bytes.
+    uint8_t* _M_certificates;
+
+    // Chunk being hashed, if it is not in the first bytes.
+    uint8_t* _M_chunk;
+
+    bool _M_failed;
+
+    const uint8_t* _M_signature;
+    size_t _M_signaturelen;
+
+    uint8_t _M_sha1[authenticode::SHA1_LEN];
+    uint8_t _M_sha256[authenticode::SHA256_LEN];
+
+    bool _M_has_sha1;
+    bool _M_has_sha256;
+
+    uint64_t _M_hashed;
+
+    // Read the certificate table.
+    bool read_certificates(const uint8_t*& data);
+
+    // Find the first Authenticode signature of the certificate table.
+    void find_signature(const uint8_t* data, size_t certlen);
+
+    // Read chunk (authenticode::source).
+    const uint8_t* read(uint64_t offset, size_t len);
+};
+
+inline image_context::image_context()
+  : _M_header(nullptr),
+    _M_headerlen(0),
+    _M_certificates(nullptr),
+    _M_chunk(nullptr),
+    _M_failed(false),
+    _M_signature(nullptr),
+    _M_signaturelen(0),
+    _M_has_sha1(false),
+    _M_has_sha256(false),
+    _M_hashed(0)
+{
+}
+
+inline image_context::~image_context()
+{
+  close();
+}
+
+inline bool image_context::pe() const
+{
+  return _M_layout.pe;
+}
+
+inline const uint8_t* image_context::signature(size_t& len) const
+{
+  len = _M_signaturelen;
+  return _M_signature;
+}
+
+inline const uint8_t* image_context::sha1() const
+{
+  return _M_has_sha1 ? _M_sha1 : nullptr;
+}
+
+inline const uint8_t* image_context::sha256() const
+{
+  return _M_has_sha256 ? _M_sha256 : nullptr;
+}
+
+inline uint64_t image_context::hashed() const
+{
+  return _M_hashed;
+}
+
+inline bool image_context::failed() const
+{
+  return _M_failed;
+}
+
+#endif // IMAGE_CONTEXT_H
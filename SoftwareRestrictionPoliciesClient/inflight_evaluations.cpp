@@ -0,0 +1,103 @@
+#include <new>
+#include <chrono>
+#include "inflight_evaluations.h"
+#include "monotonic_clock.h"
+
+inflight_evaluations::evaluation*
+inflight_evaluations::join(uint64_t key,
+                           const file_identity& id,
+                           uint32_t generation,
+                           bool& leader)
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  // If the same version of the file is being evaluated (by the same
+  // path)...
+  for (evaluation* e = _M_head; e; e = e->next) {
+    if ((e->key == key) && (e->id == id) && (e->generation == generation)) {
+      e->refs++;
+
+      leader = false;
+      return e;
+    }
+  }
+
+  evaluation* e;
+  if ((e = new (std::nothrow) evaluation()) == nullptr) {
+    return nullptr;
+  }
+
+  e->key = key;
+  e->id = id;
+  e->generation = generation;
+  e->refs = 1;
+  e->done = false;
+  e->completed = false;
+  e->allowed = false;
+
+  e->next = _M_head;
+  _M_head = e;
+
+  leader = true;
+  return e;
+}
+
+void inflight_evaluations::finish(evaluation* e, bool completed, bool allowed)
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  e->done = true;
+  e->completed = completed;
+  e->allowed = allowed;
+
+  // Remove the evaluation from the list: the next request evaluates the
+  // file again (or finds the verdict in the cache).
+  evaluation** prev = &_M_head;
+  while (*prev != e) {
+    prev = &(*prev)->next;
+  }
+
+  *prev = e->next;
+
+  e->cv.notify_all();
+
+  leave(e);
+}
+
+bool inflight_evaluations::wait(evaluation* e,
+                                uint64_t deadline,
+                                bool& allowed)
+{
+  std::unique_lock<std::mutex> lock(_M_mutex);
+
+  while (!e->done) {
+    if (deadline == UINT64_MAX) {
+      e->cv.wait(lock);
+    } else {
+      uint64_t now = monotonic_clock::now();
+      if (now >= deadline) {
+        break;
+      }
+
+      e->cv.wait_for(lock, std::chrono::nanoseconds(deadline - now));
+    }
+  }
+
+  // Otherwise, the caller evaluates the file itself (it is not counted).
+  bool ret = ((e->done) && (e->completed));
+  if (ret) {
+    allowed = e->allowed;
+    _M_coalesced++;
+  }
+
+  leave(e);
+
+  return ret;
+}
+
+void inflight_evaluations::leave(evaluation* e)
+{
+  if (--e->refs == 0) {
+    delete e;
+  }
+}
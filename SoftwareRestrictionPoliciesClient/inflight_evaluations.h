@@ -0,0 +1,94 @@
+#ifndef INFLIGHT_EVALUATIONS_H
+#define INFLIGHT_EVALUATIONS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <condition_variable>
+#include "file_identity.h"
+
+// Evaluations in progress, keyed by the path (see verdict_cache::key()),
+// the identity of the file and the generation of the policy: the first
+// request for a version of a file evaluates it and the concurrent requests
+// for the same version wait for its verdict, so N simultaneous executions
+// cost one evaluation.
+// The path is part of the key, like in the verdict cache: the hard links of
+// a file share its identity but not the path rules.
+// There are at most as many evaluations in progress as evaluating threads,
+// they are kept in a list.
+class inflight_evaluations {
+  public:
+    // Evaluation in progress.
+    struct evaluation {
+      uint64_t key;
+      file_identity id;
+      uint32_t generation;
+
+      // Threads which have joined and not left yet.
+      size_t refs;
+
+      bool done;
+      bool completed;
+      bool allowed;
+
+      evaluation* next;
+
+      std::condition_variable cv;
+    };
+
+    // Constructor.
+    inflight_evaluations();
+
+    // Destructor.
+    ~inflight_evaluations();
+
+    // Join the evaluation of the file (`leader`: the caller evaluates the
+    // file and calls finish(), otherwise it calls wait()).
+    // Returns nullptr if out of memory (the caller evaluates the file).
+    evaluation* join(uint64_t key,
+                     const file_identity& id,
+                     uint32_t generation,
+                     bool& leader);
+
+    // Publish the verdict (`completed`: false if the evaluation was
+    // abandoned) and leave the evaluation.
+    void finish(evaluation* e, bool completed, bool allowed);
+
+    // Wait for the verdict until `deadline` (monotonic clock, nanoseconds;
+    // UINT64_MAX: no deadline) and leave the evaluation.
+    // Returns false if the deadline passed or the evaluation was abandoned
+    // (`allowed` is then not set).
+    bool wait(evaluation* e, uint64_t deadline, bool& allowed);
+
+    // Get number of requests which got the verdict of another one.
+    uint64_t coalesced() const;
+
+  private:
+    // Evaluations in progress.
+    evaluation* _M_head;
+
+    uint64_t _M_coalesced;
+
+    mutable std::mutex _M_mutex;
+
+    // Leave the evaluation (the last thread frees it).
+    void leave(evaluation* e);
+};
+
+inline inflight_evaluations::inflight_evaluations()
+  : _M_head(nullptr),
+    _M_coalesced(0)
+{
+}
+
+inline inflight_evaluations::~inflight_evaluations()
+{
+}
+
+inline uint64_t inflight_evaluations::coalesced() const
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+  return _M_coalesced;
+}
+
+#endif // INFLIGHT_EVALUATIONS_H
@@ -0,0 +1,291 @@
+#ifdef __linux__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include "inotify_change_feed.h"
+
+// Events of the files and of the directories.
+static const uint32_t FILE_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO;
+static const uint32_t DIRECTORY_EVENTS = IN_CREATE | IN_MOVED_TO;
+
+inotify_change_feed::~inotify_change_feed()
+{
+  if (_M_fd != -1) {
+    close(_M_fd);
+  }
+
+  if (_M_pipe[0] != -1) {
+    close(_M_pipe[0]);
+    close(_M_pipe[1]);
+  }
+
+  for (size_t i = 0; i < _M_nwatches; i++) {
+    free(_M_watches[i].path);
+  }
+
+  if (_M_watches) {
+    free(_M_watches);
+  }
+}
+
+bool inotify_change_feed::add(const wchar_t* directory)
+{
+  // Convert directory name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, directory, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return false;
+  }
+
+  // Remove the trailing slashes.
+  while ((len > 1) && (path[len - 1] == '/')) {
+    path[--len] = 0;
+  }
+
+  return ((init()) && (watch_directory(path)));
+}
+
+bool inotify_change_feed::next(wchar_t* filename,
+                               size_t& len,
+                               unsigned timeout)
+{
+  if (_M_queue.pop(filename, len)) {
+    return true;
+  }
+
+  if (_M_fd == -1) {
+    return false;
+  }
+
+  struct pollfd fds[2];
+  fds[0].fd = _M_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = _M_pipe[0];
+  fds[1].events = POLLIN;
+
+  // If there are events and the feed is not being shut down...
+  if ((poll(fds, 2, static_cast<int>(timeout)) > 0) &&
+      ((fds[1].revents & POLLIN) == 0) &&
+      ((fds[0].revents & POLLIN) != 0)) {
+    read_events();
+    return _M_queue.pop(filename, len);
+  }
+
+  return false;
+}
+
+void inotify_change_feed::shutdown()
+{
+  // The byte stays in the pipe, so the next calls return immediately.
+  if (_M_pipe[1] != -1) {
+    char c = 0;
+    if (write(_M_pipe[1], &c, 1) < 0) {
+      // Nothing to do, next() times out.
+    }
+  }
+}
+
+bool inotify_change_feed::init()
+{
+  if (_M_fd != -1) {
+    return true;
+  }
+
+  if ((_M_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) != -1) {
+    if (pipe2(_M_pipe, O_NONBLOCK | O_CLOEXEC) == 0) {
+      return true;
+    }
+
+    _M_pipe[0] = -1;
+    _M_pipe[1] = -1;
+
+    close(_M_fd);
+    _M_fd = -1;
+  }
+
+  return false;
+}
+
+bool inotify_change_feed::watch_directory(const char* path)
+{
+  // Watch the directory before scanning it, so no file is missed.
+  int wd;
+  if ((wd = inotify_add_watch(_M_fd,
+                              path,
+                              FILE_EVENTS |
+                              DIRECTORY_EVENTS |
+                              IN_ONLYDIR |
+                              IN_DONT_FOLLOW)) == -1) {
+    return false;
+  }
+
+  // If the directory is not watched yet...
+  if (!find(wd)) {
+    if (_M_nwatches == _M_size) {
+      size_t size = (_M_size != 0) ? _M_size * 2 : 64;
+
+      watch* watches;
+      if ((watches = reinterpret_cast<watch*>(
+                       realloc(_M_watches, size * sizeof(watch))
+                     )) == nullptr) {
+        inotify_rm_watch(_M_fd, wd);
+        return false;
+      }
+
+      _M_watches = watches;
+      _M_size = size;
+    }
+
+    char* p;
+    if ((p = strdup(path)) == nullptr) {
+      inotify_rm_watch(_M_fd, wd);
+      return false;
+    }
+
+    _M_watches[_M_nwatches].wd = wd;
+    _M_watches[_M_nwatches].path = p;
+    _M_nwatches++;
+  }
+
+  // Report the files and watch the subdirectories.
+  DIR* dir;
+  if ((dir = opendir(path)) != nullptr) {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if ((strcmp(entry->d_name, ".") != 0) &&
+          (strcmp(entry->d_name, "..") != 0)) {
+        char subpath[PATH_MAX];
+        if (snprintf(subpath,
+                     sizeof(subpath),
+                     "%s/%s",
+                     path,
+                     entry->d_name) < static_cast<int>(sizeof(subpath))) {
+          struct stat sbuf;
+          if (lstat(subpath, &sbuf) == 0) {
+            if (S_ISDIR(sbuf.st_mode)) {
+              watch_directory(subpath);
+            } else if (S_ISREG(sbuf.st_mode)) {
+              push(path, entry->d_name);
+            }
+          }
+        }
+      }
+    }
+
+    closedir(dir);
+  }
+
+  return true;
+}
+
+void inotify_change_feed::scan(const char* path)
+{
+  DIR* dir;
+  if ((dir = opendir(path)) != nullptr) {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if ((entry->d_type == DT_REG) || (entry->d_type == DT_UNKNOWN)) {
+        push(path, entry->d_name);
+      }
+    }
+
+    closedir(dir);
+  }
+}
+
+void inotify_change_feed::read_events()
+{
+  char buf[64 * 1024]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  ssize_t len;
+  while ((len = read(_M_fd, buf, sizeof(buf))) > 0) {
+    const char* ptr = buf;
+    const char* end = buf + len;
+
+    while (ptr < end) {
+      const struct inotify_event* ev =
+        reinterpret_cast<const struct inotify_event*>(ptr);
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        // Events were lost: report every file again.
+        for (size_t i = 0; i < _M_nwatches; i++) {
+          scan(_M_watches[i].path);
+        }
+      } else if (ev->mask & IN_IGNORED) {
+        // The directory was removed.
+        remove(ev->wd);
+      } else if (ev->len > 0) {
+        const char* directory;
+        if ((directory = find(ev->wd)) != nullptr) {
+          if (ev->mask & IN_ISDIR) {
+            // Watch the new directory (and report the files which were
+            // created before the watch).
+            char path[PATH_MAX];
+            if (snprintf(path,
+                         sizeof(path),
+                         "%s/%s",
+                         directory,
+                         ev->name) < static_cast<int>(sizeof(path))) {
+              watch_directory(path);
+            }
+          } else if (ev->mask & FILE_EVENTS) {
+            push(directory, ev->name);
+          }
+        }
+      }
+
+      ptr += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+}
+
+void inotify_change_feed::push(const char* directory, const char* name)
+{
+  char path[PATH_MAX];
+  if (snprintf(path,
+               sizeof(path),
+               "%s/%s",
+               directory,
+               name) < static_cast<int>(sizeof(path))) {
+    // Convert file name to wide characters.
+    wchar_t filename[FILENAME_MAX_LEN + 1];
+    size_t len = mbstowcs(filename, path, FILENAME_MAX_LEN + 1);
+    if ((len != static_cast<size_t>(-1)) && (len <= FILENAME_MAX_LEN)) {
+      _M_queue.push(filename, len);
+    }
+  }
+}
+
+const char* inotify_change_feed::find(int wd) const
+{
+  for (size_t i = 0; i < _M_nwatches; i++) {
+    if (_M_watches[i].wd == wd) {
+      return _M_watches[i].path;
+    }
+  }
+
+  return nullptr;
+}
+
+void inotify_change_feed::remove(int wd)
+{
+  for (size_t i = 0; i < _M_nwatches; i++) {
+    if (_M_watches[i].wd == wd) {
+      free(_M_watches[i].path);
+      _M_watches[i] = _M_watches[--_M_nwatches];
+      return;
+    }
+  }
+}
+
+#endif // __linux__
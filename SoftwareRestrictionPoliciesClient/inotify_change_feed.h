@@ -0,0 +1,78 @@
+#ifndef INOTIFY_CHANGE_FEED_H
+#define INOTIFY_CHANGE_FEED_H
+
+#include "change_feed.h"
+
+// Change feed of Linux (inotify), so the pre-verification can be tested
+// without the driver. Every directory has its own watch (inotify is not
+// recursive): the new subdirectories are watched and scanned as they
+// appear.
+class inotify_change_feed : public change_feed {
+  public:
+    // Constructor.
+    inotify_change_feed();
+
+    // Destructor.
+    ~inotify_change_feed();
+
+    // Add directory.
+    bool add(const wchar_t* directory);
+
+    // Get next file.
+    bool next(wchar_t* filename, size_t& len, unsigned timeout);
+
+    // Wake up the thread waiting in next().
+    void shutdown();
+
+  private:
+    // Watched directory.
+    struct watch {
+      int wd;
+      char* path;
+    };
+
+    // inotify instance.
+    int _M_fd;
+
+    // Pipe which wakes up next() (shutdown).
+    int _M_pipe[2];
+
+    watch* _M_watches;
+    size_t _M_nwatches;
+    size_t _M_size;
+
+    queue _M_queue;
+
+    // Create the inotify instance and the pipe (if not created yet).
+    bool init();
+
+    // Watch directory and its subdirectories and report their files.
+    bool watch_directory(const char* path);
+
+    // Report the files of a watched directory (not its subdirectories).
+    void scan(const char* path);
+
+    // Read the events.
+    void read_events();
+
+    // Report file.
+    void push(const char* directory, const char* name);
+
+    // Find the path of a watch (nullptr if not found).
+    const char* find(int wd) const;
+
+    // Remove watch.
+    void remove(int wd);
+};
+
+inline inotify_change_feed::inotify_change_feed()
+  : _M_fd(-1),
+    _M_watches(nullptr),
+    _M_nwatches(0),
+    _M_size(0)
+{
+  _M_pipe[0] = -1;
+  _M_pipe[1] = -1;
+}
+
+#endif // INOTIFY_CHANGE_FEED_H
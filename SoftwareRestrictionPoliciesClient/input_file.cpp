@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+#include "input_file.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <limits.h>
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+input_file::input_file()
+  : _M_handle(INVALID_HANDLE_VALUE),
+    _M_size(0)
+{
+}
+
+bool input_file::open(const wchar_t* filename)
+{
+  if (_M_handle != INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  HANDLE hFile;
+  if ((hFile = CreateFileW(filename,
+                           GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN,
+                           NULL)) != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(hFile, &size)) {
+      _M_handle = hFile;
+      _M_size = static_cast<uint64_t>(size.QuadPart);
+
+      return true;
+    }
+
+    CloseHandle(hFile);
+  }
+
+  return false;
+}
+
+void input_file::close()
+{
+  if (_M_handle != INVALID_HANDLE_VALUE) {
+    CloseHandle(_M_handle);
+
+    _M_handle = INVALID_HANDLE_VALUE;
+    _M_size = 0;
+  }
+}
+
+bool input_file::read(uint64_t offset, void* buf, size_t len)
+{
+  uint8_t* ptr = static_cast<uint8_t*>(buf);
+
+  while (len > 0) {
+    // The offset is passed in the OVERLAPPED structure (the handle is
+    // synchronous, so ReadFile() returns when the data has been read).
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(OVERLAPPED));
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD n = (len > MAXDWORD) ? MAXDWORD : static_cast<DWORD>(len);
+    DWORD nread;
+    if ((!ReadFile(_M_handle, ptr, n, &nread, &overlapped)) ||
+        (nread == 0)) {
+      return false;
+    }
+
+    ptr += nread;
+    offset += nread;
+    len -= nread;
+  }
+
+  return true;
+}
+#else
+input_file::input_file()
+  : _M_fd(-1),
+    _M_size(0)
+{
+}
+
+bool input_file::open(const wchar_t* filename)
+{
+  if (_M_fd != -1) {
+    return false;
+  }
+
+  // Convert file name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return false;
+  }
+
+  int fd;
+  if ((fd = ::open(path, O_RDONLY)) != -1) {
+    struct stat sbuf;
+    if ((fstat(fd, &sbuf) == 0) && (S_ISREG(sbuf.st_mode))) {
+      _M_fd = fd;
+      _M_size = static_cast<uint64_t>(sbuf.st_size);
+
+      return true;
+    }
+
+    ::close(fd);
+  }
+
+  return false;
+}
+
+void input_file::close()
+{
+  if (_M_fd != -1) {
+    ::close(_M_fd);
+
+    _M_fd = -1;
+    _M_size = 0;
+  }
+}
+
+bool input_file::read(uint64_t offset, void* buf, size_t len)
+{
+  uint8_t* ptr = static_cast<uint8_t*>(buf);
+
+  while (len > 0) {
+    ssize_t ret;
+    if ((ret = pread(_M_fd, ptr, len, static_cast<off_t>(offset))) > 0) {
+      ptr += ret;
+      offset += static_cast<uint64_t>(ret);
+      len -= static_cast<size_t>(ret);
+    } else if ((ret == 0) || (errno != EINTR)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+#endif
@@ -0,0 +1,52 @@
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// File opened read-only and read at any offset into the buffers of the caller
+// (nothing is mapped: an I/O error fails the read instead of raising an
+// exception when a page is touched, and the size of the file is not limited
+// by the address space).
+class input_file {
+  public:
+    // Constructor.
+    input_file();
+
+    // Destructor.
+    ~input_file();
+
+    // Open.
+    bool open(const wchar_t* filename);
+
+    // Close.
+    void close();
+
+    // Read `len` bytes at `offset` (fails if the file is shorter).
+    bool read(uint64_t offset, void* buf, size_t len);
+
+    // Get size.
+    uint64_t size() const;
+
+  private:
+#ifdef _WIN32
+    // File handle (HANDLE).
+    void* _M_handle;
+#else
+    int _M_fd;
+#endif
+
+    uint64_t _M_size;
+};
+
+inline input_file::~input_file()
+{
+  close();
+}
+
+inline uint64_t input_file::size() const
+{
+  return _M_size;
+}
+
+#endif // INPUT_FILE_H
@@ -0,0 +1,73 @@
+#include "latency_histogram.h"
+
+void latency_histogram::clear()
+{
+  for (size_t i = 0; i < NBUCKETS; i++) {
+    _M_counts[i].store(0, std::memory_order_relaxed);
+  }
+
+  _M_count.store(0, std::memory_order_relaxed);
+  _M_sum.store(0, std::memory_order_relaxed);
+  _M_max.store(0, std::memory_order_relaxed);
+}
+
+void latency_histogram::merge(const latency_histogram& other)
+{
+  uint64_t count = 0;
+  for (size_t i = 0; i < NBUCKETS; i++) {
+    uint64_t n = other._M_counts[i].load(std::memory_order_relaxed);
+    increment(_M_counts[i], n);
+    count += n;
+  }
+
+  // The count is the sum of the buckets (the writer might be in the middle
+  // of an add()).
+  increment(_M_count, count);
+  increment(_M_sum, other.sum());
+
+  if (other.max() > max()) {
+    _M_max.store(other.max(), std::memory_order_relaxed);
+  }
+}
+
+uint64_t latency_histogram::percentile(double p) const
+{
+  uint64_t n;
+  if ((n = count()) == 0) {
+    return 0;
+  }
+
+  // Rank of the value (nearest rank).
+  uint64_t rank = static_cast<uint64_t>((p * n) + 0.999999);
+  if (rank == 0) {
+    rank = 1;
+  } else if (rank > n) {
+    rank = n;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NBUCKETS; i++) {
+    if ((seen += _M_counts[i].load(std::memory_order_relaxed)) >= rank) {
+      uint64_t value = upper_bound(i);
+      return (value < max()) ? value : max();
+    }
+  }
+
+  return max();
+}
+
+uint64_t latency_histogram::upper_bound(size_t bucket)
+{
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+
+  unsigned exponent = static_cast<unsigned>(bucket / SUB_BUCKETS) +
+                      SUB_BUCKET_BITS - 1;
+
+  uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + (bucket % SUB_BUCKETS))
+                   << (exponent - SUB_BUCKET_BITS);
+
+  return lower + (static_cast<uint64_t>(1) << (exponent - SUB_BUCKET_BITS)) -
+         1;
+}
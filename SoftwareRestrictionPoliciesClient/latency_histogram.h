@@ -0,0 +1,123 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Histogram of durations (nanoseconds), HDR style: the values below 16 have
+// their own bucket and every power of two above is split in 16 buckets, so a
+// value is known within 1/16 (6.25%), from 1 ns to about 68 s.
+//
+// A histogram has a single writer and it can be read at any time (from
+// another thread or, if it is in shared memory, from another process): the
+// counters are atomic, but they are updated without locked instructions
+// where the processor allows it.
+// A zero-filled histogram is empty.
+class latency_histogram {
+  public:
+    static const unsigned SUB_BUCKET_BITS = 4;
+    static const size_t SUB_BUCKETS = static_cast<size_t>(1) << SUB_BUCKET_BITS;
+
+    // Values above 2^(MAX_EXPONENT + 1) - 1 go to the last bucket.
+    static const unsigned MAX_EXPONENT = 35;
+
+    static const size_t NBUCKETS =
+      (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    // Clear.
+    void clear();
+
+    // Add value (only from the writer).
+    void add(uint64_t value);
+
+    // Add the values of another histogram.
+    void merge(const latency_histogram& other);
+
+    // Get number of values.
+    uint64_t count() const;
+
+    // Get sum of the values.
+    uint64_t sum() const;
+
+    // Get maximum value.
+    uint64_t max() const;
+
+    // Get percentile (`p` between 0 and 1): upper bound of the bucket of
+    // the value (never more than the maximum).
+    uint64_t percentile(double p) const;
+
+    // Get bucket of a value.
+    static size_t bucket(uint64_t value);
+
+    // Get highest value of a bucket.
+    static uint64_t upper_bound(size_t bucket);
+
+  private:
+    std::atomic<uint64_t> _M_counts[NBUCKETS];
+
+    std::atomic<uint64_t> _M_count;
+    std::atomic<uint64_t> _M_sum;
+    std::atomic<uint64_t> _M_max;
+
+    // Increment counter (single writer).
+    static void increment(std::atomic<uint64_t>& counter, uint64_t n);
+};
+
+inline void latency_histogram::add(uint64_t value)
+{
+  increment(_M_counts[bucket(value)], 1);
+  increment(_M_count, 1);
+  increment(_M_sum, value);
+
+  if (value > _M_max.load(std::memory_order_relaxed)) {
+    _M_max.store(value, std::memory_order_relaxed);
+  }
+}
+
+inline uint64_t latency_histogram::count() const
+{
+  return _M_count.load(std::memory_order_relaxed);
+}
+
+inline uint64_t latency_histogram::sum() const
+{
+  return _M_sum.load(std::memory_order_relaxed);
+}
+
+inline uint64_t latency_histogram::max() const
+{
+  return _M_max.load(std::memory_order_relaxed);
+}
+
+inline size_t latency_histogram::bucket(uint64_t value)
+{
+  if (value < SUB_BUCKETS) {
+    return static_cast<size_t>(value);
+  }
+
+  // Position of the most significant bit.
+  unsigned exponent = 0;
+  for (unsigned shift = 32; shift > 0; shift /= 2) {
+    if ((value >> (exponent + shift)) != 0) {
+      exponent += shift;
+    }
+  }
+
+  if (exponent > MAX_EXPONENT) {
+    return NBUCKETS - 1;
+  }
+
+  return ((exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS) +
+         static_cast<size_t>((value >> (exponent - SUB_BUCKET_BITS)) &
+                             (SUB_BUCKETS - 1));
+}
+
+inline void latency_histogram::increment(std::atomic<uint64_t>& counter,
+                                         uint64_t n)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+}
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <wchar.h>
+#include <chrono>
+#include "load_benchmark.h"
+#include "string_list.h"
+#include "digest_set.h"
+#include "path_list.h"
+
+static const size_t SHA256_LEN = 32;
+static const size_t NAME_MAX_LEN = 64;
+
+// Pseudo-random number generator (xorshift64*), so every run uses the same
+// entries.
+static uint64_t next(uint64_t& state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+
+  return state * 2685821657736338717ull;
+}
+
+// Milliseconds elapsed since `start`.
+static double elapsed(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration<double, std::milli>(
+           std::chrono::steady_clock::now() - start
+         ).count();
+}
+
+// Generate signer names.
+static wchar_t* generate_signers(size_t n)
+{
+  wchar_t* signers;
+  if ((signers = reinterpret_cast<wchar_t*>(
+                   malloc(n * NAME_MAX_LEN * sizeof(wchar_t))
+                 )) != nullptr) {
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+
+    for (size_t i = 0; i < n; i++) {
+      swprintf(signers + (i * NAME_MAX_LEN),
+               NAME_MAX_LEN,
+               L"Signer %016llx Corporation",
+               static_cast<unsigned long long>(next(state)));
+    }
+  }
+
+  return signers;
+}
+
+// Generate SHA-256 digests.
+static uint8_t* generate_hashes(size_t n)
+{
+  uint8_t* hashes;
+  if ((hashes = reinterpret_cast<uint8_t*>(
+                  malloc(n * SHA256_LEN)
+                )) != nullptr) {
+    uint64_t state = 0x2545f4914f6cdd1dull;
+
+    for (size_t i = 0; i < n * SHA256_LEN; i += sizeof(uint64_t)) {
+      uint64_t v = next(state);
+      memcpy(hashes + i, &v, sizeof(uint64_t));
+    }
+  }
+
+  return hashes;
+}
+
+// Generate paths (a tree of 16 directories per level).
+static wchar_t* generate_paths(size_t n)
+{
+  wchar_t* paths;
+  if ((paths = reinterpret_cast<wchar_t*>(
+                 malloc(n * NAME_MAX_LEN * sizeof(wchar_t))
+               )) != nullptr) {
+    uint64_t state = 0x853c49e6748fea9bull;
+
+    for (size_t i = 0; i < n; i++) {
+      uint64_t v = next(state);
+
+      swprintf(paths + (i * NAME_MAX_LEN),
+               NAME_MAX_LEN,
+               L"C:\\Program Files\\Dir%u\\Dir%u\\Dir%u\\File%016llx.exe",
+               static_cast<unsigned>(v & 0x0f),
+               static_cast<unsigned>((v >> 4) & 0x0f),
+               static_cast<unsigned>((v >> 8) & 0x0f),
+               static_cast<unsigned long long>(v));
+    }
+  }
+
+  return paths;
+}
+
+static void print(const char* name, double add, double build)
+{
+  printf("%-8s add(): %10.1f ms, append() + build(): %10.1f ms (x%.1f)\n",
+         name,
+         add,
+         build,
+         (build > 0) ? add / build : 0.0);
+}
+
+static bool benchmark_signers(size_t n)
+{
+  wchar_t* signers;
+  if ((signers = generate_signers(n)) == nullptr) {
+    return false;
+  }
+
+  bool ret = false;
+
+  double add;
+  {
+    string_list<wchar_t> list;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+      const wchar_t* signer = signers + (i * NAME_MAX_LEN);
+      if (!list.add(signer, wcslen(signer))) {
+        break;
+      }
+    }
+
+    add = elapsed(start);
+
+    ret = (i == n);
+  }
+
+  if (ret) {
+    string_list<wchar_t> list;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+      const wchar_t* signer = signers + (i * NAME_MAX_LEN);
+      if (!list.append(signer, wcslen(signer))) {
+        break;
+      }
+    }
+
+    if ((ret = ((i == n) && (list.build()))) == true) {
+      print("Signers", add, elapsed(start));
+    }
+  }
+
+  free(signers);
+
+  return ret;
+}
+
+static bool benchmark_hashes(size_t n)
+{
+  uint8_t* hashes;
+  if ((hashes = generate_hashes(n)) == nullptr) {
+    return false;
+  }
+
+  bool ret = false;
+
+  double add;
+  {
+    digest_set<SHA256_LEN> set;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    size_t i;
+    for (i = 0; (i < n) && (set.add(hashes + (i * SHA256_LEN))); i++);
+
+    add = elapsed(start);
+
+    ret = (i == n);
+  }
+
+  if (ret) {
+    digest_set<SHA256_LEN> set;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    size_t i;
+    for (i = 0; (i < n) && (set.append(hashes + (i * SHA256_LEN))); i++);
+
+    if ((ret = ((i == n) && (set.build()))) == true) {
+      print("Hashes", add, elapsed(start));
+    }
+  }
+
+  free(hashes);
+
+  return ret;
+}
+
+static bool benchmark_paths(size_t n)
+{
+  wchar_t* paths;
+  if ((paths = generate_paths(n)) == nullptr) {
+    return false;
+  }
+
+  bool ret = false;
+
+  double add;
+  {
+    path_list list;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+      const wchar_t* path = paths + (i * NAME_MAX_LEN);
+      if (!list.add(path, wcslen(path), false)) {
+        break;
+      }
+    }
+
+    add = elapsed(start);
+
+    ret = (i == n);
+  }
+
+  if (ret) {
+    path_list list;
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+      const wchar_t* path = paths + (i * NAME_MAX_LEN);
+      if (!list.append(path, wcslen(path), false)) {
+        break;
+      }
+    }
+
+    if ((ret = ((i == n) && (list.build()))) == true) {
+      print("Paths", add, elapsed(start));
+    }
+  }
+
+  free(paths);
+
+  return ret;
+}
+
+bool load_benchmark(size_t n)
+{
+  printf("Entries: %llu\n", static_cast<unsigned long long>(n));
+
+  return ((benchmark_signers(n)) &&
+          (benchmark_hashes(n)) &&
+          (benchmark_paths(n)));
+}
@@ -0,0 +1,11 @@
+#ifndef LOAD_BENCHMARK_H
+#define LOAD_BENCHMARK_H
+
+#include <stddef.h>
+
+// Startup benchmark: build the policy data structures with `n` synthetic
+// entries, inserting them one by one (add()) and in bulk (append() +
+// build()), and print the times.
+bool load_benchmark(size_t n);
+
+#endif // LOAD_BENCHMARK_H
@@ -0,0 +1,229 @@
+#include <string.h>
+#include <wchar.h>
+#include <new>
+#include <chrono>
+#include "loopback_transport.h"
+#include "monotonic_clock.h"
+#include "fast_path.h"
+#include "upcase.h"
+
+bool loopback_transport::create(size_t nslots)
+{
+  if ((nslots > 0) && (!_M_slots)) {
+    if ((_M_slots = new (std::nothrow) slot[nslots]) != nullptr) {
+      _M_nslots = nslots;
+
+      // Build free list.
+      for (size_t i = 0; i < nslots; i++) {
+        _M_slots[i].st = slot::state::free;
+        _M_slots[i].next = (i + 1 < nslots) ? _M_slots + i + 1 : nullptr;
+      }
+
+      _M_free = _M_slots;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool loopback_transport::send(const wchar_t* filename,
+                              size_t filenamelen,
+                              unsigned timeout,
+                              bool& allowed)
+{
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  // The request is sent now (the time waiting for a slot counts).
+  uint64_t arrival = monotonic_clock::now();
+
+  std::unique_lock<std::mutex> lock(_M_mutex);
+
+  // Allowed by the fast path? (like the driver, the prefix "\??\" is
+  // skipped).
+  if (_M_fast_path) {
+    const wchar_t* path = filename;
+    size_t pathlen = filenamelen;
+    if ((pathlen > 4) && (wmemcmp(path, L"\\??\\", 4) == 0)) {
+      path += 4;
+      pathlen -= 4;
+    }
+
+    if (fast_path_find(_M_fast_path, path, pathlen, upcase::convert)) {
+      _M_fast_path_hits++;
+
+      allowed = true;
+      return true;
+    }
+  }
+
+  // Wait for a free slot.
+  while (!_M_free) {
+    if (_M_free_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+      if (!_M_free) {
+        _M_timeouts++;
+
+        allowed = true;
+        return false;
+      }
+    }
+  }
+
+  slot* s = _M_free;
+  _M_free = s->next;
+
+  // Copy file name.
+  if (filenamelen > request::FILENAME_MAX_LEN) {
+    filenamelen = request::FILENAME_MAX_LEN;
+  }
+
+  wmemcpy(s->buf, filename, filenamelen);
+  s->buf[filenamelen] = 0;
+
+  s->filename = s->buf;
+  s->filenamelen = filenamelen;
+  s->arrival = arrival;
+
+  // Append request to the queue.
+  s->st = slot::state::queued;
+  s->next = nullptr;
+
+  if (_M_tail) {
+    _M_tail->next = s;
+  } else {
+    _M_head = s;
+  }
+
+  _M_tail = s;
+
+  _M_queue_cv.notify_one();
+
+  // Wait for the reply.
+  while (s->st != slot::state::replied) {
+    if (s->cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+      if (s->st == slot::state::replied) {
+        break;
+      }
+
+      _M_timeouts++;
+
+      // If the request has not been received yet...
+      if (s->st == slot::state::queued) {
+        // Remove request from the queue.
+        slot* prev = nullptr;
+        for (slot* cur = _M_head; cur != s; prev = cur, cur = cur->next);
+
+        if (prev) {
+          prev->next = s->next;
+        } else {
+          _M_head = s->next;
+        }
+
+        if (_M_tail == s) {
+          _M_tail = prev;
+        }
+
+        release(s);
+      } else {
+        // The worker will release the slot when it replies.
+        s->st = slot::state::abandoned;
+      }
+
+      // Fail open (like the driver).
+      allowed = true;
+      return false;
+    }
+  }
+
+  allowed = s->allowed;
+
+  release(s);
+
+  return true;
+}
+
+request* loopback_transport::receive(unsigned timeout)
+{
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  std::unique_lock<std::mutex> lock(_M_mutex);
+
+  while ((!_M_head) && (!_M_shutdown)) {
+    if (_M_queue_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+      break;
+    }
+  }
+
+  slot* s;
+  if (((s = _M_head) != nullptr) && (!_M_shutdown)) {
+    if ((_M_head = s->next) == nullptr) {
+      _M_tail = nullptr;
+    }
+
+    s->st = slot::state::processing;
+
+    return s;
+  }
+
+  return nullptr;
+}
+
+bool loopback_transport::reply(request* req, bool allowed)
+{
+  slot* s = static_cast<slot*>(req);
+
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  // If the sender has given up...
+  if (s->st == slot::state::abandoned) {
+    release(s);
+    return false;
+  }
+
+  s->allowed = allowed;
+  s->st = slot::state::replied;
+
+  s->cv.notify_one();
+
+  return true;
+}
+
+void loopback_transport::shutdown()
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  _M_shutdown = true;
+  _M_queue_cv.notify_all();
+}
+
+bool loopback_transport::set_fast_path(const void* blob, size_t len)
+{
+  void* copy = nullptr;
+  if (blob) {
+    if ((!fast_path_validate(blob, len)) ||
+        ((copy = malloc(len)) == nullptr)) {
+      return false;
+    }
+
+    memcpy(copy, blob, len);
+  }
+
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  free(_M_fast_path);
+  _M_fast_path = copy;
+
+  return true;
+}
+
+void loopback_transport::release(slot* s)
+{
+  s->st = slot::state::free;
+  s->next = _M_free;
+  _M_free = s;
+
+  _M_free_cv.notify_one();
+}
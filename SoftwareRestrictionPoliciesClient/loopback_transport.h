@@ -0,0 +1,128 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include "transport.h"
+
+// In-process transport: send() plays the role of the driver's
+// FltSendMessage() (it blocks until the reply arrives or the timeout expires,
+// in which case the executable is allowed), so the worker pool can be
+// load-tested without the driver.
+// Like the driver, send() allows the paths of the fast path (if set) without
+// sending a request.
+class loopback_transport : public transport {
+  public:
+    // Constructor.
+    loopback_transport();
+
+    // Destructor.
+    ~loopback_transport();
+
+    // Create.
+    bool create(size_t nslots);
+
+    // Send request and wait for the reply.
+    // Returns false if the request timed out (`allowed` is then set to true).
+    bool send(const wchar_t* filename,
+              size_t filenamelen,
+              unsigned timeout,
+              bool& allowed);
+
+    // Receive request (waits up to `timeout` milliseconds).
+    request* receive(unsigned timeout);
+
+    // Reply to request.
+    bool reply(request* req, bool allowed);
+
+    // Wake up the threads waiting in receive().
+    void shutdown();
+
+    // Set the fast path of the policy (the blob is copied).
+    bool set_fast_path(const void* blob, size_t len);
+
+    // Get number of requests which timed out.
+    uint64_t timeouts() const;
+
+    // Get number of requests answered by the fast path.
+    uint64_t fast_path_hits() const;
+
+  private:
+    struct slot : public request {
+      enum class state {
+        free,
+        queued,
+        processing,
+        replied,
+        abandoned
+      };
+
+      state st;
+      bool allowed;
+
+      slot* next;
+
+      std::condition_variable cv;
+
+      wchar_t buf[FILENAME_MAX_LEN + 1];
+    };
+
+    slot* _M_slots;
+    size_t _M_nslots;
+
+    slot* _M_free;
+
+    // Queue of pending requests.
+    slot* _M_head;
+    slot* _M_tail;
+
+    bool _M_shutdown;
+
+    uint64_t _M_timeouts;
+
+    // Fast path of the policy (nullptr: none).
+    void* _M_fast_path;
+    uint64_t _M_fast_path_hits;
+
+    mutable std::mutex _M_mutex;
+    std::condition_variable _M_queue_cv;
+    std::condition_variable _M_free_cv;
+
+    // Release slot.
+    void release(slot* s);
+};
+
+inline loopback_transport::loopback_transport()
+  : _M_slots(nullptr),
+    _M_nslots(0),
+    _M_free(nullptr),
+    _M_head(nullptr),
+    _M_tail(nullptr),
+    _M_shutdown(false),
+    _M_timeouts(0),
+    _M_fast_path(nullptr),
+    _M_fast_path_hits(0)
+{
+}
+
+inline loopback_transport::~loopback_transport()
+{
+  delete [] _M_slots;
+  free(_M_fast_path);
+}
+
+inline uint64_t loopback_transport::timeouts() const
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+  return _M_timeouts;
+}
+
+inline uint64_t loopback_transport::fast_path_hits() const
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+  return _M_fast_path_hits;
+}
+
+#endif // LOOPBACK_TRANSPORT_H
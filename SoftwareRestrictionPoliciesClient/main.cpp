@@ -3,20 +3,189 @@
 #include <stdio.h>
 #include <tchar.h>
 #include <windows.h>
-#include <fltuser.h>
 #include "software_restriction_policies.h"
+#include "filter_port_transport.h"
+#include "worker_pool.h"
+#include "policy_reloader.h"
+#include "load_benchmark.h"
+#include "hash_benchmark.h"
+#include "catalog_benchmark.h"
+#include "exec_trace.h"
+#include "trace_replay.h"
+#include "monotonic_clock.h"
+#include "service_stats.h"
+#include "event_trace.h"
+#include "directory_change_feed.h"
+#include "verdict_warmer.h"
+#include "deferred_feed.h"
 #include "communication_port.h"
 
-#define TIMEOUT 250 // Milliseconds.
+#define MAX_WORKERS 64
+
+// Time budget of a request, the rest of the timeout of the driver is left
+// for the reply.
+#define DEFAULT_BUDGET (REQUEST_TIMEOUT - 50) // Milliseconds.
+
+// Evaluator of a worker thread (each worker has its own catalog).
+class policy_evaluator : public worker_pool::evaluator {
+  public:
+    // Initialize (`stats`: statistics of the running client, the evaluator
+    // uses the worker `idx`; `recorder`: trace the requests are recorded to;
+    // `deferred`: feed the abandoned evaluations are pushed to, to be
+    // finished in the background; nullptr: none).
+    bool init(const software_restriction_policies& policies,
+              service_stats* stats = nullptr,
+              size_t idx = 0,
+              exec_trace::writer* recorder = nullptr,
+              deferred_feed* deferred = nullptr)
+    {
+      _M_software_restriction_policies = &policies;
+      _M_stats = stats;
+      _M_idx = idx;
+      _M_recorder = recorder;
+      _M_deferred = deferred;
+      return _M_catalog.open();
+    }
+
+    // Allow?
+    bool allow(const wchar_t* filename, size_t filenamelen)
+    {
+      bool allowed;
+      return ((allow_before(filename, filenamelen, UINT64_MAX, allowed)) &&
+              (allowed));
+    }
+
+    // Allow, if the verdict is reached before the deadline?
+    bool allow_before(const wchar_t* filename,
+                      size_t filenamelen,
+                      uint64_t deadline,
+                      bool& allowed)
+    {
+      if ((!_M_stats) && (!_M_recorder)) {
+        return _M_software_restriction_policies->allow(filename,
+                                                       _M_catalog,
+                                                       deadline,
+                                                       allowed);
+      }
+
+      // Record the request, the verdict and how long each stage took (if
+      // the evaluation is abandoned, once the fallback verdict is known).
+      _M_evaluation = evaluation_stats();
+      _M_start = monotonic_clock::now();
+
+      if (!_M_software_restriction_policies->allow(filename,
+                                                   _M_catalog,
+                                                   deadline,
+                                                   allowed,
+                                                   &_M_evaluation)) {
+        return false;
+      }
+
+      record(filename, filenamelen, allowed);
+
+      return true;
+    }
+
+    // The evaluation was abandoned.
+    void missed(const wchar_t* filename, size_t filenamelen, bool allowed)
+    {
+      if (_M_stats) {
+        _M_stats->deadline_miss(_M_idx);
+      }
+
+      if ((_M_stats) || (_M_recorder)) {
+        record(filename, filenamelen, allowed);
+      }
+
+      // Finish the evaluation in the background, so the next execution
+      // finds the verdict in the cache.
+      if (_M_deferred) {
+        _M_deferred->push(filename, filenamelen);
+      }
+    }
+
+    // The reply didn't reach the driver.
+    void undelivered()
+    {
+      if (_M_stats) {
+        _M_stats->timeout(_M_idx);
+      }
+    }
+
+  private:
+    const software_restriction_policies* _M_software_restriction_policies;
+    service_stats* _M_stats;
+    size_t _M_idx;
+    exec_trace::writer* _M_recorder;
+    deferred_feed* _M_deferred;
+    catalog _M_catalog;
+
+    // Evaluation of the last request and when it started.
+    evaluation_stats _M_evaluation;
+    uint64_t _M_start;
+
+    // Record the last request.
+    void record(const wchar_t* filename, size_t filenamelen, bool allowed)
+    {
+      uint64_t latency = monotonic_clock::now() - _M_start;
+
+      if (_M_stats) {
+        _M_stats->record(_M_idx, _M_evaluation, latency, allowed);
+      }
+
+      if (_M_recorder) {
+        _M_recorder->write(_M_start,
+                           latency,
+                           filename,
+                           filenamelen,
+                           _M_evaluation,
+                           allowed);
+      }
+    }
+};
 
 static void usage(const TCHAR* program);
 
-static
-bool run(const software_restriction_policies& software_restriction_policies);
+static bool run(software_restriction_policies& software_restriction_policies,
+                size_t nworkers,
+                unsigned budget,
+                bool fallback,
+                bool deferred,
+                const TCHAR* const* filenames,
+                size_t nfilenames,
+                const TCHAR* const* directories,
+                size_t ndirectories,
+                const TCHAR* record);
+
+static bool replay(const software_restriction_policies& policies,
+                   const TCHAR* filename,
+                   size_t nworkers,
+                   unsigned budget,
+                   bool fallback,
+                   bool deferred,
+                   size_t nsenders,
+                   double speed);
+
+static bool start_deferred(
+  const software_restriction_policies& software_restriction_policies,
+  deferred_feed& feed,
+  policy_evaluator& evaluator,
+  verdict_warmer& finisher
+);
+
+static bool watch_directory(change_feed& feed, const TCHAR* directory);
+
+static bool reload();
+
+static bool print_stats(bool json);
+
+static bool dump_events(const TCHAR* filename);
 
-static BOOL WINAPI HandlerRoutine(DWORD dwCtrlType);
+static void write_events(const TCHAR* filename);
 
-static bool running = false;
+BOOL WINAPI HandlerRoutine(DWORD dwCtrlType);
+
+static HANDLE stop_event = NULL;
 
 int _tmain(int argc, const TCHAR** argv)
 {
@@ -27,9 +196,17 @@ int _tmain(int argc, const TCHAR** argv)
 
   enum class command {
     run,
+    reload,
+    stats,
     print_signers,
     print_hash,
-    query
+    query,
+    replay,
+    dump_events,
+    compile,
+    benchmark,
+    hash_benchmark,
+    catalog_benchmark
   };
 
   command cmd;
@@ -37,6 +214,12 @@ int _tmain(int argc, const TCHAR** argv)
   if (_tcsicmp(argv[argc - 1], _T("run")) == 0) {
     cmd = command::run;
     lastarg = argc - 1;
+  } else if (_tcsicmp(argv[argc - 1], _T("reload")) == 0) {
+    cmd = command::reload;
+    lastarg = argc - 1;
+  } else if (_tcsicmp(argv[argc - 1], _T("stats")) == 0) {
+    cmd = command::stats;
+    lastarg = argc - 1;
   } else if (_tcsicmp(argv[argc - 2], _T("print-signers")) == 0) {
     cmd = command::print_signers;
     lastarg = argc - 2;
@@ -46,6 +229,24 @@ int _tmain(int argc, const TCHAR** argv)
   } else if (_tcsicmp(argv[argc - 2], _T("query")) == 0) {
     cmd = command::query;
     lastarg = argc - 2;
+  } else if (_tcsicmp(argv[argc - 2], _T("replay")) == 0) {
+    cmd = command::replay;
+    lastarg = argc - 2;
+  } else if (_tcsicmp(argv[argc - 2], _T("dump-events")) == 0) {
+    cmd = command::dump_events;
+    lastarg = argc - 2;
+  } else if (_tcsicmp(argv[argc - 2], _T("compile")) == 0) {
+    cmd = command::compile;
+    lastarg = argc - 2;
+  } else if (_tcsicmp(argv[argc - 2], _T("benchmark")) == 0) {
+    cmd = command::benchmark;
+    lastarg = argc - 2;
+  } else if (_tcsicmp(argv[argc - 2], _T("hash-benchmark")) == 0) {
+    cmd = command::hash_benchmark;
+    lastarg = argc - 2;
+  } else if (_tcsicmp(argv[argc - 2], _T("catalog-benchmark")) == 0) {
+    cmd = command::catalog_benchmark;
+    lastarg = argc - 2;
   } else {
     usage(argv[0]);
     return -1;
@@ -54,7 +255,34 @@ int _tmain(int argc, const TCHAR** argv)
   const TCHAR* signers = nullptr;
   const TCHAR* hashes = nullptr;
   const TCHAR* paths = nullptr;
+  const TCHAR* compiled_policy = nullptr;
+  const TCHAR* catalog_index_file = nullptr;
+  const TCHAR* record = nullptr;
+  const TCHAR* events = nullptr;
+  const TCHAR* verdict_store_file = nullptr;
+
+  // Directories whose executables are pre-verified.
+  const TCHAR* directories[directory_change_feed::MAX_DIRECTORIES];
+  size_t ndirectories = 0;
+
   bool all_signers = false;
+  bool json = false;
+  size_t cache_size = verdict_cache::default_size;
+  unsigned deny_ttl = verdict_cache::default_deny_ttl;
+
+  // A request whose verdict would be late is allowed, as the driver does
+  // when the client doesn't reply in time.
+  unsigned budget = DEFAULT_BUDGET;
+  bool fallback = true;
+
+  // By default, one worker per processor.
+  SYSTEM_INFO system_info;
+  GetSystemInfo(&system_info);
+  size_t nworkers = system_info.dwNumberOfProcessors;
+
+  // Replay: by default, as many senders as workers, at the original speed.
+  size_t nsenders = 0;
+  double speed = 1.0;
 
   int i = 1;
   while (i < lastarg) {
@@ -85,28 +313,339 @@ int _tmain(int argc, const TCHAR** argv)
 
       paths = argv[i + 1];
       i += 2;
+    } else if (_tcsicmp(argv[i], _T("--policy")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      compiled_policy = argv[i + 1];
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--catalog-index")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      catalog_index_file = argv[i + 1];
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--record")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      record = argv[i + 1];
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--events")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      events = argv[i + 1];
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--verdict-store")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      verdict_store_file = argv[i + 1];
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--warm")) == 0) {
+      // Last argument or too many directories?
+      if ((i + 1 == lastarg) ||
+          (ndirectories == directory_change_feed::MAX_DIRECTORIES)) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      directories[ndirectories++] = argv[i + 1];
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--replay-speed")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if ((speed = _tcstod(argv[i + 1], NULL)) < 0) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--replay-threads")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      nsenders = _tcstoul(argv[i + 1], NULL, 10);
+      i += 2;
     } else if (_tcsicmp(argv[i], _T("--all-signers")) == 0) {
       all_signers = true;
       i++;
+    } else if (_tcsicmp(argv[i], _T("--json")) == 0) {
+      json = true;
+      i++;
+    } else if (_tcsicmp(argv[i], _T("--cache-size")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      cache_size = _tcstoul(argv[i + 1], NULL, 10);
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--deny-ttl")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      deny_ttl = _tcstoul(argv[i + 1], NULL, 10);
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--budget")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      budget = _tcstoul(argv[i + 1], NULL, 10);
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--fallback")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      if (_tcsicmp(argv[i + 1], _T("allow")) == 0) {
+        fallback = true;
+      } else if (_tcsicmp(argv[i + 1], _T("deny")) == 0) {
+        fallback = false;
+      } else {
+        usage(argv[0]);
+        return -1;
+      }
+
+      i += 2;
+    } else if (_tcsicmp(argv[i], _T("--workers")) == 0) {
+      // Last argument?
+      if (i + 1 == lastarg) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      nworkers = _tcstoul(argv[i + 1], NULL, 10);
+      i += 2;
     } else {
       usage(argv[0]);
       return -1;
     }
   }
 
+  // A compiled policy replaces the lists (and cannot be compiled again).
+  if ((compiled_policy) &&
+      ((signers) || (hashes) || (paths) || (cmd == command::compile))) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  if (nworkers == 0) {
+    nworkers = 1;
+  } else if (nworkers > MAX_WORKERS) {
+    nworkers = MAX_WORKERS;
+  }
+
+  if (nsenders == 0) {
+    nsenders = nworkers;
+  }
+
+  // The verdicts of the pre-verified executables are kept in the cache.
+  if ((ndirectories > 0) && (cache_size == 0)) {
+    _ftprintf_p(stderr,
+                _T("The verdict cache is disabled, the executables won't ")
+                _T("be pre-verified.\n"));
+
+    ndirectories = 0;
+  }
+
+  if ((verdict_store_file) && (cache_size == 0)) {
+    _ftprintf_p(stderr,
+                _T("The verdict cache is disabled, the verdicts won't be ")
+                _T("persisted.\n"));
+
+    verdict_store_file = nullptr;
+  }
+
+  // Reload the policy of the running client?
+  if (cmd == command::reload) {
+    if (reload()) {
+      return 0;
+    }
+
+    _ftprintf_p(stderr, _T("Error signaling the running client.\n"));
+    return -1;
+  }
+
+  // Print the statistics of the running client?
+  if (cmd == command::stats) {
+    if (print_stats(json)) {
+      return 0;
+    }
+
+    _ftprintf_p(stderr,
+                _T("Error reading the statistics of the running client.\n"));
+
+    return -1;
+  }
+
+  // Write the events of the running client?
+  if (cmd == command::dump_events) {
+    if (dump_events(argv[argc - 1])) {
+      return 0;
+    }
+
+    _ftprintf_p(stderr,
+                _T("Error writing the events of the running client ")
+                _T("(is the tracing compiled in?).\n"));
+
+    return -1;
+  }
+
+#if EVENT_TRACE
+  // Trace the events of the commands `run` and `replay` (including the
+  // loading of the policy).
+  if (((cmd == command::run) || (cmd == command::replay)) &&
+      (!event_trace::create())) {
+    _ftprintf_p(stderr, _T("Error creating the event trace.\n"));
+  }
+#endif
+
+  // Startup benchmark?
+  if (cmd == command::benchmark) {
+    size_t n;
+    if ((n = _tcstoul(argv[argc - 1], NULL, 10)) > 0) {
+      if (load_benchmark(n)) {
+        return 0;
+      }
+
+      _ftprintf_p(stderr, _T("Error running benchmark.\n"));
+    } else {
+      usage(argv[0]);
+    }
+
+    return -1;
+  }
+
+  // Hash benchmark?
+  if (cmd == command::hash_benchmark) {
+    size_t megabytes;
+    if ((megabytes = _tcstoul(argv[argc - 1], NULL, 10)) > 0) {
+      if (hash_benchmark(megabytes)) {
+        return 0;
+      }
+
+      _ftprintf_p(stderr, _T("Error running hash benchmark.\n"));
+    } else {
+      usage(argv[0]);
+    }
+
+    return -1;
+  }
+
+  // Catalog benchmark?
+  if (cmd == command::catalog_benchmark) {
+    if (catalog_benchmark(argv[argc - 1], nworkers)) {
+      return 0;
+    }
+
+    _ftprintf_p(stderr, _T("Error running catalog benchmark.\n"));
+    return -1;
+  }
+
   // Initialize software restriction policies.
-  software_restriction_policies software_restriction_policies(all_signers);
+  software_restriction_policies software_restriction_policies(all_signers,
+                                                              cache_size,
+                                                              deny_ttl);
   if (software_restriction_policies.init()) {
     // Load files (if needed).
-    if (((cmd != command::run) && (cmd != command::query)) ||
-        (software_restriction_policies.load(signers, hashes, paths))) {
+    if (((cmd != command::run) &&
+         (cmd != command::query) &&
+         (cmd != command::replay) &&
+         (cmd != command::compile)) ||
+        ((compiled_policy) ?
+          software_restriction_policies.load(compiled_policy) :
+          software_restriction_policies.load(signers, hashes, paths))) {
+      // Index the catalogs (if it fails, the catalog API is used).
+      if (((cmd == command::run) ||
+           (cmd == command::query) ||
+           (cmd == command::replay)) &&
+          (!software_restriction_policies.index_catalogs(catalog_index_file))) {
+        _ftprintf_p(stderr, _T("Error indexing the catalogs.\n"));
+      }
+
+      // Restore the verdicts of the previous run (if it fails, the client
+      // runs without them).
+      if ((cmd == command::run) && (verdict_store_file)) {
+        size_t restored;
+        if (software_restriction_policies.persist_verdicts(verdict_store_file,
+                                                           restored)) {
+          _tprintf(_T("Verdicts restored: %llu.\n"),
+                   static_cast<unsigned long long>(restored));
+        } else {
+          _ftprintf_p(stderr,
+                      _T("Error opening the persistent verdicts '%s'.\n"),
+                      verdict_store_file);
+        }
+      }
+
       switch (cmd) {
         case command::run:
-          if (SetConsoleCtrlHandler(HandlerRoutine, TRUE)) {
-            run(software_restriction_policies);
-            SetConsoleCtrlHandler(HandlerRoutine, FALSE);
+          if ((stop_event = CreateEvent(NULL, TRUE, FALSE, NULL)) != NULL) {
+            if (SetConsoleCtrlHandler(HandlerRoutine, TRUE)) {
+              // Files to watch for changes.
+              const TCHAR* filenames[] = {signers,
+                                           hashes,
+                                           paths,
+                                           compiled_policy};
+
+              // The abandoned evaluations are finished in the background
+              // for the verdict cache.
+              if (!run(software_restriction_policies,
+                       nworkers,
+                       budget,
+                       fallback,
+                       cache_size > 0,
+                       filenames,
+                       _countof(filenames),
+                       directories,
+                       ndirectories,
+                       record)) {
+                _ftprintf_p(stderr, _T("Error running.\n"));
+              }
+
+              write_events(events);
+
+              SetConsoleCtrlHandler(HandlerRoutine, FALSE);
+            } else {
+              _ftprintf_p(stderr, _T("Error setting control handler.\n"));
+            }
+
+            CloseHandle(stop_event);
           } else {
-            _ftprintf_p(stderr, _T("Error setting control handler.\n"));
+            _ftprintf_p(stderr, _T("Error creating event.\n"));
           }
 
           break;
@@ -132,6 +671,35 @@ int _tmain(int argc, const TCHAR** argv)
 
           _tprintf(_T("Not allowed.\n"));
           break;
+        case command::replay:
+          if (replay(software_restriction_policies,
+                     argv[argc - 1],
+                     nworkers,
+                     budget,
+                     fallback,
+                     cache_size > 0,
+                     nsenders,
+                     speed)) {
+            write_events(events);
+            return 0;
+          }
+
+          _ftprintf_p(stderr, _T("Error replaying trace.\n"));
+          break;
+        case command::compile:
+          if (software_restriction_policies.compile(argv[argc - 1])) {
+            return 0;
+          }
+
+          _ftprintf_p(stderr, _T("Error compiling policy.\n"));
+          break;
+        case command::reload:
+        case command::stats:
+        case command::dump_events:
+        case command::benchmark:
+        case command::hash_benchmark:
+        case command::catalog_benchmark:
+          break;
       }
     } else {
       _ftprintf_p(stderr, _T("Error loading files.\n"));
@@ -152,112 +720,177 @@ void usage(const TCHAR* program)
   _ftprintf_p(stderr, _T("\n"));
   _ftprintf_p(stderr, _T("Commands:\n"));
   _ftprintf_p(stderr, _T("\trun\n"));
+  _ftprintf_p(stderr, _T("\treload\n"));
+  _ftprintf_p(stderr, _T("\tstats\n"));
   _ftprintf_p(stderr, _T("\tprint-signers\n"));
   _ftprintf_p(stderr, _T("\tprint-hash\n"));
   _ftprintf_p(stderr, _T("\tquery\n"));
+  _ftprintf_p(stderr, _T("\treplay <trace>\n"));
+  _ftprintf_p(stderr, _T("\tdump-events <filename>\n"));
+  _ftprintf_p(stderr, _T("\tcompile\n"));
+  _ftprintf_p(stderr, _T("\tbenchmark <entries>\n"));
+  _ftprintf_p(stderr, _T("\thash-benchmark <megabytes>\n"));
+  _ftprintf_p(stderr, _T("\tcatalog-benchmark <directory>\n"));
   _ftprintf_p(stderr, _T("\n"));
   _ftprintf_p(stderr, _T("\n"));
   _ftprintf_p(stderr, _T("Options:\n"));
   _ftprintf_p(stderr, _T("\t--signers <filename>\n"));
   _ftprintf_p(stderr, _T("\t--hashes <filename>\n"));
   _ftprintf_p(stderr, _T("\t--paths <filename>\n"));
+  _ftprintf_p(stderr, _T("\t--policy <filename>\n"));
+  _ftprintf_p(stderr, _T("\t--catalog-index <filename>\n"));
   _ftprintf_p(stderr, _T("\t--all-signers\n"));
+  _ftprintf_p(stderr, _T("\t--cache-size <entries>\n"));
+  _ftprintf_p(stderr, _T("\t--deny-ttl <milliseconds>\n"));
+  _ftprintf_p(stderr, _T("\t--verdict-store <filename>\n"));
+  _ftprintf_p(stderr, _T("\t--workers <number>\n"));
+  _ftprintf_p(stderr, _T("\t--budget <milliseconds>\n"));
+  _ftprintf_p(stderr, _T("\t--fallback allow|deny\n"));
+  _ftprintf_p(stderr, _T("\t--record <filename>\n"));
+  _ftprintf_p(stderr, _T("\t--events <filename>\n"));
+  _ftprintf_p(stderr, _T("\t--warm <directory>\n"));
+  _ftprintf_p(stderr, _T("\t--replay-speed <factor>\n"));
+  _ftprintf_p(stderr, _T("\t--replay-threads <number>\n"));
+  _ftprintf_p(stderr, _T("\t--json\n"));
   _ftprintf_p(stderr, _T("\n"));
 }
 
-bool run(const software_restriction_policies& software_restriction_policies)
+bool run(software_restriction_policies& software_restriction_policies,
+         size_t nworkers,
+         unsigned budget,
+         bool fallback,
+         bool deferred,
+         const TCHAR* const* filenames,
+         size_t nfilenames,
+         const TCHAR* const* directories,
+         size_t ndirectories,
+         const TCHAR* record)
 {
-  static const size_t FILENAME_MAX_LEN = 4 * 1024;
+  // Number of receives posted per worker, so a request doesn't have to wait
+  // for a worker to post a new receive.
+  static const size_t RECEIVES_PER_WORKER = 4;
 
-  struct request_message {
-    FILTER_MESSAGE_HEADER hdr;
-    wchar_t filename[FILENAME_MAX_LEN];
-  };
+  // Open the trace the requests are recorded to (if any).
+  exec_trace::writer recorder;
+  if ((record) && (!recorder.open(record))) {
+    _ftprintf_p(stderr, _T("Error opening trace '%s'.\n"), record);
+    return false;
+  }
 
-  static const size_t REQUEST_MAX_SIZE = sizeof(FILTER_MESSAGE_HEADER) +
-                                         FILENAME_MAX_LEN;
+  // Publish the statistics (the client runs without them if the section
+  // cannot be created).
+  service_stats stats;
+  if (stats.create()) {
+    software_restriction_policies.publish_stats(&stats);
+  } else {
+    _ftprintf_p(stderr, _T("Error creating the statistics.\n"));
+  }
 
-  struct reply_message {
-    FILTER_REPLY_HEADER hdr;
-    int reply;
-  };
+  // Finish the abandoned evaluations in the background (the client runs
+  // without it if it cannot be started).
+  deferred_feed deferred_files;
+  policy_evaluator deferred_evaluator;
+  verdict_warmer finisher;
+  deferred = ((budget > 0) &&
+              (deferred) &&
+              (start_deferred(software_restriction_policies,
+                              deferred_files,
+                              deferred_evaluator,
+                              finisher)));
 
-  static const size_t RESPONSE_SIZE = sizeof(FILTER_REPLY_HEADER) + sizeof(int);
+  // Initialize evaluators.
+  policy_evaluator evaluators[MAX_WORKERS];
+  worker_pool::evaluator* pointers[MAX_WORKERS];
+  for (size_t i = 0; i < nworkers; i++) {
+    if (!evaluators[i].init(software_restriction_policies,
+                            &stats,
+                            i,
+                            record ? &recorder : nullptr,
+                            deferred ? &deferred_files : nullptr)) {
+      software_restriction_policies.publish_stats(nullptr);
+      return false;
+    }
+
+    pointers[i] = evaluators + i;
+  }
 
   // Open connection to driver.
-  HANDLE port;
-  if (FilterConnectCommunicationPort(COMMUNICATION_PORT,
-                                     0,
-                                     NULL,
-                                     0,
-                                     NULL,
-                                     &port) == S_OK) {
-    OVERLAPPED overlapped;
-    memset(&overlapped, 0, sizeof(OVERLAPPED));
-
-    // Create event.
-    if ((overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) != NULL) {
-      running = true;
-
-      do {
-        request_message request;
-        reply_message reply;
-
-        // Receive message.
-        overlapped.InternalHigh = 0;
-
-        switch (HRESULT_CODE(FilterGetMessage(port,
-                                              &request.hdr,
-                                              REQUEST_MAX_SIZE,
-                                              &overlapped))) {
-          case ERROR_IO_PENDING:
-            if (WaitForSingleObject(overlapped.hEvent,
-                                    TIMEOUT) != WAIT_OBJECT_0) {
-              break;
-            }
+  filter_port_transport transport;
+  if (transport.open(nworkers * RECEIVES_PER_WORKER, nworkers)) {
+    // Let the driver allow the allowed paths itself (the client still gets
+    // the other requests if it fails).
+    software_restriction_policies.publish_fast_path(&transport);
 
-            // Fall through.
-          case S_OK:
-            reply.hdr.Status = 0;
-            reply.hdr.MessageId = request.hdr.MessageId;
+    // Start workers.
+    worker_pool pool;
+    if (pool.start(transport, pointers, nworkers, budget, fallback)) {
+      // Reload the policy when it changes.
+      policy_reloader reloader;
+      if (!reloader.start(software_restriction_policies,
+                          filenames,
+                          nfilenames)) {
+        _ftprintf_p(stderr, _T("Error watching the policy for changes.\n"));
+      }
 
-            if (overlapped.InternalHigh < REQUEST_MAX_SIZE) {
-              size_t filenamelen = (overlapped.InternalHigh -
-                                    sizeof(FILTER_MESSAGE_HEADER)
-                                   ) /
-                                   sizeof(wchar_t);
+      // Pre-verify the executables of the watched directories (the warmer
+      // has its own evaluator, its requests are not counted as the
+      // driver's).
+      directory_change_feed feed;
+      policy_evaluator warm_evaluator;
+      verdict_warmer warmer;
+      if (ndirectories > 0) {
+        if (warm_evaluator.init(software_restriction_policies)) {
+          for (size_t i = 0; i < ndirectories; i++) {
+            if (!watch_directory(feed, directories[i])) {
+              _ftprintf_p(stderr,
+                          _T("Error watching directory '%s'.\n"),
+                          directories[i]);
+            }
+          }
 
-              request.filename[filenamelen] = 0;
+          if (!warmer.start(feed, warm_evaluator)) {
+            _ftprintf_p(stderr, _T("Error starting the pre-verification.\n"));
+          }
+        } else {
+          _ftprintf_p(stderr, _T("Error initializing the pre-verification.\n"));
+        }
+      }
 
-              const wchar_t* filename = request.filename;
+      // Wait until the program is stopped.
+      WaitForSingleObject(stop_event, INFINITE);
 
-              if ((filenamelen > 4) &&
-                  (wmemcmp(request.filename, L"\\??\\", 4) == 0)) {
-                filename += 4;
-              }
+      warmer.stop();
+      reloader.stop();
+      pool.stop();
+      finisher.stop();
 
-              reply.reply =
-                software_restriction_policies.allow(filename) ? 1 : 0;
+      software_restriction_policies.publish_fast_path(nullptr);
+      transport.close();
 
-#if _DEBUG
-              _tprintf(_T("Filename: '%ls' => %s.\n"),
-                       filename,
-                       reply.reply ? _T("allowed") : _T("not allowed"));
-#endif // _DEBUG
-            } else {
-              reply.reply = 0;
-            }
+      software_restriction_policies.publish_stats(nullptr);
+      software_restriction_policies.print_stats();
 
-            FilterReplyMessage(port,
-                               reinterpret_cast<FILTER_REPLY_HEADER*>(&reply),
-                               RESPONSE_SIZE);
+      if (ndirectories > 0) {
+        _tprintf(_T("Files pre-verified: %llu.\n"),
+                 static_cast<unsigned long long>(warmer.warmed()));
+      }
 
-            break;
-        }
-      } while (running);
+      if (budget > 0) {
+        _tprintf(_T("Deadline misses: %llu (%llu finished in the ")
+                 _T("background).\n"),
+                 static_cast<unsigned long long>(pool.missed()),
+                 static_cast<unsigned long long>(finisher.warmed()));
+      }
 
-      CloseHandle(overlapped.hEvent);
-      CloseHandle(port);
+      if (record) {
+        uint64_t count = recorder.count();
+        if (recorder.close()) {
+          _tprintf(_T("Requests recorded: %llu.\n"),
+                   static_cast<unsigned long long>(count));
+        } else {
+          _ftprintf_p(stderr, _T("Error writing trace '%s'.\n"), record);
+        }
+      }
 
 #if _DEBUG
       _tprintf(_T("Exiting...\n"));
@@ -266,14 +899,171 @@ bool run(const software_restriction_policies& software_restriction_policies)
       return true;
     }
 
-    CloseHandle(port);
+    software_restriction_policies.publish_fast_path(nullptr);
+    transport.close();
+  }
+
+  software_restriction_policies.publish_stats(nullptr);
+
+  return false;
+}
+
+bool replay(const software_restriction_policies& policies,
+            const TCHAR* filename,
+            size_t nworkers,
+            unsigned budget,
+            bool fallback,
+            bool deferred,
+            size_t nsenders,
+            double speed)
+{
+  // Load trace.
+  exec_trace trace;
+  if (!trace.load(filename)) {
+    _ftprintf_p(stderr, _T("Error loading trace '%s'.\n"), filename);
+    return false;
+  }
+
+  // Finish the abandoned evaluations in the background, like `run` does.
+  deferred_feed deferred_files;
+  policy_evaluator deferred_evaluator;
+  verdict_warmer finisher;
+  deferred = ((budget > 0) &&
+              (deferred) &&
+              (start_deferred(policies,
+                              deferred_files,
+                              deferred_evaluator,
+                              finisher)));
+
+  // Initialize evaluators.
+  policy_evaluator evaluators[MAX_WORKERS];
+  worker_pool::evaluator* pointers[MAX_WORKERS];
+  for (size_t i = 0; i < nworkers; i++) {
+    if (!evaluators[i].init(policies,
+                            nullptr,
+                            0,
+                            nullptr,
+                            deferred ? &deferred_files : nullptr)) {
+      return false;
+    }
+
+    pointers[i] = evaluators + i;
+  }
+
+  // The requests of the allowed paths are answered by the fast path, like
+  // the driver does.
+  void* fast_path;
+  size_t fast_path_len;
+  if (!policies.fast_path(fast_path, fast_path_len)) {
+    return false;
+  }
+
+  bool ret = replay_trace(trace,
+                          pointers,
+                          nworkers,
+                          nsenders,
+                          speed,
+                          fast_path,
+                          fast_path_len,
+                          budget,
+                          fallback);
+
+  free(fast_path);
+
+  return ret;
+}
+
+bool start_deferred(
+  const software_restriction_policies& software_restriction_policies,
+  deferred_feed& feed,
+  policy_evaluator& evaluator,
+  verdict_warmer& finisher
+)
+{
+  // The files are evaluated as soon as they are pushed (no settle time: the
+  // files were complete when they were run).
+  if ((evaluator.init(software_restriction_policies)) &&
+      (finisher.start(feed, evaluator, 0))) {
+    return true;
+  }
+
+  _ftprintf_p(stderr,
+              _T("Error starting the background evaluations, the ")
+              _T("abandoned evaluations won't be finished.\n"));
+
+  return false;
+}
+
+bool watch_directory(change_feed& feed, const TCHAR* directory)
+{
+#ifdef UNICODE
+  return feed.add(directory);
+#else
+  wchar_t path[_MAX_PATH];
+  size_t len;
+  return ((mbstowcs_s(&len, path, _countof(path), directory, _countof(path)) ==
+           0) &&
+          (feed.add(path)));
+#endif
+}
+
+bool reload()
+{
+  HANDLE hEvent;
+  if ((hEvent = OpenEvent(EVENT_MODIFY_STATE,
+                          FALSE,
+                          policy_reloader::event_name)) != NULL) {
+    BOOL ret = SetEvent(hEvent);
+
+    CloseHandle(hEvent);
+
+    return (ret != FALSE);
+  }
+
+  return false;
+}
+
+bool print_stats(bool json)
+{
+  service_stats stats;
+  if (stats.open()) {
+    stats.print(json);
+    return true;
   }
 
   return false;
 }
 
+bool dump_events(const TCHAR* filename)
+{
+#ifdef UNICODE
+  return event_trace::dump(filename);
+#else
+  wchar_t path[_MAX_PATH];
+  size_t len;
+  return ((mbstowcs_s(&len, path, _countof(path), filename, _countof(path)) ==
+           0) &&
+          (event_trace::dump(path)));
+#endif
+}
+
+void write_events(const TCHAR* filename)
+{
+#if EVENT_TRACE
+  if ((filename) && (!dump_events(filename))) {
+    _ftprintf_p(stderr, _T("Error writing events to '%s'.\n"), filename);
+  }
+
+  event_trace::close();
+#else
+  if (filename) {
+    _ftprintf_p(stderr, _T("The tracing is not compiled in.\n"));
+  }
+#endif
+}
+
 BOOL WINAPI HandlerRoutine(DWORD dwCtrlType)
 {
-  running = false;
+  SetEvent(stop_event);
   return TRUE;
 }
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "mapped_file.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <limits.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+bool mapped_file::open(const wchar_t* filename)
+{
+  if (_M_data) {
+    return false;
+  }
+
+  HANDLE hFile;
+  if ((hFile = CreateFileW(filename,
+                           GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL,
+                           NULL)) != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER size;
+    if ((GetFileSizeEx(hFile, &size)) &&
+        (size.QuadPart > 0) &&
+        (static_cast<uint64_t>(size.QuadPart) <= SIZE_MAX)) {
+      HANDLE hMapping;
+      if ((hMapping = CreateFileMappingW(hFile,
+                                         NULL,
+                                         PAGE_READONLY,
+                                         0,
+                                         0,
+                                         NULL)) != NULL) {
+        // The view keeps a reference to the mapping and the file.
+        _M_data = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+
+        CloseHandle(hMapping);
+
+        if (_M_data) {
+          CloseHandle(hFile);
+
+          _M_size = static_cast<size_t>(size.QuadPart);
+          return true;
+        }
+      }
+    }
+
+    CloseHandle(hFile);
+  }
+
+  return false;
+}
+
+void mapped_file::close()
+{
+  if (_M_data) {
+    UnmapViewOfFile(_M_data);
+
+    _M_data = nullptr;
+    _M_size = 0;
+  }
+}
+#else
+bool mapped_file::open(const wchar_t* filename)
+{
+  if (_M_data) {
+    return false;
+  }
+
+  // Convert file name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return false;
+  }
+
+  int fd;
+  if ((fd = ::open(path, O_RDONLY)) != -1) {
+    struct stat sbuf;
+    if ((fstat(fd, &sbuf) == 0) &&
+        (sbuf.st_size > 0) &&
+        (static_cast<uint64_t>(sbuf.st_size) <= SIZE_MAX)) {
+      void* data;
+      if ((data = mmap(nullptr,
+                       static_cast<size_t>(sbuf.st_size),
+                       PROT_READ,
+                       MAP_SHARED,
+                       fd,
+                       0)) != MAP_FAILED) {
+        ::close(fd);
+
+        _M_data = data;
+        _M_size = static_cast<size_t>(sbuf.st_size);
+
+        return true;
+      }
+    }
+
+    ::close(fd);
+  }
+
+  return false;
+}
+
+void mapped_file::close()
+{
+  if (_M_data) {
+    munmap(_M_data, _M_size);
+
+    _M_data = nullptr;
+    _M_size = 0;
+  }
+}
+#endif
@@ -0,0 +1,54 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+// File mapped read-only (the pages are shared by all the processes mapping
+// the same file).
+class mapped_file {
+  public:
+    // Constructor.
+    mapped_file();
+
+    // Destructor.
+    ~mapped_file();
+
+    // Open.
+    bool open(const wchar_t* filename);
+
+    // Close.
+    void close();
+
+    // Get data.
+    const void* data() const;
+
+    // Get size.
+    size_t size() const;
+
+  private:
+    void* _M_data;
+    size_t _M_size;
+};
+
+inline mapped_file::mapped_file()
+  : _M_data(nullptr),
+    _M_size(0)
+{
+}
+
+inline mapped_file::~mapped_file()
+{
+  close();
+}
+
+inline const void* mapped_file::data() const
+{
+  return _M_data;
+}
+
+inline size_t mapped_file::size() const
+{
+  return _M_size;
+}
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,44 @@
+#include "monotonic_clock.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+
+#ifdef _WIN32
+// Frequency of the performance counter (fixed at boot).
+static uint64_t frequency()
+{
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+
+  return static_cast<uint64_t>(freq.QuadPart);
+}
+
+static const uint64_t counter_frequency = frequency();
+
+uint64_t monotonic_clock::now()
+{
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+
+  return from_counter(static_cast<uint64_t>(counter.QuadPart));
+}
+
+uint64_t monotonic_clock::from_counter(uint64_t counter)
+{
+  // Split the conversion, so it doesn't overflow.
+  return ((counter / counter_frequency) * 1000000000ull) +
+         (((counter % counter_frequency) * 1000000000ull) /
+          counter_frequency);
+}
+#else
+uint64_t monotonic_clock::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ull) + ts.tv_nsec;
+}
+#endif
@@ -0,0 +1,20 @@
+#ifndef MONOTONIC_CLOCK_H
+#define MONOTONIC_CLOCK_H
+
+#include <stdint.h>
+
+// Monotonic clock with sub-microsecond resolution (the steady_clock of
+// Visual Studio 2013 only advances with the system timer).
+class monotonic_clock {
+  public:
+    // Current time in nanoseconds (the origin is arbitrary).
+    static uint64_t now();
+
+#ifdef _WIN32
+    // Convert a value of the performance counter (e.g. the time the driver
+    // sent a request) to the time of the clock.
+    static uint64_t from_counter(uint64_t counter);
+#endif
+};
+
+#endif // MONOTONIC_CLOCK_H
@@ -0,0 +1,138 @@
+#ifndef PARALLEL_SORT_H
+#define PARALLEL_SORT_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+// Wait for the threads which could be started.
+inline void parallel_sort_join(std::thread* threads, size_t nthreads)
+{
+  for (size_t i = 0; i < nthreads; i++) {
+    if (threads[i].joinable()) {
+      threads[i].join();
+    }
+  }
+}
+
+// Sort `n` elements (which must be trivially copyable) using all the
+// processors: each thread sorts a chunk and then the chunks are merged in
+// pairs.
+template<typename T, typename Compare>
+bool parallel_sort(T* data, size_t n, Compare cmp)
+{
+  static const size_t MIN_CHUNK_SIZE = 16 * 1024;
+  static const size_t MAX_THREADS = 64;
+
+  size_t nthreads = std::thread::hardware_concurrency();
+  if (nthreads > MAX_THREADS) {
+    nthreads = MAX_THREADS;
+  }
+
+  if (nthreads > n / MIN_CHUNK_SIZE) {
+    nthreads = n / MIN_CHUNK_SIZE;
+  }
+
+  // If it is not worth to use several threads...
+  if (nthreads <= 1) {
+    std::sort(data, data + n, cmp);
+    return true;
+  }
+
+  T* tmp;
+  if ((tmp = reinterpret_cast<T*>(malloc(n * sizeof(T)))) == nullptr) {
+    return false;
+  }
+
+  // Chunk boundaries.
+  size_t bounds[MAX_THREADS + 1];
+  for (size_t i = 0; i <= nthreads; i++) {
+    bounds[i] = (n * i) / nthreads;
+  }
+
+  std::thread threads[MAX_THREADS];
+
+  // Sort chunks.
+  for (size_t i = 0; i < nthreads; i++) {
+    try {
+      threads[i] = std::thread([=]() {
+                                 std::sort(data + bounds[i],
+                                           data + bounds[i + 1],
+                                           cmp);
+                               });
+    } catch (...) {
+      // Sort the chunk in this thread.
+      std::sort(data + bounds[i], data + bounds[i + 1], cmp);
+    }
+  }
+
+  parallel_sort_join(threads, nthreads);
+
+  // Merge chunks in pairs until there is only one.
+  T* src = data;
+  T* dest = tmp;
+  size_t nchunks = nthreads;
+
+  while (nchunks > 1) {
+    size_t nmerges = nchunks / 2;
+
+    for (size_t i = 0; i < nmerges; i++) {
+      size_t begin = bounds[2 * i];
+      size_t middle = bounds[(2 * i) + 1];
+      size_t end = bounds[(2 * i) + 2];
+
+      try {
+        threads[i] = std::thread([=]() {
+                                   std::merge(src + begin,
+                                              src + middle,
+                                              src + middle,
+                                              src + end,
+                                              dest + begin,
+                                              cmp);
+                                 });
+      } catch (...) {
+        std::merge(src + begin,
+                   src + middle,
+                   src + middle,
+                   src + end,
+                   dest + begin,
+                   cmp);
+      }
+    }
+
+    // Odd number of chunks: copy the last one.
+    if (nchunks % 2) {
+      memcpy(dest + bounds[nchunks - 1],
+             src + bounds[nchunks - 1],
+             (bounds[nchunks] - bounds[nchunks - 1]) * sizeof(T));
+    }
+
+    parallel_sort_join(threads, nmerges);
+
+    // Update chunk boundaries.
+    for (size_t i = 0; i < nmerges; i++) {
+      bounds[i + 1] = bounds[(2 * i) + 2];
+    }
+
+    if (nchunks % 2) {
+      bounds[nmerges + 1] = bounds[nchunks];
+    }
+
+    nchunks = nmerges + (nchunks % 2);
+
+    T* t = src;
+    src = dest;
+    dest = t;
+  }
+
+  if (src != data) {
+    memcpy(data, src, n * sizeof(T));
+  }
+
+  free(tmp);
+
+  return true;
+}
+
+#endif // PARALLEL_SORT_H
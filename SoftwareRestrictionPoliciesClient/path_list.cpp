@@ -1,121 +1,356 @@
 #include <string.h>
-#include <wchar.h>
-#include <sys/stat.h>
-#include <ctype.h>
+#include <algorithm>
 #include "path_list.h"
+#include "upcase.h"
+#include "fast_path.h"
 
-bool path_list::add(const wchar_t* path, size_t pathlen)
+bool path_list::add(const wchar_t* path, size_t pathlen, bool directory)
 {
-  // If the path is neither too short nor too long...
-  if ((pathlen > 0) && (pathlen < _MAX_PATH)) {
-    // If the path exists...
-    struct _stat sbuf;
-    if (_wstat(path, &sbuf) == 0) {
-      wchar_t lastchar;
-
-      // Directory?
-      if (sbuf.st_mode & _S_IFDIR) {
-        if (path[pathlen - 1] != L'\\') {
-          if (pathlen + 1 == _MAX_PATH) {
-            return false;
-          }
-
-          lastchar = L'\\';
-        } else {
-          lastchar = L'\0';
-        }
-      } else if (sbuf.st_mode & _S_IFREG) {
-        lastchar = L'\0';
-      } else {
+  if (_M_mapped) {
+    return false;
+  }
+
+  // A directory matches the files under it, ignore trailing separators.
+  if (directory) {
+    while ((pathlen > 0) && (path[pathlen - 1] == L'\\')) {
+      pathlen--;
+    }
+  }
+
+  if (pathlen == 0) {
+    return false;
+  }
+
+  // Create root node (if not created yet).
+  if (_M_used == 0) {
+    if ((_M_nodes = reinterpret_cast<struct node*>(
+                      malloc(32 * sizeof(struct node))
+                    )) == nullptr) {
+      return false;
+    }
+
+    _M_size = 32;
+
+    _M_nodes[root].parent = root;
+    _M_nodes[root].off = 0;
+    _M_nodes[root].len = 0;
+    _M_nodes[root].hash = 0;
+    _M_nodes[root].flags = 0;
+
+    _M_used = 1;
+  }
+
+  // For each component...
+  uint32_t n = root;
+  size_t pos = 0;
+  do {
+    size_t end;
+    for (end = pos; (end < pathlen) && (path[end] != L'\\'); end++);
+
+    uint32_t h = hash(n, path + pos, end - pos);
+
+    uint32_t child;
+    if ((child = find(n, path + pos, end - pos, h)) == 0) {
+      if ((child = add(n, path + pos, end - pos, h)) == 0) {
         return false;
       }
+    }
 
-      // Convert path to lower case.
-      wchar_t tmppath[_MAX_PATH];
-      for (size_t i = 0; i < pathlen; i++) {
-        tmppath[i] = tolower(path[i]);
-      }
+    n = child;
+    pos = end + 1;
+  } while (pos <= pathlen);
 
-      if (lastchar) {
-        tmppath[pathlen++] = lastchar;
-      }
+  _M_nodes[n].flags |= directory ? allowed_directory : allowed_file;
+
+  return true;
+}
+
+bool path_list::find(const wchar_t* path, size_t pathlen) const
+{
+  if ((_M_used == 0) || (pathlen == 0)) {
+    return false;
+  }
+
+  // For each component...
+  uint32_t n = root;
+  size_t pos = 0;
+  do {
+    size_t end;
+    for (end = pos; (end < pathlen) && (path[end] != L'\\'); end++);
+
+    if ((n = find(n, path + pos, end - pos, hash(n, path + pos, end - pos))) ==
+        0) {
+      return false;
+    }
 
-      tmppath[pathlen] = L'\0';
+    // Last component?
+    if (end == pathlen) {
+      return ((_M_nodes[n].flags & allowed_file) != 0);
+    }
 
-      // If the path has not been inserted yet...
-      size_t pos;
-      if (!find(tmppath, pathlen, pos)) {
-        size_t off = _M_data.length();
+    // If the directory is allowed...
+    if (_M_nodes[n].flags & allowed_directory) {
+      return true;
+    }
 
-        if (_M_data.add(tmppath, pathlen)) {
-          if (_M_used == _M_size) {
-            size_t size = (_M_size != 0) ? (_M_size * 2) : 32;
+    pos = end + 1;
+  } while (true);
+}
 
-            struct string* strings;
-            if ((strings = reinterpret_cast<struct string*>(
-                             realloc(_M_strings, size * sizeof(struct string))
-                           )) == nullptr) {
-              return false;
-            }
+bool path_list::save(image_writer& writer, image& img) const
+{
+  return ((writer.add(_M_nodes,
+                      _M_used * sizeof(struct node),
+                      sizeof(uint64_t),
+                      img.nodes)) &&
+          (writer.add(_M_buckets,
+                      _M_nbuckets * sizeof(uint32_t),
+                      sizeof(uint64_t),
+                      img.buckets)) &&
+          (writer.add(_M_data.buffer(),
+                      _M_data.length() * sizeof(wchar_t),
+                      sizeof(uint64_t),
+                      img.data)));
+}
 
-            _M_strings = strings;
-            _M_size = size;
-          }
+bool path_list::attach(const image_reader& reader, const image& img)
+{
+  const void* nodes;
+  const void* buckets;
+  const void* data;
+  if ((_M_used == 0) &&
+      ((nodes = reader.get(img.nodes,
+                           sizeof(uint64_t),
+                           sizeof(struct node))) != nullptr) &&
+      ((buckets = reader.get(img.buckets,
+                             sizeof(uint64_t),
+                             sizeof(uint32_t))) != nullptr) &&
+      ((data = reader.get(img.data,
+                          sizeof(uint64_t),
+                          sizeof(wchar_t))) != nullptr)) {
+    size_t nnodes = static_cast<size_t>(img.nodes.len / sizeof(struct node));
+    size_t nbuckets = static_cast<size_t>(img.buckets.len / sizeof(uint32_t));
+    size_t datalen = static_cast<size_t>(img.data.len / sizeof(wchar_t));
+
+    // The number of buckets must be a power of two and leave empty buckets
+    // (so lookups terminate).
+    if ((nnodes > UINT32_MAX) ||
+        ((nbuckets & (nbuckets - 1)) != 0) ||
+        ((nnodes > 0) && (nnodes * 2 > nbuckets))) {
+      return false;
+    }
 
-          // If not in the last position...
-          if (pos < _M_used) {
-            memmove(_M_strings + pos + 1,
-                    _M_strings + pos,
-                    (_M_used - pos) * sizeof(struct string));
-          }
+    // The root is its own parent and every other node comes after its parent
+    // (so the nodes form a tree). Every name must be in the data.
+    const struct node* n = reinterpret_cast<const struct node*>(nodes);
+    for (size_t i = 0; i < nnodes; i++) {
+      if (((i == root) ? (n[i].parent != root) : (n[i].parent >= i)) ||
+          (n[i].off > datalen) ||
+          (n[i].len > datalen - n[i].off)) {
+        return false;
+      }
+    }
 
-          _M_strings[pos].off = off;
-          _M_strings[pos].len = pathlen;
+    // Every bucket is empty or contains a node which is not the root, and
+    // at least one bucket is empty.
+    const uint32_t* b = reinterpret_cast<const uint32_t*>(buckets);
+    size_t nempty = 0;
+    for (size_t i = 0; i < nbuckets; i++) {
+      if (b[i] == 0) {
+        nempty++;
+      } else if (b[i] >= nnodes) {
+        return false;
+      }
+    }
 
-          _M_used++;
+    if ((nbuckets > 0) && (nempty == 0)) {
+      return false;
+    }
 
-          return true;
-        }
-      } else {
-        return true;
+    // The names are compared in upper case: they must have been converted
+    // with the same table (e.g. not by a system with a different one).
+    const wchar_t* d = reinterpret_cast<const wchar_t*>(data);
+    for (size_t i = 0; i < datalen; i++) {
+      if (upcase::convert(d[i]) != d[i]) {
+        return false;
       }
     }
+
+    if (_M_nodes) {
+      free(_M_nodes);
+    }
+
+    if (_M_buckets) {
+      free(_M_buckets);
+    }
+
+    _M_nodes = reinterpret_cast<struct node*>(const_cast<void*>(nodes));
+    _M_size = 0;
+    _M_used = nnodes;
+
+    _M_buckets = reinterpret_cast<uint32_t*>(const_cast<void*>(buckets));
+    _M_nbuckets = nbuckets;
+
+    _M_mapped = true;
+
+    _M_data.attach(reinterpret_cast<const wchar_t*>(data), datalen);
+
+    return true;
   }
 
   return false;
 }
 
-bool path_list::find(const wchar_t* path, size_t pathlen) const
+bool path_list::fast_path(void*& blob, size_t& len) const
 {
-  // If the path is neither too short nor too long...
-  if ((pathlen > 0) && (pathlen < _MAX_PATH)) {
-    // Convert path to lower case.
-    wchar_t tmppath[_MAX_PATH];
-    for (size_t i = 0; i < pathlen; i++) {
-      tmppath[i] = tolower(path[i]);
+  // The blob has at least the root.
+  size_t nnodes = (_M_used > 0) ? _M_used : 1;
+  size_t nunits = _M_data.length();
+
+  size_t size = sizeof(fast_path_header) +
+                (nnodes * sizeof(fast_path_node)) +
+                (nunits * sizeof(uint16_t));
+
+  if (size > FAST_PATH_MAX_SIZE) {
+    return false;
+  }
+
+  // Children of each node, grouped by parent: the children of `n` are
+  // children[first[n]] ... children[first[n + 1] - 1].
+  uint32_t* first;
+  uint32_t* children;
+
+  // Nodes of the list in the order of the blob (breadth-first).
+  uint32_t* order;
+
+  uint8_t* b;
+
+  if ((first = reinterpret_cast<uint32_t*>(
+                 calloc(nnodes + 1, sizeof(uint32_t))
+               )) == nullptr) {
+    return false;
+  }
+
+  if (((children = reinterpret_cast<uint32_t*>(
+                     malloc(nnodes * sizeof(uint32_t))
+                   )) == nullptr) ||
+      ((order = reinterpret_cast<uint32_t*>(
+                  malloc(nnodes * sizeof(uint32_t))
+                )) == nullptr)) {
+    free(children);
+    free(first);
+
+    return false;
+  }
+
+  if ((b = reinterpret_cast<uint8_t*>(malloc(size))) == nullptr) {
+    free(order);
+    free(children);
+    free(first);
+
+    return false;
+  }
+
+  // Group the nodes by parent (the root is never a child).
+  for (size_t i = 1; i < _M_used; i++) {
+    first[_M_nodes[i].parent + 1]++;
+  }
+
+  for (size_t i = 1; i <= nnodes; i++) {
+    first[i] += first[i - 1];
+  }
+
+  for (size_t i = 1; i < _M_used; i++) {
+    children[first[_M_nodes[i].parent]++] = static_cast<uint32_t>(i);
+  }
+
+  // Each group now starts where the previous one ended.
+  memmove(first + 1, first, nnodes * sizeof(uint32_t));
+  first[0] = 0;
+
+  // Sort the children of each node by name, the way fast_path_find()
+  // searches them.
+  const wchar_t* data = _M_data.buffer();
+
+  for (size_t i = 0; i < nnodes; i++) {
+    std::sort(children + first[i],
+              children + first[i + 1],
+              [this, data](uint32_t x, uint32_t y) {
+                const struct node& n1 = _M_nodes[x];
+                const struct node& n2 = _M_nodes[y];
+
+                size_t n = (n1.len < n2.len) ? n1.len : n2.len;
+                for (size_t j = 0; j < n; j++) {
+                  uint16_t c1 = static_cast<uint16_t>(data[n1.off + j]);
+                  uint16_t c2 = static_cast<uint16_t>(data[n2.off + j]);
+
+                  if (c1 != c2) {
+                    return (c1 < c2);
+                  }
+                }
+
+                return (n1.len < n2.len);
+              });
+  }
+
+  fast_path_header* hdr = reinterpret_cast<fast_path_header*>(b);
+  hdr->magic = FAST_PATH_MAGIC;
+  hdr->version = FAST_PATH_VERSION;
+  hdr->size = static_cast<uint32_t>(size);
+  hdr->nnodes = static_cast<uint32_t>(nnodes);
+  hdr->nunits = static_cast<uint32_t>(nunits);
+
+  fast_path_node* nodes = reinterpret_cast<fast_path_node*>(hdr + 1);
+
+  // Lay out the nodes breadth-first, so the children of a node are
+  // consecutive.
+  order[0] = root;
+  size_t next = 1;
+
+  for (size_t i = 0; i < nnodes; i++) {
+    uint32_t n = order[i];
+    uint32_t nchildren = first[n + 1] - first[n];
+
+    if (n != root) {
+      nodes[i].name = _M_nodes[n].off;
+      nodes[i].len = _M_nodes[n].len;
+      nodes[i].flags = ((_M_nodes[n].flags & allowed_file) ?
+                         FAST_PATH_FILE : 0) |
+                       ((_M_nodes[n].flags & allowed_directory) ?
+                         FAST_PATH_DIRECTORY : 0);
+    } else {
+      nodes[i].name = 0;
+      nodes[i].len = 0;
+      nodes[i].flags = 0;
     }
 
-    tmppath[pathlen] = L'\0';
+    nodes[i].children = (nchildren > 0) ? static_cast<uint32_t>(next) : 0;
+    nodes[i].nchildren = nchildren;
 
-    do {
-      size_t pos;
-      if (find(tmppath, pathlen, pos)) {
-        return true;
-      }
+    memcpy(order + next, children + first[n], nchildren * sizeof(uint32_t));
+    next += nchildren;
+  }
 
-      for (--pathlen;
-           (pathlen > 0) && (tmppath[pathlen - 1] != L'\\');
-           pathlen--);
-    } while (pathlen > 0);
+  // Names (UTF-16).
+  uint16_t* units = reinterpret_cast<uint16_t*>(nodes + nnodes);
+  for (size_t i = 0; i < nunits; i++) {
+    units[i] = static_cast<uint16_t>(data[i]);
   }
 
-  return false;
+  free(order);
+  free(children);
+  free(first);
+
+  blob = b;
+  len = size;
+
+  return true;
 }
 
 bool path_list::data::add(const wchar_t* path, size_t pathlen)
 {
-  if (allocate(pathlen)) {
-    wmemcpy(_M_data + _M_used, path, pathlen);
+  if ((!_M_mapped) && (allocate(pathlen))) {
+    upcase::convert(path, pathlen, _M_data + _M_used);
     _M_used += pathlen;
 
     return true;
@@ -166,36 +401,114 @@ bool path_list::data::allocate(size_t size)
   return false;
 }
 
-bool path_list::find(const wchar_t* path, size_t pathlen, size_t& pos) const
+uint32_t path_list::find(uint32_t parent,
+                         const wchar_t* name,
+                         size_t namelen,
+                         uint32_t hash) const
 {
-  int i = 0;
-  int j = _M_used - 1;
+  if (_M_nbuckets > 0) {
+    size_t mask = _M_nbuckets - 1;
+
+    uint32_t idx;
+    for (size_t i = hash & mask;
+         (idx = _M_buckets[i]) != 0;
+         i = (i + 1) & mask) {
+      const struct node* n = _M_nodes + idx;
+
+      if ((n->hash == hash) && (n->parent == parent) && (n->len == namelen)) {
+        if (upcase::equal(name, _M_data.buffer() + n->off, namelen)) {
+          return idx;
+        }
+      }
+    }
+  }
 
-  while (i <= j) {
-    int mid = (i + j) / 2;
+  return 0;
+}
 
-    const struct string* str = _M_strings + mid;
+uint32_t path_list::add(uint32_t parent,
+                        const wchar_t* name,
+                        size_t namelen,
+                        uint32_t hash)
+{
+  // Keep the load factor of the hash table under 50%.
+  if ((_M_used * 2 >= _M_nbuckets) && (!grow())) {
+    return 0;
+  }
 
-    size_t l = (pathlen < str->len) ? pathlen : str->len;
+  if (_M_used == _M_size) {
+    size_t size = _M_size * 2;
 
-    int ret;
-    if ((ret = wmemcmp(path, _M_data.buffer() + str->off, l)) < 0) {
-      j = mid - 1;
-    } else if (ret > 0) {
-      i = mid + 1;
-    } else {
-      if (pathlen < str->len) {
-        j = mid - 1;
-      } else if (pathlen > str->len) {
-        i = mid + 1;
-      } else {
-        pos = mid;
-        return true;
-      }
+    struct node* nodes;
+    if ((size > UINT32_MAX) ||
+        ((nodes = reinterpret_cast<struct node*>(
+                    realloc(_M_nodes, size * sizeof(struct node))
+                  )) == nullptr)) {
+      return 0;
     }
+
+    _M_nodes = nodes;
+    _M_size = size;
   }
 
-  pos = i;
+  size_t off = _M_data.length();
+  if ((off + namelen > UINT32_MAX) || (!_M_data.add(name, namelen))) {
+    return 0;
+  }
 
-  return false;
+  uint32_t idx = static_cast<uint32_t>(_M_used++);
+
+  struct node* n = _M_nodes + idx;
+  n->parent = parent;
+  n->off = static_cast<uint32_t>(off);
+  n->len = static_cast<uint32_t>(namelen);
+  n->hash = hash;
+  n->flags = 0;
+
+  // Insert node in the hash table.
+  size_t mask = _M_nbuckets - 1;
+  size_t i;
+  for (i = hash & mask; _M_buckets[i] != 0; i = (i + 1) & mask);
+
+  _M_buckets[i] = idx;
+
+  return idx;
+}
+
+bool path_list::grow()
+{
+  size_t nbuckets = (_M_nbuckets != 0) ? (_M_nbuckets * 2) : 64;
+
+  uint32_t* buckets;
+  if ((buckets = reinterpret_cast<uint32_t*>(
+                   calloc(nbuckets, sizeof(uint32_t))
+                 )) == nullptr) {
+    return false;
+  }
+
+  // Rehash nodes (skip the root).
+  size_t mask = nbuckets - 1;
+  for (size_t idx = 1; idx < _M_used; idx++) {
+    size_t i;
+    for (i = _M_nodes[idx].hash & mask; buckets[i] != 0; i = (i + 1) & mask);
+
+    buckets[i] = static_cast<uint32_t>(idx);
+  }
+
+  if (_M_buckets) {
+    free(_M_buckets);
+  }
+
+  _M_buckets = buckets;
+  _M_nbuckets = nbuckets;
+
+  return true;
+}
+
+uint32_t path_list::hash(uint32_t parent, const wchar_t* name, size_t namelen)
+{
+  // Seeded with the parent.
+  return static_cast<uint32_t>(
+           upcase::hash(name, namelen, (parent + 1) * 0x9e3779b97f4a7c15ull)
+         );
 }
@@ -2,9 +2,24 @@
 #define PATH_LIST_H
 
 #include <stdlib.h>
-
+#include <stdint.h>
+#include "image.h"
+
+// List of allowed paths (files and directories), stored as a trie of path
+// components. Paths are case-insensitive, the way NTFS compares them (see
+// upcase).
+// find() walks the path from left to right once: at each component it
+// follows the child of the current node with that name and stops as soon as
+// it reaches an allowed directory.
 class path_list {
   public:
+    // Location of the list in an image.
+    struct image {
+      image_block nodes;
+      image_block buckets;
+      image_block data;
+    };
+
     // Constructor.
     path_list();
 
@@ -12,21 +27,65 @@ class path_list {
     ~path_list();
 
     // Add.
-    bool add(const wchar_t* path, size_t pathlen);
+    bool add(const wchar_t* path, size_t pathlen, bool directory);
+
+    // Append (bulk load).
+    // The trie doesn't keep a sorted array, so the path is inserted right
+    // away; it is there so all the lists are loaded the same way.
+    bool append(const wchar_t* path, size_t pathlen, bool directory);
+
+    // Build.
+    bool build();
 
     // Find.
     bool find(const wchar_t* path, size_t pathlen) const;
 
+    // Memory usage (bytes, allocated or attached).
+    size_t memory_usage() const;
+
+    // Save to image.
+    bool save(image_writer& writer, image& img) const;
+
+    // Attach to image (the list becomes read-only and uses the image in
+    // place).
+    bool attach(const image_reader& reader, const image& img);
+
+    // Compile the fast path of the driver (see fast_path.h), allocated with
+    // malloc().
+    bool fast_path(void*& blob, size_t& len) const;
+
   private:
-    struct string {
-      size_t off;
-      size_t len;
+    static const uint32_t root = 0;
+
+    enum {
+      allowed_file = 0x01,
+      allowed_directory = 0x02
     };
 
-    struct string* _M_strings;
+    struct node {
+      uint32_t parent;
+
+      // Name of the component (upper case).
+      uint32_t off;
+      uint32_t len;
+
+      uint32_t hash;
+
+      uint32_t flags;
+    };
+
+    struct node* _M_nodes;
     size_t _M_size;
     size_t _M_used;
 
+    // Hash table of nodes keyed by (parent, name).
+    // Each bucket contains a node index (0 = empty, the root is never a child).
+    uint32_t* _M_buckets;
+    size_t _M_nbuckets;
+
+    // Attached to an image?
+    bool _M_mapped;
+
     class data {
       public:
         // Constructor.
@@ -41,9 +100,15 @@ class path_list {
         // Length.
         size_t length() const;
 
-        // Add.
+        // Memory usage (bytes, allocated or attached).
+        size_t memory_usage() const;
+
+        // Add (converting to upper case).
         bool add(const wchar_t* path, size_t pathlen);
 
+        // Attach to (read-only) buffer.
+        void attach(const wchar_t* s, size_t len);
+
       private:
         static const size_t initial_alloc = 32;
 
@@ -51,38 +116,85 @@ class path_list {
         size_t _M_size;
         size_t _M_used;
 
+        // Attached to a read-only buffer?
+        bool _M_mapped;
+
         // Allocate.
         bool allocate(size_t size);
     } _M_data;
 
-    // Find.
-    bool find(const wchar_t* path, size_t pathlen, size_t& pos) const;
+    // Find child.
+    uint32_t find(uint32_t parent,
+                  const wchar_t* name,
+                  size_t namelen,
+                  uint32_t hash) const;
+
+    // Add child.
+    uint32_t add(uint32_t parent,
+                 const wchar_t* name,
+                 size_t namelen,
+                 uint32_t hash);
+
+    // Grow hash table.
+    bool grow();
+
+    // Hash component (case insensitive).
+    static uint32_t hash(uint32_t parent, const wchar_t* name, size_t namelen);
 };
 
 inline path_list::path_list()
-  : _M_strings(nullptr),
+  : _M_nodes(nullptr),
     _M_size(0),
-    _M_used(0)
+    _M_used(0),
+    _M_buckets(nullptr),
+    _M_nbuckets(0),
+    _M_mapped(false)
 {
 }
 
 inline path_list::~path_list()
 {
-  if (_M_strings) {
-    free(_M_strings);
+  if (!_M_mapped) {
+    if (_M_nodes) {
+      free(_M_nodes);
+    }
+
+    if (_M_buckets) {
+      free(_M_buckets);
+    }
   }
 }
 
+inline bool path_list::append(const wchar_t* path,
+                              size_t pathlen,
+                              bool directory)
+{
+  return add(path, pathlen, directory);
+}
+
+inline bool path_list::build()
+{
+  return true;
+}
+
+inline size_t path_list::memory_usage() const
+{
+  return ((_M_mapped ? _M_used : _M_size) * sizeof(struct node)) +
+         (_M_nbuckets * sizeof(uint32_t)) +
+         _M_data.memory_usage();
+}
+
 inline path_list::data::data()
   : _M_data(nullptr),
     _M_size(0),
-    _M_used(0)
+    _M_used(0),
+    _M_mapped(false)
 {
 }
 
 inline path_list::data::~data()
 {
-  if (_M_data) {
+  if ((_M_data) && (!_M_mapped)) {
     free(_M_data);
   }
 }
@@ -97,4 +209,21 @@ inline size_t path_list::data::length() const
   return _M_used;
 }
 
+inline size_t path_list::data::memory_usage() const
+{
+  return (_M_mapped ? _M_used : _M_size) * sizeof(wchar_t);
+}
+
+inline void path_list::data::attach(const wchar_t* s, size_t len)
+{
+  if ((_M_data) && (!_M_mapped)) {
+    free(_M_data);
+  }
+
+  _M_data = const_cast<wchar_t*>(s);
+  _M_size = 0;
+  _M_used = len;
+  _M_mapped = true;
+}
+
 #endif // PATH_LIST_H
@@ -0,0 +1,519 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "string_list.h"
+#include "image.h"
+
+// Minimal perfect hash of the strings of a (built) string list: each string
+// has its own slot and there are as many slots as strings, so a lookup hashes
+// the string once and compares it with the only string of the list which can
+// match, however many strings there are.
+//
+// The hash selects the bucket of the string (3 strings per bucket on
+// average) and, mixed with the pilot of the bucket, its slot, which holds
+// the index of the string in the list. The pilots are searched for when the
+// index is built (hash and displace): largest buckets first, each one gets
+// the smallest pilot which sends its strings to free slots.
+template<typename _CharT>
+class perfect_hash {
+  public:
+    typedef _CharT char_type;
+
+    // Location of the index in an image.
+    struct image {
+      image_block pilots;
+      image_block slots;
+      uint64_t seed;
+    };
+
+    // Constructor.
+    perfect_hash();
+
+    // Destructor.
+    ~perfect_hash();
+
+    // Build the index of the strings of a list (the list must have been
+    // built and not change afterwards).
+    bool build(const string_list<char_type>& list);
+
+    // Find (in the list the index was built for).
+    bool find(const string_list<char_type>& list,
+              const char_type* s,
+              size_t len) const;
+
+    // Number of strings.
+    size_t count() const;
+
+    // Memory usage (bytes, allocated or attached).
+    size_t memory_usage() const;
+
+    // Save to image.
+    bool save(image_writer& writer, image& img) const;
+
+    // Attach to image (the index becomes read-only and uses the image in
+    // place). `list` is the (attached) list the index was built for.
+    bool attach(const string_list<char_type>& list,
+                const image_reader& reader,
+                const image& img);
+
+  private:
+    // Average number of strings per bucket.
+    static const size_t BUCKET_SIZE = 3;
+
+    // Maximum number of strings per bucket.
+    static const size_t MAX_BUCKET_SIZE = 32;
+
+    // Number of seeds tried before giving up.
+    static const unsigned MAX_SEEDS = 16;
+
+    // Pilot of each bucket.
+    uint32_t* _M_pilots;
+    size_t _M_nbuckets;
+
+    // Index (in the list) of the string of each slot.
+    uint32_t* _M_slots;
+    size_t _M_count;
+
+    uint64_t _M_seed;
+
+    // Attached to an image?
+    bool _M_mapped;
+
+    // Search for the pilots with the hashes of a seed (returns false if
+    // the seed doesn't work).
+    static bool place(const uint64_t* hashes,
+                      size_t count,
+                      size_t nbuckets,
+                      uint32_t* pilots,
+                      uint32_t* slots);
+
+    // Free the arrays (if not attached).
+    void clear();
+
+    // Number of buckets.
+    static size_t buckets(size_t count);
+
+    // Hash string.
+    static uint64_t hash(const char_type* s, size_t len, uint64_t seed);
+
+    // Bucket of a hash.
+    static size_t bucket(uint64_t h, size_t nbuckets);
+
+    // Slot of a hash.
+    static size_t slot(uint64_t h, uint32_t pilot, size_t count);
+};
+
+template<typename _CharT>
+inline perfect_hash<_CharT>::perfect_hash()
+  : _M_pilots(nullptr),
+    _M_nbuckets(0),
+    _M_slots(nullptr),
+    _M_count(0),
+    _M_seed(0),
+    _M_mapped(false)
+{
+}
+
+template<typename _CharT>
+inline perfect_hash<_CharT>::~perfect_hash()
+{
+  clear();
+}
+
+template<typename _CharT>
+bool perfect_hash<_CharT>::build(const string_list<char_type>& list)
+{
+  if (_M_mapped) {
+    return false;
+  }
+
+  size_t count = list.count();
+  if (count > UINT32_MAX) {
+    return false;
+  }
+
+  clear();
+
+  if (count == 0) {
+    return true;
+  }
+
+  size_t nbuckets = buckets(count);
+
+  uint32_t* pilots;
+  uint32_t* slots;
+  uint64_t* hashes;
+  if ((pilots = reinterpret_cast<uint32_t*>(
+                  malloc(nbuckets * sizeof(uint32_t))
+                )) != nullptr) {
+    if ((slots = reinterpret_cast<uint32_t*>(
+                   malloc(count * sizeof(uint32_t))
+                 )) != nullptr) {
+      if ((hashes = reinterpret_cast<uint64_t*>(
+                      malloc(count * sizeof(uint64_t))
+                    )) != nullptr) {
+        // The seeds are always the same, so the same list always gets the
+        // same index.
+        for (unsigned i = 1; i <= MAX_SEEDS; i++) {
+          uint64_t seed = i * 0x9e3779b97f4a7c15ull;
+
+          for (size_t j = 0; j < count; j++) {
+            size_t len;
+            const char_type* s = list.get(j, len);
+            hashes[j] = hash(s, len, seed);
+          }
+
+          if (place(hashes, count, nbuckets, pilots, slots)) {
+            free(hashes);
+
+            _M_pilots = pilots;
+            _M_nbuckets = nbuckets;
+            _M_slots = slots;
+            _M_count = count;
+            _M_seed = seed;
+
+            return true;
+          }
+        }
+
+        free(hashes);
+      }
+
+      free(slots);
+    }
+
+    free(pilots);
+  }
+
+  return false;
+}
+
+template<typename _CharT>
+inline bool perfect_hash<_CharT>::find(const string_list<char_type>& list,
+                                       const char_type* s,
+                                       size_t len) const
+{
+  if (_M_count > 0) {
+    uint64_t h = hash(s, len, _M_seed);
+
+    size_t idx = _M_slots[slot(h,
+                               _M_pilots[bucket(h, _M_nbuckets)],
+                               _M_count)];
+
+    size_t l;
+    const char_type* str = list.get(idx, l);
+
+    return ((l == len) && (memcmp(str, s, len * sizeof(char_type)) == 0));
+  }
+
+  return false;
+}
+
+template<typename _CharT>
+inline size_t perfect_hash<_CharT>::count() const
+{
+  return _M_count;
+}
+
+template<typename _CharT>
+inline size_t perfect_hash<_CharT>::memory_usage() const
+{
+  return (_M_nbuckets + _M_count) * sizeof(uint32_t);
+}
+
+template<typename _CharT>
+bool perfect_hash<_CharT>::save(image_writer& writer, image& img) const
+{
+  img.seed = _M_seed;
+
+  return ((writer.add(_M_pilots,
+                      _M_nbuckets * sizeof(uint32_t),
+                      sizeof(uint32_t),
+                      img.pilots)) &&
+          (writer.add(_M_slots,
+                      _M_count * sizeof(uint32_t),
+                      sizeof(uint32_t),
+                      img.slots)));
+}
+
+template<typename _CharT>
+bool perfect_hash<_CharT>::attach(const string_list<char_type>& list,
+                                  const image_reader& reader,
+                                  const image& img)
+{
+  const void* pilots;
+  const void* slots;
+  if ((_M_count == 0) &&
+      ((pilots = reader.get(img.pilots,
+                            sizeof(uint32_t),
+                            sizeof(uint32_t))) != nullptr) &&
+      ((slots = reader.get(img.slots,
+                           sizeof(uint32_t),
+                           sizeof(uint32_t))) != nullptr)) {
+    size_t nbuckets = static_cast<size_t>(img.pilots.len / sizeof(uint32_t));
+    size_t count = static_cast<size_t>(img.slots.len / sizeof(uint32_t));
+
+    // There must be a slot per string of the list.
+    if ((count != list.count()) || (nbuckets != buckets(count))) {
+      return false;
+    }
+
+    // Every slot must point to a string.
+    const uint32_t* s = reinterpret_cast<const uint32_t*>(slots);
+    for (size_t i = 0; i < count; i++) {
+      if (s[i] >= count) {
+        return false;
+      }
+    }
+
+    clear();
+
+    _M_pilots = reinterpret_cast<uint32_t*>(const_cast<void*>(pilots));
+    _M_nbuckets = nbuckets;
+    _M_slots = const_cast<uint32_t*>(s);
+    _M_count = count;
+    _M_seed = img.seed;
+    _M_mapped = true;
+
+    return true;
+  }
+
+  return false;
+}
+
+template<typename _CharT>
+bool perfect_hash<_CharT>::place(const uint64_t* hashes,
+                                 size_t count,
+                                 size_t nbuckets,
+                                 uint32_t* pilots,
+                                 uint32_t* slots)
+{
+  // Pilots tried per bucket: the last buckets have few free slots left.
+  uint64_t max_pilot = 16 * static_cast<uint64_t>(count) + 1024;
+  if (max_pilot > UINT32_MAX) {
+    max_pilot = UINT32_MAX;
+  }
+
+  uint32_t* starts = nullptr;
+  uint32_t* keys = nullptr;
+  uint32_t* order = nullptr;
+  uint64_t* taken = nullptr;
+  bool ret = false;
+
+  if (((starts = reinterpret_cast<uint32_t*>(
+                   calloc(nbuckets + 1, sizeof(uint32_t))
+                 )) != nullptr) &&
+      ((keys = reinterpret_cast<uint32_t*>(
+                 malloc(count * sizeof(uint32_t))
+               )) != nullptr) &&
+      ((order = reinterpret_cast<uint32_t*>(
+                  malloc(nbuckets * sizeof(uint32_t))
+                )) != nullptr) &&
+      ((taken = reinterpret_cast<uint64_t*>(
+                  calloc((count + 63) / 64, sizeof(uint64_t))
+                )) != nullptr)) {
+    // Group the strings by bucket.
+    for (size_t i = 0; i < count; i++) {
+      starts[bucket(hashes[i], nbuckets) + 1]++;
+    }
+
+    for (size_t b = 0; b < nbuckets; b++) {
+      starts[b + 1] += starts[b];
+      order[b] = starts[b];
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      keys[order[bucket(hashes[i], nbuckets)]++] = static_cast<uint32_t>(i);
+    }
+
+    // Sort the buckets by decreasing size.
+    size_t sizes[MAX_BUCKET_SIZE + 1];
+    memset(sizes, 0, sizeof(sizes));
+
+    ret = true;
+    for (size_t b = 0; b < nbuckets; b++) {
+      size_t size = starts[b + 1] - starts[b];
+      if (size > MAX_BUCKET_SIZE) {
+        ret = false;
+        break;
+      }
+
+      sizes[size]++;
+    }
+
+    if (ret) {
+      size_t pos = 0;
+      for (size_t size = MAX_BUCKET_SIZE + 1; size > 0; size--) {
+        size_t n = sizes[size - 1];
+        sizes[size - 1] = pos;
+        pos += n;
+      }
+
+      for (size_t b = 0; b < nbuckets; b++) {
+        order[sizes[starts[b + 1] - starts[b]]++] = static_cast<uint32_t>(b);
+      }
+
+      memset(pilots, 0, nbuckets * sizeof(uint32_t));
+
+      for (size_t i = 0; (i < nbuckets) && (ret); i++) {
+        size_t b = order[i];
+
+        const uint32_t* bkeys = keys + starts[b];
+        size_t size = starts[b + 1] - starts[b];
+
+        // The remaining buckets are empty.
+        if (size == 0) {
+          break;
+        }
+
+        // Strings with the same hash would always share a slot.
+        for (size_t j = 1; (j < size) && (ret); j++) {
+          for (size_t k = 0; k < j; k++) {
+            if (hashes[bkeys[j]] == hashes[bkeys[k]]) {
+              ret = false;
+              break;
+            }
+          }
+        }
+
+        // Search for the first pilot which sends the strings of the bucket
+        // to different free slots.
+        size_t s[MAX_BUCKET_SIZE];
+        uint64_t pilot;
+        for (pilot = 0; (pilot < max_pilot) && (ret); pilot++) {
+          size_t j;
+          for (j = 0; j < size; j++) {
+            s[j] = slot(hashes[bkeys[j]], static_cast<uint32_t>(pilot), count);
+
+            if ((taken[s[j] / 64] & (1ull << (s[j] % 64))) != 0) {
+              break;
+            }
+
+            bool shared = false;
+            for (size_t k = 0; k < j; k++) {
+              if (s[k] == s[j]) {
+                shared = true;
+                break;
+              }
+            }
+
+            if (shared) {
+              break;
+            }
+          }
+
+          if (j == size) {
+            break;
+          }
+        }
+
+        if (pilot == max_pilot) {
+          ret = false;
+        }
+
+        if (ret) {
+          pilots[b] = static_cast<uint32_t>(pilot);
+
+          for (size_t j = 0; j < size; j++) {
+            taken[s[j] / 64] |= (1ull << (s[j] % 64));
+            slots[s[j]] = bkeys[j];
+          }
+        }
+      }
+    }
+  }
+
+  free(taken);
+  free(order);
+  free(keys);
+  free(starts);
+
+  return ret;
+}
+
+template<typename _CharT>
+inline void perfect_hash<_CharT>::clear()
+{
+  if (!_M_mapped) {
+    if (_M_pilots) {
+      free(_M_pilots);
+    }
+
+    if (_M_slots) {
+      free(_M_slots);
+    }
+  }
+
+  _M_pilots = nullptr;
+  _M_nbuckets = 0;
+  _M_slots = nullptr;
+  _M_count = 0;
+  _M_seed = 0;
+  _M_mapped = false;
+}
+
+template<typename _CharT>
+inline size_t perfect_hash<_CharT>::buckets(size_t count)
+{
+  return (count + BUCKET_SIZE - 1) / BUCKET_SIZE;
+}
+
+template<typename _CharT>
+inline uint64_t perfect_hash<_CharT>::hash(const char_type* s,
+                                           size_t len,
+                                           uint64_t seed)
+{
+  static const uint64_t prime = 0x9e3779b97f4a7c15ull;
+
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(s);
+  len *= sizeof(char_type);
+
+  uint64_t h = seed ^ (len * prime);
+
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, ptr, sizeof(uint64_t));
+
+    h = (h ^ w) * prime;
+    h ^= h >> 29;
+
+    ptr += sizeof(uint64_t);
+  }
+
+  for (; len > 0; len--) {
+    h = (h ^ *ptr++) * prime;
+  }
+
+  // Every bit depends on every byte.
+  h ^= h >> 32;
+  h *= 0xd6e8feb86659fd93ull;
+  h ^= h >> 32;
+
+  return h;
+}
+
+template<typename _CharT>
+inline size_t perfect_hash<_CharT>::bucket(uint64_t h, size_t nbuckets)
+{
+  // Low 32 bits of the hash scaled to [0, nbuckets).
+  return static_cast<size_t>(((h & 0xffffffffull) * nbuckets) >> 32);
+}
+
+template<typename _CharT>
+inline size_t perfect_hash<_CharT>::slot(uint64_t h,
+                                         uint32_t pilot,
+                                         size_t count)
+{
+  uint64_t x = h ^ (pilot * 0xbf58476d1ce4e5b9ull);
+  x ^= x >> 31;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 32;
+
+  // High 32 bits scaled to [0, count).
+  return static_cast<size_t>(((x >> 32) * count) >> 32);
+}
+
+#endif // PERFECT_HASH_H
@@ -0,0 +1,461 @@
+#include <string.h>
+#include "pkcs7.h"
+
+// 1.2.840.113549.1.7.2 (signedData).
+static const uint8_t OID_SIGNED_DATA[] = {
+  0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x07, 0x02
+};
+
+// 2.5.4.3 (commonName).
+static const uint8_t OID_COMMON_NAME[] = {0x55, 0x04, 0x03};
+
+// 2.5.4.11 (organizationalUnitName).
+static const uint8_t OID_ORGANIZATIONAL_UNIT_NAME[] = {0x55, 0x04, 0x0b};
+
+// 2.5.4.10 (organizationName).
+static const uint8_t OID_ORGANIZATION_NAME[] = {0x55, 0x04, 0x0a};
+
+// 1.2.840.113549.1.9.1 (emailAddress).
+static const uint8_t OID_EMAIL_ADDRESS[] = {
+  0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x09, 0x01
+};
+
+// Skip the leading bytes which don't change the value of an INTEGER (like
+// CertCompareIntegerBlob()).
+static void strip_integer(const uint8_t*& data, size_t& len)
+{
+  if (len > 0) {
+    uint8_t pad = data[0];
+    if ((pad == 0x00) || (pad == 0xff)) {
+      while ((len > 1) && (data[0] == pad)) {
+        data++;
+        len--;
+      }
+    }
+  }
+}
+
+// Append a character.
+static bool append(uint32_t c, wchar_t* buf, size_t size, size_t& len)
+{
+  if ((sizeof(wchar_t) == 2) && (c > 0xffff)) {
+    // Surrogate pair.
+    if (len + 2 >= size) {
+      return false;
+    }
+
+    c -= 0x10000;
+    buf[len++] = static_cast<wchar_t>(0xd800 + (c >> 10));
+    buf[len++] = static_cast<wchar_t>(0xdc00 + (c & 0x3ff));
+  } else {
+    if (len + 1 >= size) {
+      return false;
+    }
+
+    buf[len++] = static_cast<wchar_t>(c);
+  }
+
+  return true;
+}
+
+// Decode UTF-8.
+static bool decode_utf8(const uint8_t* data,
+                        size_t n,
+                        wchar_t* buf,
+                        size_t size,
+                        size_t& len)
+{
+  const uint8_t* end = data + n;
+
+  while (data < end) {
+    uint32_t c = *data++;
+    size_t extra;
+    uint32_t min;
+
+    if (c < 0x80) {
+      extra = 0;
+      min = 0;
+    } else if ((c & 0xe0) == 0xc0) {
+      c &= 0x1f;
+      extra = 1;
+      min = 0x80;
+    } else if ((c & 0xf0) == 0xe0) {
+      c &= 0x0f;
+      extra = 2;
+      min = 0x800;
+    } else if ((c & 0xf8) == 0xf0) {
+      c &= 0x07;
+      extra = 3;
+      min = 0x10000;
+    } else {
+      return false;
+    }
+
+    if (extra > static_cast<size_t>(end - data)) {
+      return false;
+    }
+
+    for (size_t i = 0; i < extra; i++) {
+      if ((*data & 0xc0) != 0x80) {
+        return false;
+      }
+
+      c = (c << 6) | (*data++ & 0x3f);
+    }
+
+    if ((c < min) || (c > 0x10ffff) || ((c >= 0xd800) && (c <= 0xdfff))) {
+      return false;
+    }
+
+    if (!append(c, buf, size, len)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool pkcs7::parse(const uint8_t* data, size_t len)
+{
+  _M_count = 0;
+
+  // ContentInfo ::= SEQUENCE {
+  //   contentType ContentType,
+  //   content [0] EXPLICIT SignedData
+  // }
+  der_reader reader(data, len);
+  der_element content_info;
+  if (!reader.next(der_reader::SEQUENCE, content_info)) {
+    return false;
+  }
+
+  der_reader content_info_reader(content_info);
+  der_element content_type;
+  der_element content;
+  if ((!content_info_reader.next(der_reader::OID, content_type)) ||
+      (content_type.len != sizeof(OID_SIGNED_DATA)) ||
+      (memcmp(content_type.data,
+              OID_SIGNED_DATA,
+              sizeof(OID_SIGNED_DATA)) != 0) ||
+      (!content_info_reader.next(der_reader::CONTEXT_0, content))) {
+    return false;
+  }
+
+  // SignedData ::= SEQUENCE {
+  //   version CMSVersion,
+  //   digestAlgorithms DigestAlgorithmIdentifiers,
+  //   encapContentInfo EncapsulatedContentInfo,
+  //   certificates [0] IMPLICIT CertificateSet OPTIONAL,
+  //   crls [1] IMPLICIT RevocationInfoChoices OPTIONAL,
+  //   signerInfos SignerInfos
+  // }
+  der_reader content_reader(content);
+  der_element signed_data;
+  if (!content_reader.next(der_reader::SEQUENCE, signed_data)) {
+    return false;
+  }
+
+  der_reader signed_data_reader(signed_data);
+  der_element element;
+  if ((!signed_data_reader.next(der_reader::INTEGER, element)) ||
+      (!signed_data_reader.next(der_reader::SET, element)) ||
+      (!signed_data_reader.next(der_reader::SEQUENCE, element))) {
+    return false;
+  }
+
+  if (signed_data_reader.peek() == der_reader::CONTEXT_0) {
+    if (!signed_data_reader.next(_M_certificates)) {
+      return false;
+    }
+  } else {
+    _M_certificates.len = 0;
+  }
+
+  if ((signed_data_reader.peek() == der_reader::CONTEXT_1) &&
+      (!signed_data_reader.next(element))) {
+    return false;
+  }
+
+  if (!signed_data_reader.next(der_reader::SET, _M_signer_infos)) {
+    return false;
+  }
+
+  // Count signers.
+  der_reader signer_infos_reader(_M_signer_infos);
+  while (signer_infos_reader.more()) {
+    if (!signer_infos_reader.next(der_reader::SEQUENCE, element)) {
+      return false;
+    }
+
+    _M_count++;
+  }
+
+  return true;
+}
+
+bool pkcs7::get(size_t idx, signer& signer) const
+{
+  return ((identity(idx, signer)) &&
+          (find_certificate(signer.issuer, signer.serial, signer.subject)));
+}
+
+bool pkcs7::identity(size_t idx, signer& signer) const
+{
+  if (idx >= _M_count) {
+    return false;
+  }
+
+  // Skip the previous signers.
+  der_reader signer_infos_reader(_M_signer_infos);
+  der_element signer_info;
+  for (size_t i = 0; i <= idx; i++) {
+    if (!signer_infos_reader.next(signer_info)) {
+      return false;
+    }
+  }
+
+  // SignerInfo ::= SEQUENCE {
+  //   version CMSVersion,
+  //   sid SignerIdentifier,
+  //   ...
+  // }
+  //
+  // IssuerAndSerialNumber ::= SEQUENCE {
+  //   issuer Name,
+  //   serialNumber CertificateSerialNumber
+  // }
+  der_reader signer_info_reader(signer_info);
+  der_element element;
+  der_element sid;
+  if ((!signer_info_reader.next(der_reader::INTEGER, element)) ||
+      (!signer_info_reader.next(der_reader::SEQUENCE, sid))) {
+    return false;
+  }
+
+  der_reader sid_reader(sid);
+  return ((sid_reader.next(der_reader::SEQUENCE, signer.issuer)) &&
+          (sid_reader.next(der_reader::INTEGER, signer.serial)));
+}
+
+bool pkcs7::name(const der_element& name,
+                 wchar_t* buf,
+                 size_t size,
+                 size_t& len)
+{
+  der_element value;
+  if ((find_attribute(name,
+                      OID_COMMON_NAME,
+                      sizeof(OID_COMMON_NAME),
+                      value)) ||
+      (find_attribute(name,
+                      OID_ORGANIZATIONAL_UNIT_NAME,
+                      sizeof(OID_ORGANIZATIONAL_UNIT_NAME),
+                      value)) ||
+      (find_attribute(name,
+                      OID_ORGANIZATION_NAME,
+                      sizeof(OID_ORGANIZATION_NAME),
+                      value)) ||
+      (find_attribute(name,
+                      OID_EMAIL_ADDRESS,
+                      sizeof(OID_EMAIL_ADDRESS),
+                      value)) ||
+      (find_attribute(name, nullptr, 0, value))) {
+    return decode(value, buf, size, len);
+  }
+
+  return false;
+}
+
+bool pkcs7::find_certificate(const der_element& issuer,
+                             const der_element& serial,
+                             der_element& subject) const
+{
+  const uint8_t* serialdata = serial.data;
+  size_t seriallen = serial.len;
+  strip_integer(serialdata, seriallen);
+
+  // Certificate ::= SEQUENCE {
+  //   tbsCertificate TBSCertificate,
+  //   ...
+  // }
+  //
+  // TBSCertificate ::= SEQUENCE {
+  //   version [0] EXPLICIT Version DEFAULT v1,
+  //   serialNumber CertificateSerialNumber,
+  //   signature AlgorithmIdentifier,
+  //   issuer Name,
+  //   validity Validity,
+  //   subject Name,
+  //   ...
+  // }
+  der_reader certificates_reader(_M_certificates);
+  while (certificates_reader.more()) {
+    der_element certificate;
+    if (!certificates_reader.next(certificate)) {
+      return false;
+    }
+
+    // Skip other kinds of certificates.
+    if (certificate.tag != der_reader::SEQUENCE) {
+      continue;
+    }
+
+    der_reader certificate_reader(certificate);
+    der_element tbs;
+    if (!certificate_reader.next(der_reader::SEQUENCE, tbs)) {
+      return false;
+    }
+
+    der_reader tbs_reader(tbs);
+    der_element element;
+    if ((tbs_reader.peek() == der_reader::CONTEXT_0) &&
+        (!tbs_reader.next(element))) {
+      return false;
+    }
+
+    der_element certserial;
+    der_element certissuer;
+    if ((!tbs_reader.next(der_reader::INTEGER, certserial)) ||
+        (!tbs_reader.next(der_reader::SEQUENCE, element)) ||
+        (!tbs_reader.next(der_reader::SEQUENCE, certissuer))) {
+      return false;
+    }
+
+    const uint8_t* certserialdata = certserial.data;
+    size_t certseriallen = certserial.len;
+    strip_integer(certserialdata, certseriallen);
+
+    if ((certseriallen == seriallen) &&
+        (memcmp(certserialdata, serialdata, seriallen) == 0) &&
+        (certissuer.encodinglen == issuer.encodinglen) &&
+        (memcmp(certissuer.encoding,
+                issuer.encoding,
+                issuer.encodinglen) == 0)) {
+      return ((tbs_reader.next(der_reader::SEQUENCE, element)) &&
+              (tbs_reader.next(der_reader::SEQUENCE, subject)));
+    }
+  }
+
+  return false;
+}
+
+bool pkcs7::find_attribute(const der_element& name,
+                           const uint8_t* oid,
+                           size_t oidlen,
+                           der_element& value)
+{
+  // Name ::= SEQUENCE OF RelativeDistinguishedName
+  // RelativeDistinguishedName ::= SET OF AttributeTypeAndValue
+  // AttributeTypeAndValue ::= SEQUENCE {
+  //   type AttributeType,
+  //   value AttributeValue
+  // }
+  der_reader name_reader(name);
+  while (name_reader.more()) {
+    der_element rdn;
+    if (!name_reader.next(der_reader::SET, rdn)) {
+      return false;
+    }
+
+    der_reader rdn_reader(rdn);
+    while (rdn_reader.more()) {
+      der_element attribute;
+      if (!rdn_reader.next(der_reader::SEQUENCE, attribute)) {
+        return false;
+      }
+
+      der_reader attribute_reader(attribute);
+      der_element type;
+      if ((!attribute_reader.next(der_reader::OID, type)) ||
+          (!attribute_reader.next(value))) {
+        return false;
+      }
+
+      // No OID: first attribute.
+      if ((!oid) ||
+          ((type.len == oidlen) && (memcmp(type.data, oid, oidlen) == 0))) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+bool pkcs7::decode(const der_element& value,
+                   wchar_t* buf,
+                   size_t size,
+                   size_t& len)
+{
+  len = 0;
+
+  if (size == 0) {
+    return false;
+  }
+
+  switch (value.tag) {
+    case der_reader::UTF8_STRING:
+      if (!decode_utf8(value.data, value.len, buf, size, len)) {
+        return false;
+      }
+
+      break;
+    case der_reader::T61_STRING:
+      // Usually UTF-8 in practice, else Latin-1.
+      if (decode_utf8(value.data, value.len, buf, size, len)) {
+        break;
+      }
+
+      len = 0;
+
+      // Fall through.
+    case der_reader::PRINTABLE_STRING:
+    case der_reader::IA5_STRING:
+    case der_reader::VISIBLE_STRING:
+      for (size_t i = 0; i < value.len; i++) {
+        if (!append(value.data[i], buf, size, len)) {
+          return false;
+        }
+      }
+
+      break;
+    case der_reader::BMP_STRING:
+      if ((value.len % 2) != 0) {
+        return false;
+      }
+
+      for (size_t i = 0; i < value.len; i += 2) {
+        uint32_t c = (static_cast<uint32_t>(value.data[i]) << 8) |
+                     value.data[i + 1];
+
+        if (!append(c, buf, size, len)) {
+          return false;
+        }
+      }
+
+      break;
+    case der_reader::UNIVERSAL_STRING:
+      if ((value.len % 4) != 0) {
+        return false;
+      }
+
+      for (size_t i = 0; i < value.len; i += 4) {
+        uint32_t c = (static_cast<uint32_t>(value.data[i]) << 24) |
+                     (static_cast<uint32_t>(value.data[i + 1]) << 16) |
+                     (static_cast<uint32_t>(value.data[i + 2]) << 8) |
+                     value.data[i + 3];
+
+        if ((c > 0x10ffff) || (!append(c, buf, size, len))) {
+          return false;
+        }
+      }
+
+      break;
+    default:
+      return false;
+  }
+
+  buf[len] = 0;
+
+  return true;
+}
@@ -0,0 +1,87 @@
+#ifndef PKCS7_H
+#define PKCS7_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "der.h"
+
+// Signers of a PKCS#7 SignedData (the Authenticode signature of a PE image),
+// parsed in place: nothing is copied or allocated.
+class pkcs7 {
+  public:
+    // Signer.
+    struct signer {
+      // Issuer (encoded Name) and serial number (contents of the INTEGER)
+      // of the certificate.
+      der_element issuer;
+      der_element serial;
+
+      // Subject of the certificate (encoded Name).
+      der_element subject;
+    };
+
+    // Constructor.
+    pkcs7();
+
+    // Parse.
+    bool parse(const uint8_t* data, size_t len);
+
+    // Get number of signers.
+    size_t count() const;
+
+    // Get signer (fails if its certificate is not in the signature).
+    bool get(size_t idx, signer& signer) const;
+
+    // Get the issuer and the serial number of the signer's certificate
+    // (without looking for the certificate: the subject is not set).
+    bool identity(size_t idx, signer& signer) const;
+
+    // Get the display name of a Name, like CertGetNameStringW() with
+    // CERT_NAME_SIMPLE_DISPLAY_TYPE: the first common name, organizational
+    // unit, organization or e-mail address, else the first attribute.
+    // `size` includes the terminating '\0'.
+    static bool name(const der_element& name,
+                     wchar_t* buf,
+                     size_t size,
+                     size_t& len);
+
+  private:
+    // SET OF Certificate.
+    der_element _M_certificates;
+
+    // SET OF SignerInfo.
+    der_element _M_signer_infos;
+
+    size_t _M_count;
+
+    // Find the certificate by issuer and serial number and get its subject.
+    bool find_certificate(const der_element& issuer,
+                          const der_element& serial,
+                          der_element& subject) const;
+
+    // Find attribute in a Name.
+    static bool find_attribute(const der_element& name,
+                               const uint8_t* oid,
+                               size_t oidlen,
+                               der_element& value);
+
+    // Decode string (to UTF-16 or UTF-32, depending on wchar_t).
+    static bool decode(const der_element& value,
+                       wchar_t* buf,
+                       size_t size,
+                       size_t& len);
+};
+
+inline pkcs7::pkcs7()
+  : _M_count(0)
+{
+  _M_certificates.len = 0;
+  _M_signer_infos.len = 0;
+}
+
+inline size_t pkcs7::count() const
+{
+  return _M_count;
+}
+
+#endif // PKCS7_H
@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <new>
+#include <thread>
+#include "policy.h"
+#include "policy_image.h"
+#include "event_trace.h"
+#include <tchar.h>
+
+std::atomic<uint32_t> policy::_M_next_generation(0);
+
+bool policy::load(const TCHAR* signers,
+                  const TCHAR* hashes,
+                  const TCHAR* paths)
+{
+  // Load the files concurrently (each one into its own lists): the signers
+  // and the hashes on their own threads, the paths on this one.
+  bool signers_loaded = true;
+  bool hashes_loaded = true;
+
+  std::thread signers_thread;
+  if (signers) {
+    try {
+      signers_thread = std::thread([&]() {
+                                     signers_loaded = load_signers(signers);
+                                   });
+    } catch (...) {
+      signers_loaded = load_signers(signers);
+    }
+  }
+
+  std::thread hashes_thread;
+  if (hashes) {
+    try {
+      hashes_thread = std::thread([&]() {
+                                    hashes_loaded = load_hashes(hashes);
+                                  });
+    } catch (...) {
+      hashes_loaded = load_hashes(hashes);
+    }
+  }
+
+  bool paths_loaded = ((!paths) || (load_paths(paths)));
+
+  if (signers_thread.joinable()) {
+    signers_thread.join();
+  }
+
+  if (hashes_thread.joinable()) {
+    hashes_thread.join();
+  }
+
+  return ((signers_loaded) && (hashes_loaded) && (paths_loaded));
+}
+
+bool policy::load(const TCHAR* filename)
+{
+  EVENT_TRACE_SCOPE(event_load_policy);
+
+  // Map file.
+  if (_M_file.open(filename)) {
+    // If the image is valid...
+    const policy_image::header* hdr;
+    if ((hdr = policy_image::validate(_M_file.data(),
+                                      _M_file.size())) != nullptr) {
+      image_reader reader(_M_file.data(), _M_file.size());
+
+      if ((_M_signers.attach(reader, hdr->signers)) &&
+          (_M_signer_index.attach(_M_signers, reader, hdr->signer_index)) &&
+          (_M_sha1_hashes.attach(reader, hdr->sha1_hashes)) &&
+          (_M_sha256_hashes.attach(reader, hdr->sha256_hashes)) &&
+          (_M_paths.attach(reader, hdr->paths))) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+uint64_t policy::fingerprint() const
+{
+  // If the policy is compiled, its checksum has already been computed.
+  if (_M_file.data()) {
+    return static_cast<const policy_image::header*>(_M_file.data())->checksum;
+  }
+
+  // Build image (as compile() does).
+  image_writer writer;
+  policy_image::header hdr;
+  if ((!policy_image::begin(writer)) ||
+      (!_M_signers.save(writer, hdr.signers)) ||
+      (!_M_signer_index.save(writer, hdr.signer_index)) ||
+      (!_M_sha1_hashes.save(writer, hdr.sha1_hashes)) ||
+      (!_M_sha256_hashes.save(writer, hdr.sha256_hashes)) ||
+      (!_M_paths.save(writer, hdr.paths))) {
+    return 0;
+  }
+
+  policy_image::end(writer, hdr);
+
+  return hdr.checksum;
+}
+
+bool policy::compile(const TCHAR* filename) const
+{
+  // Build image.
+  image_writer writer;
+  policy_image::header hdr;
+  if ((!policy_image::begin(writer)) ||
+      (!_M_signers.save(writer, hdr.signers)) ||
+      (!_M_signer_index.save(writer, hdr.signer_index)) ||
+      (!_M_sha1_hashes.save(writer, hdr.sha1_hashes)) ||
+      (!_M_sha256_hashes.save(writer, hdr.sha256_hashes)) ||
+      (!_M_paths.save(writer, hdr.paths))) {
+    return false;
+  }
+
+  policy_image::end(writer, hdr);
+
+  // Write to a temporary file and rename it, so a process mapping the
+  // policy never sees a half-written file.
+  TCHAR tmpfilename[MAX_PATH];
+  TCHAR oldfilename[MAX_PATH];
+  if ((_sntprintf_s(tmpfilename,
+                    _countof(tmpfilename),
+                    _TRUNCATE,
+                    _T("%s.tmp"),
+                    filename) < 0) ||
+      (_sntprintf_s(oldfilename,
+                    _countof(oldfilename),
+                    _TRUNCATE,
+                    _T("%s.old"),
+                    filename) < 0)) {
+    return false;
+  }
+
+  FILE* file;
+  if (_tfopen_s(&file, tmpfilename, _T("wb")) == 0) {
+    bool ret = (fwrite(writer.buffer(), 1, writer.length(), file) ==
+                writer.length());
+
+    if ((fclose(file) == 0) && (ret)) {
+      if (MoveFileEx(tmpfilename, filename, MOVEFILE_REPLACE_EXISTING)) {
+        return true;
+      }
+
+      // A file which is mapped (e.g. by a running client) cannot be
+      // replaced, but it can be renamed.
+      DeleteFile(oldfilename);
+
+      if ((MoveFile(filename, oldfilename)) &&
+          (MoveFile(tmpfilename, filename))) {
+        return true;
+      }
+    }
+
+    _tremove(tmpfilename);
+  }
+
+  return false;
+}
+
+const TCHAR* policy::describe(reason reason)
+{
+  switch (reason) {
+    case reason::open:
+      return _T("the file cannot be opened");
+    case reason::line_too_long:
+      return _T("the line is too long");
+    case reason::invalid_hash:
+      return _T("invalid hash");
+    case reason::path_not_found:
+      return _T("the path doesn't exist");
+    case reason::not_file_or_directory:
+      return _T("the path is neither a file nor a directory");
+    case reason::no_memory:
+      return _T("out of memory");
+  }
+
+  return _T("unknown error");
+}
+
+bool policy::load_signers(const TCHAR* filename)
+{
+  EVENT_TRACE_SCOPE(event_load_signers);
+
+  text_file file;
+  if (!file.open(filename)) {
+    add_error(file::signers, 0, reason::open);
+    return false;
+  }
+
+  // Parse the chunks into their own lists.
+  text_file::chunk chunks[text_file::MAX_CHUNKS];
+  size_t nchunks = file.split(chunks, MIN_CHUNK_SIZE);
+
+  string_list<wchar_t>* lists;
+  chunk_result* results;
+  if ((lists = new (std::nothrow) string_list<wchar_t>[nchunks + 1]) ==
+      nullptr) {
+    add_error(file::signers, 0, reason::no_memory);
+    return false;
+  }
+
+  if ((results = new (std::nothrow) chunk_result[nchunks + 1]) == nullptr) {
+    delete [] lists;
+    add_error(file::signers, 0, reason::no_memory);
+    return false;
+  }
+
+  text_file::parallel(nchunks, [&](size_t i) {
+                                 parse_signers(chunks[i],
+                                               lists[i],
+                                               results[i]);
+                               });
+
+  // Append the lists in order.
+  bool ret = add_errors(results, nchunks);
+  for (size_t i = 0; (i < nchunks) && (ret); i++) {
+    for (size_t j = 0; j < lists[i].count(); j++) {
+      size_t len;
+      const wchar_t* signer = lists[i].get(j, len);
+
+      if (!_M_signers.append(signer, len)) {
+        add_error(file::signers, 0, reason::no_memory);
+        ret = false;
+        break;
+      }
+    }
+  }
+
+  delete [] results;
+  delete [] lists;
+
+  // Sort, remove duplicates, compact and index.
+  return ((ret) &&
+          (_M_signers.build()) &&
+          (_M_signer_index.build(_M_signers)));
+}
+
+bool policy::load_hashes(const TCHAR* filename)
+{
+  EVENT_TRACE_SCOPE(event_load_hashes);
+
+  text_file file;
+  if (!file.open(filename)) {
+    add_error(file::hashes, 0, reason::open);
+    return false;
+  }
+
+  // Parse the chunks into their own sets.
+  text_file::chunk chunks[text_file::MAX_CHUNKS];
+  size_t nchunks = file.split(chunks, MIN_CHUNK_SIZE);
+
+  digest_set<authenticode::SHA1_LEN>* sha1_sets;
+  digest_set<authenticode::SHA256_LEN>* sha256_sets;
+  chunk_result* results;
+  if ((sha1_sets = new (std::nothrow)
+                     digest_set<authenticode::SHA1_LEN>[nchunks + 1]) ==
+      nullptr) {
+    add_error(file::hashes, 0, reason::no_memory);
+    return false;
+  }
+
+  if ((sha256_sets = new (std::nothrow)
+                       digest_set<authenticode::SHA256_LEN>[nchunks + 1]) ==
+      nullptr) {
+    delete [] sha1_sets;
+    add_error(file::hashes, 0, reason::no_memory);
+    return false;
+  }
+
+  if ((results = new (std::nothrow) chunk_result[nchunks + 1]) == nullptr) {
+    delete [] sha256_sets;
+    delete [] sha1_sets;
+    add_error(file::hashes, 0, reason::no_memory);
+    return false;
+  }
+
+  text_file::parallel(nchunks, [&](size_t i) {
+                                 parse_hashes(chunks[i],
+                                              sha1_sets[i],
+                                              sha256_sets[i],
+                                              results[i]);
+                               });
+
+  // Append the sets in order.
+  bool ret = add_errors(results, nchunks);
+  for (size_t i = 0; (i < nchunks) && (ret); i++) {
+    if ((!_M_sha1_hashes.append(sha1_sets[i])) ||
+        (!_M_sha256_hashes.append(sha256_sets[i]))) {
+      add_error(file::hashes, 0, reason::no_memory);
+      ret = false;
+    }
+  }
+
+  delete [] results;
+  delete [] sha256_sets;
+  delete [] sha1_sets;
+
+  // Insert the hashes (duplicates are skipped).
+  return ((ret) && (_M_sha1_hashes.build()) && (_M_sha256_hashes.build()));
+}
+
+bool policy::load_paths(const TCHAR* filename)
+{
+  EVENT_TRACE_SCOPE(event_load_paths);
+
+  text_file file;
+  if (!file.open(filename)) {
+    add_error(file::paths, 0, reason::open);
+    return false;
+  }
+
+  // Parse and check the paths of the chunks (the checks are the slow part,
+  // e.g. on network shares, so the chunks are smaller).
+  text_file::chunk chunks[text_file::MAX_CHUNKS];
+  size_t nchunks = file.split(chunks, MIN_PATHS_CHUNK_SIZE);
+
+  string_list<wchar_t>* files;
+  string_list<wchar_t>* directories;
+  chunk_result* results;
+  if ((files = new (std::nothrow) string_list<wchar_t>[nchunks + 1]) ==
+      nullptr) {
+    add_error(file::paths, 0, reason::no_memory);
+    return false;
+  }
+
+  if ((directories = new (std::nothrow) string_list<wchar_t>[nchunks + 1]) ==
+      nullptr) {
+    delete [] files;
+    add_error(file::paths, 0, reason::no_memory);
+    return false;
+  }
+
+  if ((results = new (std::nothrow) chunk_result[nchunks + 1]) == nullptr) {
+    delete [] directories;
+    delete [] files;
+    add_error(file::paths, 0, reason::no_memory);
+    return false;
+  }
+
+  text_file::parallel(nchunks, [&](size_t i) {
+                                 parse_paths(chunks[i],
+                                             files[i],
+                                             directories[i],
+                                             results[i]);
+                               });
+
+  // Insert the paths in the trie.
+  bool ret = add_errors(results, nchunks);
+  for (size_t i = 0; (i < nchunks) && (ret); i++) {
+    for (size_t j = 0; (j < files[i].count()) && (ret); j++) {
+      size_t len;
+      const wchar_t* path = files[i].get(j, len);
+      ret = _M_paths.append(path, len, false);
+    }
+
+    for (size_t j = 0; (j < directories[i].count()) && (ret); j++) {
+      size_t len;
+      const wchar_t* path = directories[i].get(j, len);
+      ret = _M_paths.append(path, len, true);
+    }
+
+    if (!ret) {
+      add_error(file::paths, 0, reason::no_memory);
+    }
+  }
+
+  delete [] results;
+  delete [] directories;
+  delete [] files;
+
+  return ((ret) && (_M_paths.build()));
+}
+
+void policy::parse_signers(const text_file::chunk& chunk,
+                           string_list<wchar_t>& signers,
+                           chunk_result& result)
+{
+  result.nlines = 0;
+  result.nerrors = 0;
+
+  wchar_t signer[SIGNER_MAX_LEN];
+
+  // For each line...
+  const char* ptr = chunk.begin;
+  const char* line;
+  size_t len;
+  while (text_file::next_line(ptr, chunk.end, line, len)) {
+    result.nlines++;
+
+    // Skip initial blanks (if any).
+    while ((len > 0) && ((*line == ' ') || (*line == '\t'))) {
+      line++;
+      len--;
+    }
+
+    // Skip comments and empty lines.
+    if ((len == 0) || (*line == '#')) {
+      continue;
+    }
+
+    // Skip trailing blanks.
+    while ((len > 0) && (static_cast<unsigned char>(line[len - 1]) <= ' ')) {
+      len--;
+    }
+
+    // A UTF-8 signer has at least as many bytes as characters.
+    if (len > SIGNER_MAX_LEN) {
+      result.error(file::signers, reason::line_too_long);
+    } else if (!signers.append(signer, text_file::decode(line, len, signer))) {
+      result.error(file::signers, reason::no_memory);
+      return;
+    }
+  }
+}
+
+// Value of a hexadecimal digit (-1: not a hexadecimal digit).
+static inline int hex_digit(char c)
+{
+  if ((c >= '0') && (c <= '9')) {
+    return c - '0';
+  } else if ((c >= 'a') && (c <= 'f')) {
+    return c - 'a' + 10;
+  } else if ((c >= 'A') && (c <= 'F')) {
+    return c - 'A' + 10;
+  }
+
+  return -1;
+}
+
+void policy::parse_hashes(const text_file::chunk& chunk,
+                          digest_set<authenticode::SHA1_LEN>& sha1_hashes,
+                          digest_set<authenticode::SHA256_LEN>& sha256_hashes,
+                          chunk_result& result)
+{
+  result.nlines = 0;
+  result.nerrors = 0;
+
+  // For each line...
+  const char* ptr = chunk.begin;
+  const char* line;
+  size_t len;
+  while (text_file::next_line(ptr, chunk.end, line, len)) {
+    result.nlines++;
+
+    // Skip comments.
+    if ((len > 0) && (*line == '#')) {
+      continue;
+    }
+
+    BYTE hash[HASH_MAX_LEN];
+    size_t ndigits = 0;
+    bool valid = true;
+
+    while ((ndigits < len) &&
+           (ndigits < 2 * HASH_MAX_LEN) &&
+           (line[ndigits] > ' ')) {
+      int digit;
+      if ((digit = hex_digit(line[ndigits])) < 0) {
+        valid = false;
+        break;
+      }
+
+      if ((ndigits % 2) == 0) {
+        hash[ndigits / 2] = static_cast<BYTE>(digit << 4);
+      } else {
+        hash[ndigits / 2] |= static_cast<BYTE>(digit);
+      }
+
+      ndigits++;
+    }
+
+    // Skip lines which don't start with a hash.
+    if ((valid) && (ndigits == 0)) {
+      continue;
+    }
+
+    // The hash must be the whole line.
+    if ((!valid) || (ndigits < len)) {
+      result.error(file::hashes, reason::invalid_hash);
+    } else if (ndigits == 2 * authenticode::SHA1_LEN) {
+      if (!sha1_hashes.append(hash)) {
+        result.error(file::hashes, reason::no_memory);
+        return;
+      }
+    } else if (ndigits == 2 * authenticode::SHA256_LEN) {
+      if (!sha256_hashes.append(hash)) {
+        result.error(file::hashes, reason::no_memory);
+        return;
+      }
+    } else {
+      result.error(file::hashes, reason::invalid_hash);
+    }
+  }
+}
+
+void policy::parse_paths(const text_file::chunk& chunk,
+                         string_list<wchar_t>& files,
+                         string_list<wchar_t>& directories,
+                         chunk_result& result)
+{
+  result.nlines = 0;
+  result.nerrors = 0;
+
+  wchar_t path[PATH_MAX_LEN + 1];
+
+  // For each line...
+  const char* ptr = chunk.begin;
+  const char* line;
+  size_t len;
+  while (text_file::next_line(ptr, chunk.end, line, len)) {
+    result.nlines++;
+
+    // Skip comments and empty lines.
+    if ((len == 0) || (*line == '#')) {
+      continue;
+    }
+
+    // A UTF-8 path has at least as many bytes as characters.
+    if (len > PATH_MAX_LEN) {
+      result.error(file::paths, reason::line_too_long);
+      continue;
+    }
+
+    size_t pathlen = text_file::decode(line, len, path);
+    path[pathlen] = 0;
+
+    // If the path doesn't exist or is neither a directory nor a regular
+    // file...
+    struct _stat sbuf;
+    if (_wstat(path, &sbuf) != 0) {
+      result.error(file::paths, reason::path_not_found);
+    } else if ((sbuf.st_mode & (_S_IFDIR | _S_IFREG)) == 0) {
+      result.error(file::paths, reason::not_file_or_directory);
+    } else if (!(((sbuf.st_mode & _S_IFDIR) != 0) ?
+                   directories.append(path, pathlen) :
+                   files.append(path, pathlen))) {
+      result.error(file::paths, reason::no_memory);
+      return;
+    }
+  }
+}
+
+void policy::add_error(file file, size_t line, reason reason)
+{
+  std::lock_guard<std::mutex> lock(_M_errors_mutex);
+
+  if (_M_nerrors < MAX_ERRORS) {
+    _M_errors[_M_nerrors].file = file;
+    _M_errors[_M_nerrors].line = line;
+    _M_errors[_M_nerrors].reason = reason;
+  }
+
+  _M_nerrors++;
+}
+
+bool policy::add_errors(const chunk_result* results, size_t nchunks)
+{
+  std::lock_guard<std::mutex> lock(_M_errors_mutex);
+
+  // Number of the line before the chunk.
+  size_t base = 0;
+
+  bool ret = true;
+  for (size_t i = 0; i < nchunks; i++) {
+    const chunk_result& result = results[i];
+
+    for (size_t j = 0; j < result.nerrors; j++) {
+      // Keep the error (if there is room), otherwise only count it.
+      if ((j < MAX_ERRORS) && (_M_nerrors < MAX_ERRORS)) {
+        _M_errors[_M_nerrors] = result.errors[j];
+        _M_errors[_M_nerrors].line += base;
+      }
+
+      _M_nerrors++;
+    }
+
+    if (result.nerrors > 0) {
+      ret = false;
+    }
+
+    base += result.nlines;
+  }
+
+  return ret;
+}
@@ -0,0 +1,289 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <windows.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "authenticode.h"
+#include "string_list.h"
+#include "perfect_hash.h"
+#include "digest_set.h"
+#include "path_list.h"
+#include "mapped_file.h"
+#include "text_file.h"
+
+// Lists of allowed signers, hashes and paths.
+// A policy is built once (from the text files or from a compiled policy)
+// and it is not modified afterwards, so it can be shared by all the threads.
+//
+// The text files are loaded concurrently, and a big file is split into
+// chunks of lines parsed by several threads. The paths are checked (do they
+// exist, are they files or directories?) by the threads parsing them.
+// Every line which cannot be loaded is reported (see error()).
+class policy {
+  public:
+    static const DWORD SIGNER_MAX_LEN = 4 * 1024;
+
+    // Maximum number of errors kept (the rest are only counted).
+    static const size_t MAX_ERRORS = 64;
+
+    // Text file of the policy.
+    enum class file {
+      signers,
+      hashes,
+      paths
+    };
+
+    // Why a line could not be loaded.
+    enum class reason {
+      open,
+      line_too_long,
+      invalid_hash,
+      path_not_found,
+      not_file_or_directory,
+      no_memory
+    };
+
+    // Line of a text file which could not be loaded (line 0: the whole
+    // file).
+    struct load_error {
+      policy::file file;
+      size_t line;
+      policy::reason reason;
+    };
+
+    // Constructor.
+    policy();
+
+    // Destructor.
+    ~policy();
+
+    // Load (nullptr: no file).
+    bool load(const TCHAR* signers,
+              const TCHAR* hashes,
+              const TCHAR* paths);
+
+    // Load compiled policy (the file is mapped and used in place).
+    bool load(const TCHAR* filename);
+
+    // Get number of errors of the text files (the first MAX_ERRORS are
+    // kept, in the order of the lines of each file).
+    size_t errors() const;
+
+    // Get error.
+    const load_error& error(size_t idx) const;
+
+    // Get description of a reason.
+    static const TCHAR* describe(reason reason);
+
+    // Compile policy (write the lists to a file).
+    bool compile(const TCHAR* filename) const;
+
+    // Is the signer allowed?
+    bool signer(const wchar_t* signer, size_t signerlen) const;
+
+    // Is the SHA-1 hash allowed?
+    bool sha1_hash(const BYTE* hash) const;
+
+    // Is the SHA-256 hash allowed?
+    bool sha256_hash(const BYTE* hash) const;
+
+    // Are there SHA-256 hashes?
+    bool sha256_hashes() const;
+
+    // Is the path allowed?
+    bool path(const wchar_t* path, size_t pathlen) const;
+
+    // Compile the fast path of the driver: the allowed paths (see
+    // fast_path.h), allocated with malloc().
+    bool fast_path(void*& blob, size_t& len) const;
+
+    // Generation (every policy gets a different one).
+    uint32_t generation() const;
+
+    // Fingerprint of the lists: the same lists have the same fingerprint,
+    // whether they are loaded from the text files or from a compiled policy
+    // (it is the checksum of the compiled policy).
+    uint64_t fingerprint() const;
+
+    // Memory usage of each list (bytes, allocated or mapped).
+    struct memory {
+      size_t signers;
+      size_t sha1_hashes;
+      size_t sha256_hashes;
+      size_t paths;
+    };
+
+    // Memory usage of the lists (bytes, allocated or mapped).
+    size_t memory_usage() const;
+
+    // Memory usage of each list.
+    void memory_usage(memory& memory) const;
+
+  private:
+    static const size_t HASH_MAX_LEN = authenticode::SHA256_LEN;
+    static const size_t PATH_MAX_LEN = 32 * 1024;
+
+    string_list<wchar_t> _M_signers;
+
+    // Index of the signers (one hash and one comparison per lookup).
+    perfect_hash<wchar_t> _M_signer_index;
+
+    digest_set<authenticode::SHA1_LEN> _M_sha1_hashes;
+    digest_set<authenticode::SHA256_LEN> _M_sha256_hashes;
+
+    path_list _M_paths;
+
+    // Compiled policy (if loaded).
+    mapped_file _M_file;
+
+    uint32_t _M_generation;
+
+    static std::atomic<uint32_t> _M_next_generation;
+
+    // Errors of the text files.
+    load_error _M_errors[MAX_ERRORS];
+    size_t _M_nerrors;
+    std::mutex _M_errors_mutex;
+
+    // Minimum size of a chunk of a text file (the paths are checked while
+    // they are parsed, their chunks are smaller).
+    static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+    static const size_t MIN_PATHS_CHUNK_SIZE = 4 * 1024;
+
+    // Result of the parsing of a chunk.
+    struct chunk_result {
+      // Number of lines.
+      size_t nlines;
+
+      // Errors (line numbers relative to the chunk).
+      load_error errors[MAX_ERRORS];
+      size_t nerrors;
+
+      // Add error.
+      void error(file file, reason reason);
+    };
+
+    // Load signers.
+    bool load_signers(const TCHAR* filename);
+
+    // Load hashes.
+    bool load_hashes(const TCHAR* filename);
+
+    // Load paths.
+    bool load_paths(const TCHAR* filename);
+
+    // Parse a chunk of the file of signers.
+    static void parse_signers(const text_file::chunk& chunk,
+                              string_list<wchar_t>& signers,
+                              chunk_result& result);
+
+    // Parse a chunk of the file of hashes.
+    static void parse_hashes(
+      const text_file::chunk& chunk,
+      digest_set<authenticode::SHA1_LEN>& sha1_hashes,
+      digest_set<authenticode::SHA256_LEN>& sha256_hashes,
+      chunk_result& result
+    );
+
+    // Parse a chunk of the file of paths (the files and the directories are
+    // kept apart).
+    static void parse_paths(const text_file::chunk& chunk,
+                            string_list<wchar_t>& files,
+                            string_list<wchar_t>& directories,
+                            chunk_result& result);
+
+    // Add error.
+    void add_error(file file, size_t line, reason reason);
+
+    // Add the errors of the chunks of a file (returns false if there were
+    // errors).
+    bool add_errors(const chunk_result* results, size_t nchunks);
+};
+
+inline policy::policy()
+  : _M_generation(++_M_next_generation),
+    _M_nerrors(0)
+{
+}
+
+inline policy::~policy()
+{
+}
+
+inline bool policy::signer(const wchar_t* signer, size_t signerlen) const
+{
+  return _M_signer_index.find(_M_signers, signer, signerlen);
+}
+
+inline bool policy::sha1_hash(const BYTE* hash) const
+{
+  return _M_sha1_hashes.find(hash);
+}
+
+inline bool policy::sha256_hash(const BYTE* hash) const
+{
+  return _M_sha256_hashes.find(hash);
+}
+
+inline bool policy::sha256_hashes() const
+{
+  return (_M_sha256_hashes.count() > 0);
+}
+
+inline bool policy::path(const wchar_t* path, size_t pathlen) const
+{
+  return _M_paths.find(path, pathlen);
+}
+
+inline bool policy::fast_path(void*& blob, size_t& len) const
+{
+  return _M_paths.fast_path(blob, len);
+}
+
+inline size_t policy::errors() const
+{
+  return _M_nerrors;
+}
+
+inline const policy::load_error& policy::error(size_t idx) const
+{
+  return _M_errors[idx];
+}
+
+inline void policy::chunk_result::error(file file, reason reason)
+{
+  if (nerrors < MAX_ERRORS) {
+    errors[nerrors].file = file;
+    errors[nerrors].line = nlines;
+    errors[nerrors].reason = reason;
+  }
+
+  nerrors++;
+}
+
+inline uint32_t policy::generation() const
+{
+  return _M_generation;
+}
+
+inline size_t policy::memory_usage() const
+{
+  return _M_signers.memory_usage() +
+         _M_signer_index.memory_usage() +
+         _M_sha1_hashes.memory_usage() +
+         _M_sha256_hashes.memory_usage() +
+         _M_paths.memory_usage();
+}
+
+inline void policy::memory_usage(memory& memory) const
+{
+  memory.signers = _M_signers.memory_usage() +
+                   _M_signer_index.memory_usage();
+  memory.sha1_hashes = _M_sha1_hashes.memory_usage();
+  memory.sha256_hashes = _M_sha256_hashes.memory_usage();
+  memory.paths = _M_paths.memory_usage();
+}
+
+#endif // POLICY_H
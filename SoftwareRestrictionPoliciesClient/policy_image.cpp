@@ -0,0 +1,47 @@
+#include <string.h>
+#include "policy_image.h"
+
+const uint8_t policy_image::magic[8] = {'S', 'R', 'P', 'O', 'L', 'I', 'C', 'Y'};
+
+bool policy_image::begin(image_writer& writer)
+{
+  header hdr;
+  memset(&hdr, 0, sizeof(header));
+
+  image_block block;
+  return ((writer.length() == 0) &&
+          (writer.add(&hdr, sizeof(header), 64, block)));
+}
+
+void policy_image::end(image_writer& writer, header& hdr)
+{
+  memcpy(hdr.magic, magic, sizeof(magic));
+  hdr.version = version;
+  hdr.layout = layout();
+  hdr.size = writer.length();
+  hdr.checksum = image_checksum(writer.buffer() + sizeof(header),
+                                writer.length() - sizeof(header));
+
+  memcpy(writer.buffer(), &hdr, sizeof(header));
+}
+
+const policy_image::header* policy_image::validate(const void* data,
+                                                   size_t len)
+{
+  if (len >= sizeof(header)) {
+    const header* hdr = reinterpret_cast<const header*>(data);
+
+    if ((memcmp(hdr->magic, magic, sizeof(magic)) == 0) &&
+        (hdr->version == version) &&
+        (hdr->layout == layout()) &&
+        (hdr->size == len) &&
+        (hdr->checksum ==
+         image_checksum(reinterpret_cast<const uint8_t*>(data) +
+                        sizeof(header),
+                        len - sizeof(header)))) {
+      return hdr;
+    }
+  }
+
+  return nullptr;
+}
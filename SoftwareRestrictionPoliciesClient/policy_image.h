@@ -0,0 +1,63 @@
+#ifndef POLICY_IMAGE_H
+#define POLICY_IMAGE_H
+
+#include <stdint.h>
+#include "image.h"
+#include "string_list.h"
+#include "perfect_hash.h"
+#include "digest_set.h"
+#include "path_list.h"
+
+// Compiled policy: binary image of the lists of signers, hashes and paths,
+// already built, so it can be mapped and used in place.
+//
+// The image starts with a header and is followed by the blocks of the
+// lists, each one at its natural alignment. The image is only valid for the
+// architecture which wrote it (size of size_t and wchar_t).
+class policy_image {
+  public:
+    static const uint32_t version = 3;
+
+    struct header {
+      uint8_t magic[8];
+      uint32_t version;
+
+      // (sizeof(size_t) << 8) | sizeof(wchar_t).
+      uint32_t layout;
+
+      // Size of the image (including the header).
+      uint64_t size;
+
+      // Checksum of the image (excluding the header).
+      uint64_t checksum;
+
+      string_list<wchar_t>::image signers;
+      perfect_hash<wchar_t>::image signer_index;
+      digest_set<20>::image sha1_hashes;
+      digest_set<32>::image sha256_hashes;
+      path_list::image paths;
+    };
+
+    // Begin image (reserves the header).
+    static bool begin(image_writer& writer);
+
+    // End image (fills in and writes the header).
+    static void end(image_writer& writer, header& hdr);
+
+    // Validate image: returns the header or nullptr if the image is not
+    // valid.
+    static const header* validate(const void* data, size_t len);
+
+  private:
+    static const uint8_t magic[8];
+
+    // Layout of the current architecture.
+    static uint32_t layout();
+};
+
+inline uint32_t policy_image::layout()
+{
+  return static_cast<uint32_t>((sizeof(size_t) << 8) | sizeof(wchar_t));
+}
+
+#endif // POLICY_IMAGE_H
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <tchar.h>
+#include "policy_reloader.h"
+
+const TCHAR* const policy_reloader::event_name =
+  _T("Global\\SoftwareRestrictionPoliciesReload");
+
+// Get the directory of a file.
+static bool get_directory(const TCHAR* filename, TCHAR* directory, DWORD size)
+{
+  TCHAR* name;
+  DWORD len = GetFullPathName(filename, size, directory, &name);
+  if ((len > 0) && (len < size) && (name)) {
+    *name = 0;
+    return true;
+  }
+
+  return false;
+}
+
+bool policy_reloader::start(software_restriction_policies& policies,
+                            const TCHAR* const* filenames,
+                            size_t nfilenames)
+{
+  if (_M_nhandles != 0) {
+    return false;
+  }
+
+  _M_policies = &policies;
+
+  // Create stop event.
+  if ((_M_handles[0] = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL) {
+    return false;
+  }
+
+  _M_nhandles = 1;
+
+  // Create reload event.
+  if ((_M_handles[1] = CreateEvent(NULL, FALSE, FALSE, event_name)) == NULL) {
+    close();
+    return false;
+  }
+
+  _M_nhandles = 2;
+
+  // Watch files.
+  for (size_t i = 0; i < nfilenames; i++) {
+    if (filenames[i]) {
+      if ((_M_nfiles == MAX_FILES) || (!watch(filenames[i]))) {
+        close();
+        return false;
+      }
+
+      _M_files[_M_nfiles].filename = filenames[i];
+      _M_files[_M_nfiles].exists = false;
+      _M_nfiles++;
+    }
+  }
+
+  // Watch the catalog files (if they are indexed).
+  const wchar_t* catalog_directory;
+  if ((catalog_directory = policies.catalog_directory()) != nullptr) {
+    HANDLE h;
+    if ((h = FindFirstChangeNotificationW(catalog_directory,
+                                          FALSE,
+                                          FILE_NOTIFY_CHANGE_FILE_NAME |
+                                          FILE_NOTIFY_CHANGE_SIZE |
+                                          FILE_NOTIFY_CHANGE_LAST_WRITE)) ==
+        INVALID_HANDLE_VALUE) {
+      close();
+      return false;
+    }
+
+    _M_catalog_handle = _M_nhandles;
+    _M_handles[_M_nhandles++] = h;
+  }
+
+  // Save the current identities of the files.
+  changed();
+
+  try {
+    _M_thread = std::thread(&policy_reloader::run, this);
+    return true;
+  } catch (...) {
+    close();
+    return false;
+  }
+}
+
+void policy_reloader::stop()
+{
+  if (_M_nhandles != 0) {
+    if (_M_thread.joinable()) {
+      SetEvent(_M_handles[0]);
+      _M_thread.join();
+    }
+
+    close();
+  }
+}
+
+bool policy_reloader::watch(const TCHAR* filename)
+{
+  TCHAR directory[MAX_PATH];
+  if (!get_directory(filename, directory, _countof(directory))) {
+    return false;
+  }
+
+  // If the directory is already being watched...
+  for (size_t i = 0; i < _M_nfiles; i++) {
+    TCHAR dir[MAX_PATH];
+    if ((get_directory(_M_files[i].filename, dir, _countof(dir))) &&
+        (_tcsicmp(dir, directory) == 0)) {
+      return true;
+    }
+  }
+
+  HANDLE h;
+  if ((h = FindFirstChangeNotification(directory,
+                                       FALSE,
+                                       FILE_NOTIFY_CHANGE_FILE_NAME |
+                                       FILE_NOTIFY_CHANGE_SIZE |
+                                       FILE_NOTIFY_CHANGE_LAST_WRITE)) !=
+      INVALID_HANDLE_VALUE) {
+    _M_handles[_M_nhandles++] = h;
+    return true;
+  }
+
+  return false;
+}
+
+bool policy_reloader::changed()
+{
+  bool ret = false;
+
+  for (size_t i = 0; i < _M_nfiles; i++) {
+    file* f = _M_files + i;
+
+    file_identity id;
+    bool exists = _M_file_identity_probe.probe(f->filename,
+                                               _tcslen(f->filename),
+                                               id);
+
+    if ((exists != f->exists) || ((exists) && (id != f->id))) {
+      f->id = id;
+      f->exists = exists;
+
+      ret = true;
+    }
+  }
+
+  return ret;
+}
+
+void policy_reloader::reload()
+{
+  if (_M_policies->reload()) {
+    _tprintf(_T("Policy reloaded.\n"));
+  } else {
+    _ftprintf_p(stderr,
+                _T("Error reloading policy (the previous one is kept).\n"));
+  }
+}
+
+void policy_reloader::run()
+{
+  // Has a change been notified (policy files, catalog files)?
+  bool pending = false;
+  bool catalogs = false;
+
+  do {
+    DWORD ret = WaitForMultipleObjects(_M_nhandles,
+                                       _M_handles,
+                                       FALSE,
+                                       ((pending) || (catalogs)) ?
+                                         SETTLE_TIME :
+                                         INFINITE);
+
+    if (ret == WAIT_OBJECT_0) {
+      // Stop.
+      return;
+    } else if (ret == WAIT_OBJECT_0 + 1) {
+      // Reload on command.
+      changed();
+      reload();
+
+      pending = false;
+    } else if ((ret > WAIT_OBJECT_0 + 1) &&
+               (ret < WAIT_OBJECT_0 + _M_nhandles)) {
+      // A directory has changed, wait until the changes settle.
+      FindNextChangeNotification(_M_handles[ret - WAIT_OBJECT_0]);
+
+      if (ret - WAIT_OBJECT_0 == _M_catalog_handle) {
+        catalogs = true;
+      } else {
+        pending = true;
+      }
+    } else if (ret == WAIT_TIMEOUT) {
+      // Reload if one of the files has changed.
+      if ((pending) && (changed())) {
+        reload();
+      }
+
+      // Update the index if the catalog files have changed.
+      if ((catalogs) && (!_M_policies->update_catalog_index())) {
+        _ftprintf_p(stderr,
+                    _T("Error updating the index of the catalogs ")
+                    _T("(the previous one is kept).\n"));
+      }
+
+      pending = false;
+      catalogs = false;
+    } else {
+      _ftprintf_p(stderr, _T("Error waiting for policy changes.\n"));
+      return;
+    }
+  } while (true);
+}
+
+void policy_reloader::close()
+{
+  for (DWORD i = 0; i < _M_nhandles; i++) {
+    if (i < 2) {
+      CloseHandle(_M_handles[i]);
+    } else {
+      FindCloseChangeNotification(_M_handles[i]);
+    }
+  }
+
+  _M_nhandles = 0;
+  _M_nfiles = 0;
+  _M_catalog_handle = 0;
+}
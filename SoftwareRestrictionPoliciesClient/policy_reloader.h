@@ -0,0 +1,92 @@
+#ifndef POLICY_RELOADER_H
+#define POLICY_RELOADER_H
+
+#include <windows.h>
+#include <thread>
+#include "software_restriction_policies.h"
+#include "file_identity.h"
+
+// Background thread which reloads the policy when one of its files changes
+// or when the reload event is signaled (command `reload`), and updates the
+// index of the catalog files when one of them changes.
+// The new policy is built on this thread: the workers keep evaluating with
+// the current policy until the new one is published.
+class policy_reloader {
+  public:
+    // Name of the event which makes the client reload the policy.
+    static const TCHAR* const event_name;
+
+    // Constructor.
+    policy_reloader();
+
+    // Destructor.
+    ~policy_reloader();
+
+    // Start (nullptr file names are skipped).
+    bool start(software_restriction_policies& policies,
+               const TCHAR* const* filenames,
+               size_t nfilenames);
+
+    // Stop.
+    void stop();
+
+  private:
+    static const size_t MAX_FILES = 4;
+
+    // Time to wait after the last change before reloading (editors and
+    // copies write the files in several steps).
+    static const DWORD SETTLE_TIME = 500; // Milliseconds.
+
+    software_restriction_policies* _M_policies;
+
+    struct file {
+      const TCHAR* filename;
+      file_identity id;
+      bool exists;
+    };
+
+    file _M_files[MAX_FILES];
+    size_t _M_nfiles;
+
+    system_file_identity_probe _M_file_identity_probe;
+
+    // Stop event, reload event, one change notification per directory and
+    // the change notification of the catalog directory.
+    HANDLE _M_handles[2 + MAX_FILES + 1];
+    DWORD _M_nhandles;
+
+    // Index of the change notification of the catalog directory (0: none).
+    DWORD _M_catalog_handle;
+
+    std::thread _M_thread;
+
+    // Watch the directory of the file.
+    bool watch(const TCHAR* filename);
+
+    // Update the identities of the files: have they changed?
+    bool changed();
+
+    // Reload.
+    void reload();
+
+    // Thread.
+    void run();
+
+    // Close handles.
+    void close();
+};
+
+inline policy_reloader::policy_reloader()
+  : _M_policies(nullptr),
+    _M_nfiles(0),
+    _M_nhandles(0),
+    _M_catalog_handle(0)
+{
+}
+
+inline policy_reloader::~policy_reloader()
+{
+  stop();
+}
+
+#endif // POLICY_RELOADER_H
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <string.h>
+#include <tchar.h>
+#include "service_stats.h"
+
+const TCHAR* const service_stats::section_name =
+  _T("Global\\SoftwareRestrictionPoliciesStats");
+
+static const uint8_t magic[8] = {'S', 'R', 'P', 'S', 'T', 'A', 'T', 'S'};
+
+// Percentiles printed.
+static const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+
+bool service_stats::create()
+{
+  if (_M_section) {
+    return false;
+  }
+
+  // The section is zero-filled (a section left open by a reader is reused
+  // and cleared).
+  if (((_M_section = CreateFileMapping(INVALID_HANDLE_VALUE,
+                                       NULL,
+                                       PAGE_READWRITE,
+                                       0,
+                                       sizeof(data),
+                                       section_name)) == NULL) ||
+      (!map(FILE_MAP_READ | FILE_MAP_WRITE))) {
+    close();
+    return false;
+  }
+
+  memset(_M_data, 0, sizeof(data));
+
+  _M_data->version = VERSION;
+  _M_data->size = sizeof(data);
+  memcpy(_M_data->magic, magic, sizeof(magic));
+
+  return true;
+}
+
+bool service_stats::open()
+{
+  if (_M_section) {
+    return false;
+  }
+
+  // Write access: on 32-bit x86, the 64-bit atomic loads are locked
+  // compare-exchanges.
+  if (((_M_section = OpenFileMapping(FILE_MAP_READ | FILE_MAP_WRITE,
+                                     FALSE,
+                                     section_name)) == NULL) ||
+      (!map(FILE_MAP_READ | FILE_MAP_WRITE)) ||
+      (memcmp(_M_data->magic, magic, sizeof(magic)) != 0) ||
+      (_M_data->version != VERSION) ||
+      (_M_data->size != sizeof(data))) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void service_stats::close()
+{
+  if (_M_data) {
+    UnmapViewOfFile(_M_data);
+    _M_data = nullptr;
+  }
+
+  if (_M_section) {
+    CloseHandle(_M_section);
+    _M_section = NULL;
+  }
+}
+
+void service_stats::record(size_t idx,
+                           const evaluation_stats& stats,
+                           uint64_t latency,
+                           bool allowed)
+{
+  if ((!_M_data) || (idx >= MAX_THREADS)) {
+    return;
+  }
+
+  worker& w = _M_data->workers[idx];
+
+  increment(w.counters[counter_requests], 1);
+  increment(w.counters[allowed ? counter_allowed : counter_denied], 1);
+
+  if (stats.cache_lookup) {
+    increment(w.counters[stats.cached ?
+                           counter_cache_hits :
+                           counter_cache_misses],
+              1);
+  }
+
+  if (stats.coalesced) {
+    increment(w.counters[counter_coalesced], 1);
+  }
+
+  increment(w.counters[counter_signer_hits], stats.signer_hits);
+  increment(w.counters[counter_signer_misses], stats.signer_misses);
+  increment(w.counters[counter_bytes_hashed], stats.hashed);
+
+  for (unsigned s = 0; s < evaluation_stats::NSTAGES; s++) {
+    if ((stats.stages & (static_cast<uint32_t>(1) << s)) != 0) {
+      w.stages[s].add(stats.durations[s]);
+    }
+  }
+
+  w.requests.add(latency);
+}
+
+void service_stats::print(bool json) const
+{
+  if (!_M_data) {
+    return;
+  }
+
+  // Add up the workers.
+  uint64_t counters[NCOUNTERS];
+  memset(counters, 0, sizeof(counters));
+
+  latency_histogram stages[evaluation_stats::NSTAGES];
+  latency_histogram requests;
+
+  for (unsigned s = 0; s < evaluation_stats::NSTAGES; s++) {
+    stages[s].clear();
+  }
+
+  requests.clear();
+
+  for (size_t i = 0; i < MAX_THREADS; i++) {
+    const worker& w = _M_data->workers[i];
+
+    for (unsigned c = 0; c < NCOUNTERS; c++) {
+      counters[c] += w.counters[c].load(std::memory_order_relaxed);
+    }
+
+    for (unsigned s = 0; s < evaluation_stats::NSTAGES; s++) {
+      stages[s].merge(w.stages[s]);
+    }
+
+    requests.merge(w.requests);
+  }
+
+  uint64_t gauges[NGAUGES];
+  for (unsigned g = 0; g < NGAUGES; g++) {
+    gauges[g] = _M_data->gauges[g].load(std::memory_order_relaxed);
+  }
+
+  if (json) {
+    _tprintf(_T("{\"counters\": {"));
+
+    for (unsigned c = 0; c < NCOUNTERS; c++) {
+      _tprintf(_T("%s\"%hs\": %llu"),
+               (c > 0) ? _T(", ") : _T(""),
+               name(static_cast<counter>(c)),
+               static_cast<unsigned long long>(counters[c]));
+    }
+
+    _tprintf(_T("}, \"gauges\": {"));
+
+    for (unsigned g = 0; g < NGAUGES; g++) {
+      _tprintf(_T("%s\"%hs\": %llu"),
+               (g > 0) ? _T(", ") : _T(""),
+               name(static_cast<gauge>(g)),
+               static_cast<unsigned long long>(gauges[g]));
+    }
+
+    _tprintf(_T("}, \"latency\": {"));
+  } else {
+    uint64_t hits = counters[counter_cache_hits];
+    uint64_t misses = counters[counter_cache_misses];
+
+    _tprintf(_T("Requests: %llu (%llu allowed, %llu not allowed), ")
+             _T("%llu timeouts, %llu deadline misses.\n"),
+             static_cast<unsigned long long>(counters[counter_requests]),
+             static_cast<unsigned long long>(counters[counter_allowed]),
+             static_cast<unsigned long long>(counters[counter_denied]),
+             static_cast<unsigned long long>(counters[counter_timeouts]),
+             static_cast<unsigned long long>(
+               counters[counter_deadline_misses]
+             ));
+
+    _tprintf(_T("Verdict cache: %llu hits, %llu misses (%.1f%%).\n"),
+             static_cast<unsigned long long>(hits),
+             static_cast<unsigned long long>(misses),
+             (hits + misses > 0) ? (100.0 * hits) / (hits + misses) : 0.0);
+
+    _tprintf(_T("Coalesced evaluations: %llu.\n"),
+             static_cast<unsigned long long>(counters[counter_coalesced]));
+
+    hits = counters[counter_signer_hits];
+    misses = counters[counter_signer_misses];
+
+    _tprintf(_T("Signer cache: %llu hits, %llu misses (%.1f%%).\n"),
+             static_cast<unsigned long long>(hits),
+             static_cast<unsigned long long>(misses),
+             (hits + misses > 0) ? (100.0 * hits) / (hits + misses) : 0.0);
+
+    _tprintf(_T("Bytes hashed: %llu.\n"),
+             static_cast<unsigned long long>(counters[counter_bytes_hashed]));
+
+    _tprintf(_T("Policy (generation %llu): signers: %llu bytes, ")
+             _T("SHA-1 hashes: %llu bytes, SHA-256 hashes: %llu bytes, ")
+             _T("paths: %llu bytes.\n"),
+             static_cast<unsigned long long>(gauges[gauge_generation]),
+             static_cast<unsigned long long>(gauges[gauge_signers_memory]),
+             static_cast<unsigned long long>(
+               gauges[gauge_sha1_hashes_memory]
+             ),
+             static_cast<unsigned long long>(
+               gauges[gauge_sha256_hashes_memory]
+             ),
+             static_cast<unsigned long long>(gauges[gauge_paths_memory]));
+
+    _tprintf(_T("Catalog index: %llu hashes, %llu bytes.\n\n"),
+             static_cast<unsigned long long>(gauges[gauge_catalog_hashes]),
+             static_cast<unsigned long long>(
+               gauges[gauge_catalog_index_memory]
+             ));
+
+    _tprintf(_T("%-12s %12s %10s %10s %10s %10s %10s\n"),
+             _T("Latency (ms)"),
+             _T("Count"),
+             _T("p50"),
+             _T("p90"),
+             _T("p99"),
+             _T("p99.9"),
+             _T("Max"));
+  }
+
+  print("request", requests, json, true);
+
+  for (unsigned s = 0; s < evaluation_stats::NSTAGES; s++) {
+    print(evaluation_stats::name(static_cast<evaluation_stats::stage>(s)),
+          stages[s],
+          json,
+          false);
+  }
+
+  if (json) {
+    _tprintf(_T("}}\n"));
+  }
+}
+
+bool service_stats::map(DWORD access)
+{
+  return ((_M_data = reinterpret_cast<data*>(
+                       MapViewOfFile(_M_section, access, 0, 0, sizeof(data))
+                     )) != nullptr);
+}
+
+void service_stats::print(const char* name,
+                          const latency_histogram& histogram,
+                          bool json,
+                          bool first)
+{
+  if (json) {
+    // Nanoseconds.
+    _tprintf(_T("%s\"%hs\": {\"count\": %llu, \"sum\": %llu"),
+             first ? _T("") : _T(", "),
+             name,
+             static_cast<unsigned long long>(histogram.count()),
+             static_cast<unsigned long long>(histogram.sum()));
+
+    for (size_t i = 0; i < _countof(percentiles); i++) {
+      _tprintf(_T(", \"p%g\": %llu"),
+               100.0 * percentiles[i],
+               static_cast<unsigned long long>(
+                 histogram.percentile(percentiles[i])
+               ));
+    }
+
+    _tprintf(_T(", \"max\": %llu}"),
+             static_cast<unsigned long long>(histogram.max()));
+  } else {
+    // Milliseconds.
+    _tprintf(_T("%-12hs %12llu"),
+             name,
+             static_cast<unsigned long long>(histogram.count()));
+
+    for (size_t i = 0; i < _countof(percentiles); i++) {
+      _tprintf(_T(" %10.3f"), histogram.percentile(percentiles[i]) / 1e6);
+    }
+
+    _tprintf(_T(" %10.3f\n"), histogram.max() / 1e6);
+  }
+}
+
+const char* service_stats::name(counter c)
+{
+  static const char* const names[] = {
+    "requests",
+    "allowed",
+    "denied",
+    "cache_hits",
+    "cache_misses",
+    "coalesced",
+    "signer_hits",
+    "signer_misses",
+    "timeouts",
+    "deadline_misses",
+    "bytes_hashed"
+  };
+
+  return (c < NCOUNTERS) ? names[c] : "unknown";
+}
+
+const char* service_stats::name(gauge g)
+{
+  static const char* const names[] = {
+    "generation",
+    "signers_memory",
+    "sha1_hashes_memory",
+    "sha256_hashes_memory",
+    "paths_memory",
+    "catalog_hashes",
+    "catalog_index_memory"
+  };
+
+  return (g < NGAUGES) ? names[g] : "unknown";
+}
@@ -0,0 +1,168 @@
+#ifndef SERVICE_STATS_H
+#define SERVICE_STATS_H
+
+#include <windows.h>
+#include <stdint.h>
+#include <atomic>
+#include "evaluation_stats.h"
+#include "latency_histogram.h"
+
+// Statistics of the running client, in a named section of shared memory, so
+// the command `stats` can read them at any time.
+// Every worker has its own counters and histograms (they are updated without
+// locks), the reader adds them up.
+class service_stats {
+  public:
+    // Name of the section.
+    static const TCHAR* const section_name;
+
+    // Maximum number of workers.
+    static const size_t MAX_THREADS = 64;
+
+    // Counters of a worker.
+    enum counter {
+      counter_requests,
+      counter_allowed,
+      counter_denied,
+      counter_cache_hits,
+      counter_cache_misses,
+      counter_coalesced, // Waited for a concurrent evaluation.
+      counter_signer_hits,
+      counter_signer_misses,
+      counter_timeouts, // Replies which didn't reach the driver.
+      counter_deadline_misses, // Replied with the fallback verdict.
+      counter_bytes_hashed,
+      NCOUNTERS
+    };
+
+    // Gauges of the policy (set when a policy or an index is published).
+    enum gauge {
+      gauge_generation,
+      gauge_signers_memory,
+      gauge_sha1_hashes_memory,
+      gauge_sha256_hashes_memory,
+      gauge_paths_memory,
+      gauge_catalog_hashes,
+      gauge_catalog_index_memory,
+      NGAUGES
+    };
+
+    // Constructor.
+    service_stats();
+
+    // Destructor.
+    ~service_stats();
+
+    // Create the section (running client).
+    bool create();
+
+    // Open the section of the running client.
+    bool open();
+
+    // Close.
+    void close();
+
+    // Record an evaluation of the worker `idx` (`latency` in nanoseconds).
+    void record(size_t idx,
+                const evaluation_stats& stats,
+                uint64_t latency,
+                bool allowed);
+
+    // Record a reply of the worker `idx` which didn't reach the driver.
+    void timeout(size_t idx);
+
+    // Record a request of the worker `idx` whose evaluation was abandoned
+    // (the fallback verdict was replied).
+    void deadline_miss(size_t idx);
+
+    // Set gauge.
+    void set(gauge g, uint64_t value);
+
+    // Print (as text or as JSON).
+    void print(bool json) const;
+
+  private:
+    static const uint32_t VERSION = 3;
+
+    // Statistics of a worker.
+    struct worker {
+      std::atomic<uint64_t> counters[NCOUNTERS];
+
+      // Latency of each stage and of the whole request.
+      latency_histogram stages[evaluation_stats::NSTAGES];
+      latency_histogram requests;
+    };
+
+    // Layout of the section (zero-filled when it is created).
+    struct data {
+      uint8_t magic[8];
+      uint32_t version;
+      uint32_t size;
+
+      std::atomic<uint64_t> gauges[NGAUGES];
+
+      worker workers[MAX_THREADS];
+    };
+
+    HANDLE _M_section;
+    data* _M_data;
+
+    // Map the section.
+    bool map(DWORD access);
+
+    // Print latency histogram.
+    static void print(const char* name,
+                      const latency_histogram& histogram,
+                      bool json,
+                      bool first);
+
+    // Increment counter (single writer).
+    static void increment(std::atomic<uint64_t>& counter, uint64_t n);
+
+    // Get name of a counter.
+    static const char* name(counter c);
+
+    // Get name of a gauge.
+    static const char* name(gauge g);
+};
+
+inline service_stats::service_stats()
+  : _M_section(NULL),
+    _M_data(nullptr)
+{
+}
+
+inline service_stats::~service_stats()
+{
+  close();
+}
+
+inline void service_stats::timeout(size_t idx)
+{
+  if ((_M_data) && (idx < MAX_THREADS)) {
+    increment(_M_data->workers[idx].counters[counter_timeouts], 1);
+  }
+}
+
+inline void service_stats::deadline_miss(size_t idx)
+{
+  if ((_M_data) && (idx < MAX_THREADS)) {
+    increment(_M_data->workers[idx].counters[counter_deadline_misses], 1);
+  }
+}
+
+inline void service_stats::set(gauge g, uint64_t value)
+{
+  if (_M_data) {
+    _M_data->gauges[g].store(value, std::memory_order_relaxed);
+  }
+}
+
+inline void service_stats::increment(std::atomic<uint64_t>& counter,
+                                     uint64_t n)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+}
+
+#endif // SERVICE_STATS_H
@@ -0,0 +1,195 @@
+#include <string.h>
+#include "sha1.h"
+
+static inline uint32_t rol(uint32_t x, unsigned n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t load_be32(const uint8_t* p)
+{
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) |
+         static_cast<uint32_t>(p[3]);
+}
+
+static inline void store_be32(uint8_t* p, uint32_t x)
+{
+  p[0] = static_cast<uint8_t>(x >> 24);
+  p[1] = static_cast<uint8_t>(x >> 16);
+  p[2] = static_cast<uint8_t>(x >> 8);
+  p[3] = static_cast<uint8_t>(x);
+}
+
+void sha1::init()
+{
+  _M_state[0] = 0x67452301;
+  _M_state[1] = 0xefcdab89;
+  _M_state[2] = 0x98badcfe;
+  _M_state[3] = 0x10325476;
+  _M_state[4] = 0xc3d2e1f0;
+
+  _M_length = 0;
+  _M_buflen = 0;
+}
+
+void sha1::update(const void* data, size_t len)
+{
+  const uint8_t* ptr = static_cast<const uint8_t*>(data);
+
+  _M_length += len;
+
+  // Complete the buffered block (if any).
+  if (_M_buflen > 0) {
+    size_t n = BLOCK_LEN - _M_buflen;
+    if (n > len) {
+      n = len;
+    }
+
+    memcpy(_M_buffer + _M_buflen, ptr, n);
+    _M_buflen += n;
+
+    ptr += n;
+    len -= n;
+
+    if (_M_buflen < BLOCK_LEN) {
+      return;
+    }
+
+    _M_transform(_M_state, _M_buffer, 1);
+    _M_buflen = 0;
+  }
+
+  // Process the whole blocks in place.
+  size_t nblocks = len / BLOCK_LEN;
+  if (nblocks > 0) {
+    _M_transform(_M_state, ptr, nblocks);
+
+    ptr += nblocks * BLOCK_LEN;
+    len -= nblocks * BLOCK_LEN;
+  }
+
+  // Buffer the rest.
+  memcpy(_M_buffer, ptr, len);
+  _M_buflen = len;
+}
+
+void sha1::finish(uint8_t* digest)
+{
+  uint64_t bits = _M_length * 8;
+
+  // Padding: 0x80, zeros and the length in bits (big-endian).
+  _M_buffer[_M_buflen++] = 0x80;
+
+  if (_M_buflen > BLOCK_LEN - 8) {
+    memset(_M_buffer + _M_buflen, 0, BLOCK_LEN - _M_buflen);
+    _M_transform(_M_state, _M_buffer, 1);
+    _M_buflen = 0;
+  }
+
+  memset(_M_buffer + _M_buflen, 0, BLOCK_LEN - 8 - _M_buflen);
+  store_be32(_M_buffer + BLOCK_LEN - 8, static_cast<uint32_t>(bits >> 32));
+  store_be32(_M_buffer + BLOCK_LEN - 4, static_cast<uint32_t>(bits));
+
+  _M_transform(_M_state, _M_buffer, 1);
+
+  for (size_t i = 0; i < 5; i++) {
+    store_be32(digest + (i * 4), _M_state[i]);
+  }
+}
+
+sha_transform sha1::get(sha_kernel kernel)
+{
+#if defined(SHA_KERNEL_X86)
+  switch (kernel) {
+    case sha_kernel::ssse3:
+      return transform_ssse3;
+    case sha_kernel::avx2:
+      return transform_avx2;
+    case sha_kernel::shani:
+      return transform_shani;
+    default:
+      return transform_scalar;
+  }
+#else
+  return transform_scalar;
+#endif
+}
+
+void sha1::transform_scalar(uint32_t* state,
+                            const uint8_t* data,
+                            size_t nblocks)
+{
+  static const uint32_t K[4] = {
+    0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+  };
+
+  for (; nblocks > 0; nblocks--, data += BLOCK_LEN) {
+    uint32_t w[ROUNDS];
+    for (size_t i = 0; i < 16; i++) {
+      w[i] = load_be32(data + (i * 4));
+    }
+
+    for (size_t i = 16; i < ROUNDS; i++) {
+      w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    for (size_t i = 0; i < ROUNDS; i++) {
+      w[i] += K[i / 20];
+    }
+
+    rounds(state, w);
+  }
+}
+
+void sha1::rounds(uint32_t* state, const uint32_t* wk)
+{
+  uint32_t a = state[0];
+  uint32_t b = state[1];
+  uint32_t c = state[2];
+  uint32_t d = state[3];
+  uint32_t e = state[4];
+
+  for (size_t i = 0; i < 20; i++) {
+    uint32_t t = rol(a, 5) + ((b & c) | (~b & d)) + e + wk[i];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+
+  for (size_t i = 20; i < 40; i++) {
+    uint32_t t = rol(a, 5) + (b ^ c ^ d) + e + wk[i];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+
+  for (size_t i = 40; i < 60; i++) {
+    uint32_t t = rol(a, 5) + ((b & c) | (b & d) | (c & d)) + e + wk[i];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+
+  for (size_t i = 60; i < ROUNDS; i++) {
+    uint32_t t = rol(a, 5) + (b ^ c ^ d) + e + wk[i];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
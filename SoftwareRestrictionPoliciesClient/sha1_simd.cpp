@@ -0,0 +1,246 @@
+#include "sha1.h"
+
+#if defined(SHA_KERNEL_X86)
+#include <immintrin.h>
+
+static const uint32_t K[4] = {
+  0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+};
+
+// Rotate the words of the vector left by 1 bit.
+SHA_TARGET("ssse3")
+static inline __m128i rol1(__m128i x)
+{
+  return _mm_or_si128(_mm_slli_epi32(x, 1), _mm_srli_epi32(x, 31));
+}
+
+// Four words of the message schedule: W[i] = rol1(W[i-3] ^ W[i-8] ^
+// W[i-14] ^ W[i-16]). W[i+3] depends on W[i], which is computed in the same
+// vector: it is taken as 0 and its contribution is added afterwards.
+SHA_TARGET("ssse3")
+static inline __m128i schedule(__m128i w16, __m128i w12, __m128i w8, __m128i w4)
+{
+  __m128i t = _mm_xor_si128(_mm_xor_si128(_mm_srli_si128(w4, 4), w8),
+                            _mm_xor_si128(_mm_alignr_epi8(w12, w16, 8), w16));
+
+  __m128i u = _mm_slli_si128(t, 12);
+
+  return _mm_xor_si128(rol1(t),
+                       _mm_or_si128(_mm_slli_epi32(u, 2),
+                                    _mm_srli_epi32(u, 30)));
+}
+
+SHA_TARGET("avx2")
+static inline __m256i rol1(__m256i x)
+{
+  return _mm256_or_si256(_mm256_slli_epi32(x, 1), _mm256_srli_epi32(x, 31));
+}
+
+// Same as above, for two blocks (one per 128-bit lane).
+SHA_TARGET("avx2")
+static inline __m256i schedule(__m256i w16, __m256i w12, __m256i w8, __m256i w4)
+{
+  __m256i t = _mm256_xor_si256(
+                _mm256_xor_si256(_mm256_srli_si256(w4, 4), w8),
+                _mm256_xor_si256(_mm256_alignr_epi8(w12, w16, 8), w16)
+              );
+
+  __m256i u = _mm256_slli_si256(t, 12);
+
+  return _mm256_xor_si256(rol1(t),
+                          _mm256_or_si256(_mm256_slli_epi32(u, 2),
+                                          _mm256_srli_epi32(u, 30)));
+}
+
+SHA_TARGET("ssse3")
+void sha1::transform_ssse3(uint32_t* state,
+                           const uint8_t* data,
+                           size_t nblocks)
+{
+  const __m128i mask = _mm_set_epi8(12, 13, 14, 15,
+                                    8, 9, 10, 11,
+                                    4, 5, 6, 7,
+                                    0, 1, 2, 3);
+
+  for (; nblocks > 0; nblocks--, data += BLOCK_LEN) {
+    __m128i w[ROUNDS / 4];
+    uint32_t wk[ROUNDS];
+
+    for (size_t i = 0; i < 4; i++) {
+      w[i] = _mm_shuffle_epi8(
+               _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + i),
+               mask
+             );
+    }
+
+    for (size_t i = 4; i < ROUNDS / 4; i++) {
+      w[i] = schedule(w[i - 4], w[i - 3], w[i - 2], w[i - 1]);
+    }
+
+    for (size_t i = 0; i < ROUNDS / 4; i++) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(wk) + i,
+                       _mm_add_epi32(w[i], _mm_set1_epi32(K[i / 5])));
+    }
+
+    rounds(state, wk);
+  }
+}
+
+SHA_TARGET("avx2")
+void sha1::transform_avx2(uint32_t* state,
+                          const uint8_t* data,
+                          size_t nblocks)
+{
+  const __m256i mask = _mm256_set_epi8(12, 13, 14, 15,
+                                       8, 9, 10, 11,
+                                       4, 5, 6, 7,
+                                       0, 1, 2, 3,
+                                       12, 13, 14, 15,
+                                       8, 9, 10, 11,
+                                       4, 5, 6, 7,
+                                       0, 1, 2, 3);
+
+  // Two blocks at a time: the first one in the low lane, the second one in
+  // the high lane.
+  for (; nblocks >= 2; nblocks -= 2, data += 2 * BLOCK_LEN) {
+    __m256i w[ROUNDS / 4];
+    uint32_t wk[2][ROUNDS];
+
+    const __m128i* p = reinterpret_cast<const __m128i*>(data);
+
+    for (size_t i = 0; i < 4; i++) {
+      w[i] = _mm256_shuffle_epi8(
+               _mm256_inserti128_si256(
+                 _mm256_castsi128_si256(_mm_loadu_si128(p + i)),
+                 _mm_loadu_si128(p + 4 + i),
+                 1
+               ),
+               mask
+             );
+    }
+
+    for (size_t i = 4; i < ROUNDS / 4; i++) {
+      w[i] = schedule(w[i - 4], w[i - 3], w[i - 2], w[i - 1]);
+    }
+
+    for (size_t i = 0; i < ROUNDS / 4; i++) {
+      __m256i v = _mm256_add_epi32(w[i], _mm256_set1_epi32(K[i / 5]));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(wk[0]) + i,
+                       _mm256_castsi256_si128(v));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(wk[1]) + i,
+                       _mm256_extracti128_si256(v, 1));
+    }
+
+    rounds(state, wk[0]);
+    rounds(state, wk[1]);
+  }
+
+  _mm256_zeroupper();
+
+  // Last block (if any).
+  if (nblocks > 0) {
+    transform_ssse3(state, data, nblocks);
+  }
+}
+
+// Four rounds: `e` is computed from `a` of four rounds ago.
+#define SHA1_ROUNDS(m, f)                                                     \
+  e = _mm_sha1nexte_epu32(prev, m);                                           \
+  prev = abcd;                                                                \
+  abcd = _mm_sha1rnds4_epu32(abcd, e, f);
+
+// Next four words of the message schedule (from the previous 16).
+#define SHA1_SCHEDULE(m0, m1, m2, m3)                                         \
+  m0 = _mm_sha1msg2_epu32(                                                    \
+         _mm_xor_si128(_mm_sha1msg1_epu32(m0, m1), m2),                       \
+         m3                                                                   \
+       );
+
+SHA_TARGET("sha,sse4.1,ssse3")
+void sha1::transform_shani(uint32_t* state,
+                           const uint8_t* data,
+                           size_t nblocks)
+{
+  // The words are loaded in reverse order (W0 in the highest element).
+  const __m128i mask = _mm_set_epi8(0, 1, 2, 3,
+                                    4, 5, 6, 7,
+                                    8, 9, 10, 11,
+                                    12, 13, 14, 15);
+
+  __m128i abcd = _mm_shuffle_epi32(
+                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)),
+                   0x1b
+                 );
+
+  __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+  for (; nblocks > 0; nblocks--, data += BLOCK_LEN) {
+    __m128i abcd_save = abcd;
+    __m128i e0_save = e0;
+
+    const __m128i* p = reinterpret_cast<const __m128i*>(data);
+    __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128(p), mask);
+    __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), mask);
+    __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), mask);
+    __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), mask);
+
+    // Rounds 0-3.
+    __m128i e = _mm_add_epi32(e0, m0);
+    __m128i prev = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e, 0);
+
+    // Rounds 4-19.
+    SHA1_ROUNDS(m1, 0)
+    SHA1_ROUNDS(m2, 0)
+    SHA1_ROUNDS(m3, 0)
+    SHA1_SCHEDULE(m0, m1, m2, m3)
+    SHA1_ROUNDS(m0, 0)
+
+    // Rounds 20-39.
+    SHA1_SCHEDULE(m1, m2, m3, m0)
+    SHA1_ROUNDS(m1, 1)
+    SHA1_SCHEDULE(m2, m3, m0, m1)
+    SHA1_ROUNDS(m2, 1)
+    SHA1_SCHEDULE(m3, m0, m1, m2)
+    SHA1_ROUNDS(m3, 1)
+    SHA1_SCHEDULE(m0, m1, m2, m3)
+    SHA1_ROUNDS(m0, 1)
+    SHA1_SCHEDULE(m1, m2, m3, m0)
+    SHA1_ROUNDS(m1, 1)
+
+    // Rounds 40-59.
+    SHA1_SCHEDULE(m2, m3, m0, m1)
+    SHA1_ROUNDS(m2, 2)
+    SHA1_SCHEDULE(m3, m0, m1, m2)
+    SHA1_ROUNDS(m3, 2)
+    SHA1_SCHEDULE(m0, m1, m2, m3)
+    SHA1_ROUNDS(m0, 2)
+    SHA1_SCHEDULE(m1, m2, m3, m0)
+    SHA1_ROUNDS(m1, 2)
+    SHA1_SCHEDULE(m2, m3, m0, m1)
+    SHA1_ROUNDS(m2, 2)
+
+    // Rounds 60-79.
+    SHA1_SCHEDULE(m3, m0, m1, m2)
+    SHA1_ROUNDS(m3, 3)
+    SHA1_SCHEDULE(m0, m1, m2, m3)
+    SHA1_ROUNDS(m0, 3)
+    SHA1_SCHEDULE(m1, m2, m3, m0)
+    SHA1_ROUNDS(m1, 3)
+    SHA1_SCHEDULE(m2, m3, m0, m1)
+    SHA1_ROUNDS(m2, 3)
+    SHA1_SCHEDULE(m3, m0, m1, m2)
+    SHA1_ROUNDS(m3, 3)
+
+    e0 = _mm_sha1nexte_epu32(prev, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, 0x1b));
+
+  state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+#endif // SHA_KERNEL_X86
@@ -0,0 +1,203 @@
+#include <string.h>
+#include "sha256.h"
+
+const uint32_t sha256::K[ROUNDS] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t ror(uint32_t x, unsigned n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t load_be32(const uint8_t* p)
+{
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) |
+         static_cast<uint32_t>(p[3]);
+}
+
+static inline void store_be32(uint8_t* p, uint32_t x)
+{
+  p[0] = static_cast<uint8_t>(x >> 24);
+  p[1] = static_cast<uint8_t>(x >> 16);
+  p[2] = static_cast<uint8_t>(x >> 8);
+  p[3] = static_cast<uint8_t>(x);
+}
+
+void sha256::init()
+{
+  _M_state[0] = 0x6a09e667;
+  _M_state[1] = 0xbb67ae85;
+  _M_state[2] = 0x3c6ef372;
+  _M_state[3] = 0xa54ff53a;
+  _M_state[4] = 0x510e527f;
+  _M_state[5] = 0x9b05688c;
+  _M_state[6] = 0x1f83d9ab;
+  _M_state[7] = 0x5be0cd19;
+
+  _M_length = 0;
+  _M_buflen = 0;
+}
+
+void sha256::update(const void* data, size_t len)
+{
+  const uint8_t* ptr = static_cast<const uint8_t*>(data);
+
+  _M_length += len;
+
+  // Complete the buffered block (if any).
+  if (_M_buflen > 0) {
+    size_t n = BLOCK_LEN - _M_buflen;
+    if (n > len) {
+      n = len;
+    }
+
+    memcpy(_M_buffer + _M_buflen, ptr, n);
+    _M_buflen += n;
+
+    ptr += n;
+    len -= n;
+
+    if (_M_buflen < BLOCK_LEN) {
+      return;
+    }
+
+    _M_transform(_M_state, _M_buffer, 1);
+    _M_buflen = 0;
+  }
+
+  // Process the whole blocks in place.
+  size_t nblocks = len / BLOCK_LEN;
+  if (nblocks > 0) {
+    _M_transform(_M_state, ptr, nblocks);
+
+    ptr += nblocks * BLOCK_LEN;
+    len -= nblocks * BLOCK_LEN;
+  }
+
+  // Buffer the rest.
+  memcpy(_M_buffer, ptr, len);
+  _M_buflen = len;
+}
+
+void sha256::finish(uint8_t* digest)
+{
+  uint64_t bits = _M_length * 8;
+
+  // Padding: 0x80, zeros and the length in bits (big-endian).
+  _M_buffer[_M_buflen++] = 0x80;
+
+  if (_M_buflen > BLOCK_LEN - 8) {
+    memset(_M_buffer + _M_buflen, 0, BLOCK_LEN - _M_buflen);
+    _M_transform(_M_state, _M_buffer, 1);
+    _M_buflen = 0;
+  }
+
+  memset(_M_buffer + _M_buflen, 0, BLOCK_LEN - 8 - _M_buflen);
+  store_be32(_M_buffer + BLOCK_LEN - 8, static_cast<uint32_t>(bits >> 32));
+  store_be32(_M_buffer + BLOCK_LEN - 4, static_cast<uint32_t>(bits));
+
+  _M_transform(_M_state, _M_buffer, 1);
+
+  for (size_t i = 0; i < 8; i++) {
+    store_be32(digest + (i * 4), _M_state[i]);
+  }
+}
+
+sha_transform sha256::get(sha_kernel kernel)
+{
+#if defined(SHA_KERNEL_X86)
+  switch (kernel) {
+    case sha_kernel::ssse3:
+      return transform_ssse3;
+    case sha_kernel::avx2:
+      return transform_avx2;
+    case sha_kernel::shani:
+      return transform_shani;
+    default:
+      return transform_scalar;
+  }
+#else
+  return transform_scalar;
+#endif
+}
+
+void sha256::transform_scalar(uint32_t* state,
+                              const uint8_t* data,
+                              size_t nblocks)
+{
+  for (; nblocks > 0; nblocks--, data += BLOCK_LEN) {
+    uint32_t w[ROUNDS];
+    for (size_t i = 0; i < 16; i++) {
+      w[i] = load_be32(data + (i * 4));
+    }
+
+    for (size_t i = 16; i < ROUNDS; i++) {
+      uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    for (size_t i = 0; i < ROUNDS; i++) {
+      w[i] += K[i];
+    }
+
+    rounds(state, w);
+  }
+}
+
+void sha256::rounds(uint32_t* state, const uint32_t* wk)
+{
+  uint32_t a = state[0];
+  uint32_t b = state[1];
+  uint32_t c = state[2];
+  uint32_t d = state[3];
+  uint32_t e = state[4];
+  uint32_t f = state[5];
+  uint32_t g = state[6];
+  uint32_t h = state[7];
+
+  for (size_t i = 0; i < ROUNDS; i++) {
+    uint32_t s1 = ror(e, 6) ^ ror(e, 11) ^ ror(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = h + s1 + ch + wk[i];
+    uint32_t s0 = ror(a, 2) ^ ror(a, 13) ^ ror(a, 22);
+    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = s0 + maj;
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
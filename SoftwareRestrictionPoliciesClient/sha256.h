@@ -0,0 +1,80 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sha_kernel.h"
+
+// Streaming SHA-256.
+class sha256 {
+  public:
+    static const size_t DIGEST_LEN = 32;
+    static const size_t BLOCK_LEN = 64;
+
+    // Constructor (fastest kernel supported by the processor).
+    sha256();
+
+    // Constructor (the kernel has to be supported by the processor).
+    explicit sha256(sha_kernel kernel);
+
+    // Initialize.
+    void init();
+
+    // Update.
+    void update(const void* data, size_t len);
+
+    // Finish (the object has to be initialized again to be reused).
+    void finish(uint8_t* digest);
+
+  private:
+    static const size_t ROUNDS = 64;
+
+    sha_transform _M_transform;
+
+    uint32_t _M_state[8];
+    uint64_t _M_length;
+
+    uint8_t _M_buffer[BLOCK_LEN];
+    size_t _M_buflen;
+
+    // Get block function.
+    static sha_transform get(sha_kernel kernel);
+
+    // Block functions.
+    static void transform_scalar(uint32_t* state,
+                                 const uint8_t* data,
+                                 size_t nblocks);
+
+    static void transform_ssse3(uint32_t* state,
+                                const uint8_t* data,
+                                size_t nblocks);
+
+    static void transform_avx2(uint32_t* state,
+                               const uint8_t* data,
+                               size_t nblocks);
+
+    static void transform_shani(uint32_t* state,
+                                const uint8_t* data,
+                                size_t nblocks);
+
+    // 64 rounds, with the message schedule already computed and the round
+    // constants added (`wk`).
+    static void rounds(uint32_t* state, const uint32_t* wk);
+
+    // Round constants.
+    static const uint32_t K[ROUNDS];
+};
+
+inline sha256::sha256()
+  : _M_transform(get(sha_kernel_best()))
+{
+  init();
+}
+
+inline sha256::sha256(sha_kernel kernel)
+  : _M_transform(get(kernel))
+{
+  init();
+}
+
+#endif // SHA256_H
@@ -0,0 +1,266 @@
+#include "sha256.h"
+
+#if defined(SHA_KERNEL_X86)
+#include <immintrin.h>
+
+// Rotate the words of the vector right by `n` bits.
+#define ROR(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n))
+
+#define ROR256(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n),                \
+                                     _mm256_slli_epi32(x, 32 - n))
+
+SHA_TARGET("ssse3")
+static inline __m128i sigma0(__m128i x)
+{
+  return _mm_xor_si128(_mm_xor_si128(ROR(x, 7), ROR(x, 18)),
+                       _mm_srli_epi32(x, 3));
+}
+
+SHA_TARGET("ssse3")
+static inline __m128i sigma1(__m128i x)
+{
+  return _mm_xor_si128(_mm_xor_si128(ROR(x, 17), ROR(x, 19)),
+                       _mm_srli_epi32(x, 10));
+}
+
+// Four words of the message schedule: W[i] = W[i-16] + sigma0(W[i-15]) +
+// W[i-7] + sigma1(W[i-2]). W[i+2] and W[i+3] depend on W[i] and W[i+1], so
+// sigma1 is added in two halves.
+SHA_TARGET("ssse3")
+static inline __m128i schedule(__m128i w16,
+                               __m128i w12,
+                               __m128i w8,
+                               __m128i w4)
+{
+  __m128i t = _mm_add_epi32(
+                _mm_add_epi32(w16, sigma0(_mm_alignr_epi8(w12, w16, 4))),
+                _mm_alignr_epi8(w4, w8, 4)
+              );
+
+  t = _mm_add_epi32(t, sigma1(_mm_srli_si128(w4, 8)));
+
+  return _mm_add_epi32(t, sigma1(_mm_slli_si128(t, 8)));
+}
+
+SHA_TARGET("avx2")
+static inline __m256i sigma0(__m256i x)
+{
+  return _mm256_xor_si256(_mm256_xor_si256(ROR256(x, 7), ROR256(x, 18)),
+                          _mm256_srli_epi32(x, 3));
+}
+
+SHA_TARGET("avx2")
+static inline __m256i sigma1(__m256i x)
+{
+  return _mm256_xor_si256(_mm256_xor_si256(ROR256(x, 17), ROR256(x, 19)),
+                          _mm256_srli_epi32(x, 10));
+}
+
+// Same as above, for two blocks (one per 128-bit lane).
+SHA_TARGET("avx2")
+static inline __m256i schedule(__m256i w16,
+                               __m256i w12,
+                               __m256i w8,
+                               __m256i w4)
+{
+  __m256i t = _mm256_add_epi32(
+                _mm256_add_epi32(w16,
+                                 sigma0(_mm256_alignr_epi8(w12, w16, 4))),
+                _mm256_alignr_epi8(w4, w8, 4)
+              );
+
+  t = _mm256_add_epi32(t, sigma1(_mm256_srli_si256(w4, 8)));
+
+  return _mm256_add_epi32(t, sigma1(_mm256_slli_si256(t, 8)));
+}
+
+SHA_TARGET("ssse3")
+void sha256::transform_ssse3(uint32_t* state,
+                             const uint8_t* data,
+                             size_t nblocks)
+{
+  const __m128i mask = _mm_set_epi8(12, 13, 14, 15,
+                                    8, 9, 10, 11,
+                                    4, 5, 6, 7,
+                                    0, 1, 2, 3);
+
+  for (; nblocks > 0; nblocks--, data += BLOCK_LEN) {
+    __m128i w[ROUNDS / 4];
+    uint32_t wk[ROUNDS];
+
+    for (size_t i = 0; i < 4; i++) {
+      w[i] = _mm_shuffle_epi8(
+               _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + i),
+               mask
+             );
+    }
+
+    for (size_t i = 4; i < ROUNDS / 4; i++) {
+      w[i] = schedule(w[i - 4], w[i - 3], w[i - 2], w[i - 1]);
+    }
+
+    for (size_t i = 0; i < ROUNDS / 4; i++) {
+      _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(wk) + i,
+        _mm_add_epi32(
+          w[i],
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(K) + i)
+        )
+      );
+    }
+
+    rounds(state, wk);
+  }
+}
+
+SHA_TARGET("avx2")
+void sha256::transform_avx2(uint32_t* state,
+                            const uint8_t* data,
+                            size_t nblocks)
+{
+  const __m256i mask = _mm256_set_epi8(12, 13, 14, 15,
+                                       8, 9, 10, 11,
+                                       4, 5, 6, 7,
+                                       0, 1, 2, 3,
+                                       12, 13, 14, 15,
+                                       8, 9, 10, 11,
+                                       4, 5, 6, 7,
+                                       0, 1, 2, 3);
+
+  // Two blocks at a time: the first one in the low lane, the second one in
+  // the high lane.
+  for (; nblocks >= 2; nblocks -= 2, data += 2 * BLOCK_LEN) {
+    __m256i w[ROUNDS / 4];
+    uint32_t wk[2][ROUNDS];
+
+    const __m128i* p = reinterpret_cast<const __m128i*>(data);
+
+    for (size_t i = 0; i < 4; i++) {
+      w[i] = _mm256_shuffle_epi8(
+               _mm256_inserti128_si256(
+                 _mm256_castsi128_si256(_mm_loadu_si128(p + i)),
+                 _mm_loadu_si128(p + 4 + i),
+                 1
+               ),
+               mask
+             );
+    }
+
+    for (size_t i = 4; i < ROUNDS / 4; i++) {
+      w[i] = schedule(w[i - 4], w[i - 3], w[i - 2], w[i - 1]);
+    }
+
+    for (size_t i = 0; i < ROUNDS / 4; i++) {
+      __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(K) + i);
+
+      __m256i v = _mm256_add_epi32(
+                    w[i],
+                    _mm256_inserti128_si256(_mm256_castsi128_si256(k), k, 1)
+                  );
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(wk[0]) + i,
+                       _mm256_castsi256_si128(v));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(wk[1]) + i,
+                       _mm256_extracti128_si256(v, 1));
+    }
+
+    rounds(state, wk[0]);
+    rounds(state, wk[1]);
+  }
+
+  _mm256_zeroupper();
+
+  // Last block (if any).
+  if (nblocks > 0) {
+    transform_ssse3(state, data, nblocks);
+  }
+}
+
+// Four rounds (two per instruction).
+#define SHA256_ROUNDS(m, i)                                                   \
+  msg = _mm_add_epi32(                                                        \
+          m,                                                                  \
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(K) + (i))          \
+        );                                                                    \
+  state1 = _mm_sha256rnds2_epu32(state1, state0, msg);                        \
+  state0 = _mm_sha256rnds2_epu32(state0,                                      \
+                                 state1,                                      \
+                                 _mm_shuffle_epi32(msg, 0x0e));
+
+// Next four words of the message schedule (from the previous 16).
+#define SHA256_SCHEDULE(m0, m1, m2, m3)                                       \
+  m0 = _mm_sha256msg2_epu32(                                                  \
+         _mm_add_epi32(_mm_sha256msg1_epu32(m0, m1),                          \
+                       _mm_alignr_epi8(m3, m2, 4)),                           \
+         m3                                                                   \
+       );
+
+SHA_TARGET("sha,sse4.1,ssse3")
+void sha256::transform_shani(uint32_t* state,
+                             const uint8_t* data,
+                             size_t nblocks)
+{
+  const __m128i mask = _mm_set_epi8(12, 13, 14, 15,
+                                    8, 9, 10, 11,
+                                    4, 5, 6, 7,
+                                    0, 1, 2, 3);
+
+  // The instructions work with the state as ABEF and CDGH.
+  __m128i tmp = _mm_shuffle_epi32(
+                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)),
+                  0xb1
+                );
+
+  __m128i state1 = _mm_shuffle_epi32(
+                     _mm_loadu_si128(
+                       reinterpret_cast<const __m128i*>(state + 4)
+                     ),
+                     0x1b
+                   );
+
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+  for (; nblocks > 0; nblocks--, data += BLOCK_LEN) {
+    __m128i state0_save = state0;
+    __m128i state1_save = state1;
+    __m128i msg;
+
+    const __m128i* p = reinterpret_cast<const __m128i*>(data);
+    __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128(p), mask);
+    __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), mask);
+    __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), mask);
+    __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), mask);
+
+    SHA256_ROUNDS(m0, 0)
+    SHA256_ROUNDS(m1, 1)
+    SHA256_ROUNDS(m2, 2)
+    SHA256_ROUNDS(m3, 3)
+
+    for (size_t i = 4; i < ROUNDS / 4; i += 4) {
+      SHA256_SCHEDULE(m0, m1, m2, m3)
+      SHA256_ROUNDS(m0, i)
+      SHA256_SCHEDULE(m1, m2, m3, m0)
+      SHA256_ROUNDS(m1, i + 1)
+      SHA256_SCHEDULE(m2, m3, m0, m1)
+      SHA256_ROUNDS(m2, i + 2)
+      SHA256_SCHEDULE(m3, m0, m1, m2)
+      SHA256_ROUNDS(m3, i + 3)
+    }
+
+    state0 = _mm_add_epi32(state0, state0_save);
+    state1 = _mm_add_epi32(state1, state1_save);
+  }
+
+  // Back to ABCD and EFGH.
+  tmp = _mm_shuffle_epi32(state0, 0x1b);
+  state1 = _mm_shuffle_epi32(state1, 0xb1);
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_blend_epi16(tmp, state1, 0xf0));
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4),
+                   _mm_alignr_epi8(state1, tmp, 8));
+}
+#endif // SHA_KERNEL_X86
@@ -0,0 +1,134 @@
+#include "sha_kernel.h"
+
+#if defined(SHA_KERNEL_X86)
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    #include <immintrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
+struct cpu_features {
+  bool ssse3;
+  bool sse41;
+  bool avx2;
+  bool sha;
+};
+
+#if defined(SHA_KERNEL_X86)
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned* regs)
+{
+#if defined(_MSC_VER)
+  int r[4];
+  __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+
+  for (size_t i = 0; i < 4; i++) {
+    regs[i] = static_cast<unsigned>(r[i]);
+  }
+#else
+  if (!__get_cpuid_count(leaf, subleaf, regs, regs + 1, regs + 2, regs + 3)) {
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+  }
+#endif
+}
+
+// Are the AVX registers saved by the operating system?
+static bool avx_enabled()
+{
+#if defined(_MSC_VER)
+  return ((_xgetbv(0) & 0x06) == 0x06);
+#else
+  unsigned eax, edx;
+  __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+
+  return ((eax & 0x06) == 0x06);
+#endif
+}
+#endif
+
+static cpu_features detect()
+{
+  cpu_features features = {false, false, false, false};
+
+#if defined(SHA_KERNEL_X86)
+  unsigned regs[4];
+  cpuid(0, 0, regs);
+  unsigned max = regs[0];
+
+  if (max >= 1) {
+    cpuid(1, 0, regs);
+
+    features.ssse3 = ((regs[2] & (1u << 9)) != 0);
+    features.sse41 = ((regs[2] & (1u << 19)) != 0);
+
+    bool avx = (((regs[2] & (1u << 27)) != 0) && // OSXSAVE.
+                ((regs[2] & (1u << 28)) != 0) && // AVX.
+                (avx_enabled()));
+
+    if (max >= 7) {
+      cpuid(7, 0, regs);
+
+      features.avx2 = ((avx) && ((regs[1] & (1u << 5)) != 0));
+      features.sha = ((regs[1] & (1u << 29)) != 0);
+    }
+  }
+#endif
+
+  return features;
+}
+
+static sha_kernel best(const cpu_features& features)
+{
+  if ((features.sha) && (features.sse41) && (features.ssse3)) {
+    return sha_kernel::shani;
+  } else if (features.avx2) {
+    return sha_kernel::avx2;
+  } else if (features.ssse3) {
+    return sha_kernel::ssse3;
+  } else {
+    return sha_kernel::scalar;
+  }
+}
+
+// Detected once, before main() (until then, only the scalar kernel is
+// reported as supported).
+static const cpu_features features = detect();
+static const sha_kernel best_kernel = best(features);
+
+const char* sha_kernel_name(sha_kernel kernel)
+{
+  switch (kernel) {
+    case sha_kernel::scalar:
+      return "scalar";
+    case sha_kernel::ssse3:
+      return "ssse3";
+    case sha_kernel::avx2:
+      return "avx2";
+    case sha_kernel::shani:
+      return "sha-ni";
+    default:
+      return "unknown";
+  }
+}
+
+bool sha_kernel_supported(sha_kernel kernel)
+{
+  switch (kernel) {
+    case sha_kernel::scalar:
+      return true;
+    case sha_kernel::ssse3:
+      return features.ssse3;
+    case sha_kernel::avx2:
+      return features.avx2;
+    case sha_kernel::shani:
+      return ((features.sha) && (features.sse41) && (features.ssse3));
+    default:
+      return false;
+  }
+}
+
+sha_kernel sha_kernel_best()
+{
+  return best_kernel;
+}
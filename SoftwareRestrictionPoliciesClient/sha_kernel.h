@@ -0,0 +1,49 @@
+#ifndef SHA_KERNEL_H
+#define SHA_KERNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+  #define SHA_KERNEL_X86 1
+#endif
+
+// The SIMD kernels are compiled for the instruction set they use (GCC and
+// Clang need it per function, MSVC doesn't) and only called if the
+// processor supports it.
+#if defined(__GNUC__)
+  #define SHA_TARGET(x) __attribute__((target(x)))
+#else
+  #define SHA_TARGET(x)
+#endif
+
+// Implementations of the block functions of SHA-1 and SHA-256:
+// - scalar: portable.
+// - ssse3: message schedule computed with SSSE3, four words at a time.
+// - avx2: message schedule of two blocks at a time (AVX2).
+// - shani: Intel SHA extensions.
+enum class sha_kernel {
+  scalar,
+  ssse3,
+  avx2,
+  shani
+};
+
+static const size_t SHA_KERNELS = 4;
+
+// Get kernel name.
+const char* sha_kernel_name(sha_kernel kernel);
+
+// Is the kernel supported by the processor?
+bool sha_kernel_supported(sha_kernel kernel);
+
+// Fastest kernel supported by the processor.
+sha_kernel sha_kernel_best();
+
+// Block function.
+typedef void (*sha_transform)(uint32_t* state,
+                              const uint8_t* data,
+                              size_t nblocks);
+
+#endif // SHA_KERNEL_H
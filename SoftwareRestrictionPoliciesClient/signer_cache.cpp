@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+#include "signer_cache.h"
+
+bool signer_cache::create(size_t size)
+{
+  // Round number of sets up to a power of two.
+  size_t nsets = 1;
+  while (nsets * ways < size) {
+    nsets *= 2;
+  }
+
+  entry* entries;
+  if ((entries = reinterpret_cast<entry*>(
+                   calloc(nsets * ways, sizeof(entry))
+                 )) != nullptr) {
+    if (_M_entries) {
+      free(_M_entries);
+    }
+
+    _M_entries = entries;
+    _M_mask = nsets - 1;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool signer_cache::find(const uint8_t* issuer,
+                        size_t issuerlen,
+                        const uint8_t* serial,
+                        size_t seriallen,
+                        uint32_t generation,
+                        bool& allowed)
+{
+  if ((_M_entries) && (issuerlen + seriallen <= KEY_MAX_LEN)) {
+    uint64_t key = hash(issuer, issuerlen, serial, seriallen);
+    size_t set = static_cast<size_t>(key) & _M_mask;
+
+    std::lock_guard<std::mutex> lock(_M_locks[set % nlocks]);
+
+    entry* e = _M_entries + (set * ways);
+    for (size_t i = 0; i < ways; i++, e++) {
+      if (match(e, key, issuer, issuerlen, serial, seriallen)) {
+        // If the entry comes from another policy...
+        if (e->generation != generation) {
+          e->used = 0;
+          break;
+        }
+
+        e->last_used = ++_M_clock;
+        allowed = (e->allowed != 0);
+
+        _M_hits++;
+
+        return true;
+      }
+    }
+  }
+
+  _M_misses++;
+
+  return false;
+}
+
+void signer_cache::insert(const uint8_t* issuer,
+                          size_t issuerlen,
+                          const uint8_t* serial,
+                          size_t seriallen,
+                          uint32_t generation,
+                          bool allowed)
+{
+  if ((_M_entries) && (issuerlen + seriallen <= KEY_MAX_LEN)) {
+    uint64_t key = hash(issuer, issuerlen, serial, seriallen);
+    size_t set = static_cast<size_t>(key) & _M_mask;
+
+    std::lock_guard<std::mutex> lock(_M_locks[set % nlocks]);
+
+    // Look for the same key, a free entry or the least recently used one.
+    entry* e = _M_entries + (set * ways);
+    entry* victim = e;
+    for (size_t i = 0; i < ways; i++, e++) {
+      if (match(e, key, issuer, issuerlen, serial, seriallen)) {
+        victim = e;
+        break;
+      }
+
+      if (!e->used) {
+        victim = e;
+      } else if ((victim->used) && (e->last_used < victim->last_used)) {
+        victim = e;
+      }
+    }
+
+    victim->hash = key;
+    victim->generation = generation;
+    victim->last_used = ++_M_clock;
+    victim->issuerlen = static_cast<uint16_t>(issuerlen);
+    victim->seriallen = static_cast<uint16_t>(seriallen);
+    victim->used = 1;
+    victim->allowed = allowed ? 1 : 0;
+
+    memcpy(victim->key, issuer, issuerlen);
+    memcpy(victim->key + issuerlen, serial, seriallen);
+  }
+}
+
+bool signer_cache::match(const entry* e,
+                         uint64_t hash,
+                         const uint8_t* issuer,
+                         size_t issuerlen,
+                         const uint8_t* serial,
+                         size_t seriallen)
+{
+  return ((e->used) &&
+          (e->hash == hash) &&
+          (e->issuerlen == issuerlen) &&
+          (e->seriallen == seriallen) &&
+          (memcmp(e->key, issuer, issuerlen) == 0) &&
+          (memcmp(e->key + issuerlen, serial, seriallen) == 0));
+}
+
+uint64_t signer_cache::hash(const uint8_t* issuer,
+                            size_t issuerlen,
+                            const uint8_t* serial,
+                            size_t seriallen)
+{
+  // FNV-1a (the length of the issuer separates it from the serial number).
+  uint64_t h = 14695981039346656037ull;
+
+  for (size_t i = 0; i < issuerlen; i++) {
+    h ^= issuer[i];
+    h *= 1099511628211ull;
+  }
+
+  h ^= issuerlen;
+  h *= 1099511628211ull;
+
+  for (size_t i = 0; i < seriallen; i++) {
+    h ^= serial[i];
+    h *= 1099511628211ull;
+  }
+
+  return h;
+}
@@ -0,0 +1,123 @@
+#ifndef SIGNER_CACHE_H
+#define SIGNER_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+
+// Cache of signer verdicts keyed by the identity of the certificate (issuer
+// and serial number): many executables are signed with the same few
+// certificates, so their names don't have to be resolved and looked up in
+// the list of signers again.
+// The subject of the certificate is not part of the key: it is determined
+// by its issuer and serial number (the signature isn't verified either).
+//
+// Every verdict records the generation of the policy which produced it: a
+// verdict from another policy is a miss. The cache is set-associative, like
+// the cache of verdicts.
+class signer_cache {
+  public:
+    static const size_t default_size = 256;
+
+    // Longest key (issuer + serial number) which is cached.
+    static const size_t KEY_MAX_LEN = 256;
+
+    // Constructor.
+    signer_cache();
+
+    // Destructor.
+    ~signer_cache();
+
+    // Create.
+    bool create(size_t size);
+
+    // Find.
+    bool find(const uint8_t* issuer,
+              size_t issuerlen,
+              const uint8_t* serial,
+              size_t seriallen,
+              uint32_t generation,
+              bool& allowed);
+
+    // Insert.
+    void insert(const uint8_t* issuer,
+                size_t issuerlen,
+                const uint8_t* serial,
+                size_t seriallen,
+                uint32_t generation,
+                bool allowed);
+
+    // Get number of hits.
+    uint64_t hits() const;
+
+    // Get number of misses.
+    uint64_t misses() const;
+
+  private:
+    static const size_t ways = 4;
+    static const size_t nlocks = 16;
+
+    struct entry {
+      uint64_t hash;
+      uint32_t generation;
+      uint32_t last_used;
+      uint16_t issuerlen;
+      uint16_t seriallen;
+      uint8_t used;
+      uint8_t allowed;
+      uint8_t key[KEY_MAX_LEN];
+    };
+
+    entry* _M_entries;
+    size_t _M_mask;
+
+    std::atomic<uint32_t> _M_clock;
+
+    std::mutex _M_locks[nlocks];
+
+    std::atomic<uint64_t> _M_hits;
+    std::atomic<uint64_t> _M_misses;
+
+    // Does the entry have the key?
+    static bool match(const entry* e,
+                      uint64_t hash,
+                      const uint8_t* issuer,
+                      size_t issuerlen,
+                      const uint8_t* serial,
+                      size_t seriallen);
+
+    // Hash key.
+    static uint64_t hash(const uint8_t* issuer,
+                         size_t issuerlen,
+                         const uint8_t* serial,
+                         size_t seriallen);
+};
+
+inline signer_cache::signer_cache()
+  : _M_entries(nullptr),
+    _M_mask(0),
+    _M_clock(0),
+    _M_hits(0),
+    _M_misses(0)
+{
+}
+
+inline signer_cache::~signer_cache()
+{
+  if (_M_entries) {
+    free(_M_entries);
+  }
+}
+
+inline uint64_t signer_cache::hits() const
+{
+  return _M_hits;
+}
+
+inline uint64_t signer_cache::misses() const
+{
+  return _M_misses;
+}
+
+#endif // SIGNER_CACHE_H
@@ -0,0 +1,98 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Pointer to an immutable object which can be replaced while it is in use.
+//
+// Readers never block: they enter the counter of the current epoch, read the
+// pointer and leave the counter when they are done with the object.
+// The writer publishes the new object and then, twice, moves to the next
+// epoch and waits for the counter of the previous one to drain. After that,
+// no reader can still be using the old object and it is deleted.
+template<typename T>
+class snapshot {
+  public:
+    // Constructor.
+    snapshot();
+
+    // Destructor.
+    ~snapshot();
+
+    // Acquire the current object (nullptr if none): the object stays alive
+    // until release() is called with the same `slot`.
+    const T* acquire(unsigned& slot) const;
+
+    // Release.
+    void release(unsigned slot) const;
+
+    // Publish (takes ownership of `obj` and deletes the previous object once
+    // it is no longer used). Only one thread may publish at a time.
+    void publish(T* obj);
+
+  private:
+    std::atomic<T*> _M_current;
+
+    std::atomic<unsigned> _M_epoch;
+    mutable std::atomic<unsigned> _M_readers[2];
+
+    // Wait for the readers of the current epoch to leave.
+    void synchronize();
+};
+
+template<typename T>
+inline snapshot<T>::snapshot()
+  : _M_current(nullptr),
+    _M_epoch(0)
+{
+  _M_readers[0] = 0;
+  _M_readers[1] = 0;
+}
+
+template<typename T>
+inline snapshot<T>::~snapshot()
+{
+  delete _M_current.load();
+}
+
+template<typename T>
+inline const T* snapshot<T>::acquire(unsigned& slot) const
+{
+  slot = _M_epoch.load() & 1;
+  _M_readers[slot]++;
+
+  return _M_current.load();
+}
+
+template<typename T>
+inline void snapshot<T>::release(unsigned slot) const
+{
+  _M_readers[slot]--;
+}
+
+template<typename T>
+void snapshot<T>::publish(T* obj)
+{
+  T* old = _M_current.exchange(obj);
+
+  // A reader which read the epoch before the previous publication might
+  // still be in the other counter: wait for both.
+  synchronize();
+  synchronize();
+
+  delete old;
+}
+
+template<typename T>
+void snapshot<T>::synchronize()
+{
+  unsigned slot = _M_epoch++ & 1;
+
+  while (_M_readers[slot].load() != 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+#endif // SNAPSHOT_H
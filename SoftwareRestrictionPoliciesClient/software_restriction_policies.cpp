@@ -1,48 +1,372 @@
+#include <stdlib.h>
 #include <stdio.h>
+#include <new>
+#include <thread>
 #include "software_restriction_policies.h"
-#include <softpub.h>
+#include "image_context.h"
+#include "pkcs7.h"
 #include <tchar.h>
 
-#pragma comment(lib, "crypt32.lib")
-#pragma comment(lib, "wintrust.lib")
-
-#define ENCODING (X509_ASN_ENCODING | PKCS_7_ASN_ENCODING)
-
-const GUID software_restriction_policies::driver_action_verify = DRIVER_ACTION_VERIFY;
-
-software_restriction_policies::software_restriction_policies(bool all_signers)
-  : _M_catalog(nullptr),
-    _M_all_signers(all_signers)
+software_restriction_policies::software_restriction_policies(
+  bool all_signers,
+  size_t cache_size,
+  unsigned deny_ttl
+)
+  : _M_all_signers(all_signers),
+    _M_signers_file(nullptr),
+    _M_hashes_file(nullptr),
+    _M_paths_file(nullptr),
+    _M_policy_file(nullptr),
+    _M_catalog_index_file(nullptr),
+    _M_cache_size(cache_size),
+    _M_deny_ttl(deny_ttl),
+    _M_verdict_store_file(nullptr),
+    _M_hash_speed(DEFAULT_HASH_SPEED),
+    _M_stats(nullptr),
+    _M_transport(nullptr)
 {
+  *_M_catalog_directory = 0;
 }
 
 software_restriction_policies::~software_restriction_policies()
 {
-  if (_M_catalog) {
-    CryptCATAdminReleaseContext(_M_catalog, 0);
-  }
 }
 
 bool software_restriction_policies::init()
 {
+  // Create cache of verdicts (if enabled).
+  if ((_M_cache_size > 0) && (!_M_cache.create(_M_cache_size, _M_deny_ttl))) {
+    return false;
+  }
+
+  // Create cache of signer verdicts.
+  if (!_M_signer_cache.create(signer_cache::default_size)) {
+    return false;
+  }
+
   // Acquire handle to catalog.
-  return (CryptCATAdminAcquireContext2(&_M_catalog,
-                                       &driver_action_verify,
-                                       NULL,
-                                       NULL,
-                                       0) == TRUE);
+  return _M_catalog.open();
 }
 
 bool software_restriction_policies::load(const TCHAR* signers,
                                          const TCHAR* hashes,
                                          const TCHAR* paths)
 {
-  return (((_M_all_signers) || (!signers) || (load_signers(signers))) &&
-          ((!hashes) || (load_hashes(hashes))) &&
-          ((!paths) || (load_paths(paths))));
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  _M_signers_file = _M_all_signers ? nullptr : signers;
+  _M_hashes_file = hashes;
+  _M_paths_file = paths;
+  _M_policy_file = nullptr;
+
+  return load();
+}
+
+bool software_restriction_policies::load(const TCHAR* policy)
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  _M_signers_file = nullptr;
+  _M_hashes_file = nullptr;
+  _M_paths_file = nullptr;
+  _M_policy_file = policy;
+
+  return load();
+}
+
+bool software_restriction_policies::reload()
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+  return load();
+}
+
+bool software_restriction_policies::compile(const TCHAR* filename) const
+{
+  unsigned slot;
+  const policy* policy;
+  if ((policy = _M_policy.acquire(slot)) != nullptr) {
+    bool ret = policy->compile(filename);
+
+    _M_policy.release(slot);
+
+    return ret;
+  }
+
+  _M_policy.release(slot);
+
+  return false;
+}
+
+bool software_restriction_policies::index_catalogs(const TCHAR* filename)
+{
+  std::lock_guard<std::mutex> lock(_M_catalog_mutex);
+
+  // Directory of the catalogs the catalog API uses (DRIVER_ACTION_VERIFY).
+  wchar_t directory[MAX_PATH];
+  UINT len = GetSystemDirectoryW(directory, _countof(directory));
+  if ((len == 0) ||
+      (len >= _countof(directory)) ||
+      (_snwprintf_s(_M_catalog_directory,
+                    _countof(_M_catalog_directory),
+                    _TRUNCATE,
+                    L"%s\\CatRoot\\{F750E6C3-38EE-11D1-85E5-00C04FC295EE}",
+                    directory) < 0)) {
+    *_M_catalog_directory = 0;
+    return false;
+  }
+
+  _M_catalog_index_file = filename;
+
+  // Load the previous index (if any).
+  catalog_index previous;
+  bool loaded = false;
+  if (filename) {
+#ifdef UNICODE
+    loaded = previous.load(filename);
+#else
+    wchar_t path[_MAX_PATH];
+    size_t pathlen;
+    loaded = ((mbstowcs_s(&pathlen,
+                          path,
+                          _countof(path),
+                          filename,
+                          _countof(path)) == 0) &&
+              (previous.load(path)));
+#endif
+  }
+
+  if (build_catalog_index(loaded ? &previous : nullptr)) {
+    return true;
+  }
+
+  *_M_catalog_directory = 0;
+
+  return false;
+}
+
+bool software_restriction_policies::update_catalog_index()
+{
+  std::lock_guard<std::mutex> lock(_M_catalog_mutex);
+
+  // Build the new index from the current one.
+  unsigned slot;
+  const catalog_index* current = _M_catalog_index.acquire(slot);
+
+  bool ret = ((current) && (build_catalog_index(current)));
+
+  _M_catalog_index.release(slot);
+
+  return ret;
+}
+
+bool software_restriction_policies::build_catalog_index(
+  const catalog_index* previous
+)
+{
+  size_t nthreads;
+  if ((nthreads = std::thread::hardware_concurrency()) == 0) {
+    nthreads = 1;
+  }
+
+  catalog_index* index;
+  if ((index = new (std::nothrow) catalog_index()) == nullptr) {
+    return false;
+  }
+
+  bool built;
+  {
+    EVENT_TRACE_SCOPE(event_index_catalogs);
+    built = index->build(_M_catalog_directory, previous, nthreads);
+  }
+
+  if (!built) {
+    delete index;
+    return false;
+  }
+
+  _tprintf(_T("Catalogs indexed: %llu files (%llu parsed, %llu failed), ")
+           _T("%llu hashes.\n"),
+           static_cast<unsigned long long>(index->files()),
+           static_cast<unsigned long long>(index->parsed()),
+           static_cast<unsigned long long>(index->failed()),
+           static_cast<unsigned long long>(index->count()));
+
+  publish_stats(*index);
+
+  // Save the index (if it has changed).
+  if ((_M_catalog_index_file) &&
+      ((!previous) ||
+       (index->parsed() > 0) ||
+       (index->files() != previous->files()))) {
+#ifdef UNICODE
+    const wchar_t* filename = _M_catalog_index_file;
+#else
+    wchar_t filename[_MAX_PATH];
+    size_t len;
+    if (mbstowcs_s(&len,
+                   filename,
+                   _countof(filename),
+                   _M_catalog_index_file,
+                   _countof(filename)) != 0) {
+      *filename = 0;
+    }
+#endif
+
+    if ((!*filename) || (!index->save(filename))) {
+      _ftprintf_p(stderr, _T("Error saving the index of the catalogs.\n"));
+    }
+  }
+
+  _M_catalog_index.publish(index);
+
+  return true;
+}
+
+bool software_restriction_policies::load()
+{
+  // Build the new policy while the current one is being used.
+  policy* p;
+  if ((p = new (std::nothrow) policy()) != nullptr) {
+    if ((_M_policy_file) ?
+          p->load(_M_policy_file) :
+          p->load(_M_signers_file, _M_hashes_file, _M_paths_file)) {
+      // Switch the persistent verdicts to the new policy before publishing
+      // it, so no verdict of the previous policy is appended afterwards.
+      if ((_M_verdict_store_file) &&
+          (!_M_verdict_store.reset(fingerprint(*p),
+                                   p->generation(),
+                                   _M_cache))) {
+        _ftprintf_p(stderr, _T("Error writing the persistent verdicts.\n"));
+      }
+
+      // Remove the fast path of the previous policy first: until the driver
+      // has the new one, every path is sent to the client, so the paths the
+      // new policy no longer allows are never allowed by the driver.
+      if ((_M_transport) && (!_M_transport->set_fast_path(nullptr, 0))) {
+        _ftprintf_p(stderr, _T("Error removing the fast path.\n"));
+      }
+
+      publish_stats(*p);
+      _M_policy.publish(p);
+
+      publish_fast_path(*p);
+
+      return true;
+    }
+
+    print_errors(*p);
+
+    delete p;
+  }
+
+  return false;
+}
+
+void software_restriction_policies::print_errors(const policy& policy) const
+{
+  size_t nerrors = policy.errors();
+  for (size_t i = 0; (i < nerrors) && (i < policy::MAX_ERRORS); i++) {
+    const policy::load_error& error = policy.error(i);
+
+    const TCHAR* filename;
+    switch (error.file) {
+      case policy::file::signers:
+        filename = _M_signers_file;
+        break;
+      case policy::file::hashes:
+        filename = _M_hashes_file;
+        break;
+      default:
+        filename = _M_paths_file;
+    }
+
+    if (error.line > 0) {
+      _ftprintf_p(stderr,
+                  _T("%s, line %llu: %s.\n"),
+                  filename,
+                  static_cast<unsigned long long>(error.line),
+                  policy::describe(error.reason));
+    } else {
+      _ftprintf_p(stderr,
+                  _T("%s: %s.\n"),
+                  filename,
+                  policy::describe(error.reason));
+    }
+  }
+
+  if (nerrors > policy::MAX_ERRORS) {
+    _ftprintf_p(stderr,
+                _T("%llu more errors.\n"),
+                static_cast<unsigned long long>(nerrors - policy::MAX_ERRORS));
+  }
+}
+
+bool software_restriction_policies::persist_verdicts(const TCHAR* filename,
+                                                     size_t& restored)
+{
+  // The verdicts are restored in the verdict cache.
+  if (_M_cache_size == 0) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  if (_M_verdict_store_file) {
+    return false;
+  }
+
+#ifdef UNICODE
+  const wchar_t* path = filename;
+#else
+  wchar_t path[_MAX_PATH];
+  size_t len;
+  if (mbstowcs_s(&len, path, _countof(path), filename, _countof(path)) != 0) {
+    return false;
+  }
+#endif
+
+  unsigned slot;
+  const policy* policy;
+  if ((policy = _M_policy.acquire(slot)) != nullptr) {
+    // Keep as many verdicts as fit in the cache.
+    if (_M_verdict_store.open(path,
+                              _M_cache_size,
+                              fingerprint(*policy),
+                              policy->generation(),
+                              _M_cache)) {
+      _M_policy.release(slot);
+
+      _M_verdict_store_file = filename;
+      restored = _M_verdict_store.restored();
+
+      return true;
+    }
+  }
+
+  _M_policy.release(slot);
+
+  return false;
 }
 
 bool software_restriction_policies::allow(const TCHAR* filename) const
+{
+  return allow(filename, _M_catalog);
+}
+
+bool software_restriction_policies::allow(const TCHAR* filename,
+                                          const catalog& catalog,
+                                          evaluation_stats* stats) const
+{
+  bool allowed;
+  return ((allow(filename, catalog, NO_DEADLINE, allowed, stats)) &&
+          (allowed));
+}
+
+bool software_restriction_policies::allow(const TCHAR* filename,
+                                          const catalog& catalog,
+                                          uint64_t deadline,
+                                          bool& allowed,
+                                          evaluation_stats* stats) const
 {
 #ifdef UNICODE
   const WCHAR* tmpfilename = filename;
@@ -51,38 +375,244 @@ bool software_restriction_policies::allow(const TCHAR* filename) const
   WCHAR path[_MAX_PATH];
   size_t len;
   if (mbstowcs_s(&len, path, _countof(path), filename, _countof(path)) != 0) {
-    return false;
+    allowed = false;
+    return true;
   }
 
   const WCHAR* tmpfilename = path;
 #endif
 
+  // Use the current policy until the end of the evaluation (even if a new
+  // one is published in the meantime).
+  unsigned slot;
+  const policy* policy;
+  if ((policy = _M_policy.acquire(slot)) == nullptr) {
+    _M_policy.release(slot);
+
+    allowed = false;
+    return true;
+  }
+
+  stage_timer timer(stats);
+
+  // Probe the identity of the file (for the cache, the evaluations in
+  // progress and the statistics).
+  file_identity id;
+  bool identified = _M_file_identity_probe.probe(tmpfilename, len, id);
+
+  // If the verdict for this version of the file is cached...
+  bool cacheable = ((identified) && (_M_cache_size > 0));
+
+  bool cached = ((cacheable) &&
+                 (_M_cache.find(tmpfilename,
+                                len,
+                                id,
+                                policy->generation(),
+                                allowed)));
+
+  timer.end(evaluation_stats::stage_cache);
+
+  if (stats) {
+    if ((stats->identified = identified) == true) {
+      stats->id = id;
+    }
+
+    stats->cache_lookup = cacheable;
+    stats->cached = cached;
+  }
+
+  bool completed = true;
+
+  if (!cached) {
+    // If the same version of the file is being evaluated by another
+    // thread, wait for its verdict instead of evaluating the file again.
+    uint64_t key = verdict_cache::key(tmpfilename, len);
+
+    bool leader = true;
+    inflight_evaluations::evaluation* e =
+      identified ? _M_inflight.join(key, id, policy->generation(), leader) :
+                   nullptr;
+
+    bool coalesced = false;
+    if ((e) && (!leader)) {
+      coalesced = _M_inflight.wait(e, deadline, allowed);
+      e = nullptr;
+
+      if (stats) {
+        stats->coalesced = coalesced;
+      }
+    }
+
+    // If the other evaluation was abandoned, the file is evaluated here.
+    if (!coalesced) {
+      // If the evaluation ended before the deadline (and the verdict
+      // doesn't come from an error reading the file)...
+      bool cache;
+      if ((completed = evaluate(tmpfilename,
+                                len,
+                                catalog,
+                                *policy,
+                                deadline,
+                                timer,
+                                allowed,
+                                cache)) &&
+          (cache) &&
+          (cacheable)) {
+        _M_cache.insert(key, id, policy->generation(), allowed);
+
+        if ((allowed) && (_M_verdict_store_file)) {
+          _M_verdict_store.append(key, id, policy->generation());
+        }
+      }
+
+      // Publish the verdict once it is in the cache, so no request
+      // evaluates the file in between.
+      if (e) {
+        _M_inflight.finish(e, completed, allowed);
+      }
+    }
+  }
+
+  _M_policy.release(slot);
+
+  return completed;
+}
+
+uint64_t software_restriction_policies::fingerprint(const policy& policy) const
+{
+  uint64_t fingerprint = policy.fingerprint();
+  return _M_all_signers ? ~fingerprint : fingerprint;
+}
+
+bool software_restriction_policies::evaluate(const wchar_t* filename,
+                                             size_t len,
+                                             const catalog& catalog,
+                                             const policy& policy,
+                                             uint64_t deadline,
+                                             stage_timer& timer,
+                                             bool& allowed,
+                                             bool& cache) const
+{
+  // The stages go from the cheapest to the most expensive one, the deadline
+  // is checked before each of them.
+  cache = true;
+
   // If the path is allowed...
-  if (_M_paths.find(tmpfilename, len)) {
+  allowed = policy.path(filename, len);
+  timer.end(evaluation_stats::stage_path);
+
+  if (allowed) {
     return true;
   }
 
+  if (expired(deadline)) {
+    return false;
+  }
+
+  // Open the file once: the signature check, the hashes and the lookups of
+  // the hashes use the same context.
+  image_context image;
+  bool opened = image.open(filename);
+  timer.end(evaluation_stats::stage_open);
+
+  // The file is denied if it cannot be opened or read, but the verdict is
+  // not cached: the error may be transient. A malformed image is denied.
+  if (!opened) {
+    cache = !image.failed();
+    return true;
+  }
+
+  if (expired(deadline)) {
+    return false;
+  }
+
   // If the file is signed...
-  if (is_signed(tmpfilename)) {
+  allowed = is_signed(image, policy, timer.stats());
+  timer.end(evaluation_stats::stage_signature);
+
+  if (allowed) {
     return true;
   }
 
-  // Calculate hash.
-  BYTE hash[HASH_MAX_LEN];
-  DWORD hashlen;
-  if (calculate_hash(filename, hash, hashlen)) {
-    // If the file is in the catalog...
-    if (in_catalog(hash, hashlen)) {
+  // Calculate the SHA-1 hash and, if there are SHA-256 hashes, the SHA-256
+  // hash (both in a single pass over the file).
+  bool sha256_hashes = policy.sha256_hashes();
+  bool hashed = hash(image, sha256_hashes, deadline);
+  timer.end(evaluation_stats::stage_hash);
+
+  if (!hashed) {
+    // If the file couldn't be read, deny it (without caching the verdict).
+    if (image.failed()) {
+      cache = false;
       return true;
     }
 
-    // If the hash is allowed...
-    if (_M_hashes.find(hash, hashlen)) {
-      return true;
+    return false;
+  }
+
+  if (timer.stats()) {
+    timer.stats()->hashed = image.hashed();
+  }
+
+  // The catalog API (used if the index is incomplete) can be slow.
+  if (expired(deadline)) {
+    return false;
+  }
+
+  // If the file is in the catalog...
+  allowed = in_catalog(image, sha256_hashes, catalog);
+  timer.end(evaluation_stats::stage_catalog);
+
+  if (allowed) {
+    return true;
+  }
+
+  // If the hash is allowed...
+  allowed = ((policy.sha1_hash(image.sha1())) ||
+             ((sha256_hashes) && (policy.sha256_hash(image.sha256()))));
+  timer.end(evaluation_stats::stage_hashes);
+
+  return true;
+}
+
+bool software_restriction_policies::hash(image_context& image,
+                                         bool sha256,
+                                         uint64_t deadline) const
+{
+  uint64_t size = image.hash_size();
+  uint64_t start = monotonic_clock::now();
+
+  // Don't start if the file is not expected to be hashed before the
+  // deadline (the hashing also stops at the deadline).
+  if (deadline != NO_DEADLINE) {
+    uint64_t estimate = (size * 1000) / _M_hash_speed.load();
+    if ((start >= deadline) || (estimate > deadline - start)) {
+      return false;
     }
   }
 
-  return false;
+  if (!image.hash(sha256, deadline)) {
+    return false;
+  }
+
+  // Update the hashing speed (the small files are dominated by the
+  // overhead).
+  if (size >= HASH_SPEED_MIN_SIZE) {
+    uint64_t elapsed = (monotonic_clock::now() - start) / 1000;
+
+    if (elapsed > 0) {
+      uint64_t speed = size / elapsed;
+      if (speed == 0) {
+        speed = 1;
+      }
+
+      // Several threads may update it at the same time, one of the updates
+      // wins.
+      _M_hash_speed.store(((_M_hash_speed.load() * 7) + speed) / 8);
+    }
+  }
+
+  return true;
 }
 
 bool software_restriction_policies::print_signers(const TCHAR* filename) const
@@ -99,48 +629,28 @@ bool software_restriction_policies::print_signers(const TCHAR* filename) const
   const WCHAR* tmpfilename = path;
 #endif
 
-  HCERTSTORE certificate_store;
-  HCRYPTMSG msg;
-  if (CryptQueryObject(CERT_QUERY_OBJECT_FILE,
-                       tmpfilename,
-                       CERT_QUERY_CONTENT_FLAG_PKCS7_SIGNED_EMBED,
-                       CERT_QUERY_FORMAT_FLAG_BINARY,
-                       0,
-                       NULL,
-                       NULL,
-                       NULL,
-                       &certificate_store,
-                       &msg,
-                       NULL)) {
-    // Get number of signers.
-    DWORD nsigners;
-    DWORD len = sizeof(DWORD);
-    if (CryptMsgGetParam(msg,
-                         CMSG_SIGNER_COUNT_PARAM,
-                         0,
-                         &nsigners,
-                         &len)) {
-      for (DWORD i = 0; i < nsigners; i++) {
-        wchar_t signer[SIGNER_MAX_LEN + 1];
-        DWORD signerlen;
-        if (get_signer(certificate_store, msg, i, signer, signerlen)) {
-          _tprintf(_T("Signer: '%ls'.\n"), signer);
-        } else {
-          CertCloseStore(certificate_store, 0);
-          CryptMsgClose(msg);
+  image_context image;
+  if (!image.open(tmpfilename)) {
+    return false;
+  }
 
-          return false;
-        }
+  // Parse signature.
+  pkcs7 signature;
+  size_t len;
+  const uint8_t* data;
+  if (((data = image.signature(len)) != nullptr) &&
+      (signature.parse(data, len))) {
+    for (size_t i = 0; i < signature.count(); i++) {
+      wchar_t signer[SIGNER_MAX_LEN + 1];
+      size_t signerlen;
+      if (get_signer(signature, i, signer, signerlen)) {
+        _tprintf(_T("Signer: '%ls'.\n"), signer);
+      } else {
+        return false;
       }
-
-      CertCloseStore(certificate_store, 0);
-      CryptMsgClose(msg);
-
-      return true;
-    } else {
-      CertCloseStore(certificate_store, 0);
-      CryptMsgClose(msg);
     }
+
+    return true;
   }
 
   return false;
@@ -148,11 +658,30 @@ bool software_restriction_policies::print_signers(const TCHAR* filename) const
 
 bool software_restriction_policies::print_hash(const TCHAR* filename) const
 {
-  BYTE hash[HASH_MAX_LEN];
-  DWORD hashlen;
-  if (calculate_hash(filename, hash, hashlen)) {
-    for (DWORD i = 0; i < hashlen; i++) {
-      _tprintf(_T("%02x"), hash[i]);
+#ifdef UNICODE
+  const WCHAR* tmpfilename = filename;
+#else
+  WCHAR path[_MAX_PATH];
+  size_t len;
+  if (mbstowcs_s(&len, path, _countof(path), filename, _countof(path)) != 0) {
+    return false;
+  }
+
+  const WCHAR* tmpfilename = path;
+#endif
+
+  image_context image;
+  if ((image.open(tmpfilename)) && (image.hash(true))) {
+    const uint8_t* sha1 = image.sha1();
+    for (size_t i = 0; i < authenticode::SHA1_LEN; i++) {
+      _tprintf(_T("%02x"), sha1[i]);
+    }
+
+    _tprintf(_T("\n"));
+
+    const uint8_t* sha256 = image.sha256();
+    for (size_t i = 0; i < authenticode::SHA256_LEN; i++) {
+      _tprintf(_T("%02x"), sha256[i]);
     }
 
     _tprintf(_T("\n"));
@@ -163,307 +692,221 @@ bool software_restriction_policies::print_hash(const TCHAR* filename) const
   }
 }
 
-bool software_restriction_policies::load_signers(const TCHAR* filename)
+void software_restriction_policies::print_stats() const
 {
-  // Open file for reading.
-  FILE* file;
-  if (_tfopen_s(&file, filename, _T("r, ccs=UTF-8")) == 0) {
-    // For each line...
-    wchar_t line[SIGNER_MAX_LEN + 1];
-    while (fgetws(line, _countof(line), file)) {
-      // Skip initial blanks (if any).
-      const wchar_t* begin = line;
-      while ((*begin == L' ') || (*begin == L'\t')) {
-        begin++;
-      }
+  uint64_t hits = _M_cache.hits();
+  uint64_t misses = _M_cache.misses();
+  _tprintf(_T("Verdict cache: %llu hits, %llu misses (%.1f%%).\n"),
+           static_cast<unsigned long long>(hits),
+           static_cast<unsigned long long>(misses),
+           (hits + misses > 0) ? (100.0 * hits) / (hits + misses) : 0.0);
+
+  hits = _M_signer_cache.hits();
+  misses = _M_signer_cache.misses();
+  _tprintf(_T("Signer cache: %llu hits, %llu misses (%.1f%%).\n"),
+           static_cast<unsigned long long>(hits),
+           static_cast<unsigned long long>(misses),
+           (hits + misses > 0) ? (100.0 * hits) / (hits + misses) : 0.0);
+
+  _tprintf(_T("Coalesced evaluations: %llu.\n"),
+           static_cast<unsigned long long>(_M_inflight.coalesced()));
+}
 
-      // If not a comment...
-      if (*begin != L'#') {
-        const wchar_t* ptr = begin;
-        const wchar_t* end = begin;
-        while ((*ptr) && (*ptr != L'\n')) {
-          if (*ptr > L' ') {
-            end = ++ptr;
-          } else {
-            ptr++;
-          }
-        }
+void software_restriction_policies::publish_stats(service_stats* stats)
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+  std::lock_guard<std::mutex> catalog_lock(_M_catalog_mutex);
+
+  if ((_M_stats = stats) != nullptr) {
+    unsigned slot;
+    const policy* policy;
+    if ((policy = _M_policy.acquire(slot)) != nullptr) {
+      publish_stats(*policy);
+    }
 
-        size_t len;
-        if ((len = end - begin) > 0) {
-          if (!_M_signers.add(begin, len)) {
-            fclose(file);
-            return false;
-          }
-        }
-      }
+    _M_policy.release(slot);
+
+    const catalog_index* index;
+    if ((index = _M_catalog_index.acquire(slot)) != nullptr) {
+      publish_stats(*index);
     }
 
-    fclose(file);
+    _M_catalog_index.release(slot);
+  }
+}
+
+void software_restriction_policies::publish_stats(const policy& policy)
+{
+  if (_M_stats) {
+    policy::memory memory;
+    policy.memory_usage(memory);
+
+    _M_stats->set(service_stats::gauge_generation, policy.generation());
+    _M_stats->set(service_stats::gauge_signers_memory, memory.signers);
+    _M_stats->set(service_stats::gauge_sha1_hashes_memory,
+                  memory.sha1_hashes);
+    _M_stats->set(service_stats::gauge_sha256_hashes_memory,
+                  memory.sha256_hashes);
+    _M_stats->set(service_stats::gauge_paths_memory, memory.paths);
+  }
+}
 
-    return true;
+void software_restriction_policies::publish_stats(const catalog_index& index)
+{
+  if (_M_stats) {
+    _M_stats->set(service_stats::gauge_catalog_hashes, index.count());
+    _M_stats->set(service_stats::gauge_catalog_index_memory,
+                  index.memory_usage());
   }
+}
 
-  return false;
+bool software_restriction_policies::fast_path(void*& blob, size_t& len) const
+{
+  unsigned slot;
+  const policy* policy;
+  bool ret = (((policy = _M_policy.acquire(slot)) != nullptr) &&
+              (policy->fast_path(blob, len)));
+
+  _M_policy.release(slot);
+
+  return ret;
 }
 
-bool software_restriction_policies::load_hashes(const TCHAR* filename)
+void software_restriction_policies::publish_fast_path(transport* transport)
 {
-  // Open file for reading.
-  FILE* file;
-  if (_tfopen_s(&file, filename, _T("r")) == 0) {
-    // For each line...
-    char line[(2 * HASH_MAX_LEN) + 256];
-    while (fgets(line, sizeof(line), file)) {
-      // If not a comment...
-      if (*line != '#') {
-        BYTE hash[HASH_MAX_LEN];
-        const BYTE* const hashend = hash + sizeof(hash);
-        BYTE* out = hash;
-        size_t len = 0;
-
-        const char* ptr = line;
-        while ((out < hashend) && (*ptr > ' ')) {
-          if ((*ptr >= '0') && (*ptr <= '9')) {
-            if ((len % 2) == 0) {
-              *out = (*ptr - '0') << 4;
-            } else {
-              *out++ |= (*ptr - '0');
-            }
-          } else if ((*ptr >= 'a') && (*ptr <= 'f')) {
-            if ((len % 2) == 0) {
-              *out = (*ptr - 'a' + 10) << 4;
-            } else {
-              *out++ |= (*ptr - 'a' + 10);
-            }
-          } else if ((*ptr >= 'A') && (*ptr <= 'F')) {
-            if ((len % 2) == 0) {
-              *out = (*ptr - 'A' + 10) << 4;
-            } else {
-              *out++ |= (*ptr - 'A' + 10);
-            }
-          } else {
-            fclose(file);
-            return false;
-          }
-
-          len++;
-          ptr++;
-        }
+  std::lock_guard<std::mutex> lock(_M_mutex);
 
-        if (len > 0) {
-          if (((len % 2) == 0) && ((*ptr == '\n') || (!*ptr))) {
-            if (!_M_hashes.add(hash, out - hash)) {
-              fclose(file);
-              return false;
-            }
-          } else {
-            fclose(file);
-            return false;
-          }
-        }
-      }
+  if ((_M_transport = transport) != nullptr) {
+    unsigned slot;
+    const policy* policy;
+    if ((policy = _M_policy.acquire(slot)) != nullptr) {
+      publish_fast_path(*policy);
     }
 
-    fclose(file);
-
-    return true;
+    _M_policy.release(slot);
   }
-
-  return false;
 }
 
-bool software_restriction_policies::load_paths(const TCHAR* filename)
+void software_restriction_policies::publish_fast_path(const policy& policy)
 {
-  // Open file for reading.
-  FILE* file;
-  if (_tfopen_s(&file, filename, _T("r, ccs=UTF-8")) == 0) {
-    // For each line...
-    wchar_t line[_MAX_PATH + 256];
-    while (fgetws(line, _countof(line), file)) {
-      // If not a comment...
-      if (*line != L'#') {
-        const wchar_t* ptr = line;
-        while ((*ptr) && (*ptr != L'\n')) {
-          ptr++;
-        }
-
-        size_t len;
-        if ((len = ptr - line) > 0) {
-          if (!_M_paths.add(line, len)) {
-            fclose(file);
-            return false;
-          }
-        }
+  if (_M_transport) {
+    void* blob;
+    size_t len;
+    if (policy.fast_path(blob, len)) {
+      bool ret = _M_transport->set_fast_path(blob, len);
+      free(blob);
+
+      if (ret) {
+        return;
       }
     }
 
-    fclose(file);
+    // Don't leave the fast path of the previous policy.
+    _M_transport->set_fast_path(nullptr, 0);
 
-    return true;
+    _ftprintf_p(stderr, _T("Error setting the fast path of the policy.\n"));
   }
-
-  return false;
 }
 
-bool software_restriction_policies::in_catalog(BYTE* hash, DWORD hashlen) const
+bool software_restriction_policies::in_catalog(const image_context& image,
+                                               bool sha256,
+                                               const catalog& catalog) const
 {
-  HCATINFO info;
-  if ((info = CryptCATAdminEnumCatalogFromHash(_M_catalog,
-                                               hash,
-                                               hashlen,
-                                               0,
-                                               NULL)) != NULL) {
-    CryptCATAdminReleaseCatalogContext(_M_catalog, info, 0);
+  unsigned slot;
+  const catalog_index* index;
+  if ((index = _M_catalog_index.acquire(slot)) != nullptr) {
+    bool found = ((index->find(image.sha1(), authenticode::SHA1_LEN)) ||
+                  ((sha256) &&
+                   (index->find(image.sha256(), authenticode::SHA256_LEN))));
 
-    return true;
+    bool complete = (index->failed() == 0);
+
+    _M_catalog_index.release(slot);
+
+    // If the hash is not in the index but a catalog file could not be
+    // parsed, ask the catalog API.
+    if ((found) || (complete)) {
+      return found;
+    }
+  } else {
+    _M_catalog_index.release(slot);
   }
 
-  return false;
+  return catalog.find(image.sha1(), authenticode::SHA1_LEN);
 }
 
-bool software_restriction_policies::is_signed(const wchar_t* filename) const
+bool software_restriction_policies::is_signed(const image_context& image,
+                                              const policy& policy,
+                                              evaluation_stats* stats) const
 {
-  HCERTSTORE certificate_store;
-  HCRYPTMSG msg;
-  if (CryptQueryObject(CERT_QUERY_OBJECT_FILE,
-                       filename,
-                       CERT_QUERY_CONTENT_FLAG_PKCS7_SIGNED_EMBED,
-                       CERT_QUERY_FORMAT_FLAG_BINARY,
-                       0,
-                       NULL,
-                       NULL,
-                       NULL,
-                       &certificate_store,
-                       &msg,
-                       NULL)) {
+  // Parse signature (in place, the signature is in the mapping).
+  pkcs7 signature;
+  size_t len;
+  const uint8_t* data;
+  if (((data = image.signature(len)) != nullptr) &&
+      (signature.parse(data, len))) {
     // All signers?
     if (_M_all_signers) {
-      CertCloseStore(certificate_store, 0);
-      CryptMsgClose(msg);
-
       return true;
     }
 
-    // Get number of signers.
-    DWORD nsigners;
-    DWORD len = sizeof(DWORD);
-    if (CryptMsgGetParam(msg,
-                         CMSG_SIGNER_COUNT_PARAM,
-                         0,
-                         &nsigners,
-                         &len)) {
-      for (DWORD i = 0; i < nsigners; i++) {
-        wchar_t signer[SIGNER_MAX_LEN + 1];
-        DWORD signerlen;
-        if (get_signer(certificate_store, msg, i, signer, signerlen)) {
-#if _DEBUG
-          _tprintf(_T("Filename: '%ls', signer: '%ls'.\n"), filename, signer);
-#endif
-
-          if (_M_signers.find(signer, signerlen)) {
-            CertCloseStore(certificate_store, 0);
-            CryptMsgClose(msg);
+    for (size_t i = 0; i < signature.count(); i++) {
+      // If the verdict for this certificate is cached...
+      pkcs7::signer info;
+      if (!signature.identity(i, info)) {
+        return false;
+      }
 
-            return true;
-          }
-        } else {
-          CertCloseStore(certificate_store, 0);
-          CryptMsgClose(msg);
+      bool allowed;
+      if (!_M_signer_cache.find(info.issuer.data,
+                                info.issuer.len,
+                                info.serial.data,
+                                info.serial.len,
+                                policy.generation(),
+                                allowed)) {
+        if (stats) {
+          stats->signer_misses++;
+        }
 
+        wchar_t signer[SIGNER_MAX_LEN + 1];
+        size_t signerlen;
+        if (!get_signer(signature, i, signer, signerlen)) {
           return false;
         }
-      }
-    }
 
-    CertCloseStore(certificate_store, 0);
-    CryptMsgClose(msg);
-  }
+#if _DEBUG
+        _tprintf(_T("Signer: '%ls'.\n"), signer);
+#endif
 
-  return false;
-}
+        allowed = policy.signer(signer, signerlen);
 
-bool software_restriction_policies::get_signer(HCERTSTORE certificate_store,
-                                               HCRYPTMSG msg,
-                                               DWORD idx,
-                                               wchar_t* signer,
-                                               DWORD& signerlen) const
-{
-  UINT8 buf[SIGNER_INFO_MAX_LEN];
-  CMSG_SIGNER_INFO* signer_info = reinterpret_cast<CMSG_SIGNER_INFO*>(buf);
-  DWORD len = sizeof(buf);
-
-  if (CryptMsgGetParam(msg,
-                       CMSG_SIGNER_INFO_PARAM,
-                       idx,
-                       signer_info,
-                       &len)) {
-    CERT_INFO cert_info;
-    cert_info.Issuer = signer_info->Issuer;
-    cert_info.SerialNumber = signer_info->SerialNumber;
-
-    const CERT_CONTEXT* context;
-    if ((context = CertFindCertificateInStore(certificate_store,
-                                              ENCODING,
-                                              0,
-                                              CERT_FIND_SUBJECT_CERT,
-                                              &cert_info,
-                                              NULL)) != NULL) {
-      // Get signer name size.
-      if (((len = CertGetNameStringW(context,
-                                     CERT_NAME_SIMPLE_DISPLAY_TYPE,
-                                     0,
-                                     NULL,
-                                     NULL,
-                                     0)) > 1) &&
-          (len - 1 <= SIGNER_MAX_LEN)) {
-        // Get signer name.
-        if (CertGetNameStringW(context,
-                               CERT_NAME_SIMPLE_DISPLAY_TYPE,
-                               0,
-                               NULL,
-                               signer,
-                               len) > 1) {
-          CertFreeCertificateContext(context);
-
-          signerlen = len - 1; // Without trailing '\0'.
-          return true;
-        }
+        _M_signer_cache.insert(info.issuer.data,
+                               info.issuer.len,
+                               info.serial.data,
+                               info.serial.len,
+                               policy.generation(),
+                               allowed);
+      } else if (stats) {
+        stats->signer_hits++;
       }
 
-      CertFreeCertificateContext(context);
+      if (allowed) {
+        return true;
+      }
     }
   }
 
   return false;
 }
 
-bool software_restriction_policies::calculate_hash(const TCHAR* filename,
-                                                   BYTE* hash,
-                                                   DWORD& hashlen) const
+bool software_restriction_policies::get_signer(const pkcs7& signature,
+                                               size_t idx,
+                                               wchar_t* signer,
+                                               size_t& signerlen) const
 {
-  // Open file for reading.
-  HANDLE hFile;
-  if ((hFile = CreateFile(filename,
-                          GENERIC_READ,
-                          FILE_SHARE_READ,
-                          NULL,
-                          OPEN_EXISTING,
-                          FILE_ATTRIBUTE_NORMAL,
-                          NULL)) != INVALID_HANDLE_VALUE) {
-    // Calculate hash.
-    hashlen = HASH_MAX_LEN;
-    if (CryptCATAdminCalcHashFromFileHandle2(_M_catalog,
-                                             hFile,
-                                             &hashlen,
-                                             hash,
-                                             0)) {
-      CloseHandle(hFile);
-      return true;
-    }
-
-    CloseHandle(hFile);
-  }
-
-  return false;
+  // Get the subject of the signer's certificate and its display name.
+  pkcs7::signer info;
+  return ((signature.get(idx, info)) &&
+          (pkcs7::name(info.subject, signer, SIGNER_MAX_LEN + 1, signerlen)) &&
+          (signerlen > 0));
 }
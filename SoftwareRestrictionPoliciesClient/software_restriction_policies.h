@@ -2,14 +2,33 @@
 #define SOFTWARE_RESTRICTION_POLICIES_H
 
 #include <windows.h>
-#include <mscat.h>
-#include "string_list.h"
-#include "path_list.h"
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "catalog.h"
+#include "catalog_index.h"
+#include "policy.h"
+#include "snapshot.h"
+#include "file_identity.h"
+#include "verdict_cache.h"
+#include "verdict_store.h"
+#include "inflight_evaluations.h"
+#include "signer_cache.h"
+#include "image_context.h"
+#include "evaluation_stats.h"
+#include "monotonic_clock.h"
+#include "service_stats.h"
+#include "transport.h"
+#include "pkcs7.h"
 
 class software_restriction_policies {
   public:
     // Constructor.
-    software_restriction_policies(bool all_signers);
+    software_restriction_policies(
+      bool all_signers,
+      size_t cache_size = verdict_cache::default_size,
+      unsigned deny_ttl = verdict_cache::default_deny_ttl
+    );
 
     // Destructor.
     ~software_restriction_policies();
@@ -17,62 +36,210 @@ class software_restriction_policies {
     // Initialize.
     bool init();
 
-    // Load.
+    // Load (the file names must stay valid, they are used to reload).
     bool load(const TCHAR* signers,
               const TCHAR* hashes,
               const TCHAR* paths);
 
+    // Load compiled policy (the file is mapped and used in place).
+    bool load(const TCHAR* policy);
+
+    // Reload: build a new policy from the same files and publish it.
+    // The evaluations in progress keep using the previous policy.
+    bool reload();
+
+    // Compile policy (write the loaded lists to a file).
+    bool compile(const TCHAR* filename) const;
+
+    // Index the catalog files, so the hashes are looked up without the
+    // catalog API. If `filename` is not nullptr, the index is loaded from it
+    // (only the catalog files which have changed are parsed) and saved to it.
+    bool index_catalogs(const TCHAR* filename);
+
+    // Update the index of the catalog files (only the catalog files which
+    // have changed are parsed).
+    bool update_catalog_index();
+
+    // Keep the allowed verdicts in `filename`, so they survive a restart:
+    // the verdicts of the current policy are put in the verdict cache
+    // (`restored`: how many) and the new ones are appended to the file.
+    bool persist_verdicts(const TCHAR* filename, size_t& restored);
+
+    // Get the directory of the catalog files (nullptr if they are not
+    // indexed).
+    const wchar_t* catalog_directory() const;
+
     // Allow.
     bool allow(const TCHAR* filename) const;
 
+    // Allow (using the catalog of the calling thread). If `stats` is not
+    // nullptr, it is filled with what happened and how long each stage took.
+    bool allow(const TCHAR* filename,
+               const catalog& catalog,
+               evaluation_stats* stats = nullptr) const;
+
+    // Allow, if the verdict is reached before `deadline` (monotonic clock,
+    // nanoseconds). Returns false if the evaluation was abandoned, because
+    // it would have ended after the deadline (`allowed` is then not set and
+    // nothing is cached).
+    bool allow(const TCHAR* filename,
+               const catalog& catalog,
+               uint64_t deadline,
+               bool& allowed,
+               evaluation_stats* stats = nullptr) const;
+
     // Print signers.
     bool print_signers(const TCHAR* filename) const;
 
     // Print hash.
     bool print_hash(const TCHAR* filename) const;
 
+    // Print statistics of the caches.
+    void print_stats() const;
+
+    // Publish the gauges of the policy and of the index of the catalog files
+    // in `stats` (nullptr: don't publish).
+    void publish_stats(service_stats* stats);
+
+    // Compile the fast path of the current policy (see fast_path.h),
+    // allocated with malloc().
+    bool fast_path(void*& blob, size_t& len) const;
+
+    // Set the fast path of the current policy, and of every policy loaded
+    // afterwards, in `transport` (nullptr: stop).
+    void publish_fast_path(transport* transport);
+
   private:
-    static const size_t HASH_MAX_LEN = 20;
-    static const DWORD SIGNER_INFO_MAX_LEN = 64 * 1024;
-    static const DWORD SIGNER_MAX_LEN = 4 * 1024;
+    static const DWORD SIGNER_MAX_LEN = policy::SIGNER_MAX_LEN;
+
+    // No deadline.
+    static const uint64_t NO_DEADLINE = UINT64_MAX;
+
+    // Initial estimate of the hashing speed (bytes per microsecond).
+    static const uint64_t DEFAULT_HASH_SPEED = 256;
 
-    static const GUID driver_action_verify;
+    // Minimum size of a file to measure the hashing speed.
+    static const uint64_t HASH_SPEED_MIN_SIZE = 256 * 1024;
 
-    HCATADMIN _M_catalog;
+    catalog _M_catalog;
 
-    string_list<wchar_t> _M_signers;
     bool _M_all_signers;
 
-    string_list<BYTE> _M_hashes;
+    // Current policy.
+    snapshot<policy> _M_policy;
+
+    // Files the policy is loaded from.
+    const TCHAR* _M_signers_file;
+    const TCHAR* _M_hashes_file;
+    const TCHAR* _M_paths_file;
+    const TCHAR* _M_policy_file;
+
+    // Serializes loads.
+    std::mutex _M_mutex;
+
+    // Index of the catalog files (nullptr: the catalog API is used).
+    snapshot<catalog_index> _M_catalog_index;
+    const TCHAR* _M_catalog_index_file;
+    wchar_t _M_catalog_directory[MAX_PATH];
+
+    // Serializes the builds of the index of the catalog files.
+    std::mutex _M_catalog_mutex;
 
-    path_list _M_paths;
+    // Cache of verdicts (0: disabled).
+    mutable verdict_cache _M_cache;
+    size_t _M_cache_size;
+    unsigned _M_deny_ttl;
 
-    // Load signers.
-    bool load_signers(const TCHAR* filename);
+    // Evaluations in progress (the concurrent requests for the same file
+    // wait for the first one).
+    mutable inflight_evaluations _M_inflight;
 
-    // Load hashes.
-    bool load_hashes(const TCHAR* filename);
+    // Persistent copy of the allowed verdicts (nullptr: none).
+    mutable verdict_store _M_verdict_store;
+    const TCHAR* _M_verdict_store_file;
 
-    // Load paths.
-    bool load_paths(const TCHAR* filename);
+    system_file_identity_probe _M_file_identity_probe;
 
-    // In catalog?
-    bool in_catalog(BYTE* hash, DWORD hashlen) const;
+    // Cache of signer verdicts (by certificate issuer and serial number).
+    mutable signer_cache _M_signer_cache;
+
+    // Hashing speed (bytes per microsecond, moving average), to tell
+    // whether a file can be hashed before a deadline.
+    mutable std::atomic<uint64_t> _M_hash_speed;
+
+    // Statistics of the running client (nullptr: none).
+    service_stats* _M_stats;
+
+    // Transport the fast path is set in (nullptr: none).
+    transport* _M_transport;
+
+    // Publish the gauges of a policy.
+    void publish_stats(const policy& policy);
+
+    // Publish the gauges of an index of the catalog files.
+    void publish_stats(const catalog_index& index);
+
+    // Set the fast path of a policy in the transport.
+    void publish_fast_path(const policy& policy);
+
+    // Load policy from the files.
+    bool load();
+
+    // Print the lines of the text files which could not be loaded.
+    void print_errors(const policy& policy) const;
+
+    // Fingerprint of a policy, for the persistent verdicts (the verdicts
+    // also depend on whether every signer is allowed).
+    uint64_t fingerprint(const policy& policy) const;
+
+    // Evaluate (without looking at the cache) before `deadline`. Returns
+    // false if the evaluation was abandoned. `cache` is false if the verdict
+    // must not be cached (the file couldn't be read).
+    bool evaluate(const wchar_t* filename,
+                  size_t len,
+                  const catalog& catalog,
+                  const policy& policy,
+                  uint64_t deadline,
+                  stage_timer& timer,
+                  bool& allowed,
+                  bool& cache) const;
+
+    // Hash the file, unless it cannot be done before `deadline`.
+    bool hash(image_context& image, bool sha256, uint64_t deadline) const;
+
+    // Has the deadline passed?
+    static bool expired(uint64_t deadline);
+
+    // Build the index of the catalog files from the previous one and
+    // publish it.
+    bool build_catalog_index(const catalog_index* previous);
+
+    // Is the file in the catalog?
+    bool in_catalog(const image_context& image,
+                    bool sha256,
+                    const catalog& catalog) const;
 
     // Is signed?
-    bool is_signed(const wchar_t* filename) const;
+    bool is_signed(const image_context& image,
+                   const policy& policy,
+                   evaluation_stats* stats) const;
 
     // Get signer.
-    bool get_signer(HCERTSTORE certificate_store,
-                    HCRYPTMSG msg,
-                    DWORD idx,
+    bool get_signer(const pkcs7& signature,
+                    size_t idx,
                     wchar_t* signer,
-                    DWORD& signerlen) const;
-
-    // Calculate hash.
-    bool calculate_hash(const TCHAR* filename,
-                        BYTE* hash,
-                        DWORD& hashlen) const;
+                    size_t& signerlen) const;
 };
 
+inline const wchar_t* software_restriction_policies::catalog_directory() const
+{
+  return (*_M_catalog_directory) ? _M_catalog_directory : nullptr;
+}
+
+inline bool software_restriction_policies::expired(uint64_t deadline)
+{
+  // The clock is only read if there is a deadline.
+  return ((deadline != NO_DEADLINE) && (monotonic_clock::now() >= deadline));
+}
+
 #endif // SOFTWARE_RESTRICTION_POLICIES_H
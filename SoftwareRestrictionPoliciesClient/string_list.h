@@ -3,11 +3,19 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "parallel_sort.h"
+#include "image.h"
 
 template<typename _CharT>
 class string_list {
   public:
-    typedef typename _CharT char_type;
+    typedef _CharT char_type;
+
+    // Location of the list in an image.
+    struct image {
+      image_block strings;
+      image_block data;
+    };
 
     // Constructor.
     string_list();
@@ -18,9 +26,33 @@ class string_list {
     // Add.
     bool add(const char_type* s, size_t len);
 
+    // Append (bulk load): the string cannot be found until build() is
+    // called.
+    bool append(const char_type* s, size_t len);
+
+    // Build: sort the appended strings, remove duplicates and compact.
+    bool build();
+
     // Find.
     bool find(const char_type* s, size_t len) const;
 
+    // Number of strings.
+    size_t count() const;
+
+    // Get string (in the order they were appended, until build() is
+    // called).
+    const char_type* get(size_t idx, size_t& len) const;
+
+    // Memory usage (bytes, allocated or attached).
+    size_t memory_usage() const;
+
+    // Save to image.
+    bool save(image_writer& writer, image& img) const;
+
+    // Attach to image (the list becomes read-only and uses the image in
+    // place).
+    bool attach(const image_reader& reader, const image& img);
+
   private:
     struct string {
       size_t off;
@@ -31,6 +63,9 @@ class string_list {
     size_t _M_size;
     size_t _M_used;
 
+    // Attached to an image?
+    bool _M_mapped;
+
     class data {
       public:
         // Constructor.
@@ -45,9 +80,18 @@ class string_list {
         // Length.
         size_t length() const;
 
+        // Memory usage (bytes, allocated or attached).
+        size_t memory_usage() const;
+
         // Add.
         bool add(const char_type* s, size_t len);
 
+        // Swap.
+        void swap(data& other);
+
+        // Attach to (read-only) buffer.
+        void attach(const char_type* s, size_t len);
+
       private:
         static const size_t initial_alloc = 32;
 
@@ -55,26 +99,39 @@ class string_list {
         size_t _M_size;
         size_t _M_used;
 
+        // Attached to a read-only buffer?
+        bool _M_mapped;
+
         // Allocate.
         bool allocate(size_t size);
     } _M_data;
 
     // Find.
     bool find(const char_type* s, size_t len, size_t& pos) const;
+
+    // Grow array of strings (if needed).
+    bool grow();
+
+    // Compare strings.
+    static int compare(const char_type* s1,
+                       size_t len1,
+                       const char_type* s2,
+                       size_t len2);
 };
 
 template<typename _CharT>
 inline string_list<_CharT>::string_list()
   : _M_strings(nullptr),
     _M_size(0),
-    _M_used(0)
+    _M_used(0),
+    _M_mapped(false)
 {
 }
 
 template<typename _CharT>
 inline string_list<_CharT>::~string_list()
 {
-  if (_M_strings) {
+  if ((_M_strings) && (!_M_mapped)) {
     free(_M_strings);
   }
 }
@@ -82,26 +139,16 @@ inline string_list<_CharT>::~string_list()
 template<typename _CharT>
 bool string_list<_CharT>::add(const char_type* s, size_t len)
 {
+  if (_M_mapped) {
+    return false;
+  }
+
   // If the string has not been inserted yet...
   size_t pos;
   if (!find(s, len, pos)) {
     size_t off = _M_data.length();
 
-    if (_M_data.add(s, len)) {
-      if (_M_used == _M_size) {
-        size_t size = (_M_size != 0) ? (_M_size * 2) : 32;
-
-        struct string* strings;
-        if ((strings = reinterpret_cast<struct string*>(
-                         realloc(_M_strings, size * sizeof(struct string))
-                       )) == nullptr) {
-          return false;
-        }
-
-        _M_strings = strings;
-        _M_size = size;
-      }
-
+    if ((_M_data.add(s, len)) && (grow())) {
       // If not in the last position...
       if (pos < _M_used) {
         memmove(_M_strings + pos + 1,
@@ -121,6 +168,78 @@ bool string_list<_CharT>::add(const char_type* s, size_t len)
   return true;
 }
 
+template<typename _CharT>
+bool string_list<_CharT>::append(const char_type* s, size_t len)
+{
+  if (_M_mapped) {
+    return false;
+  }
+
+  size_t off = _M_data.length();
+
+  if ((_M_data.add(s, len)) && (grow())) {
+    _M_strings[_M_used].off = off;
+    _M_strings[_M_used].len = len;
+
+    _M_used++;
+
+    return true;
+  }
+
+  return false;
+}
+
+template<typename _CharT>
+bool string_list<_CharT>::build()
+{
+  if ((_M_used == 0) || (_M_mapped)) {
+    return true;
+  }
+
+  const char_type* buf = _M_data.buffer();
+
+  // Sort.
+  if (!parallel_sort(_M_strings,
+                     _M_used,
+                     [buf](const struct string& a, const struct string& b) {
+                       return (compare(buf + a.off,
+                                       a.len,
+                                       buf + b.off,
+                                       b.len) < 0);
+                     })) {
+    return false;
+  }
+
+  // Remove duplicates and copy the strings in order to a new buffer.
+  data d;
+  size_t used = 0;
+  for (size_t i = 0; i < _M_used; i++) {
+    const struct string* str = _M_strings + i;
+
+    if ((used == 0) ||
+        (compare(buf + str->off,
+                 str->len,
+                 d.buffer() + _M_strings[used - 1].off,
+                 _M_strings[used - 1].len) != 0)) {
+      size_t off = d.length();
+
+      if (!d.add(buf + str->off, str->len)) {
+        return false;
+      }
+
+      _M_strings[used].off = off;
+      _M_strings[used].len = str->len;
+
+      used++;
+    }
+  }
+
+  _M_data.swap(d);
+  _M_used = used;
+
+  return true;
+}
+
 template<typename _CharT>
 inline bool string_list<_CharT>::find(const char_type* s, size_t len) const
 {
@@ -128,18 +247,93 @@ inline bool string_list<_CharT>::find(const char_type* s, size_t len) const
   return find(s, len, pos);
 }
 
+template<typename _CharT>
+inline size_t string_list<_CharT>::count() const
+{
+  return _M_used;
+}
+
+template<typename _CharT>
+inline const _CharT* string_list<_CharT>::get(size_t idx, size_t& len) const
+{
+  len = _M_strings[idx].len;
+  return _M_data.buffer() + _M_strings[idx].off;
+}
+
+template<typename _CharT>
+inline size_t string_list<_CharT>::memory_usage() const
+{
+  return ((_M_mapped ? _M_used : _M_size) * sizeof(struct string)) +
+         _M_data.memory_usage();
+}
+
+template<typename _CharT>
+bool string_list<_CharT>::save(image_writer& writer, image& img) const
+{
+  return ((writer.add(_M_strings,
+                      _M_used * sizeof(struct string),
+                      sizeof(uint64_t),
+                      img.strings)) &&
+          (writer.add(_M_data.buffer(),
+                      _M_data.length() * sizeof(char_type),
+                      sizeof(uint64_t),
+                      img.data)));
+}
+
+template<typename _CharT>
+bool string_list<_CharT>::attach(const image_reader& reader, const image& img)
+{
+  const void* strings;
+  const void* data;
+  if ((_M_used == 0) &&
+      ((strings = reader.get(img.strings,
+                             sizeof(uint64_t),
+                             sizeof(struct string))) != nullptr) &&
+      ((data = reader.get(img.data,
+                          sizeof(uint64_t),
+                          sizeof(char_type))) != nullptr)) {
+    size_t nstrings =
+      static_cast<size_t>(img.strings.len / sizeof(struct string));
+    size_t datalen = static_cast<size_t>(img.data.len / sizeof(char_type));
+
+    // Every string must be in the data.
+    const struct string* str = reinterpret_cast<const struct string*>(strings);
+    for (size_t i = 0; i < nstrings; i++) {
+      if ((str[i].off > datalen) || (str[i].len > datalen - str[i].off)) {
+        return false;
+      }
+    }
+
+    if (_M_strings) {
+      free(_M_strings);
+    }
+
+    _M_strings = reinterpret_cast<struct string*>(const_cast<void*>(strings));
+    _M_size = 0;
+    _M_used = nstrings;
+    _M_mapped = true;
+
+    _M_data.attach(reinterpret_cast<const char_type*>(data), datalen);
+
+    return true;
+  }
+
+  return false;
+}
+
 template<typename _CharT>
 inline string_list<_CharT>::data::data()
   : _M_data(nullptr),
     _M_size(0),
-    _M_used(0)
+    _M_used(0),
+    _M_mapped(false)
 {
 }
 
 template<typename _CharT>
 inline string_list<_CharT>::data::~data()
 {
-  if (_M_data) {
+  if ((_M_data) && (!_M_mapped)) {
     free(_M_data);
   }
 }
@@ -157,10 +351,16 @@ inline size_t string_list<_CharT>::data::length() const
   return _M_used;
 }
 
+template<typename _CharT>
+inline size_t string_list<_CharT>::data::memory_usage() const
+{
+  return (_M_mapped ? _M_used : _M_size) * sizeof(char_type);
+}
+
 template<typename _CharT>
 bool string_list<_CharT>::data::add(const char_type* s, size_t len)
 {
-  if (allocate(len)) {
+  if ((!_M_mapped) && (allocate(len))) {
     memcpy(_M_data + _M_used, s, len * sizeof(char_type));
     _M_used += len;
 
@@ -170,6 +370,39 @@ bool string_list<_CharT>::data::add(const char_type* s, size_t len)
   return false;
 }
 
+template<typename _CharT>
+inline void string_list<_CharT>::data::swap(data& other)
+{
+  char_type* d = _M_data;
+  _M_data = other._M_data;
+  other._M_data = d;
+
+  size_t size = _M_size;
+  _M_size = other._M_size;
+  other._M_size = size;
+
+  size_t used = _M_used;
+  _M_used = other._M_used;
+  other._M_used = used;
+
+  bool mapped = _M_mapped;
+  _M_mapped = other._M_mapped;
+  other._M_mapped = mapped;
+}
+
+template<typename _CharT>
+inline void string_list<_CharT>::data::attach(const char_type* s, size_t len)
+{
+  if ((_M_data) && (!_M_mapped)) {
+    free(_M_data);
+  }
+
+  _M_data = const_cast<char_type*>(s);
+  _M_size = 0;
+  _M_used = len;
+  _M_mapped = true;
+}
+
 template<typename _CharT>
 bool string_list<_CharT>::data::allocate(size_t size)
 {
@@ -218,32 +451,25 @@ bool string_list<_CharT>::find(const char_type* s,
                                size_t len,
                                size_t& pos) const
 {
-  int i = 0;
-  int j = _M_used - 1;
+  size_t i = 0;
+  size_t j = _M_used;
 
-  while (i <= j) {
-    int mid = (i + j) / 2;
+  while (i < j) {
+    size_t mid = (i + j) / 2;
 
     const struct string* str = _M_strings + mid;
 
-    size_t l = (len < str->len) ? len : str->len;
-
     int ret;
-    if ((ret = memcmp(s,
-                      _M_data.buffer() + str->off,
-                      l * sizeof(char_type))) < 0) {
-      j = mid - 1;
+    if ((ret = compare(s,
+                       len,
+                       _M_data.buffer() + str->off,
+                       str->len)) < 0) {
+      j = mid;
     } else if (ret > 0) {
       i = mid + 1;
     } else {
-      if (len < str->len) {
-        j = mid - 1;
-      } else if (len > str->len) {
-        i = mid + 1;
-      } else {
-        pos = mid;
-        return true;
-      }
+      pos = mid;
+      return true;
     }
   }
 
@@ -252,4 +478,40 @@ bool string_list<_CharT>::find(const char_type* s,
   return false;
 }
 
+template<typename _CharT>
+bool string_list<_CharT>::grow()
+{
+  if (_M_used == _M_size) {
+    size_t size = (_M_size != 0) ? (_M_size * 2) : 32;
+
+    struct string* strings;
+    if ((strings = reinterpret_cast<struct string*>(
+                     realloc(_M_strings, size * sizeof(struct string))
+                   )) == nullptr) {
+      return false;
+    }
+
+    _M_strings = strings;
+    _M_size = size;
+  }
+
+  return true;
+}
+
+template<typename _CharT>
+inline int string_list<_CharT>::compare(const char_type* s1,
+                                        size_t len1,
+                                        const char_type* s2,
+                                        size_t len2)
+{
+  int ret;
+  if ((ret = memcmp(s1,
+                    s2,
+                    ((len1 < len2) ? len1 : len2) * sizeof(char_type))) != 0) {
+    return ret;
+  }
+
+  return (len1 < len2) ? -1 : ((len1 > len2) ? 1 : 0);
+}
+
 #endif // STRING_LIST_H
@@ -0,0 +1,250 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "text_file.h"
+
+#ifndef _WIN32
+  #include <limits.h>
+#endif
+
+bool text_file::open(const wchar_t* filename)
+{
+  if (!_M_file.open(filename)) {
+    // An empty file cannot be mapped.
+    FILE* file;
+#ifdef _WIN32
+    if (_wfopen_s(&file, filename, L"rb") != 0) {
+      return false;
+    }
+#else
+    char path[PATH_MAX];
+    size_t len = wcstombs(path, filename, sizeof(path));
+    if ((len == static_cast<size_t>(-1)) ||
+        (len == sizeof(path)) ||
+        ((file = fopen(path, "rb")) == nullptr)) {
+      return false;
+    }
+#endif
+
+    bool empty = (fgetc(file) == EOF);
+    fclose(file);
+
+    return empty;
+  }
+
+  const uint8_t* data = static_cast<const uint8_t*>(_M_file.data());
+  size_t len = _M_file.size();
+
+  // UTF-16LE (with BOM)?
+  if ((len >= 2) && (data[0] == 0xff) && (data[1] == 0xfe)) {
+    return convert(data + 2, len - 2);
+  }
+
+  // Skip UTF-8 BOM (if present).
+  if ((len >= 3) &&
+      (data[0] == 0xef) &&
+      (data[1] == 0xbb) &&
+      (data[2] == 0xbf)) {
+    data += 3;
+    len -= 3;
+  }
+
+  _M_data = reinterpret_cast<const char*>(data);
+  _M_len = len;
+
+  return true;
+}
+
+size_t text_file::split(chunk* chunks, size_t min_chunk_size) const
+{
+  if (_M_len == 0) {
+    return 0;
+  }
+
+  size_t nchunks = std::thread::hardware_concurrency();
+  if (nchunks > MAX_CHUNKS) {
+    nchunks = MAX_CHUNKS;
+  }
+
+  if ((min_chunk_size > 0) && (nchunks > _M_len / min_chunk_size)) {
+    nchunks = _M_len / min_chunk_size;
+  }
+
+  if (nchunks == 0) {
+    nchunks = 1;
+  }
+
+  const char* end = _M_data + _M_len;
+  const char* begin = _M_data;
+
+  size_t n = 0;
+  for (size_t i = 1; i <= nchunks; i++) {
+    // The chunk ends after the end of line which follows its nominal end.
+    const char* ptr = _M_data + ((_M_len * i) / nchunks);
+    if (ptr < begin) {
+      ptr = begin;
+    }
+
+    if (ptr < end) {
+      const char* nl;
+      ptr = ((nl = static_cast<const char*>(
+                     memchr(ptr, '\n', end - ptr)
+                   )) != nullptr) ? nl + 1 : end;
+    }
+
+    if (ptr > begin) {
+      chunks[n].begin = begin;
+      chunks[n].end = ptr;
+      n++;
+
+      begin = ptr;
+    }
+  }
+
+  return n;
+}
+
+bool text_file::next_line(const char*& ptr,
+                          const char* end,
+                          const char*& line,
+                          size_t& len)
+{
+  if (ptr == end) {
+    return false;
+  }
+
+  line = ptr;
+
+  const char* nl;
+  if ((nl = static_cast<const char*>(memchr(ptr, '\n', end - ptr))) !=
+      nullptr) {
+    ptr = nl + 1;
+  } else {
+    nl = end;
+    ptr = end;
+  }
+
+  // Remove the carriage return (if any).
+  if ((nl > line) && (nl[-1] == '\r')) {
+    nl--;
+  }
+
+  len = nl - line;
+
+  return true;
+}
+
+size_t text_file::decode(const char* s, size_t len, wchar_t* out)
+{
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(s);
+  const uint8_t* end = ptr + len;
+  wchar_t* begin = out;
+
+  while (ptr < end) {
+    uint32_t c = *ptr++;
+
+    if (c >= 0x80) {
+      size_t n;
+      uint32_t min;
+      if ((c & 0xe0) == 0xc0) {
+        c &= 0x1f;
+        n = 1;
+        min = 0x80;
+      } else if ((c & 0xf0) == 0xe0) {
+        c &= 0x0f;
+        n = 2;
+        min = 0x800;
+      } else if ((c & 0xf8) == 0xf0) {
+        c &= 0x07;
+        n = 3;
+        min = 0x10000;
+      } else {
+        *out++ = 0xfffd;
+        continue;
+      }
+
+      size_t i;
+      for (i = 0; (i < n) && (ptr < end) && ((*ptr & 0xc0) == 0x80); i++) {
+        c = (c << 6) | (*ptr++ & 0x3f);
+      }
+
+      // Truncated, overlong, surrogate or out of range?
+      if ((i < n) ||
+          (c < min) ||
+          ((c >= 0xd800) && (c <= 0xdfff)) ||
+          (c > 0x10ffff)) {
+        *out++ = 0xfffd;
+        continue;
+      }
+
+      // Surrogate pair (4 bytes in, 2 characters out)?
+      if ((c >= 0x10000) && (sizeof(wchar_t) == 2)) {
+        c -= 0x10000;
+        *out++ = static_cast<wchar_t>(0xd800 | (c >> 10));
+        *out++ = static_cast<wchar_t>(0xdc00 | (c & 0x3ff));
+        continue;
+      }
+    }
+
+    *out++ = static_cast<wchar_t>(c);
+  }
+
+  return out - begin;
+}
+
+bool text_file::convert(const uint8_t* data, size_t len)
+{
+  // At most 3 bytes per UTF-16 code unit.
+  size_t nunits = len / 2;
+  if ((_M_converted = reinterpret_cast<char*>(
+                        malloc((nunits * 3) + 1)
+                      )) == nullptr) {
+    return false;
+  }
+
+  uint8_t* out = reinterpret_cast<uint8_t*>(_M_converted);
+
+  for (size_t i = 0; i < nunits; i++) {
+    uint32_t c = data[2 * i] | (static_cast<uint32_t>(data[(2 * i) + 1]) << 8);
+
+    // Surrogate pair?
+    if ((c >= 0xd800) && (c <= 0xdbff) && (i + 1 < nunits)) {
+      uint32_t low = data[2 * (i + 1)] |
+                     (static_cast<uint32_t>(data[(2 * (i + 1)) + 1]) << 8);
+
+      if ((low >= 0xdc00) && (low <= 0xdfff)) {
+        c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+        i++;
+      }
+    }
+
+    if ((c >= 0xd800) && (c <= 0xdfff)) {
+      c = 0xfffd;
+    }
+
+    if (c < 0x80) {
+      *out++ = static_cast<uint8_t>(c);
+    } else if (c < 0x800) {
+      *out++ = static_cast<uint8_t>(0xc0 | (c >> 6));
+      *out++ = static_cast<uint8_t>(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      *out++ = static_cast<uint8_t>(0xe0 | (c >> 12));
+      *out++ = static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3f));
+      *out++ = static_cast<uint8_t>(0x80 | (c & 0x3f));
+    } else {
+      // 4 bytes for 2 code units.
+      *out++ = static_cast<uint8_t>(0xf0 | (c >> 18));
+      *out++ = static_cast<uint8_t>(0x80 | ((c >> 12) & 0x3f));
+      *out++ = static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3f));
+      *out++ = static_cast<uint8_t>(0x80 | (c & 0x3f));
+    }
+  }
+
+  _M_data = _M_converted;
+  _M_len = out - reinterpret_cast<uint8_t*>(_M_converted);
+
+  // The mapping is not needed anymore.
+  _M_file.close();
+
+  return true;
+}
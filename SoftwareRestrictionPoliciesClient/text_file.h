@@ -0,0 +1,106 @@
+#ifndef TEXT_FILE_H
+#define TEXT_FILE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <thread>
+#include "mapped_file.h"
+
+// Text file (UTF-8, with or without BOM, or UTF-16LE with BOM) mapped in
+// memory and split into chunks of whole lines, so the lines can be parsed by
+// several threads.
+class text_file {
+  public:
+    // Maximum number of chunks.
+    static const size_t MAX_CHUNKS = 64;
+
+    // Chunk of whole lines.
+    struct chunk {
+      const char* begin;
+      const char* end;
+    };
+
+    // Constructor.
+    text_file();
+
+    // Destructor.
+    ~text_file();
+
+    // Open (an empty file has no chunks).
+    bool open(const wchar_t* filename);
+
+    // Split into chunks of at least `min_chunk_size` bytes (at most one per
+    // processor). Returns the number of chunks.
+    size_t split(chunk* chunks, size_t min_chunk_size) const;
+
+    // Get next line of a chunk (without the end of line). Returns false at
+    // the end of the chunk.
+    static bool next_line(const char*& ptr,
+                          const char* end,
+                          const char*& line,
+                          size_t& len);
+
+    // Decode UTF-8 (`out` must have room for `len` characters, invalid
+    // sequences are replaced by U+FFFD). Returns the number of characters.
+    static size_t decode(const char* s, size_t len, wchar_t* out);
+
+    // Call `f(i)` for i in [0, n) (n <= MAX_CHUNKS), each call on its own
+    // thread (the first one on the calling thread).
+    template<typename Function>
+    static void parallel(size_t n, Function f);
+
+  private:
+    mapped_file _M_file;
+
+    // Text (UTF-8, without BOM).
+    const char* _M_data;
+    size_t _M_len;
+
+    // UTF-8 conversion of a UTF-16 file (nullptr: none).
+    char* _M_converted;
+
+    // Convert UTF-16LE to UTF-8.
+    bool convert(const uint8_t* data, size_t len);
+};
+
+inline text_file::text_file()
+  : _M_data(nullptr),
+    _M_len(0),
+    _M_converted(nullptr)
+{
+}
+
+inline text_file::~text_file()
+{
+  if (_M_converted) {
+    free(_M_converted);
+  }
+}
+
+template<typename Function>
+void text_file::parallel(size_t n, Function f)
+{
+  std::thread threads[MAX_CHUNKS];
+
+  for (size_t i = 1; i < n; i++) {
+    try {
+      threads[i] = std::thread(f, i);
+    } catch (...) {
+      // Run it on this thread.
+      f(i);
+    }
+  }
+
+  if (n > 0) {
+    f(0);
+  }
+
+  for (size_t i = 1; i < n; i++) {
+    if (threads[i].joinable()) {
+      threads[i].join();
+    }
+  }
+}
+
+#endif // TEXT_FILE_H
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include "trace_replay.h"
+#include "loopback_transport.h"
+#include "monotonic_clock.h"
+#include "communication_port.h"
+
+// Timeout of the driver.
+static const unsigned DRIVER_TIMEOUT = REQUEST_TIMEOUT; // Milliseconds.
+
+// State shared by the senders.
+struct replay_state {
+  const exec_trace* trace;
+  loopback_transport* transport;
+  double speed;
+
+  // When the replay started and when the first request was recorded.
+  uint64_t start;
+  uint64_t first;
+
+  // Next request to send.
+  std::atomic<size_t> next;
+
+  // Latency of each request (nanoseconds).
+  uint64_t* latencies;
+
+  std::atomic<uint64_t> timeouts;
+  std::atomic<uint64_t> mismatches;
+};
+
+// Send requests until there are no more.
+static void send_requests(replay_state* state)
+{
+  const uint64_t timeout = DRIVER_TIMEOUT * 1000000ull;
+
+  size_t i;
+  while ((i = state->next++) < state->trace->count()) {
+    const wchar_t* filename;
+    const exec_trace::record& rec = state->trace->get(i, filename);
+
+    // Wait until the request is due.
+    uint64_t due;
+    if (state->speed > 0) {
+      due = state->start +
+            static_cast<uint64_t>((rec.timestamp - state->first) /
+                                  state->speed);
+
+      uint64_t now = monotonic_clock::now();
+      if (due > now) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+      }
+    } else {
+      due = monotonic_clock::now();
+    }
+
+    bool allowed;
+    bool replied = state->transport->send(filename,
+                                          rec.filenamelen,
+                                          DRIVER_TIMEOUT,
+                                          allowed);
+
+    // The latency includes the time the request waited for a sender.
+    uint64_t latency = monotonic_clock::now() - due;
+    state->latencies[i] = latency;
+
+    if ((!replied) || (latency >= timeout)) {
+      state->timeouts++;
+    } else if (allowed != (rec.allowed != 0)) {
+      state->mismatches++;
+    }
+  }
+}
+
+// Get percentile of sorted values (nearest rank).
+static uint64_t percentile(const uint64_t* values, size_t n, double p)
+{
+  size_t rank = static_cast<size_t>((p * n) + 0.999999);
+  return values[(rank > 0) ? ((rank <= n) ? rank - 1 : n - 1) : 0];
+}
+
+// Print the percentiles of the latencies (nanoseconds, sorted).
+static void print_latencies(const char* name, const uint64_t* values, size_t n)
+{
+  printf("%s: p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms.\n",
+         name,
+         percentile(values, n, 0.5) / 1000000.0,
+         percentile(values, n, 0.99) / 1000000.0,
+         percentile(values, n, 0.999) / 1000000.0,
+         values[n - 1] / 1000000.0);
+}
+
+bool replay_trace(const exec_trace& trace,
+                  worker_pool::evaluator** evaluators,
+                  size_t nworkers,
+                  size_t nsenders,
+                  double speed,
+                  const void* fast_path,
+                  size_t fast_path_len,
+                  unsigned budget,
+                  bool fallback)
+{
+  size_t n;
+  if (((n = trace.count()) == 0) || (nworkers == 0) || (nsenders == 0)) {
+    return false;
+  }
+
+  // One slot per sender (a sender waits for the reply).
+  loopback_transport transport;
+  if ((!transport.create(nsenders)) ||
+      ((fast_path) && (!transport.set_fast_path(fast_path, fast_path_len)))) {
+    return false;
+  }
+
+  replay_state state;
+  state.trace = &trace;
+  state.transport = &transport;
+  state.speed = speed;
+  state.next = 0;
+  state.timeouts = 0;
+  state.mismatches = 0;
+
+  const wchar_t* filename;
+  state.first = trace.get(0, filename).timestamp;
+
+  if ((state.latencies = reinterpret_cast<uint64_t*>(
+                           malloc(n * sizeof(uint64_t))
+                         )) == nullptr) {
+    return false;
+  }
+
+  std::thread* senders;
+  if ((senders = new (std::nothrow) std::thread[nsenders]) == nullptr) {
+    free(state.latencies);
+    return false;
+  }
+
+  bool ret = false;
+
+  // Start workers.
+  worker_pool pool;
+  if (pool.start(transport, evaluators, nworkers, budget, fallback)) {
+    state.start = monotonic_clock::now();
+
+    // Start senders.
+    size_t nthreads = 0;
+    for (; nthreads < nsenders; nthreads++) {
+      try {
+        senders[nthreads] = std::thread(send_requests, &state);
+      } catch (...) {
+        break;
+      }
+    }
+
+    for (size_t i = 0; i < nthreads; i++) {
+      senders[i].join();
+    }
+
+    double elapsed = (monotonic_clock::now() - state.start) / 1000000000.0;
+
+    pool.stop();
+
+    // If all the senders were started...
+    if ((ret = (nthreads == nsenders)) == true) {
+      std::sort(state.latencies, state.latencies + n);
+
+      printf("Requests: %llu, elapsed: %.3f s, throughput: %.1f requests/s.\n",
+             static_cast<unsigned long long>(n),
+             elapsed,
+             (elapsed > 0) ? n / elapsed : 0.0);
+
+      print_latencies("Latency", state.latencies, n);
+
+      printf("Timeouts (>= %u ms): %llu.\n",
+             DRIVER_TIMEOUT,
+             static_cast<unsigned long long>(state.timeouts));
+
+      printf("Answered by the fast path: %llu.\n",
+             static_cast<unsigned long long>(transport.fast_path_hits()));
+
+      printf("Deadline misses (budget: %u ms): %llu.\n",
+             budget,
+             static_cast<unsigned long long>(pool.missed()));
+
+      printf("Verdicts different from the recorded ones: %llu.\n",
+             static_cast<unsigned long long>(state.mismatches));
+
+      // Recorded latencies, for comparison.
+      for (size_t i = 0; i < n; i++) {
+        state.latencies[i] = trace.get(i, filename).latency * 1000ull;
+      }
+
+      std::sort(state.latencies, state.latencies + n);
+
+      print_latencies("Recorded latency", state.latencies, n);
+    }
+  }
+
+  delete [] senders;
+  free(state.latencies);
+
+  return ret;
+}
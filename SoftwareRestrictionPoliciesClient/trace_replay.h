@@ -0,0 +1,31 @@
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include <stddef.h>
+#include "exec_trace.h"
+#include "worker_pool.h"
+
+// Replay a trace: every request is sent, from `nsenders` threads, through a
+// loopback transport (which gives up after the timeout of the driver, like
+// the driver) to a pool of workers (one per evaluator).
+// The requests are sent at the times they were recorded, `speed` times
+// faster (0: as fast as possible).
+// If `fast_path` is not nullptr, the transport allows its paths without
+// sending a request (see fast_path.h).
+// The workers answer within `budget` milliseconds (0: no budget) with the
+// verdict `fallback` if the evaluation would be late (see worker_pool).
+// Prints the latency percentiles (from the time each request should have been
+// sent until its reply), the number of requests which would have timed out,
+// the number of requests answered by the fast path, the number of deadline
+// misses and the throughput.
+bool replay_trace(const exec_trace& trace,
+                  worker_pool::evaluator** evaluators,
+                  size_t nworkers,
+                  size_t nsenders,
+                  double speed,
+                  const void* fast_path = nullptr,
+                  size_t fast_path_len = 0,
+                  unsigned budget = 0,
+                  bool fallback = true);
+
+#endif // TRACE_REPLAY_H
@@ -0,0 +1,47 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Request to evaluate an executable.
+struct request {
+  static const size_t FILENAME_MAX_LEN = 4 * 1024;
+
+  // Null-terminated file name.
+  const wchar_t* filename;
+  size_t filenamelen;
+
+  // When the driver sent the request (monotonic clock, nanoseconds): the
+  // driver stops waiting for the reply REQUEST_TIMEOUT milliseconds later
+  // (see communication_port.h).
+  uint64_t arrival;
+};
+
+// Receive/reply side of the communication with the driver.
+// All the methods can be called concurrently from several threads.
+class transport {
+  public:
+    // Destructor.
+    virtual ~transport();
+
+    // Receive request (waits up to `timeout` milliseconds).
+    // Returns nullptr on timeout or after shutdown().
+    virtual request* receive(unsigned timeout) = 0;
+
+    // Reply to request (the request cannot be used afterwards).
+    virtual bool reply(request* req, bool allowed) = 0;
+
+    // Wake up the threads waiting in receive().
+    virtual void shutdown() = 0;
+
+    // Set the fast path of the policy (see fast_path.h): the driver allows
+    // the paths of the blob without sending a request (nullptr: remove it).
+    virtual bool set_fast_path(const void* blob, size_t len) = 0;
+};
+
+inline transport::~transport()
+{
+}
+
+#endif // TRANSPORT_H
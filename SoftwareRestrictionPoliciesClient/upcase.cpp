@@ -0,0 +1,253 @@
+#include <string.h>
+#include <wctype.h>
+#include "upcase.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <locale.h>
+#endif
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || \
+    defined(__SSE2__)
+  #include <emmintrin.h>
+  #define UPCASE_SSE2 1
+#endif
+
+uint16_t upcase::_M_table[0x10000];
+const bool upcase::_M_initialized = upcase::init();
+
+static const uint64_t prime = 0x9e3779b97f4a7c15ull;
+
+// Add word to hash.
+static inline uint64_t mix(uint64_t h, uint64_t w)
+{
+  h = (h ^ w) * prime;
+  return h ^ (h >> 29);
+}
+
+#if UPCASE_SSE2
+  // Load 8 code units (as 16-bit lanes; with a 4-byte wchar_t, the code
+  // units above 0x7fff become 0x7fff, which is enough to tell ASCII).
+  static inline __m128i load(const wchar_t* s)
+  {
+  #if WCHAR_MAX > 0xffff
+    return _mm_packs_epi32(
+             _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)),
+             _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 4))
+           );
+  #else
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+  #endif
+  }
+
+  // Load 4 code units (in the low 4 lanes).
+  static inline __m128i load4(const wchar_t* s)
+  {
+  #if WCHAR_MAX > 0xffff
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    return _mm_packs_epi32(v, v);
+  #else
+    return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s));
+  #endif
+  }
+
+  // Store 8 code units.
+  static inline void store(wchar_t* s, __m128i v)
+  {
+  #if WCHAR_MAX > 0xffff
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(s),
+                     _mm_unpacklo_epi16(v, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(s + 4),
+                     _mm_unpackhi_epi16(v, zero));
+  #else
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(s), v);
+  #endif
+  }
+
+  // Are the 8 code units ASCII?
+  static inline bool ascii(__m128i v)
+  {
+    return (_mm_movemask_epi8(
+              _mm_cmpeq_epi16(
+                _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xff80))),
+                _mm_setzero_si128()
+              )
+            ) == 0xffff);
+  }
+
+  // Convert 8 ASCII code units to upper case.
+  static inline __m128i to_upper(__m128i v)
+  {
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16('a' - 1)),
+                                  _mm_cmplt_epi16(v, _mm_set1_epi16('z' + 1)));
+
+    return _mm_sub_epi16(v, _mm_and_si128(lower, _mm_set1_epi16(0x20)));
+  }
+#endif // UPCASE_SSE2
+
+void upcase::convert(const wchar_t* s, size_t len, wchar_t* upper)
+{
+  size_t i = 0;
+
+#if UPCASE_SSE2
+  for (; i + 8 <= len; i += 8) {
+    __m128i v = load(s + i);
+
+    if (ascii(v)) {
+      store(upper + i, to_upper(v));
+    } else {
+      for (size_t j = i; j < i + 8; j++) {
+        upper[j] = convert(s[j]);
+      }
+    }
+  }
+#endif
+
+  for (; i < len; i++) {
+    upper[i] = convert(s[i]);
+  }
+}
+
+bool upcase::equal(const wchar_t* s, const wchar_t* upper, size_t len)
+{
+  size_t i = 0;
+
+#if UPCASE_SSE2
+  for (; i + 8 <= len; i += 8) {
+    __m128i v = load(s + i);
+
+    if (ascii(v)) {
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(to_upper(v),
+                                            load(upper + i))) != 0xffff) {
+        return false;
+      }
+    } else {
+      for (size_t j = i; j < i + 8; j++) {
+        if (convert(s[j]) != upper[j]) {
+          return false;
+        }
+      }
+    }
+  }
+
+  if (i + 4 <= len) {
+    __m128i v = load4(s + i);
+
+    if (ascii(v)) {
+      if ((_mm_movemask_epi8(_mm_cmpeq_epi16(to_upper(v),
+                                             load4(upper + i))) & 0xff) !=
+          0xff) {
+        return false;
+      }
+
+      i += 4;
+    }
+  }
+#endif
+
+  for (; i < len; i++) {
+    if (convert(s[i]) != upper[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint64_t upcase::hash(const wchar_t* s, size_t len, uint64_t seed)
+{
+  // The code units in upper case are hashed 4 at a time (16 bits each).
+  uint64_t h = seed ^ (len * prime);
+  size_t i = 0;
+
+#if UPCASE_SSE2
+  for (; i + 8 <= len; i += 8) {
+    __m128i v = load(s + i);
+
+    if (ascii(v)) {
+      uint64_t w[2];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(w), to_upper(v));
+
+      h = mix(mix(h, w[0]), w[1]);
+    } else {
+      h = mix(mix(h, word(s + i, 4)), word(s + i + 4, 4));
+    }
+  }
+
+  if (i + 4 <= len) {
+    __m128i v = load4(s + i);
+
+    if (ascii(v)) {
+      uint64_t w[2];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(w), to_upper(v));
+
+      h = mix(h, w[0]);
+      i += 4;
+    }
+  }
+#endif
+
+  for (; i < len; i += 4) {
+    h = mix(h, word(s + i, (len - i < 4) ? len - i : 4));
+  }
+
+  return h ^ (h >> 32);
+}
+
+bool upcase::init()
+{
+#ifndef _WIN32
+  // The table doesn't depend on the locale of the process.
+  locale_t locale = newlocale(LC_CTYPE_MASK,
+                              "C.UTF-8",
+                              static_cast<locale_t>(0));
+#endif
+
+  for (size_t c = 0; c < 0x10000; c++) {
+    wchar_t upper = static_cast<wchar_t>(c);
+
+    // Surrogates have no case.
+    if ((c < 0xd800) || (c > 0xdfff)) {
+#ifdef _WIN32
+      wchar_t wc = static_cast<wchar_t>(c);
+      if (LCMapStringW(LOCALE_INVARIANT,
+                       LCMAP_UPPERCASE,
+                       &wc,
+                       1,
+                       &upper,
+                       1) != 1) {
+        upper = wc;
+      }
+#else
+      wint_t u = locale ? towupper_l(static_cast<wint_t>(c), locale) :
+                          towupper(static_cast<wint_t>(c));
+      if (u <= 0xffff) {
+        upper = static_cast<wchar_t>(u);
+      }
+#endif
+    }
+
+    _M_table[c] = static_cast<uint16_t>(upper);
+  }
+
+#ifndef _WIN32
+  if (locale) {
+    freelocale(locale);
+  }
+#endif
+
+  return true;
+}
+
+uint64_t upcase::word(const wchar_t* s, size_t len)
+{
+  uint64_t w = 0;
+  for (size_t i = 0; i < len; i++) {
+    w |= static_cast<uint64_t>(static_cast<uint16_t>(convert(s[i]))) <<
+         (i * 16);
+  }
+
+  return w;
+}
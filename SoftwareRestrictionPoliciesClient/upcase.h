@@ -0,0 +1,57 @@
+#ifndef UPCASE_H
+#define UPCASE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <wchar.h>
+
+// Case-insensitive file names, compared the way NTFS compares them: every
+// UTF-16 code unit is converted to upper case on its own, through a table of
+// the 64K code units built from the upper case mapping of the system (no
+// special casing, e.g. 'ß' is not expanded; surrogates are left as they are).
+// Runs of ASCII characters are processed 8 code units at a time (SSE2).
+class upcase {
+  public:
+    // Convert code unit to upper case.
+    static wchar_t convert(wchar_t c);
+
+    // Convert string to upper case.
+    static void convert(const wchar_t* s, size_t len, wchar_t* upper);
+
+    // Compare string with a string in upper case, ignoring the case of the
+    // former (the string is not copied).
+    static bool equal(const wchar_t* s, const wchar_t* upper, size_t len);
+
+    // Hash of the string in upper case (the string is not copied).
+    static uint64_t hash(const wchar_t* s, size_t len, uint64_t seed);
+
+  private:
+    // Upper case of every code unit.
+    static uint16_t _M_table[0x10000];
+
+    // The table is built before main() is called.
+    static const bool _M_initialized;
+
+    // Build table.
+    static bool init();
+
+    // Word of the hash (up to 4 code units in upper case).
+    static uint64_t word(const wchar_t* s, size_t len);
+};
+
+inline wchar_t upcase::convert(wchar_t c)
+{
+  if (c < 0x80) {
+    return ((c >= L'a') && (c <= L'z')) ? c - (L'a' - L'A') : c;
+  }
+
+#if WCHAR_MAX > 0xffff
+  if (c > 0xffff) {
+    return c;
+  }
+#endif
+
+  return static_cast<wchar_t>(_M_table[c]);
+}
+
+#endif // UPCASE_H
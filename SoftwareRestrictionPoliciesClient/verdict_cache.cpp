@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "verdict_cache.h"
+#include "upcase.h"
+
+bool verdict_cache::create(size_t size, unsigned deny_ttl)
+{
+  // Round number of sets up to a power of two.
+  size_t nsets = 1;
+  while (nsets * ways < size) {
+    nsets *= 2;
+  }
+
+  entry* entries;
+  if ((entries = reinterpret_cast<entry*>(
+                   calloc(nsets * ways, sizeof(entry))
+                 )) != nullptr) {
+    if (_M_entries) {
+      free(_M_entries);
+    }
+
+    _M_entries = entries;
+    _M_mask = nsets - 1;
+    _M_deny_ttl = deny_ttl;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool verdict_cache::find(const wchar_t* path,
+                         size_t pathlen,
+                         const file_identity& id,
+                         uint32_t generation,
+                         bool& allowed)
+{
+  if (_M_entries) {
+    uint64_t k = key(path, pathlen);
+    size_t set = static_cast<size_t>(k) & _M_mask;
+
+    std::lock_guard<std::mutex> lock(_M_locks[set % nlocks]);
+
+    entry* e = _M_entries + (set * ways);
+    for (size_t i = 0; i < ways; i++, e++) {
+      if ((e->used) && (e->key == k) && (e->id == id)) {
+        // If the entry has expired or it comes from another policy...
+        if (((e->expires != 0) && (e->expires <= now())) ||
+            (e->generation != generation)) {
+          e->used = 0;
+          break;
+        }
+
+        e->last_used = ++_M_clock;
+        allowed = (e->allowed != 0);
+
+        _M_hits++;
+
+        return true;
+      }
+    }
+
+    _M_misses++;
+  }
+
+  return false;
+}
+
+void verdict_cache::insert(const wchar_t* path,
+                           size_t pathlen,
+                           const file_identity& id,
+                           uint32_t generation,
+                           bool allowed)
+{
+  insert(key(path, pathlen), id, generation, allowed);
+}
+
+void verdict_cache::insert(uint64_t key,
+                           const file_identity& id,
+                           uint32_t generation,
+                           bool allowed)
+{
+  if (_M_entries) {
+    size_t set = static_cast<size_t>(key) & _M_mask;
+
+    std::lock_guard<std::mutex> lock(_M_locks[set % nlocks]);
+
+    // Look for the same key, a free entry or the least recently used one.
+    entry* e = _M_entries + (set * ways);
+    entry* victim = e;
+    for (size_t i = 0; i < ways; i++, e++) {
+      if ((e->used) && (e->key == key) && (e->id == id)) {
+        victim = e;
+        break;
+      }
+
+      if (!e->used) {
+        victim = e;
+      } else if ((victim->used) && (e->last_used < victim->last_used)) {
+        victim = e;
+      }
+    }
+
+    victim->key = key;
+    victim->id = id;
+    victim->expires = allowed ? 0 : now() + _M_deny_ttl;
+    victim->generation = generation;
+    victim->last_used = ++_M_clock;
+    victim->used = 1;
+    victim->allowed = allowed ? 1 : 0;
+  }
+}
+
+void verdict_cache::clear()
+{
+  if (_M_entries) {
+    for (size_t i = 0; i < nlocks; i++) {
+      _M_locks[i].lock();
+    }
+
+    memset(_M_entries, 0, (_M_mask + 1) * ways * sizeof(entry));
+
+    for (size_t i = nlocks; i > 0; i--) {
+      _M_locks[i - 1].unlock();
+    }
+  }
+}
+
+uint64_t verdict_cache::key(const wchar_t* path, size_t pathlen)
+{
+  // Case-insensitive, like the paths of the policy.
+  return upcase::hash(path, pathlen, 0);
+}
+
+uint64_t verdict_cache::now()
+{
+  return static_cast<uint64_t>(
+           std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()
+           ).count()
+         );
+}
@@ -0,0 +1,121 @@
+#ifndef VERDICT_CACHE_H
+#define VERDICT_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include "file_identity.h"
+
+// Bounded cache of verdicts keyed by (normalized path, file identity).
+// Every verdict records the generation of the policy which produced it: a
+// verdict from another policy is a miss.
+//
+// The cache is set-associative: each key maps to a set of `ways` entries and,
+// when the set is full, the least recently used entry is evicted.
+// Allowed verdicts stay until they are evicted (a modified file gets a
+// different identity). Denied verdicts expire after `deny_ttl` milliseconds.
+class verdict_cache {
+  public:
+    static const size_t default_size = 16 * 1024;
+    static const unsigned default_deny_ttl = 5 * 1000; // Milliseconds.
+
+    // Constructor.
+    verdict_cache();
+
+    // Destructor.
+    ~verdict_cache();
+
+    // Create.
+    bool create(size_t size, unsigned deny_ttl);
+
+    // Find.
+    bool find(const wchar_t* path,
+              size_t pathlen,
+              const file_identity& id,
+              uint32_t generation,
+              bool& allowed);
+
+    // Insert.
+    void insert(const wchar_t* path,
+                size_t pathlen,
+                const file_identity& id,
+                uint32_t generation,
+                bool allowed);
+
+    // Insert by key (see key()).
+    void insert(uint64_t key,
+                const file_identity& id,
+                uint32_t generation,
+                bool allowed);
+
+    // Clear.
+    void clear();
+
+    // Get number of hits.
+    uint64_t hits() const;
+
+    // Get number of misses.
+    uint64_t misses() const;
+
+    // Key of a path (case insensitive hash).
+    static uint64_t key(const wchar_t* path, size_t pathlen);
+
+  private:
+    static const size_t ways = 4;
+    static const size_t nlocks = 64;
+
+    struct entry {
+      uint64_t key;
+      file_identity id;
+      uint64_t expires; // 0: never.
+      uint32_t generation;
+      uint32_t last_used;
+      uint8_t used;
+      uint8_t allowed;
+    };
+
+    entry* _M_entries;
+    size_t _M_mask;
+
+    unsigned _M_deny_ttl;
+
+    std::atomic<uint32_t> _M_clock;
+
+    std::mutex _M_locks[nlocks];
+
+    std::atomic<uint64_t> _M_hits;
+    std::atomic<uint64_t> _M_misses;
+
+    // Current time in milliseconds.
+    static uint64_t now();
+};
+
+inline verdict_cache::verdict_cache()
+  : _M_entries(nullptr),
+    _M_mask(0),
+    _M_deny_ttl(default_deny_ttl),
+    _M_clock(0),
+    _M_hits(0),
+    _M_misses(0)
+{
+}
+
+inline verdict_cache::~verdict_cache()
+{
+  if (_M_entries) {
+    free(_M_entries);
+  }
+}
+
+inline uint64_t verdict_cache::hits() const
+{
+  return _M_hits;
+}
+
+inline uint64_t verdict_cache::misses() const
+{
+  return _M_misses;
+}
+
+#endif // VERDICT_CACHE_H
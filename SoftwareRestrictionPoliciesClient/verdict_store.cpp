@@ -0,0 +1,675 @@
+#include <string.h>
+#include <wchar.h>
+#include <stddef.h>
+#include "verdict_store.h"
+#include "mapped_file.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <wincrypt.h>
+  #include <sddl.h>
+
+  #pragma comment(lib, "crypt32.lib")
+#else
+  #include <limits.h>
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/stat.h>
+#endif
+
+const uint8_t verdict_store::magic[8] = {
+  'S', 'R', 'P', 'V', 'E', 'R', 'D', 'S'
+};
+
+// Open file (`mode`: "wb" or "ab").
+static FILE* open_file(const wchar_t* filename, const char* mode)
+{
+#ifdef _WIN32
+  FILE* file;
+  return (_wfopen_s(&file,
+                    filename,
+                    (mode[0] == 'a') ? L"ab" : L"wb") == 0) ? file : nullptr;
+#else
+  // Convert file name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return nullptr;
+  }
+
+  return fopen(path, mode);
+#endif
+}
+
+// Remove file.
+static void remove_file(const wchar_t* filename)
+{
+#ifdef _WIN32
+  _wremove(filename);
+#else
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  if ((len != static_cast<size_t>(-1)) && (len != sizeof(path))) {
+    remove(path);
+  }
+#endif
+}
+
+// Replace file `filename` by `tmpfilename` (`tmpfilename` is removed on
+// error).
+static bool replace_file(const wchar_t* tmpfilename, const wchar_t* filename)
+{
+#ifdef _WIN32
+  if (MoveFileExW(tmpfilename, filename, MOVEFILE_REPLACE_EXISTING)) {
+    return true;
+  }
+#else
+  // Convert file names to multibyte.
+  char path[PATH_MAX];
+  char tmppath[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  size_t tmplen = wcstombs(tmppath, tmpfilename, sizeof(tmppath));
+  if ((len != static_cast<size_t>(-1)) &&
+      (len != sizeof(path)) &&
+      (tmplen != static_cast<size_t>(-1)) &&
+      (tmplen != sizeof(tmppath))) {
+    if (rename(tmppath, path) == 0) {
+      return true;
+    }
+  }
+#endif
+
+  remove_file(tmpfilename);
+
+  return false;
+}
+
+#ifdef _WIN32
+// Read the key from the key file (`missing`: the file doesn't exist).
+static bool read_key(const wchar_t* filename, uint8_t* key, bool& missing)
+{
+  // Maximum size of the key file (the key encrypted with DPAPI).
+  static const DWORD KEY_FILE_MAX_LEN = 4 * 1024;
+
+  missing = false;
+
+  HANDLE hFile;
+  if ((hFile = CreateFileW(filename,
+                           GENERIC_READ,
+                           FILE_SHARE_READ,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL,
+                           NULL)) == INVALID_HANDLE_VALUE) {
+    missing = (GetLastError() == ERROR_FILE_NOT_FOUND);
+    return false;
+  }
+
+  BYTE blob[KEY_FILE_MAX_LEN];
+  DWORD len;
+  BOOL ret = ReadFile(hFile, blob, sizeof(blob), &len, NULL);
+
+  CloseHandle(hFile);
+
+  if ((!ret) || (len == 0) || (len == sizeof(blob))) {
+    return false;
+  }
+
+  // Decrypt the key (only the account which encrypted it can).
+  DATA_BLOB in;
+  in.pbData = blob;
+  in.cbData = len;
+
+  DATA_BLOB out;
+  if (!CryptUnprotectData(&in,
+                          NULL,
+                          NULL,
+                          NULL,
+                          NULL,
+                          CRYPTPROTECT_UI_FORBIDDEN,
+                          &out)) {
+    return false;
+  }
+
+  bool valid = (out.cbData == verdict_store::KEY_LEN);
+  if (valid) {
+    memcpy(key, out.pbData, verdict_store::KEY_LEN);
+  }
+
+  SecureZeroMemory(out.pbData, out.cbData);
+  LocalFree(out.pbData);
+
+  return valid;
+}
+
+// Create the key file with a new key.
+static bool create_key(const wchar_t* filename, uint8_t* key)
+{
+  // Generate the key.
+  HCRYPTPROV hProv;
+  if (!CryptAcquireContextW(&hProv,
+                            NULL,
+                            NULL,
+                            PROV_RSA_FULL,
+                            CRYPT_VERIFYCONTEXT)) {
+    return false;
+  }
+
+  BOOL generated = CryptGenRandom(hProv, verdict_store::KEY_LEN, key);
+  CryptReleaseContext(hProv, 0);
+
+  if (!generated) {
+    return false;
+  }
+
+  // Encrypt it for the account of the client.
+  DATA_BLOB in;
+  in.pbData = key;
+  in.cbData = verdict_store::KEY_LEN;
+
+  DATA_BLOB out;
+  if (!CryptProtectData(&in,
+                        L"Verdict store",
+                        NULL,
+                        NULL,
+                        NULL,
+                        CRYPTPROTECT_UI_FORBIDDEN,
+                        &out)) {
+    return false;
+  }
+
+  // Only SYSTEM and the Administrators can access the file.
+  SECURITY_ATTRIBUTES sa;
+  sa.nLength = sizeof(SECURITY_ATTRIBUTES);
+  sa.bInheritHandle = FALSE;
+
+  bool ret = false;
+
+  if (ConvertStringSecurityDescriptorToSecurityDescriptorW(
+        L"D:P(A;;FA;;;SY)(A;;FA;;;BA)",
+        SDDL_REVISION_1,
+        &sa.lpSecurityDescriptor,
+        NULL
+      )) {
+    HANDLE hFile;
+    if ((hFile = CreateFileW(filename,
+                             GENERIC_WRITE,
+                             0,
+                             &sa,
+                             CREATE_NEW,
+                             FILE_ATTRIBUTE_NORMAL,
+                             NULL)) != INVALID_HANDLE_VALUE) {
+      DWORD written;
+      ret = ((WriteFile(hFile, out.pbData, out.cbData, &written, NULL)) &&
+             (written == out.cbData));
+
+      CloseHandle(hFile);
+
+      if (!ret) {
+        DeleteFileW(filename);
+      }
+    }
+
+    LocalFree(sa.lpSecurityDescriptor);
+  }
+
+  LocalFree(out.pbData);
+
+  return ret;
+}
+#else
+// Read the key from the key file (`missing`: the file doesn't exist).
+static bool read_key(const wchar_t* filename, uint8_t* key, bool& missing)
+{
+  missing = false;
+
+  // Convert file name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return false;
+  }
+
+  int fd;
+  if ((fd = ::open(path, O_RDONLY | O_NOFOLLOW)) == -1) {
+    missing = (errno == ENOENT);
+    return false;
+  }
+
+  // The file has to belong to the user and cannot be accessed by others.
+  struct stat sbuf;
+  bool ret = ((fstat(fd, &sbuf) == 0) &&
+              (S_ISREG(sbuf.st_mode)) &&
+              (sbuf.st_uid == geteuid()) &&
+              ((sbuf.st_mode & (S_IRWXG | S_IRWXO)) == 0) &&
+              (sbuf.st_size == static_cast<off_t>(verdict_store::KEY_LEN)) &&
+              (read(fd, key, verdict_store::KEY_LEN) ==
+               static_cast<ssize_t>(verdict_store::KEY_LEN)));
+
+  ::close(fd);
+
+  return ret;
+}
+
+// Create the key file with a new key.
+static bool create_key(const wchar_t* filename, uint8_t* key)
+{
+  // Convert file name to multibyte.
+  char path[PATH_MAX];
+  size_t len = wcstombs(path, filename, sizeof(path));
+  if ((len == static_cast<size_t>(-1)) || (len == sizeof(path))) {
+    return false;
+  }
+
+  // Generate the key.
+  int fd;
+  if ((fd = ::open("/dev/urandom", O_RDONLY)) == -1) {
+    return false;
+  }
+
+  bool generated = (read(fd, key, verdict_store::KEY_LEN) ==
+                    static_cast<ssize_t>(verdict_store::KEY_LEN));
+
+  ::close(fd);
+
+  if ((!generated) ||
+      ((fd = ::open(path,
+                    O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW,
+                    S_IRUSR | S_IWUSR)) == -1)) {
+    return false;
+  }
+
+  bool ret = ((write(fd, key, verdict_store::KEY_LEN) ==
+               static_cast<ssize_t>(verdict_store::KEY_LEN)) &&
+              (fsync(fd) == 0));
+
+  if ((::close(fd) != 0) || (!ret)) {
+    unlink(path);
+    return false;
+  }
+
+  return true;
+}
+#endif
+
+bool verdict_store::open(const wchar_t* filename,
+                         size_t max_records,
+                         uint64_t fingerprint,
+                         uint32_t generation,
+                         verdict_cache& cache)
+{
+  size_t len = wcslen(filename);
+  if ((len == 0) || (len + 4 >= FILENAME_MAX_LEN) || (max_records == 0)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> file_lock(_M_file_mutex);
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  if (_M_filename) {
+    return false;
+  }
+
+  if ((_M_filename = reinterpret_cast<wchar_t*>(
+                       malloc((len + 1) * sizeof(wchar_t))
+                     )) == nullptr) {
+    return false;
+  }
+
+  wmemcpy(_M_filename, filename, len + 1);
+
+  _M_max_records = max_records;
+  _M_fingerprint = fingerprint;
+  _M_generation = generation;
+
+  if (((_M_pending = reinterpret_cast<record*>(
+                       malloc(MAX_PENDING * sizeof(record))
+                     )) != nullptr) &&
+      ((_M_batch = reinterpret_cast<record*>(
+                     malloc(MAX_PENDING * sizeof(record))
+                   )) != nullptr) &&
+      (load_key()) &&
+      (compact(&cache))) {
+    _M_npending = 0;
+    _M_stop = false;
+
+    try {
+      _M_thread = std::thread(&verdict_store::run, this);
+      return true;
+    } catch (...) {
+    }
+  }
+
+  if (_M_file) {
+    fclose(_M_file);
+    _M_file = nullptr;
+  }
+
+  free(_M_batch);
+  _M_batch = nullptr;
+
+  free(_M_pending);
+  _M_pending = nullptr;
+
+  free(_M_filename);
+  _M_filename = nullptr;
+
+  return false;
+}
+
+bool verdict_store::reset(uint64_t fingerprint,
+                          uint32_t generation,
+                          verdict_cache& cache)
+{
+  std::lock_guard<std::mutex> file_lock(_M_file_mutex);
+
+  if (!_M_filename) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_M_mutex);
+
+    _M_fingerprint = fingerprint;
+    _M_generation = generation;
+
+    // The records waiting are of the previous policy.
+    _M_npending = 0;
+  }
+
+  return compact(&cache);
+}
+
+void verdict_store::close()
+{
+  // Stop the writer (it writes the records waiting first).
+  {
+    std::lock_guard<std::mutex> lock(_M_mutex);
+
+    _M_stop = true;
+    _M_cv.notify_one();
+  }
+
+  if (_M_thread.joinable()) {
+    _M_thread.join();
+  }
+
+  std::lock_guard<std::mutex> file_lock(_M_file_mutex);
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  if (_M_file) {
+    fclose(_M_file);
+    _M_file = nullptr;
+  }
+
+  if (_M_filename) {
+    free(_M_filename);
+    _M_filename = nullptr;
+  }
+
+  free(_M_batch);
+  _M_batch = nullptr;
+
+  free(_M_pending);
+  _M_pending = nullptr;
+
+  _M_npending = 0;
+  _M_count = 0;
+  _M_stop = false;
+}
+
+void verdict_store::append(uint64_t key,
+                           const file_identity& id,
+                           uint32_t generation)
+{
+  std::lock_guard<std::mutex> lock(_M_mutex);
+
+  if ((_M_pending) &&
+      (!_M_stop) &&
+      (generation == _M_generation) &&
+      (_M_npending < MAX_PENDING)) {
+    record& rec = _M_pending[_M_npending++];
+    rec.key = key;
+    rec.id = id;
+    rec.policy = _M_fingerprint;
+
+    _M_cv.notify_one();
+  }
+}
+
+void verdict_store::run()
+{
+  std::unique_lock<std::mutex> lock(_M_mutex);
+
+  do {
+    while ((_M_npending == 0) && (!_M_stop)) {
+      _M_cv.wait(lock);
+    }
+
+    if (_M_npending > 0) {
+      // Take the records waiting.
+      record* records = _M_pending;
+      size_t count = _M_npending;
+
+      _M_pending = _M_batch;
+      _M_batch = records;
+      _M_npending = 0;
+
+      lock.unlock();
+
+      write(records, count);
+
+      lock.lock();
+    }
+  } while ((_M_npending > 0) || (!_M_stop));
+}
+
+void verdict_store::write(const record* records, size_t count)
+{
+  std::lock_guard<std::mutex> lock(_M_file_mutex);
+
+  for (size_t i = 0; i < count; i++) {
+    // Skip the records of a previous policy (the policy changed after they
+    // were taken).
+    if (records[i].policy != _M_fingerprint) {
+      continue;
+    }
+
+    // If the file has grown too much, drop the oldest records first.
+    if ((!_M_file) ||
+        ((_M_count >= 2 * _M_max_records) && (!compact(nullptr)))) {
+      return;
+    }
+
+    // The record is authenticated here, so the workers don't wait for it.
+    record rec = records[i];
+    authenticate(rec, rec.mac);
+
+    // Write the record at once: if the client stops, the file ends with
+    // whole records (or with an incomplete one, which is ignored).
+    if (fwrite(&rec, sizeof(record), 1, _M_file) == 1) {
+      _M_count++;
+    }
+  }
+
+  if (_M_file) {
+    fflush(_M_file);
+  }
+}
+
+bool verdict_store::compact(verdict_cache* cache)
+{
+  if (_M_file) {
+    fclose(_M_file);
+    _M_file = nullptr;
+  }
+
+  // Records to keep.
+  record* records;
+  if ((records = reinterpret_cast<record*>(
+                   malloc(_M_max_records * sizeof(record))
+                 )) == nullptr) {
+    return false;
+  }
+
+  size_t nrecords = 0;
+  size_t first = 0;
+
+  // Read the records of the policy of the store (the file is missing or
+  // not valid the first time).
+  {
+    mapped_file file;
+    if ((file.open(_M_filename)) && (file.size() >= sizeof(header))) {
+      const header* hdr = static_cast<const header*>(file.data());
+
+      if ((memcmp(hdr->magic, magic, sizeof(magic)) == 0) &&
+          (hdr->version == version) &&
+          (hdr->record_size == sizeof(record))) {
+        const uint8_t* ptr = static_cast<const uint8_t*>(file.data()) +
+                             sizeof(header);
+
+        size_t count = (file.size() - sizeof(header)) / sizeof(record);
+
+        for (size_t i = 0; i < count; i++, ptr += sizeof(record)) {
+          record rec;
+          memcpy(&rec, ptr, sizeof(record));
+
+          // The file ends at the first record which is not valid.
+          if (!valid(rec)) {
+            break;
+          }
+
+          // Keep the most recent records (circular buffer).
+          if (rec.policy == _M_fingerprint) {
+            if (nrecords < _M_max_records) {
+              records[nrecords++] = rec;
+            } else {
+              records[first] = rec;
+              first = (first + 1) % _M_max_records;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Write the records (in their order) to a temporary file.
+  wchar_t tmpfilename[FILENAME_MAX_LEN];
+  size_t len = wcslen(_M_filename);
+  wmemcpy(tmpfilename, _M_filename, len);
+  wmemcpy(tmpfilename + len, L".tmp", 5);
+
+  FILE* file;
+  if ((file = open_file(tmpfilename, "wb")) == nullptr) {
+    free(records);
+    return false;
+  }
+
+  header hdr;
+  memcpy(hdr.magic, magic, sizeof(magic));
+  hdr.version = version;
+  hdr.record_size = sizeof(record);
+
+  bool ret = (fwrite(&hdr, sizeof(header), 1, file) == 1);
+
+  for (size_t i = 0; (i < nrecords) && (ret); i++) {
+    const record& rec = records[(first + i) % _M_max_records];
+
+    ret = (fwrite(&rec, sizeof(record), 1, file) == 1);
+
+    // Put the verdict in the cache (the most recent ones last, so they are
+    // the last to be evicted).
+    if (cache) {
+      cache->insert(rec.key, rec.id, _M_generation, true);
+    }
+  }
+
+  free(records);
+
+  if ((fclose(file) != 0) || (!ret)) {
+    remove_file(tmpfilename);
+    return false;
+  }
+
+  if (cache) {
+    _M_restored = nrecords;
+  }
+
+  // Replace the file and open it for appending.
+  if ((replace_file(tmpfilename, _M_filename)) &&
+      ((_M_file = open_file(_M_filename, "ab")) != nullptr)) {
+    _M_count = nrecords;
+    return true;
+  }
+
+  return false;
+}
+
+bool verdict_store::load_key()
+{
+  wchar_t keyfilename[FILENAME_MAX_LEN];
+  size_t len = wcslen(_M_filename);
+  wmemcpy(keyfilename, _M_filename, len);
+  wmemcpy(keyfilename + len, L".key", 5);
+
+  // Create the key file the first time (a key file which cannot be read is
+  // not replaced).
+  uint8_t key[KEY_LEN];
+  bool missing;
+  if ((!read_key(keyfilename, key, missing)) &&
+      ((!missing) || (!create_key(keyfilename, key)))) {
+    return false;
+  }
+
+  // HMAC(K, m) = H((K ^ opad) || H((K ^ ipad) || m)): the padded keys are
+  // hashed once.
+  uint8_t pad[sha256::BLOCK_LEN];
+
+  memset(pad, 0x36, sizeof(pad));
+  for (size_t i = 0; i < KEY_LEN; i++) {
+    pad[i] ^= key[i];
+  }
+
+  _M_inner.init();
+  _M_inner.update(pad, sizeof(pad));
+
+  memset(pad, 0x5c, sizeof(pad));
+  for (size_t i = 0; i < KEY_LEN; i++) {
+    pad[i] ^= key[i];
+  }
+
+  _M_outer.init();
+  _M_outer.update(pad, sizeof(pad));
+
+  return true;
+}
+
+void verdict_store::authenticate(const record& rec, uint8_t* mac) const
+{
+  uint8_t digest[sha256::DIGEST_LEN];
+
+  sha256 ctx(_M_inner);
+  ctx.update(&rec, offsetof(record, mac));
+  ctx.finish(digest);
+
+  ctx = _M_outer;
+  ctx.update(digest, sizeof(digest));
+  ctx.finish(digest);
+
+  memcpy(mac, digest, MAC_LEN);
+}
+
+bool verdict_store::valid(const record& rec) const
+{
+  uint8_t mac[MAC_LEN];
+  authenticate(rec, mac);
+
+  // Compare in constant time.
+  uint8_t diff = 0;
+  for (size_t i = 0; i < MAC_LEN; i++) {
+    diff |= mac[i] ^ rec.mac[i];
+  }
+
+  return (diff == 0);
+}
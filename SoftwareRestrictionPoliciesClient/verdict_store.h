@@ -0,0 +1,200 @@
+#ifndef VERDICT_STORE_H
+#define VERDICT_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "file_identity.h"
+#include "verdict_cache.h"
+#include "sha256.h"
+
+// Persistent copy of the allowed verdicts of the verdict cache, so a client
+// which is restarted doesn't evaluate again the executables it has already
+// allowed (denied verdicts expire in seconds, they are not kept).
+//
+// The file is a header followed by fixed-size records, appended as the
+// verdicts are cached. A record is keyed by the path (see
+// verdict_cache::key()), the identity of the file (which includes its size
+// and last-write time) and the fingerprint of the policy. The file is mapped
+// when it is loaded.
+//
+// Every record is authenticated (HMAC-SHA-256, truncated) with a secret key
+// of the machine, kept in the key file (the name of the store followed by
+// ".key", created with the store): a record written by anyone who cannot
+// read the key, like an incomplete last record left by a crash, is not
+// valid. The key file is protected by the system:
+// * Windows: the key is encrypted with DPAPI (only the account of the client
+//   can decrypt it) and the file can only be accessed by SYSTEM and the
+//   Administrators.
+// * POSIX: the file has to belong to the user of the client and cannot be
+//   accessed by other users.
+// A key file which cannot be used is not replaced: the store is refused.
+//
+// When the store is opened (and when a new policy is published), the
+// records of the current policy are put in the verdict cache and the file
+// is compacted: the records of other policies are dropped. A modified file
+// has another identity, so its record is never found again and it is
+// eventually dropped (only the most recent records are kept).
+//
+// The records are written by a background thread: append() only queues
+// them, so the workers never wait for the disk (nor for a compaction).
+class verdict_store {
+  public:
+    static const uint32_t version = 2;
+
+    static const size_t FILENAME_MAX_LEN = 32 * 1024;
+
+    static const size_t KEY_LEN = 32;
+    static const size_t MAC_LEN = 16;
+
+    // Maximum number of records waiting to be written (the rest are
+    // dropped).
+    static const size_t MAX_PENDING = 1024;
+
+    struct record {
+      // Key of the path.
+      uint64_t key;
+
+      // Identity of the file.
+      file_identity id;
+
+      // Fingerprint of the policy which allowed the file.
+      uint64_t policy;
+
+      // Authentication code of the fields above.
+      uint8_t mac[MAC_LEN];
+    };
+
+    // Constructor.
+    verdict_store();
+
+    // Destructor.
+    ~verdict_store();
+
+    // Open: the records of the policy `fingerprint` are put in `cache`
+    // (with the policy generation `generation`), the file is compacted and
+    // the verdicts cached from now on are appended to it. At most
+    // `max_records` records are kept.
+    bool open(const wchar_t* filename,
+              size_t max_records,
+              uint64_t fingerprint,
+              uint32_t generation,
+              verdict_cache& cache);
+
+    // Change policy (same as open() with the same file).
+    bool reset(uint64_t fingerprint,
+               uint32_t generation,
+               verdict_cache& cache);
+
+    // Close (the records waiting are written first).
+    void close();
+
+    // Append allowed verdict (ignored if `generation` is not the generation
+    // of the policy of the store). The record is queued for the writer.
+    void append(uint64_t key, const file_identity& id, uint32_t generation);
+
+    // Get number of verdicts put in the cache by the last open() or reset().
+    size_t restored() const;
+
+  private:
+    static const uint8_t magic[8];
+
+    struct header {
+      uint8_t magic[8];
+      uint32_t version;
+      uint32_t record_size;
+    };
+
+    // Path of the file.
+    wchar_t* _M_filename;
+
+    // HMAC contexts after the inner and the outer padded keys.
+    sha256 _M_inner;
+    sha256 _M_outer;
+
+    // File opened for appending (nullptr: closed).
+    FILE* _M_file;
+
+    // Number of records of the file.
+    size_t _M_count;
+
+    size_t _M_max_records;
+
+    // Policy of the store (modified with both mutexes locked).
+    uint64_t _M_fingerprint;
+    uint32_t _M_generation;
+
+    size_t _M_restored;
+
+    // Records waiting to be written.
+    record* _M_pending;
+    size_t _M_npending;
+
+    // Records being written by the writer.
+    record* _M_batch;
+
+    bool _M_stop;
+
+    std::thread _M_thread;
+
+    // Protects the file (locked before `_M_mutex`).
+    mutable std::mutex _M_file_mutex;
+
+    // Protects the records waiting.
+    std::mutex _M_mutex;
+    std::condition_variable _M_cv;
+
+    // Writer thread.
+    void run();
+
+    // Write records (called by the writer).
+    void write(const record* records, size_t count);
+
+    // Rewrite the file with the most recent records of the policy of the
+    // store, put them in `cache` (if not nullptr) and reopen the file for
+    // appending.
+    bool compact(verdict_cache* cache);
+
+    // Load the key from the key file (created if it doesn't exist).
+    bool load_key();
+
+    // Calculate the authentication code of a record.
+    void authenticate(const record& rec, uint8_t* mac) const;
+
+    // Is the authentication code of the record valid?
+    bool valid(const record& rec) const;
+};
+
+static_assert(sizeof(verdict_store::record) == 64, "Unexpected record size.");
+
+inline verdict_store::verdict_store()
+  : _M_filename(nullptr),
+    _M_file(nullptr),
+    _M_count(0),
+    _M_max_records(0),
+    _M_fingerprint(0),
+    _M_generation(0),
+    _M_restored(0),
+    _M_pending(nullptr),
+    _M_npending(0),
+    _M_batch(nullptr),
+    _M_stop(false)
+{
+}
+
+inline verdict_store::~verdict_store()
+{
+  close();
+}
+
+inline size_t verdict_store::restored() const
+{
+  std::lock_guard<std::mutex> lock(_M_file_mutex);
+  return _M_restored;
+}
+
+#endif // VERDICT_STORE_H
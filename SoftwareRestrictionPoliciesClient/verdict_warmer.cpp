@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <wchar.h>
+#include "verdict_warmer.h"
+#include "input_file.h"
+#include "monotonic_clock.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <unistd.h>
+  #include <sys/resource.h>
+  #include <sys/syscall.h>
+#endif
+
+bool verdict_warmer::start(change_feed& feed,
+                           worker_pool::evaluator& evaluator,
+                           unsigned settle_time)
+{
+  if (!_M_thread.joinable()) {
+    _M_feed = &feed;
+    _M_evaluator = &evaluator;
+    _M_settle_time = static_cast<uint64_t>(settle_time) * 1000000ull;
+
+    _M_running = true;
+
+    try {
+      _M_thread = std::thread(&verdict_warmer::run, this);
+      return true;
+    } catch (...) {
+      _M_running = false;
+    }
+  }
+
+  return false;
+}
+
+void verdict_warmer::stop()
+{
+  if (_M_thread.joinable()) {
+    _M_running = false;
+    _M_feed->shutdown();
+
+    _M_thread.join();
+
+    clear();
+  }
+}
+
+bool verdict_warmer::push(const wchar_t* filename, size_t len, uint64_t due)
+{
+  // If the file is the last one reported (it is still being written), wait
+  // for it to settle again.
+  if (_M_count > 0) {
+    pending& last = _M_pending[(_M_begin + _M_count - 1) % _M_size];
+    if ((last.len == len) && (wmemcmp(last.filename, filename, len) == 0)) {
+      last.due = due;
+      return true;
+    }
+  }
+
+  if (_M_count == _M_size) {
+    if (_M_size == MAX_PENDING) {
+      return false;
+    }
+
+    size_t size = (_M_size != 0) ? _M_size * 2 : 256;
+
+    pending* p;
+    if ((p = reinterpret_cast<pending*>(
+               malloc(size * sizeof(pending))
+             )) == nullptr) {
+      return false;
+    }
+
+    // Copy the pending files to the beginning of the new buffer.
+    for (size_t i = 0; i < _M_count; i++) {
+      p[i] = _M_pending[(_M_begin + i) % _M_size];
+    }
+
+    free(_M_pending);
+
+    _M_pending = p;
+    _M_size = size;
+    _M_begin = 0;
+  }
+
+  wchar_t* copy;
+  if ((copy = reinterpret_cast<wchar_t*>(
+                malloc((len + 1) * sizeof(wchar_t))
+              )) == nullptr) {
+    return false;
+  }
+
+  wmemcpy(copy, filename, len);
+  copy[len] = 0;
+
+  pending& p = _M_pending[(_M_begin + _M_count) % _M_size];
+  p.filename = copy;
+  p.len = len;
+  p.due = due;
+
+  _M_count++;
+
+  return true;
+}
+
+void verdict_warmer::warm(uint64_t now)
+{
+  while ((_M_count > 0) && (_M_running)) {
+    pending& p = _M_pending[_M_begin];
+    if (p.due > now) {
+      return;
+    }
+
+    // Evaluate the file (the verdict is cached by the identity of the file,
+    // a later change invalidates it).
+    if (executable(p.filename)) {
+      _M_evaluator->allow(p.filename, p.len);
+      _M_warmed++;
+    } else {
+      _M_skipped++;
+    }
+
+    free(p.filename);
+
+    _M_begin = (_M_begin + 1) % _M_size;
+    _M_count--;
+  }
+}
+
+void verdict_warmer::clear()
+{
+  for (; _M_count > 0; _M_count--) {
+    free(_M_pending[_M_begin].filename);
+    _M_begin = (_M_begin + 1) % _M_size;
+  }
+
+  if (_M_pending) {
+    free(_M_pending);
+    _M_pending = nullptr;
+  }
+
+  _M_size = 0;
+  _M_begin = 0;
+}
+
+void verdict_warmer::run()
+{
+  lower_priority();
+
+  wchar_t filename[change_feed::FILENAME_MAX_LEN + 1];
+  size_t len;
+
+  do {
+    // Wait for the next file, but not longer than until the first pending
+    // file settles.
+    unsigned timeout = POLL_TIMEOUT;
+    if (_M_count > 0) {
+      uint64_t now = monotonic_clock::now();
+      uint64_t due = _M_pending[_M_begin].due;
+
+      if (due <= now) {
+        timeout = 0;
+      } else if ((due - now) / 1000000 < timeout) {
+        // Round up, so the file has settled when next() returns.
+        timeout = static_cast<unsigned>((due - now + 999999) / 1000000);
+      }
+    }
+
+    if (_M_feed->next(filename, len, timeout)) {
+      push(filename, len, monotonic_clock::now() + _M_settle_time);
+    }
+
+    warm(monotonic_clock::now());
+  } while (_M_running);
+}
+
+bool verdict_warmer::executable(const wchar_t* filename)
+{
+  // Check the signature of the DOS header ("MZ").
+  input_file file;
+  unsigned char data[2];
+  return ((file.open(filename)) &&
+          (file.read(0, data, sizeof(data))) &&
+          (data[0] == 'M') &&
+          (data[1] == 'Z'));
+}
+
+void verdict_warmer::lower_priority()
+{
+#ifdef _WIN32
+  // Background mode also lowers the I/O and memory priorities.
+  SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#else
+  // The nice value of a thread is set by its id.
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+}
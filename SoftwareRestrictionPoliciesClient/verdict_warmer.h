@@ -0,0 +1,124 @@
+#ifndef VERDICT_WARMER_H
+#define VERDICT_WARMER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include "change_feed.h"
+#include "worker_pool.h"
+
+// Background thread which evaluates the executables created or modified
+// under the watched directories before they are run, so the first execution
+// finds the verdict in the cache.
+// The thread runs at low priority and waits until a file has settled before
+// evaluating it (the files are written in several steps).
+class verdict_warmer {
+  public:
+    // Time to wait after a file is reported before evaluating it.
+    static const unsigned SETTLE_TIME = 500; // Milliseconds.
+
+    // Constructor.
+    verdict_warmer();
+
+    // Destructor.
+    ~verdict_warmer();
+
+    // Start (the evaluator is only used by the thread of the warmer).
+    bool start(change_feed& feed,
+               worker_pool::evaluator& evaluator,
+               unsigned settle_time = SETTLE_TIME);
+
+    // Stop (the files which haven't settled yet are discarded).
+    void stop();
+
+    // Number of executables evaluated.
+    uint64_t warmed() const;
+
+    // Number of files skipped (not executables).
+    uint64_t skipped() const;
+
+  private:
+    // Maximum time to wait for a file before checking whether to stop.
+    static const unsigned POLL_TIMEOUT = 250; // Milliseconds.
+
+    // Maximum number of files waiting to settle (the rest are evaluated on
+    // their first execution).
+    static const size_t MAX_PENDING = 64 * 1024;
+
+    // File waiting to settle.
+    struct pending {
+      wchar_t* filename;
+      size_t len;
+
+      // When it is evaluated (monotonic clock, nanoseconds).
+      uint64_t due;
+    };
+
+    change_feed* _M_feed;
+    worker_pool::evaluator* _M_evaluator;
+
+    // Settle time (nanoseconds).
+    uint64_t _M_settle_time;
+
+    // Files waiting to settle (circular buffer, ordered by due time).
+    pending* _M_pending;
+    size_t _M_size;
+    size_t _M_begin;
+    size_t _M_count;
+
+    std::atomic<uint64_t> _M_warmed;
+    std::atomic<uint64_t> _M_skipped;
+
+    std::atomic<bool> _M_running;
+
+    std::thread _M_thread;
+
+    // Add file to the pending files.
+    bool push(const wchar_t* filename, size_t len, uint64_t due);
+
+    // Evaluate the files which have settled.
+    void warm(uint64_t now);
+
+    // Free the pending files.
+    void clear();
+
+    // Thread.
+    void run();
+
+    // Is the file an executable (PE image)?
+    static bool executable(const wchar_t* filename);
+
+    // Lower the priority of the calling thread (CPU and I/O).
+    static void lower_priority();
+};
+
+inline verdict_warmer::verdict_warmer()
+  : _M_feed(nullptr),
+    _M_evaluator(nullptr),
+    _M_settle_time(0),
+    _M_pending(nullptr),
+    _M_size(0),
+    _M_begin(0),
+    _M_count(0),
+    _M_warmed(0),
+    _M_skipped(0),
+    _M_running(false)
+{
+}
+
+inline verdict_warmer::~verdict_warmer()
+{
+  stop();
+}
+
+inline uint64_t verdict_warmer::warmed() const
+{
+  return _M_warmed;
+}
+
+inline uint64_t verdict_warmer::skipped() const
+{
+  return _M_skipped;
+}
+
+#endif // VERDICT_WARMER_H
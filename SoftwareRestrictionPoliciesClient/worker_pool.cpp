@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <wchar.h>
+#include <new>
+#include "worker_pool.h"
+#include "event_trace.h"
+
+bool worker_pool::start(transport& transport,
+                        evaluator** evaluators,
+                        size_t nworkers,
+                        unsigned budget,
+                        bool fallback)
+{
+  if ((nworkers > 0) && (!_M_threads)) {
+    if ((_M_threads = new (std::nothrow) std::thread[nworkers]) != nullptr) {
+      _M_transport = &transport;
+      _M_budget = static_cast<uint64_t>(budget) * 1000000ull;
+      _M_fallback = fallback;
+      _M_running = true;
+
+      for (size_t i = 0; i < nworkers; i++) {
+        try {
+          _M_threads[i] = std::thread(&worker_pool::run, this, evaluators[i]);
+          _M_nthreads++;
+        } catch (...) {
+          stop();
+          return false;
+        }
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void worker_pool::stop()
+{
+  if (_M_threads) {
+    _M_running = false;
+    _M_transport->shutdown();
+
+    for (size_t i = 0; i < _M_nthreads; i++) {
+      _M_threads[i].join();
+    }
+
+    delete [] _M_threads;
+    _M_threads = nullptr;
+    _M_nthreads = 0;
+  }
+}
+
+void worker_pool::run(evaluator* evaluator)
+{
+  do {
+    // Receive request.
+    request* req;
+    if ((req = _M_transport->receive(RECEIVE_TIMEOUT)) != nullptr) {
+      const wchar_t* filename = req->filename;
+      size_t filenamelen = req->filenamelen;
+
+      // Skip the prefix "\??\" (if present).
+      if ((filenamelen > 4) && (wmemcmp(filename, L"\\??\\", 4) == 0)) {
+        filename += 4;
+        filenamelen -= 4;
+      }
+
+      bool allowed;
+      {
+        EVENT_TRACE_SCOPE(event_evaluate);
+
+        if (filenamelen == 0) {
+          allowed = false;
+        } else if (_M_budget == 0) {
+          allowed = evaluator->allow(filename, filenamelen);
+        } else if (!evaluator->allow_before(filename,
+                                            filenamelen,
+                                            req->arrival + _M_budget,
+                                            allowed)) {
+          // The verdict would have been late: reply with the fallback
+          // verdict.
+          allowed = _M_fallback;
+          _M_missed++;
+
+          evaluator->missed(filename, filenamelen, allowed);
+        }
+      }
+
+#if _DEBUG
+      printf("Filename: '%ls' => %s.\n",
+             filename,
+             allowed ? "allowed" : "not allowed");
+#endif // _DEBUG
+
+      bool delivered;
+      {
+        EVENT_TRACE_SCOPE(event_reply);
+        delivered = _M_transport->reply(req, allowed);
+      }
+
+      if (!delivered) {
+        evaluator->undelivered();
+      }
+    }
+  } while (_M_running);
+}
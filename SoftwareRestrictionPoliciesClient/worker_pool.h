@@ -0,0 +1,129 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include "transport.h"
+
+// Pool of threads which receive requests from a transport, evaluate them and
+// reply.
+class worker_pool {
+  public:
+    // Evaluator (one per worker, it is only used by its worker).
+    class evaluator {
+      public:
+        // Destructor.
+        virtual ~evaluator();
+
+        // Allow?
+        virtual bool allow(const wchar_t* filename, size_t filenamelen) = 0;
+
+        // Allow, if the verdict is reached before `deadline` (monotonic
+        // clock, nanoseconds)? Returns false if the evaluation was abandoned
+        // (`allowed` is then not set). By default, the deadline is ignored.
+        virtual bool allow_before(const wchar_t* filename,
+                                  size_t filenamelen,
+                                  uint64_t deadline,
+                                  bool& allowed);
+
+        // The evaluation of the last request was abandoned: `allowed` (the
+        // fallback verdict) was replied.
+        virtual void missed(const wchar_t* filename,
+                            size_t filenamelen,
+                            bool allowed);
+
+        // The reply to the last request didn't reach the driver (it stopped
+        // waiting).
+        virtual void undelivered();
+    };
+
+    // Constructor.
+    worker_pool();
+
+    // Destructor.
+    ~worker_pool();
+
+    // Start (one worker per evaluator).
+    // A request is answered within `budget` milliseconds of its arrival
+    // (0: no budget): if its evaluation would end later, it is abandoned
+    // and the verdict `fallback` is replied.
+    bool start(transport& transport,
+               evaluator** evaluators,
+               size_t nworkers,
+               unsigned budget = 0,
+               bool fallback = true);
+
+    // Stop.
+    void stop();
+
+    // Number of requests answered with the fallback verdict.
+    uint64_t missed() const;
+
+  private:
+    // Time to wait for a request before checking whether to stop.
+    static const unsigned RECEIVE_TIMEOUT = 250; // Milliseconds.
+
+    transport* _M_transport;
+
+    // Budget of a request (nanoseconds, 0: none) and fallback verdict.
+    uint64_t _M_budget;
+    bool _M_fallback;
+
+    std::atomic<uint64_t> _M_missed;
+
+    std::thread* _M_threads;
+    size_t _M_nthreads;
+
+    std::atomic<bool> _M_running;
+
+    // Worker thread.
+    void run(evaluator* evaluator);
+};
+
+inline worker_pool::evaluator::~evaluator()
+{
+}
+
+inline bool worker_pool::evaluator::allow_before(const wchar_t* filename,
+                                                 size_t filenamelen,
+                                                 uint64_t deadline,
+                                                 bool& allowed)
+{
+  allowed = allow(filename, filenamelen);
+  return true;
+}
+
+inline void worker_pool::evaluator::missed(const wchar_t* filename,
+                                           size_t filenamelen,
+                                           bool allowed)
+{
+}
+
+inline void worker_pool::evaluator::undelivered()
+{
+}
+
+inline worker_pool::worker_pool()
+  : _M_transport(nullptr),
+    _M_budget(0),
+    _M_fallback(true),
+    _M_missed(0),
+    _M_threads(nullptr),
+    _M_nthreads(0),
+    _M_running(false)
+{
+}
+
+inline worker_pool::~worker_pool()
+{
+  stop();
+}
+
+inline uint64_t worker_pool::missed() const
+{
+  return _M_missed;
+}
+
+#endif // WORKER_POOL_H
@@ -1,6 +1,7 @@
 #include <fltkernel.h>
 #include <ntddk.h>
 #include "communication_port.h"
+#include "fast_path.h"
 
 
 /******************************************************************************
@@ -10,7 +11,18 @@
  **                                                                          **
  ******************************************************************************
  ******************************************************************************/
-#define TIMEOUT (250 * 10000) /* 250 milliseconds. */
+#define TIMEOUT (REQUEST_TIMEOUT * 10000) /* 100-nanosecond units. */
+
+/* Maximum number of client connections (the requests are distributed among
+ * the connected clients).
+ */
+#define MAX_CLIENTS 8
+
+/* Pool tag of the fast path ("SrFp"). */
+#define FAST_PATH_TAG 'pFrS'
+
+/* Pool tag of the requests ("SrRq"). */
+#define REQUEST_TAG 'qRrS'
 
 
 /******************************************************************************
@@ -23,7 +35,15 @@
 typedef struct {
   PFLT_FILTER filter;
   PFLT_PORT server_port;
-  PFLT_PORT client_port;
+  PFLT_PORT client_ports[MAX_CLIENTS];
+  volatile LONG next_client;
+
+  /* Fast path of the policy (NULL: none), set by the client in slot
+   * `fast_path_owner`: its paths are allowed without sending a message.
+   */
+  PVOID fast_path;
+  ULONG fast_path_owner;
+  EX_PUSH_LOCK fast_path_lock;
 } filter_t;
 
 
@@ -59,6 +79,11 @@ void NotifyRoutine(_In_ HANDLE ParentId,
                    _In_ HANDLE ProcessId,
                    _Inout_opt_ PPS_CREATE_NOTIFY_INFO CreateInfo);
 
+static void SetFastPath(PVOID FastPath, ULONG Owner);
+static void RemoveFastPath(ULONG Owner);
+static BOOLEAN FastPathAllows(PCUNICODE_STRING ImageFileName);
+static WCHAR UpcaseChar(WCHAR c);
+
 
 /******************************************************************************
  ******************************************************************************
@@ -101,6 +126,9 @@ static filter_t filter;
   #pragma alloc_text(PAGE, DisconnectCallback)
   #pragma alloc_text(PAGE, MessageCallback)
   #pragma alloc_text(PAGE, NotifyRoutine)
+  #pragma alloc_text(PAGE, SetFastPath)
+  #pragma alloc_text(PAGE, RemoveFastPath)
+  #pragma alloc_text(PAGE, FastPathAllows)
 #endif /* ALLOC_PRAGMA */
 
 
@@ -121,6 +149,9 @@ NTSTATUS DriverEntry(_In_ PDRIVER_OBJECT DriverObject,
 
   UNREFERENCED_PARAMETER(RegistryPath);
 
+  filter.fast_path = NULL;
+  FltInitializePushLock(&filter.fast_path_lock);
+
   /* Register with the filter manager. */
   status = FltRegisterFilter(DriverObject,
                              &filter_registration,
@@ -148,7 +179,7 @@ NTSTATUS DriverEntry(_In_ PDRIVER_OBJECT DriverObject,
                                           ConnectCallback,
                                           DisconnectCallback,
                                           MessageCallback,
-                                          1);
+                                          MAX_CLIENTS);
 
       FltFreeSecurityDescriptor(sd);
 
@@ -159,7 +190,8 @@ NTSTATUS DriverEntry(_In_ PDRIVER_OBJECT DriverObject,
         status = PsSetCreateProcessNotifyRoutineEx(NotifyRoutine, FALSE);
 
         if (NT_SUCCESS(status)) {
-          filter.client_port = NULL;
+          RtlZeroMemory(filter.client_ports, sizeof(filter.client_ports));
+          filter.next_client = 0;
 
           return status;
         }
@@ -171,6 +203,8 @@ NTSTATUS DriverEntry(_In_ PDRIVER_OBJECT DriverObject,
     FltUnregisterFilter(filter.filter);
   }
 
+  FltDeletePushLock(&filter.fast_path_lock);
+
   return status;
 }
 
@@ -192,6 +226,9 @@ NTSTATUS FilterUnload(_In_ FLT_FILTER_UNLOAD_FLAGS Flags)
   FltCloseCommunicationPort(filter.server_port);
   FltUnregisterFilter(filter.filter);
 
+  SetFastPath(NULL, 0);
+  FltDeletePushLock(&filter.fast_path_lock);
+
   return STATUS_SUCCESS;
 }
 
@@ -209,16 +246,28 @@ NTSTATUS ConnectCallback(PFLT_PORT ClientPort,
                          ULONG SizeOfContext,
                          PVOID* ConnectionPortCookie)
 {
+  ULONG i;
+
   UNREFERENCED_PARAMETER(ServerPortCookie);
   UNREFERENCED_PARAMETER(ConnectionContext);
   UNREFERENCED_PARAMETER(SizeOfContext);
-  UNREFERENCED_PARAMETER(ConnectionPortCookie);
 
   PAGED_CODE();
 
   if (ClientPort) {
-    filter.client_port = ClientPort;
-    return STATUS_SUCCESS;
+    /* Look for a free slot. */
+    for (i = 0; i < MAX_CLIENTS; i++) {
+      if (InterlockedCompareExchangePointer((PVOID*) &filter.client_ports[i],
+                                            ClientPort,
+                                            NULL) == NULL) {
+        /* The cookie is the slot number. */
+        *ConnectionPortCookie = (PVOID) (ULONG_PTR) i;
+
+        return STATUS_SUCCESS;
+      }
+    }
+
+    return STATUS_CONNECTION_COUNT_LIMIT;
   }
 
   return STATUS_INVALID_HANDLE;
@@ -234,11 +283,13 @@ NTSTATUS ConnectCallback(PFLT_PORT ClientPort,
  ******************************************************************************/
 void DisconnectCallback(PVOID ConnectionCookie)
 {
-  UNREFERENCED_PARAMETER(ConnectionCookie);
-
   PAGED_CODE();
 
-  FltCloseClientPort(filter.filter, &filter.client_port);
+  FltCloseClientPort(filter.filter,
+                     &filter.client_ports[(ULONG_PTR) ConnectionCookie]);
+
+  /* The fast path goes away with the client which set it. */
+  RemoveFastPath((ULONG) (ULONG_PTR) ConnectionCookie);
 }
 
 
@@ -256,16 +307,60 @@ NTSTATUS MessageCallback(PVOID PortCookie,
                          ULONG OutputBufferLength,
                          PULONG ReturnOutputBufferLength)
 {
-  UNREFERENCED_PARAMETER(PortCookie);
-  UNREFERENCED_PARAMETER(InputBuffer);
-  UNREFERENCED_PARAMETER(InputBufferLength);
+  PVOID fast_path;
+  NTSTATUS status;
+
   UNREFERENCED_PARAMETER(OutputBuffer);
   UNREFERENCED_PARAMETER(OutputBufferLength);
-  UNREFERENCED_PARAMETER(ReturnOutputBufferLength);
 
   PAGED_CODE();
 
-  return STATUS_SUCCESS;
+  *ReturnOutputBufferLength = 0;
+
+  /* The message is the fast path of the policy (an empty message removes
+   * it, if it was set by the same client).
+   */
+  if ((!InputBuffer) || (InputBufferLength == 0)) {
+    RemoveFastPath((ULONG) (ULONG_PTR) PortCookie);
+    return STATUS_SUCCESS;
+  }
+
+  if ((InputBufferLength < sizeof(fast_path_header)) ||
+      (InputBufferLength > FAST_PATH_MAX_SIZE)) {
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  fast_path = ExAllocatePoolWithTag(PagedPool,
+                                    InputBufferLength,
+                                    FAST_PATH_TAG);
+
+  if (!fast_path) {
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+
+  /* The buffer belongs to the client: it is copied before it is validated.
+   */
+  __try {
+    ProbeForRead(InputBuffer, InputBufferLength, 1);
+    RtlCopyMemory(fast_path, InputBuffer, InputBufferLength);
+
+    status = STATUS_SUCCESS;
+  } __except (EXCEPTION_EXECUTE_HANDLER) {
+    status = GetExceptionCode();
+  }
+
+  if (NT_SUCCESS(status)) {
+    if (fast_path_validate(fast_path, InputBufferLength)) {
+      SetFastPath(fast_path, (ULONG) (ULONG_PTR) PortCookie);
+      return STATUS_SUCCESS;
+    }
+
+    status = STATUS_INVALID_PARAMETER;
+  }
+
+  ExFreePoolWithTag(fast_path, FAST_PATH_TAG);
+
+  return status;
 }
 
 
@@ -283,24 +378,78 @@ void NotifyRoutine(_In_ HANDLE ParentId,
   int reply;
   ULONG replylen;
   LARGE_INTEGER timeout;
+  ULONG first;
+  ULONG i;
+  PFLT_PORT* client_port;
+  request_header* request;
+  ULONG requestlen;
+  NTSTATUS status;
 
   UNREFERENCED_PARAMETER(ParentId);
 
   PAGED_CODE();
 
   if ((CreateInfo) && (CreateInfo->ImageFileName)) {
-    if (filter.client_port) {
+    /* Allowed by the fast path? */
+    if (FastPathAllows(CreateInfo->ImageFileName)) {
+      DbgPrint("[Fast path] PID: %d, EXE: '%wZ' => allowed.",
+               ProcessId,
+               CreateInfo->ImageFileName);
+
+      return;
+    }
+
+    /* Pick the next connected client (round robin). */
+    client_port = NULL;
+    first = (ULONG) InterlockedIncrement(&filter.next_client);
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+      if (filter.client_ports[(first + i) % MAX_CLIENTS]) {
+        client_port = &filter.client_ports[(first + i) % MAX_CLIENTS];
+        break;
+      }
+    }
+
+    if (client_port) {
+      /* The request carries the time it is sent, so the client knows how
+       * long it has left to reply.
+       */
+      requestlen = sizeof(request_header) + CreateInfo->ImageFileName->Length;
+      request = (request_header*) ExAllocatePoolWithTag(PagedPool,
+                                                        requestlen,
+                                                        REQUEST_TAG);
+
+      if (!request) {
+        DbgPrint("[Out of memory] PID: %d, EXE: '%wZ' => allowed.",
+                 ProcessId,
+                 CreateInfo->ImageFileName);
+
+        return;
+      }
+
+      RtlCopyMemory(request + 1,
+                    CreateInfo->ImageFileName->Buffer,
+                    CreateInfo->ImageFileName->Length);
+
+      request->sent = KeQueryPerformanceCounter(NULL).QuadPart;
+
+      reply = 1;
       replylen = sizeof(int);
       timeout.QuadPart = -TIMEOUT;
 
       /* Send message to client program. */
-      if (NT_SUCCESS(FltSendMessage(filter.filter,
-                                    &filter.client_port,
-                                    CreateInfo->ImageFileName->Buffer,
-                                    CreateInfo->ImageFileName->Length,
-                                    &reply,
-                                    &replylen,
-                                    &timeout))) {
+      status = FltSendMessage(filter.filter,
+                              client_port,
+                              request,
+                              requestlen,
+                              &reply,
+                              &replylen,
+                              &timeout);
+
+      /* STATUS_TIMEOUT is a success code: the reply is only read if it has
+       * arrived, otherwise the program is allowed.
+       */
+      if (status == STATUS_SUCCESS) {
         DbgPrint("PID: %d, EXE: '%wZ' => %s.",
                  ProcessId,
                  CreateInfo->ImageFileName,
@@ -309,7 +458,14 @@ void NotifyRoutine(_In_ HANDLE ParentId,
         if (!reply) {
           CreateInfo->CreationStatus = STATUS_ACCESS_DENIED;
         }
+      } else {
+        DbgPrint("[No reply: 0x%08x] PID: %d, EXE: '%wZ' => allowed.",
+                 status,
+                 ProcessId,
+                 CreateInfo->ImageFileName);
       }
+
+      ExFreePoolWithTag(request, REQUEST_TAG);
     } else {
         DbgPrint("[Client not running] PID: %d, EXE: '%wZ' => allowed.",
                  ProcessId,
@@ -317,3 +473,112 @@ void NotifyRoutine(_In_ HANDLE ParentId,
     }
   }
 }
+
+
+/******************************************************************************
+ ******************************************************************************
+ **                                                                          **
+ ** Function: SetFastPath                                                    **
+ **                                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+static void SetFastPath(PVOID FastPath, ULONG Owner)
+{
+  PVOID old;
+
+  PAGED_CODE();
+
+  FltAcquirePushLockExclusive(&filter.fast_path_lock);
+
+  old = filter.fast_path;
+  filter.fast_path = FastPath;
+  filter.fast_path_owner = Owner;
+
+  FltReleasePushLock(&filter.fast_path_lock);
+
+  if (old) {
+    ExFreePoolWithTag(old, FAST_PATH_TAG);
+  }
+}
+
+
+/******************************************************************************
+ ******************************************************************************
+ **                                                                          **
+ ** Function: RemoveFastPath                                                 **
+ **                                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+static void RemoveFastPath(ULONG Owner)
+{
+  PVOID old;
+
+  PAGED_CODE();
+
+  FltAcquirePushLockExclusive(&filter.fast_path_lock);
+
+  if (filter.fast_path_owner == Owner) {
+    old = filter.fast_path;
+    filter.fast_path = NULL;
+  } else {
+    old = NULL;
+  }
+
+  FltReleasePushLock(&filter.fast_path_lock);
+
+  if (old) {
+    ExFreePoolWithTag(old, FAST_PATH_TAG);
+  }
+}
+
+
+/******************************************************************************
+ ******************************************************************************
+ **                                                                          **
+ ** Function: FastPathAllows                                                 **
+ **                                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+static BOOLEAN FastPathAllows(PCUNICODE_STRING ImageFileName)
+{
+  const WCHAR* path;
+  size_t pathlen;
+  BOOLEAN allowed;
+
+  PAGED_CODE();
+
+  path = ImageFileName->Buffer;
+  pathlen = ImageFileName->Length / sizeof(WCHAR);
+
+  /* Skip the prefix "\??\" (if present), like the client. */
+  if ((pathlen > 4) &&
+      (path[0] == L'\\') &&
+      (path[1] == L'?') &&
+      (path[2] == L'?') &&
+      (path[3] == L'\\')) {
+    path += 4;
+    pathlen -= 4;
+  }
+
+  FltAcquirePushLockShared(&filter.fast_path_lock);
+
+  allowed = ((filter.fast_path) &&
+             (fast_path_find(filter.fast_path, path, pathlen, UpcaseChar)));
+
+  FltReleasePushLock(&filter.fast_path_lock);
+
+  return allowed;
+}
+
+
+/******************************************************************************
+ ******************************************************************************
+ **                                                                          **
+ ** Function: UpcaseChar                                                     **
+ **                                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+static WCHAR UpcaseChar(WCHAR c)
+{
+  return RtlUpcaseUnicodeChar(c);
+}
@@ -0,0 +1,520 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests.h"
+#include "authenticode.h"
+#include "image_context.h"
+
+static const size_t PATH_MAX_LEN = 1024;
+
+// Directory and name of the files derived from the fixtures.
+static const char* const TEMPORARY_DIRECTORY = ".";
+static const char* const TEMPORARY_FILENAME = "authenticode_test.tmp";
+
+// Number of bytes the large files add to a fixture (more than the image
+// context reads when it opens a file).
+static const size_t LARGE_FILE_EXTRA_LEN = (3 * authenticode::CHUNK_SIZE) + 8;
+
+// Offsets in a PE image.
+static const size_t PE_LFANEW_OFFSET = 0x3c;
+static const size_t OPTIONAL_HEADER_OFFSET = 4 + 20;
+static const size_t CERTIFICATE_TABLE_ENTRY_OFFSET = 96 + (4 * 8);
+static const size_t PE32PLUS_CERTIFICATE_TABLE_ENTRY_OFFSET = 112 + (4 * 8);
+static const uint8_t PE32PLUS_MAGIC_HIGH = 0x02;
+
+static inline uint32_t load_le32(const uint8_t* p)
+{
+  return static_cast<uint32_t>(p[0]) |
+         (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static inline void store_le32(uint8_t* p, uint32_t n)
+{
+  p[0] = static_cast<uint8_t>(n);
+  p[1] = static_cast<uint8_t>(n >> 8);
+  p[2] = static_cast<uint8_t>(n >> 16);
+  p[3] = static_cast<uint8_t>(n >> 24);
+}
+
+// Source of a file in memory which checks the size of the reads and can
+// fail them.
+class test_source : public authenticode::source {
+  public:
+    // Constructor.
+    test_source(const uint8_t* data, size_t len, uint64_t fail = UINT64_MAX);
+
+    // Read.
+    const uint8_t* read(uint64_t offset, size_t len);
+
+    // Get number of bytes read.
+    uint64_t bytes() const;
+
+    // Did a read ask for more than CHUNK_SIZE bytes or beyond the end of the
+    // file?
+    bool invalid() const;
+
+  private:
+    const uint8_t* _M_data;
+    size_t _M_len;
+
+    // Reads from this offset fail.
+    uint64_t _M_fail;
+
+    uint64_t _M_bytes;
+    bool _M_invalid;
+};
+
+test_source::test_source(const uint8_t* data, size_t len, uint64_t fail)
+  : _M_data(data),
+    _M_len(len),
+    _M_fail(fail),
+    _M_bytes(0),
+    _M_invalid(false)
+{
+}
+
+const uint8_t* test_source::read(uint64_t offset, size_t len)
+{
+  if ((len > authenticode::CHUNK_SIZE) ||
+      (offset > _M_len) ||
+      (len > _M_len - offset)) {
+    _M_invalid = true;
+    return nullptr;
+  }
+
+  if (offset + len > _M_fail) {
+    return nullptr;
+  }
+
+  _M_bytes += len;
+
+  return _M_data + offset;
+}
+
+uint64_t test_source::bytes() const
+{
+  return _M_bytes;
+}
+
+bool test_source::invalid() const
+{
+  return _M_invalid;
+}
+
+// Do both layouts describe the same parts of the file?
+static bool same_layout(const authenticode::layout& l1,
+                        const authenticode::layout& l2)
+{
+  if ((l1.pe != l2.pe) ||
+      (l1.nranges != l2.nranges) ||
+      (l1.padding != l2.padding) ||
+      (l1.certificates.offset != l2.certificates.offset) ||
+      (l1.certificates.len != l2.certificates.len)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < l1.nranges; i++) {
+    if ((l1.ranges[i].offset != l2.ranges[i].offset) ||
+        (l1.ranges[i].len != l2.ranges[i].len)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Compare the digests of a fixture with the expected ones.
+static bool check_digests(const fixture& f,
+                          const char* source,
+                          const uint8_t* sha1,
+                          const uint8_t* sha256)
+{
+  char hex[(authenticode::SHA256_LEN * 2) + 1];
+  bool ok = true;
+
+  to_hex(sha1, authenticode::SHA1_LEN, hex);
+  ok = check(strcmp(hex, f.sha1) == 0,
+             "%s (%s): SHA-1 %s, expected %s",
+             f.filename,
+             source,
+             hex,
+             f.sha1) && ok;
+
+  to_hex(sha256, authenticode::SHA256_LEN, hex);
+  ok = check(strcmp(hex, f.sha256) == 0,
+             "%s (%s): SHA-256 %s, expected %s",
+             f.filename,
+             source,
+             hex,
+             f.sha256) && ok;
+
+  return ok;
+}
+
+// Digests of a fixture in memory.
+static bool test_memory(const fixture& f, const uint8_t* data, size_t len)
+{
+  static const size_t HEADER_LEN = 1024;
+
+  authenticode::layout layout;
+  if (!check(authenticode::parse(data, len, layout),
+             "%s: the image could not be parsed",
+             f.filename)) {
+    return false;
+  }
+
+  bool ok = true;
+
+  ok = check(layout.pe == f.pe,
+             "%s: the file is%s a PE image",
+             f.filename,
+             layout.pe ? "" : " not") && ok;
+
+  ok = check((layout.certificates.len > 0) == f.signed_image,
+             "%s: the image is%s signed",
+             f.filename,
+             (layout.certificates.len > 0) ? "" : " not") && ok;
+
+  // Parsed from the first bytes only.
+  if (len > HEADER_LEN) {
+    authenticode::layout l;
+    ok = check((authenticode::parse(data, HEADER_LEN, len, l)) &&
+               (same_layout(layout, l)),
+               "%s: the layout differs when parsed from the headers",
+               f.filename) && ok;
+
+    ok = check(!authenticode::parse(data, 63, len, l),
+               "%s: parsed from less than the DOS header",
+               f.filename) && ok;
+  }
+
+  uint8_t sha1[authenticode::SHA1_LEN];
+  uint8_t sha256[authenticode::SHA256_LEN];
+  test_source src(data, len);
+  if (check(authenticode::hash(layout, src, sha1, sha256),
+            "%s: the image could not be hashed",
+            f.filename)) {
+    ok = check_digests(f, "memory", sha1, sha256) && ok;
+
+    ok = check(!src.invalid(),
+               "%s: invalid read while hashing",
+               f.filename) && ok;
+
+    // Only one of the digests.
+    uint8_t digest[authenticode::SHA1_LEN];
+    ok = check((authenticode::hash(layout, src, digest, nullptr)) &&
+               (memcmp(digest, sha1, sizeof(digest)) == 0),
+               "%s: SHA-1 alone differs",
+               f.filename) && ok;
+
+    // From memory, without a layout.
+    ok = check((authenticode::hash(data, len, digest, nullptr)) &&
+               (memcmp(digest, sha1, sizeof(digest)) == 0),
+               "%s: SHA-1 of the file in memory differs",
+               f.filename) && ok;
+  } else {
+    ok = false;
+  }
+
+  // The deadline has already passed.
+  ok = check(!authenticode::hash(layout, src, sha1, sha256, 0),
+             "%s: the hashing didn't stop at the deadline",
+             f.filename) && ok;
+
+  // The first read fails.
+  if (len > 1) {
+    test_source failing(data, len, 1);
+    ok = check(!authenticode::hash(layout, failing, sha1, sha256),
+               "%s: the hashing didn't stop at a read error",
+               f.filename) && ok;
+  }
+
+  return ok;
+}
+
+// Digests of a fixture from the file (the way the client hashes the
+// executables).
+static bool test_file(const fixture& f, const char* directory)
+{
+  wchar_t path[PATH_MAX_LEN];
+  image_context image;
+  if (!check((fixture_path(directory, f.filename, path, PATH_MAX_LEN)) &&
+             (image.open(path)),
+             "%s: the image could not be opened",
+             f.filename)) {
+    return false;
+  }
+
+  bool ok = true;
+
+  ok = check(image.pe() == f.pe,
+             "%s: the file is%s a PE image (image context)",
+             f.filename,
+             image.pe() ? "" : " not") && ok;
+
+  size_t len;
+  ok = check((image.signature(len) != nullptr) == f.signed_image,
+             "%s: the signature was%s found",
+             f.filename,
+             f.signed_image ? " not" : "") && ok;
+
+  if (check(image.hash(true),
+            "%s: the image could not be hashed (image context)",
+            f.filename)) {
+    ok = check_digests(f, "file", image.sha1(), image.sha256()) && ok;
+  } else {
+    ok = false;
+  }
+
+  return ok;
+}
+
+// Malformed PE32 images (derived from a signed one).
+static bool test_malformed(const char* directory)
+{
+  static const char* const filename = "pe32_signed.exe";
+
+  size_t len;
+  uint8_t* data;
+  if (!check((data = read_fixture(directory, filename, len)) != nullptr,
+             "%s: the fixture could not be read",
+             filename)) {
+    return false;
+  }
+
+  uint8_t* copy;
+  if ((copy = reinterpret_cast<uint8_t*>(malloc(len))) == nullptr) {
+    free(data);
+    return false;
+  }
+
+  size_t pe = load_le32(data + PE_LFANEW_OFFSET);
+  size_t optional = pe + OPTIONAL_HEADER_OFFSET;
+  size_t entry = optional + CERTIFICATE_TABLE_ENTRY_OFFSET;
+  uint32_t certoff = load_le32(data + entry);
+
+  authenticode::layout layout;
+  bool ok = true;
+
+  // Truncated in the optional header.
+  ok = check(!authenticode::parse(data, optional + 1, layout),
+             "truncated optional header accepted") && ok;
+
+  // Unknown optional header.
+  memcpy(copy, data, len);
+  copy[optional + 1] = 0x03;
+  ok = check(!authenticode::parse(copy, len, layout),
+             "unknown optional header accepted") && ok;
+
+  // Certificate table beyond the end of the file.
+  memcpy(copy, data, len);
+  store_le32(copy + entry + 4, static_cast<uint32_t>(len - certoff + 8));
+  ok = check(!authenticode::parse(copy, len, layout),
+             "certificate table beyond the end of the file accepted") && ok;
+
+  // Certificate table in the headers.
+  memcpy(copy, data, len);
+  store_le32(copy + entry, static_cast<uint32_t>(entry));
+  ok = check(!authenticode::parse(copy, len, layout),
+             "certificate table in the headers accepted") && ok;
+
+  // Not a PE signature: the file is hashed as is.
+  memcpy(copy, data, len);
+  copy[pe] = 'X';
+  ok = check((authenticode::parse(copy, len, layout)) && (!layout.pe),
+             "file without PE signature not hashed as is") && ok;
+
+  free(copy);
+  free(data);
+
+  return ok;
+}
+
+// Image larger than the bytes the image context reads when it opens it:
+// the hashed ranges (and, if `certificates` is true, the certificate table)
+// are read in chunks. The digests must be the ones of the same file in
+// memory.
+static bool test_large(const char* directory,
+                       const char* filename,
+                       bool certificates)
+{
+  size_t len;
+  uint8_t* data;
+  if (!check((data = read_fixture(directory, filename, len)) != nullptr,
+             "%s: the fixture could not be read",
+             filename)) {
+    return false;
+  }
+
+  size_t largelen = len + LARGE_FILE_EXTRA_LEN;
+  uint8_t* large;
+  if ((large = reinterpret_cast<uint8_t*>(malloc(largelen))) == nullptr) {
+    free(data);
+    return false;
+  }
+
+  // Insert the bytes before the certificate table or append them to the
+  // image.
+  size_t optional = load_le32(data + PE_LFANEW_OFFSET) +
+                    OPTIONAL_HEADER_OFFSET;
+  size_t entry = optional +
+                 ((data[optional + 1] == PE32PLUS_MAGIC_HIGH) ?
+                   PE32PLUS_CERTIFICATE_TABLE_ENTRY_OFFSET :
+                   CERTIFICATE_TABLE_ENTRY_OFFSET);
+  size_t off = certificates ? load_le32(data + entry) : len;
+
+  memcpy(large, data, off);
+
+  for (size_t i = 0; i < LARGE_FILE_EXTRA_LEN; i++) {
+    large[off + i] = static_cast<uint8_t>((i * 7) + (i >> 8));
+  }
+
+  memcpy(large + off + LARGE_FILE_EXTRA_LEN, data + off, len - off);
+
+  if (certificates) {
+    store_le32(large + entry,
+               static_cast<uint32_t>(off + LARGE_FILE_EXTRA_LEN));
+  }
+
+  free(data);
+
+  bool ok = true;
+
+  uint8_t sha1[authenticode::SHA1_LEN];
+  uint8_t sha256[authenticode::SHA256_LEN];
+  authenticode::layout layout;
+  wchar_t path[PATH_MAX_LEN];
+  image_context image;
+  if ((check(authenticode::parse(large, largelen, layout),
+             "%s (large): the image could not be parsed",
+             filename)) &&
+      (check(authenticode::hash(large, largelen, sha1, sha256),
+             "%s (large): the image could not be hashed in memory",
+             filename)) &&
+      (check((write_fixture(TEMPORARY_DIRECTORY,
+                            TEMPORARY_FILENAME,
+                            large,
+                            largelen)) &&
+             (fixture_path(TEMPORARY_DIRECTORY,
+                           TEMPORARY_FILENAME,
+                           path,
+                           PATH_MAX_LEN)),
+             "%s (large): the file could not be written",
+             filename)) &&
+      (check(image.open(path),
+             "%s (large): the image could not be opened",
+             filename))) {
+    size_t siglen;
+    const uint8_t* signature = image.signature(siglen);
+
+    if (certificates) {
+      // The signature follows the WIN_CERTIFICATE header.
+      const uint8_t* table = large + layout.certificates.offset;
+      ok = check((signature) &&
+                 (siglen == load_le32(table) - 8) &&
+                 (memcmp(signature, table + 8, siglen) == 0),
+                 "%s (large): the signature differs",
+                 filename) && ok;
+    } else {
+      ok = check(signature == nullptr,
+                 "%s (large): signature found",
+                 filename) && ok;
+    }
+
+    ok = check((image.hash(true)) &&
+               (memcmp(image.sha1(), sha1, sizeof(sha1)) == 0) &&
+               (memcmp(image.sha256(), sha256, sizeof(sha256)) == 0),
+               "%s (large): the digests differ from the ones in memory",
+               filename) && ok;
+
+    ok = check(image.hashed() == image.hash_size(),
+               "%s (large): %llu bytes hashed, expected %llu",
+               filename,
+               static_cast<unsigned long long>(image.hashed()),
+               static_cast<unsigned long long>(image.hash_size())) && ok;
+  } else {
+    ok = false;
+  }
+
+  image.close();
+  remove(TEMPORARY_FILENAME);
+
+  free(large);
+
+  return ok;
+}
+
+// Errors opening an image: a missing file fails (it can be transient), a
+// malformed image doesn't.
+static bool test_open_errors(const char* directory)
+{
+  bool ok = true;
+
+  wchar_t path[PATH_MAX_LEN];
+  image_context image;
+  ok = check((fixture_path(directory, "missing.exe", path, PATH_MAX_LEN)) &&
+             (!image.open(path)) &&
+             (image.failed()),
+             "missing file not reported as an error") && ok;
+
+  size_t len;
+  uint8_t* data;
+  if (!check((data = read_fixture(directory, "pe32.exe", len)) != nullptr,
+             "pe32.exe: the fixture could not be read")) {
+    return false;
+  }
+
+  // Unknown optional header.
+  size_t pe = load_le32(data + PE_LFANEW_OFFSET);
+  data[pe + OPTIONAL_HEADER_OFFSET + 1] = 0x03;
+
+  ok = check((write_fixture(TEMPORARY_DIRECTORY,
+                            TEMPORARY_FILENAME,
+                            data,
+                            len)) &&
+             (fixture_path(TEMPORARY_DIRECTORY,
+                           TEMPORARY_FILENAME,
+                           path,
+                           PATH_MAX_LEN)) &&
+             (!image.open(path)) &&
+             (!image.failed()),
+             "malformed image reported as an error") && ok;
+
+  remove(TEMPORARY_FILENAME);
+
+  free(data);
+
+  return ok;
+}
+
+bool test_authenticode(const char* directory)
+{
+  bool ok = true;
+
+  for (size_t i = 0; i < nfixtures; i++) {
+    const fixture& f = fixtures[i];
+
+    size_t len;
+    uint8_t* data;
+    if (check((data = read_fixture(directory, f.filename, len)) != nullptr,
+              "%s: the fixture could not be read",
+              f.filename)) {
+      ok = test_memory(f, data, len) && ok;
+      free(data);
+    } else {
+      ok = false;
+    }
+
+    ok = test_file(f, directory) && ok;
+  }
+
+  ok = test_large(directory, "pe32.exe", false) && ok;
+  ok = test_large(directory, "pe32_signed.exe", true) && ok;
+  ok = test_large(directory, "pe32plus_signed.exe", true) && ok;
+
+  ok = test_open_errors(directory) && ok;
+
+  return test_malformed(directory) && ok;
+}
@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include "tests.h"
+#include "catalog_index.h"
+
+#ifdef _WIN32
+  // Visual Studio 2013 doesn't have snprintf().
+  #define snprintf(buf, size, ...) \
+          _snprintf_s(buf, size, _TRUNCATE, __VA_ARGS__)
+#endif
+
+static const size_t PATH_MAX_LEN = 1024;
+
+// Directory of the catalog files (in the directory of the fixtures) and
+// catalog file.
+static const char* const CATALOG_DIRECTORY = "catalogs";
+static const char* const CATALOG_FILENAME = "test.cat";
+
+// Directory and name of the saved index.
+static const char* const TEMPORARY_DIRECTORY = ".";
+static const char* const TEMPORARY_FILENAME = "catalog_index_test.tmp";
+
+// Digests of the fixtures which are members of the catalog (see
+// fixtures/make_fixtures.py).
+struct expected_member {
+  const char* filename;
+
+  bool sha1;
+  bool sha256;
+};
+
+static const expected_member members[] = {
+  // SpcIndirectDataContent attribute.
+  {"pe32.exe",                 true,  false},
+  {"pe32plus.exe",             false, true},
+
+  // Same digests as the unsigned images.
+  {"pe32_signed.exe",          true,  false},
+  {"pe32plus_signed.exe",      false, true},
+
+  // Tag only.
+  {"pe32_short_directory.exe", true,  false},
+  {"not_pe.bin",               false, true}
+};
+
+static const size_t nmembers = sizeof(members) / sizeof(members[0]);
+
+// Number of members of the catalog file.
+static const size_t NSHA1 = 2;
+static const size_t NSHA256 = 2;
+
+// Find the fixture of a member.
+static const fixture* find_fixture(const char* filename)
+{
+  for (size_t i = 0; i < nfixtures; i++) {
+    if (strcmp(fixtures[i].filename, filename) == 0) {
+      return &fixtures[i];
+    }
+  }
+
+  return nullptr;
+}
+
+// Is the hash in the list?
+static bool contains(const catalog_index::hash_list& list,
+                     const uint8_t* hash,
+                     size_t hashlen)
+{
+  for (size_t i = 0; i < list.count(); i++) {
+    if (memcmp(list.data() + (i * hashlen), hash, hashlen) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Look up the digests of the fixtures: the members are found, the other
+// digests are not.
+static bool check_lookups(const catalog_index& index, const char* what)
+{
+  bool ok = true;
+
+  for (size_t i = 0; i < nmembers; i++) {
+    const expected_member& m = members[i];
+
+    const fixture* f;
+    uint8_t sha1[catalog_index::SHA1_LEN];
+    uint8_t sha256[catalog_index::SHA256_LEN];
+    if ((!check((f = find_fixture(m.filename)) != nullptr,
+                "%s: unknown fixture",
+                m.filename)) ||
+        (!from_hex(f->sha1, sha1, sizeof(sha1))) ||
+        (!from_hex(f->sha256, sha256, sizeof(sha256)))) {
+      ok = false;
+      continue;
+    }
+
+    ok = check(index.find(sha1, sizeof(sha1)) == m.sha1,
+               "%s (%s): SHA-1 %s",
+               m.filename,
+               what,
+               m.sha1 ? "not found" : "found") && ok;
+
+    ok = check(index.find(sha256, sizeof(sha256)) == m.sha256,
+               "%s (%s): SHA-256 %s",
+               m.filename,
+               what,
+               m.sha256 ? "not found" : "found") && ok;
+
+    // Neither a SHA-1 nor a SHA-256 hash.
+    ok = check(!index.find(sha256, 16),
+               "%s (%s): hash of 16 bytes found",
+               m.filename,
+               what) && ok;
+  }
+
+  return ok;
+}
+
+// Parse the catalog file in memory.
+static bool test_parse(const char* directory)
+{
+  char dir[PATH_MAX_LEN];
+  int n = snprintf(dir, sizeof(dir), "%s/%s", directory, CATALOG_DIRECTORY);
+
+  size_t len;
+  uint8_t* data;
+  if ((!check((n >= 0) && (static_cast<size_t>(n) < sizeof(dir)),
+              "%s: path too long",
+              CATALOG_DIRECTORY)) ||
+      (!check((data = read_fixture(dir, CATALOG_FILENAME, len)) != nullptr,
+              "%s: the fixture could not be read",
+              CATALOG_FILENAME))) {
+    return false;
+  }
+
+  bool ok = true;
+
+  catalog_index::hash_list sha1(catalog_index::SHA1_LEN);
+  catalog_index::hash_list sha256(catalog_index::SHA256_LEN);
+  if (check(catalog_index::parse(data, len, sha1, sha256),
+            "%s: the catalog could not be parsed",
+            CATALOG_FILENAME)) {
+    ok = check((sha1.count() == NSHA1) && (sha256.count() == NSHA256),
+               "%s: %llu SHA-1 and %llu SHA-256 members",
+               CATALOG_FILENAME,
+               static_cast<unsigned long long>(sha1.count()),
+               static_cast<unsigned long long>(sha256.count())) && ok;
+
+    for (size_t i = 0; i < nmembers; i++) {
+      const fixture* f = find_fixture(members[i].filename);
+
+      uint8_t hash[catalog_index::SHA256_LEN];
+      if ((f) &&
+          (members[i].sha1) &&
+          (from_hex(f->sha1, hash, catalog_index::SHA1_LEN))) {
+        ok = check(contains(sha1, hash, catalog_index::SHA1_LEN),
+                   "%s: SHA-1 member not parsed",
+                   members[i].filename) && ok;
+      }
+
+      if ((f) &&
+          (members[i].sha256) &&
+          (from_hex(f->sha256, hash, catalog_index::SHA256_LEN))) {
+        ok = check(contains(sha256, hash, catalog_index::SHA256_LEN),
+                   "%s: SHA-256 member not parsed",
+                   members[i].filename) && ok;
+      }
+    }
+  } else {
+    ok = false;
+  }
+
+  // Truncated catalog.
+  sha1.clear();
+  sha256.clear();
+  ok = check(!catalog_index::parse(data, len - 1, sha1, sha256),
+             "%s: truncated catalog parsed",
+             CATALOG_FILENAME) && ok;
+
+  // Not a catalog: the content type is not szOID_CTL (1.3.6.1.4.1.311.10.1).
+  static const uint8_t OID_CTL[] = {
+    0x06, 0x09, 0x2b, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x0a, 0x01
+  };
+
+  uint8_t* oid = nullptr;
+  for (size_t i = 0; i + sizeof(OID_CTL) <= len; i++) {
+    if (memcmp(data + i, OID_CTL, sizeof(OID_CTL)) == 0) {
+      oid = data + i;
+      break;
+    }
+  }
+
+  if (check(oid != nullptr,
+            "%s: content type not found",
+            CATALOG_FILENAME)) {
+    oid[sizeof(OID_CTL) - 1]++;
+
+    sha1.clear();
+    sha256.clear();
+    ok = check(!catalog_index::parse(data, len, sha1, sha256),
+               "%s: content which is not a CTL parsed",
+               CATALOG_FILENAME) && ok;
+  } else {
+    ok = false;
+  }
+
+  free(data);
+
+  return ok;
+}
+
+// Build the index of the catalog files of the directory, rebuild it from
+// the previous one, save it and load it.
+static bool test_index(const char* directory)
+{
+  wchar_t dir[PATH_MAX_LEN];
+  if (!check(fixture_path(directory, CATALOG_DIRECTORY, dir, PATH_MAX_LEN),
+             "%s: path too long",
+             CATALOG_DIRECTORY)) {
+    return false;
+  }
+
+  catalog_index index;
+  if (!check(index.build(dir, nullptr, 2),
+             "the index could not be built")) {
+    return false;
+  }
+
+  bool ok = true;
+
+  wchar_t filename[PATH_MAX_LEN];
+  ok = check((index.files() == 1) &&
+             (index.parsed() == 1) &&
+             (index.failed() == 0),
+             "build: %llu file(s), %llu parsed, %llu failed",
+             static_cast<unsigned long long>(index.files()),
+             static_cast<unsigned long long>(index.parsed()),
+             static_cast<unsigned long long>(index.failed())) && ok;
+
+  ok = check((index.files() == 1) &&
+             (mbstowcs(filename, CATALOG_FILENAME, PATH_MAX_LEN) ==
+              strlen(CATALOG_FILENAME)) &&
+             (wcscmp(index.get(0).filename, filename) == 0) &&
+             (index.get(0).parsed),
+             "build: %s not in the index",
+             CATALOG_FILENAME) && ok;
+
+  ok = check(index.count() == NSHA1 + NSHA256,
+             "build: %llu hashes",
+             static_cast<unsigned long long>(index.count())) && ok;
+
+  ok = check_lookups(index, "build") && ok;
+
+  // The file has not changed: its members are copied.
+  catalog_index rebuilt;
+  ok = check((rebuilt.build(dir, &index, 2)) &&
+             (rebuilt.files() == 1) &&
+             (rebuilt.parsed() == 0) &&
+             (rebuilt.failed() == 0),
+             "rebuild: the catalog file was parsed again") && ok;
+
+  ok = check_lookups(rebuilt, "rebuild") && ok;
+
+  // Save and load.
+  wchar_t path[PATH_MAX_LEN];
+  catalog_index loaded;
+  ok = check((fixture_path(TEMPORARY_DIRECTORY,
+                           TEMPORARY_FILENAME,
+                           path,
+                           PATH_MAX_LEN)) &&
+             (index.save(path)) &&
+             (loaded.load(path)) &&
+             (loaded.files() == 1) &&
+             (loaded.count() == index.count()),
+             "the index could not be saved and loaded") && ok;
+
+  ok = check_lookups(loaded, "load") && ok;
+
+  remove(TEMPORARY_FILENAME);
+
+  // Missing directory.
+  catalog_index missing;
+  ok = check((fixture_path(directory, "missing", dir, PATH_MAX_LEN)) &&
+             (!missing.build(dir, nullptr, 2)),
+             "index built from a missing directory") && ok;
+
+  return ok;
+}
+
+bool test_catalog_index(const char* directory)
+{
+  bool ok = test_parse(directory);
+  return test_index(directory) && ok;
+}
@@ -0,0 +1,491 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include "tests.h"
+#include "path_list.h"
+#include "upcase.h"
+#include "fast_path.h"
+
+// Length of the over-long components.
+static const size_t LONG_COMPONENT_LEN = 1000;
+
+// Random paths looked up.
+static const size_t RANDOM_PATHS = 20000;
+
+// Mutated blobs of the fuzz loop.
+static const size_t FUZZ_ITERATIONS = 20000;
+
+// Allowed paths (the same list is compiled into the fast path).
+struct allowed_path {
+  const wchar_t* path;
+  bool directory;
+};
+
+static const allowed_path allowed[] = {
+  {L"C:\\Windows\\System32\\cmd.exe",        false},
+  {L"C:\\Windows\\notepad.exe",              false},
+
+  // Prefixes of other names.
+  {L"C:\\Windows\\System",                   false},
+  {L"C:\\Win",                               true},
+
+  // Trailing separators are ignored.
+  {L"C:\\Program Files\\Tools\\",            true},
+  {L"D:\\Apps",                              true},
+
+  // The names are converted to upper case by the table of upcase.
+  {L"C:\\Users\\J\u00f6rg\\tool.exe",        false},
+  {L"C:\\Users\\\u0391\u03b8\u03b7\u03bd\u03ac\\run.exe", false}
+};
+
+static const size_t nallowed = sizeof(allowed) / sizeof(allowed[0]);
+
+// Paths looked up (`expected`: is the path allowed?).
+struct lookup {
+  const wchar_t* path;
+  bool expected;
+};
+
+static const lookup lookups[] = {
+  // Files.
+  {L"C:\\Windows\\System32\\cmd.exe",        true},
+  {L"C:\\Windows\\notepad.exe",              true},
+  {L"C:\\Windows\\System32\\calc.exe",       false},
+  {L"E:\\Windows\\notepad.exe",              false},
+
+  // Directories: the files under them, not the directory itself (it is not
+  // an allowed file).
+  {L"C:\\Program Files\\Tools\\a\\b.exe",    true},
+  {L"C:\\Program Files\\Tools",              false},
+  {L"D:\\Apps\\app.exe",                     true},
+  {L"D:\\App\\app.exe",                      false},
+  {L"C:\\Program Files\\app.exe",            false},
+
+  // Prefixes.
+  {L"C:\\Windows\\System",                   true},
+  {L"C:\\Windows\\System3",                  false},
+  {L"C:\\Windows\\System32",                 false},
+  {L"C:\\Windows\\System32x\\cmd.exe",       false},
+  {L"C:\\Wi",                                false},
+  {L"C:\\Win\\x.exe",                        true},
+  {L"C:\\Windows\\x.exe",                    false},
+  {L"C:\\Win",                               false},
+  {L"C:",                                    false},
+
+  // Case-folded.
+  {L"c:\\windows\\system32\\CMD.EXE",        true},
+  {L"C:\\PROGRAM FILES\\tools\\x.exe",       true},
+  {L"c:\\users\\j\u00d6RG\\TOOL.EXE",        true},
+  {L"C:\\USERS\\\u0391\u0398\u0397\u039d\u0386\\RUN.EXE", true},
+  {L"C:\\Users\\Jorg\\tool.exe",             false},
+
+  // Trailing separators.
+  {L"C:\\Windows\\notepad.exe\\",            false},
+  {L"C:\\Program Files\\Tools\\",            true},
+  {L"D:\\Apps\\",                            true},
+  {L"C:\\Windows\\",                         false},
+  {L"C:\\Windows\\\\notepad.exe",            false},
+  {L"\\",                                    false},
+  {L"",                                      false}
+};
+
+static const size_t nlookups = sizeof(lookups) / sizeof(lookups[0]);
+
+// Components of the random paths.
+static const wchar_t* const components[] = {
+  L"C:", L"c:", L"D:", L"Windows", L"WINDOWS", L"Win", L"Wi", L"System",
+  L"system32", L"System32", L"cmd.exe", L"notepad.exe", L"Program Files",
+  L"Tools", L"Apps", L"Users", L"J\u00f6rg", L"J\u00d6RG", L"tool.exe", L"",
+  L"\u03b1\u03b8\u03b7\u03bd\u03ac", L"run.exe"
+};
+
+static const uint32_t ncomponents = sizeof(components) /
+                                    sizeof(components[0]);
+
+// Pseudo-random numbers (the same sequence on every platform).
+class random_generator {
+  public:
+    // Constructor.
+    random_generator(uint32_t seed);
+
+    // Next number.
+    uint32_t next();
+
+    // Next number in [0, n).
+    uint32_t next(uint32_t n);
+
+  private:
+    uint32_t _M_state;
+};
+
+inline random_generator::random_generator(uint32_t seed)
+  : _M_state(seed)
+{
+}
+
+inline uint32_t random_generator::next()
+{
+  // xorshift32.
+  _M_state ^= _M_state << 13;
+  _M_state ^= _M_state >> 17;
+  _M_state ^= _M_state << 5;
+
+  return _M_state;
+}
+
+inline uint32_t random_generator::next(uint32_t n)
+{
+  return next() % n;
+}
+
+// Convert code unit to upper case (the function the driver gets).
+static wchar_t convert(wchar_t c)
+{
+  return upcase::convert(c);
+}
+
+// Look up the path in the list and in the fast path: both have to agree
+// (and with `expected`, if not null).
+static bool check_find(const path_list& paths,
+                       const void* blob,
+                       const wchar_t* path,
+                       size_t pathlen,
+                       const bool* expected)
+{
+  bool found = paths.find(path, pathlen);
+  bool fast = (fast_path_find(blob, path, pathlen, convert) != 0);
+
+  return check((found == fast) && ((!expected) || (found == *expected)),
+               "'%.*ls': path list %s, fast path %s",
+               static_cast<int>((pathlen < 256) ? pathlen : 256),
+               path,
+               found ? "allowed" : "denied",
+               fast ? "allowed" : "denied");
+}
+
+// Build the list of allowed paths and compile its fast path.
+static bool build(path_list& paths, void*& blob, size_t& len)
+{
+  for (size_t i = 0; i < nallowed; i++) {
+    if (!check(paths.add(allowed[i].path,
+                         wcslen(allowed[i].path),
+                         allowed[i].directory),
+               "'%ls' could not be added",
+               allowed[i].path)) {
+      return false;
+    }
+  }
+
+  return ((check(paths.fast_path(blob, len),
+                 "the fast path could not be compiled")) &&
+          (check(fast_path_validate(blob, len) != 0,
+                 "the fast path is not valid")));
+}
+
+// The fast path finds the paths the list finds.
+static bool test_find(const path_list& paths, const void* blob)
+{
+  bool ok = true;
+
+  for (size_t i = 0; i < nlookups; i++) {
+    ok = check_find(paths,
+                    blob,
+                    lookups[i].path,
+                    wcslen(lookups[i].path),
+                    &lookups[i].expected) && ok;
+  }
+
+  // Over-long components: first, last and under an allowed directory.
+  wchar_t path[LONG_COMPONENT_LEN + 64];
+  size_t pathlen;
+
+  static const wchar_t* const prefixes[] = {
+    L"",
+    L"C:\\Windows\\System32\\cmd.exe",
+    L"C:\\Windows\\System32\\",
+    L"D:\\Apps\\"
+  };
+
+  static const bool expected[] = {false, false, false, true};
+
+  for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+    pathlen = wcslen(prefixes[i]);
+    wmemcpy(path, prefixes[i], pathlen);
+
+    wmemset(path + pathlen, L'x', LONG_COMPONENT_LEN);
+    pathlen += LONG_COMPONENT_LEN;
+
+    ok = check_find(paths, blob, path, pathlen, &expected[i]) && ok;
+
+    // Followed by another component.
+    wmemcpy(path + pathlen, L"\\cmd.exe", 8);
+    pathlen += 8;
+
+    ok = check_find(paths, blob, path, pathlen, &expected[i]) && ok;
+  }
+
+  // Random paths built from the components of the allowed paths.
+  random_generator random(0x5eed1234);
+
+  for (size_t i = 0; i < RANDOM_PATHS; i++) {
+    size_t ncomps = 1 + random.next(5);
+
+    pathlen = 0;
+    for (size_t j = 0; j < ncomps; j++) {
+      const wchar_t* comp = components[random.next(ncomponents)];
+      size_t len = wcslen(comp);
+
+      if (j > 0) {
+        path[pathlen++] = L'\\';
+      }
+
+      wmemcpy(path + pathlen, comp, len);
+      pathlen += len;
+    }
+
+    // Trailing separator.
+    if (random.next(4) == 0) {
+      path[pathlen++] = L'\\';
+    }
+
+    ok = check_find(paths, blob, path, pathlen, nullptr) && ok;
+  }
+
+  return ok;
+}
+
+// Copy of the blob (allocated with malloc(), `extra` zero bytes at the end).
+static uint8_t* copy(const void* blob, size_t len, size_t extra)
+{
+  uint8_t* b;
+  if ((b = reinterpret_cast<uint8_t*>(malloc(len + extra))) != nullptr) {
+    memcpy(b, blob, len);
+    memset(b + len, 0, extra);
+  }
+
+  return b;
+}
+
+// Is the blob rejected?
+static bool check_rejected(const uint8_t* blob, size_t len, const char* what)
+{
+  return check(fast_path_validate(blob, len) == 0,
+               "%s: blob accepted",
+               what);
+}
+
+// Malformed blobs.
+static bool test_validate(const void* blob, size_t len)
+{
+  const fast_path_header* hdr = static_cast<const fast_path_header*>(blob);
+  size_t nodes = sizeof(fast_path_header);
+
+  uint8_t* b;
+  if (!check((b = copy(blob, len, sizeof(uint16_t))) != nullptr,
+             "the blob could not be copied")) {
+    return false;
+  }
+
+  fast_path_header* h = reinterpret_cast<fast_path_header*>(b);
+  fast_path_node* n = reinterpret_cast<fast_path_node*>(b + nodes);
+
+  bool ok = true;
+
+  // Truncated.
+  ok = check_rejected(b, len - 1, "truncated by one byte") && ok;
+  ok = check_rejected(b, len - sizeof(uint16_t), "truncated name") && ok;
+  ok = check_rejected(b, sizeof(fast_path_header), "header only") && ok;
+  ok = check_rejected(b, sizeof(fast_path_header) - 1, "truncated header") &&
+       ok;
+  ok = check_rejected(b, 0, "empty") && ok;
+
+  // Mis-sized: the size of the header is not the length of the blob, or the
+  // counts don't add up to it.
+  h->size++;
+  ok = check_rejected(b, len, "size of the header") && ok;
+
+  h->size = static_cast<unsigned int>(len + sizeof(uint16_t));
+  ok = check_rejected(b, len + sizeof(uint16_t), "extra bytes") && ok;
+
+  h->size = static_cast<unsigned int>(len);
+  h->nunits++;
+  ok = check_rejected(b, len, "number of code units") && ok;
+
+  h->nunits = hdr->nunits;
+  h->nnodes++;
+  ok = check_rejected(b, len, "number of nodes") && ok;
+
+  h->nnodes = 0;
+  ok = check_rejected(b, len, "no nodes") && ok;
+
+  h->nnodes = 0x80000000u;
+  ok = check_rejected(b, len, "overflowing number of nodes") && ok;
+
+  memcpy(b, blob, len);
+
+  h->magic++;
+  ok = check_rejected(b, len, "magic number") && ok;
+
+  memcpy(b, blob, len);
+
+  h->version++;
+  ok = check_rejected(b, len, "version") && ok;
+
+  memcpy(b, blob, len);
+
+  ok = check(fast_path_validate(b, len) != 0, "copy: blob rejected") && ok;
+
+  // Every node (the root included) with a broken field.
+  for (unsigned int i = 0; i < hdr->nnodes; i++) {
+    const fast_path_node node = n[i];
+
+    // Backward child: the first child is the node itself or comes before
+    // it (a walk could loop).
+    if (node.nchildren > 0) {
+      n[i].children = i;
+      ok = check_rejected(b, len, "child is the node itself") && ok;
+
+      if (i > 0) {
+        n[i].children = i - 1;
+        ok = check_rejected(b, len, "backward child") && ok;
+      }
+
+      memcpy(b, blob, len);
+
+      n[i].nchildren = hdr->nnodes - node.children + 1;
+      ok = check_rejected(b, len, "children out of range") && ok;
+
+      n[i].nchildren = 0xffffffffu;
+      ok = check_rejected(b, len, "overflowing number of children") && ok;
+
+      memcpy(b, blob, len);
+    }
+
+    // A node without children may point anywhere, but not past the nodes
+    // if it has some.
+    n[i].children = hdr->nnodes;
+    n[i].nchildren = 1;
+    ok = check_rejected(b, len, "children after the last node") && ok;
+
+    memcpy(b, blob, len);
+
+    // Out-of-range name.
+    n[i].name = hdr->nunits - node.len + 1;
+    ok = check_rejected(b, len, "name out of range") && ok;
+
+    n[i].name = 0;
+    n[i].len = hdr->nunits + 1;
+    ok = check_rejected(b, len, "name too long") && ok;
+
+    n[i].name = 0xffffffffu;
+    n[i].len = 2;
+    ok = check_rejected(b, len, "overflowing name") && ok;
+
+    memcpy(b, blob, len);
+
+    // Unknown flag.
+    n[i].flags |= 0x04;
+    ok = check_rejected(b, len, "unknown flag") && ok;
+
+    n[i].flags = 0x80000000u;
+    ok = check_rejected(b, len, "unknown high flag") && ok;
+
+    memcpy(b, blob, len);
+  }
+
+  free(b);
+
+  return ok;
+}
+
+// Mutated blobs: the validator rejects them or fast_path_find() can walk
+// them (the sanitizers catch the reads out of the blob).
+static bool test_fuzz(const void* blob, size_t len)
+{
+  uint8_t* b;
+  if (!check((b = copy(blob, len, 0)) != nullptr,
+             "the blob could not be copied")) {
+    return false;
+  }
+
+  random_generator random(0xf00dcafe);
+
+  size_t naccepted = 0;
+
+  for (size_t i = 0; i < FUZZ_ITERATIONS; i++) {
+    memcpy(b, blob, len);
+
+    // Flip some bits, or store an interesting value in a 32-bit field.
+    size_t nmutations = 1 + random.next(4);
+
+    for (size_t j = 0; j < nmutations; j++) {
+      if (random.next(2) == 0) {
+        b[random.next(static_cast<uint32_t>(len))] ^=
+          static_cast<uint8_t>(1 << random.next(8));
+      } else {
+        static const unsigned int values[] = {
+          0, 1, 2, 0x7fffffffu, 0x80000000u, 0xfffffffeu, 0xffffffffu
+        };
+
+        size_t field = random.next(static_cast<uint32_t>(len / 4));
+        unsigned int value =
+          values[random.next(sizeof(values) / sizeof(values[0]))];
+        memcpy(b + (field * 4), &value, sizeof(unsigned int));
+      }
+    }
+
+    // Truncate sometimes.
+    size_t l = (random.next(8) == 0) ? random.next(static_cast<uint32_t>(len))
+                                     : len;
+
+    if (fast_path_validate(b, l)) {
+      naccepted++;
+
+      for (size_t j = 0; j < nlookups; j++) {
+        fast_path_find(b, lookups[j].path, wcslen(lookups[j].path), convert);
+      }
+    }
+  }
+
+  free(b);
+
+  // Some mutations (e.g. of the flags of a node) keep the blob valid: the
+  // walks ran.
+  return check(naccepted > 0, "fuzz: no mutated blob was accepted");
+}
+
+bool test_fast_path(const char*)
+{
+  path_list paths;
+  void* blob;
+  size_t len;
+  if (!build(paths, blob, len)) {
+    return false;
+  }
+
+  bool ok = test_find(paths, blob);
+  ok = test_validate(blob, len) && ok;
+  ok = test_fuzz(blob, len) && ok;
+
+  free(blob);
+
+  // An empty list: the fast path has only the root.
+  path_list empty;
+  if (check((empty.fast_path(blob, len)) &&
+            (fast_path_validate(blob, len) != 0),
+            "empty list: the fast path could not be compiled")) {
+    for (size_t i = 0; i < nlookups; i++) {
+      ok = check_find(empty,
+                      blob,
+                      lookups[i].path,
+                      wcslen(lookups[i].path),
+                      nullptr) && ok;
+    }
+
+    free(blob);
+  } else {
+    ok = false;
+  }
+
+  return ok;
+}
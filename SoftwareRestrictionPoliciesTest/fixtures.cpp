@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "tests.h"
+
+#ifdef _WIN32
+  // Visual Studio 2013 doesn't have snprintf().
+  #define snprintf(buf, size, ...) \
+          _snprintf_s(buf, size, _TRUNCATE, __VA_ARGS__)
+#endif
+
+const fixture fixtures[] = {
+  {
+    "pe32.exe",
+    true,
+    false,
+    "149D0DD976828AD066756E864203670DA349C704",
+    "F2481D2E420AD2496E41A1CB04AC43562E6B7F0AA6B524B83499E65BE6060489"
+  },
+  {
+    "pe32_signed.exe",
+    true,
+    true,
+    "149D0DD976828AD066756E864203670DA349C704",
+    "F2481D2E420AD2496E41A1CB04AC43562E6B7F0AA6B524B83499E65BE6060489"
+  },
+  {
+    "pe32_short_directory.exe",
+    true,
+    false,
+    "F3411FC34A985079836AC576DEF7F2EE874CDC51",
+    "372652704F4F18E9101A30E80D20CFFA9C18FD59FE7EEC9B1469F1DD26C4719C"
+  },
+  {
+    "pe32plus.exe",
+    true,
+    false,
+    "2B42D44CECFD66111305329700C558BF9247A711",
+    "14337533C4FF46A6701D75C2F214512E4A9AB328196C34A9B2B21A502C1F437E"
+  },
+  {
+    "pe32plus_signed.exe",
+    true,
+    true,
+    "2B42D44CECFD66111305329700C558BF9247A711",
+    "14337533C4FF46A6701D75C2F214512E4A9AB328196C34A9B2B21A502C1F437E"
+  },
+  {
+    "not_pe.bin",
+    false,
+    false,
+    "13AA84D91C98F4B8082D2E38E5D432D70D307648",
+    "199A03EF4F7367FF512C71D2341FFCB35E41C245551C6388B00D3E8184FF3142"
+  }
+};
+
+const size_t nfixtures = sizeof(fixtures) / sizeof(fixtures[0]);
+
+bool check(bool condition, const char* format, ...)
+{
+  if (!condition) {
+    va_list ap;
+    va_start(ap, format);
+
+    fprintf(stderr, "  Check failed: ");
+    vfprintf(stderr, format, ap);
+    fprintf(stderr, "\n");
+
+    va_end(ap);
+  }
+
+  return condition;
+}
+
+bool fixture_path(const char* directory,
+                  const char* filename,
+                  wchar_t* path,
+                  size_t size)
+{
+  char buf[1024];
+  int n = snprintf(buf, sizeof(buf), "%s/%s", directory, filename);
+  if ((n < 0) || (static_cast<size_t>(n) >= sizeof(buf))) {
+    return false;
+  }
+
+  size_t len = mbstowcs(path, buf, size);
+  return ((len != static_cast<size_t>(-1)) && (len < size));
+}
+
+uint8_t* read_fixture(const char* directory,
+                      const char* filename,
+                      size_t& len)
+{
+  char path[1024];
+  int n = snprintf(path, sizeof(path), "%s/%s", directory, filename);
+  if ((n < 0) || (static_cast<size_t>(n) >= sizeof(path))) {
+    return nullptr;
+  }
+
+  FILE* file;
+  if ((file = fopen(path, "rb")) == nullptr) {
+    return nullptr;
+  }
+
+  uint8_t* data = nullptr;
+  size_t size = 0;
+  len = 0;
+
+  do {
+    if (len == size) {
+      size = (size > 0) ? size * 2 : 4096;
+
+      uint8_t* d;
+      if ((d = reinterpret_cast<uint8_t*>(realloc(data, size))) == nullptr) {
+        free(data);
+        fclose(file);
+
+        return nullptr;
+      }
+
+      data = d;
+    }
+
+    size_t count = fread(data + len, 1, size - len, file);
+    if (count == 0) {
+      break;
+    }
+
+    len += count;
+  } while (true);
+
+  bool error = (ferror(file) != 0);
+  fclose(file);
+
+  if (error) {
+    free(data);
+    return nullptr;
+  }
+
+  return data;
+}
+
+bool write_fixture(const char* directory,
+                   const char* filename,
+                   const void* data,
+                   size_t len)
+{
+  char path[1024];
+  int n = snprintf(path, sizeof(path), "%s/%s", directory, filename);
+  if ((n < 0) || (static_cast<size_t>(n) >= sizeof(path))) {
+    return false;
+  }
+
+  FILE* file;
+  if ((file = fopen(path, "wb")) == nullptr) {
+    return false;
+  }
+
+  bool written = (fwrite(data, 1, len, file) == len);
+  return ((fclose(file) == 0) && (written));
+}
+
+void to_hex(const uint8_t* digest, size_t len, char* hex)
+{
+  static const char digits[] = "0123456789ABCDEF";
+
+  for (size_t i = 0; i < len; i++) {
+    hex[i * 2] = digits[digest[i] >> 4];
+    hex[(i * 2) + 1] = digits[digest[i] & 0x0f];
+  }
+
+  hex[len * 2] = 0;
+}
+
+bool from_hex(const char* hex, uint8_t* digest, size_t len)
+{
+  if (strlen(hex) != len * 2) {
+    return false;
+  }
+
+  for (size_t i = 0; i < len * 2; i++) {
+    char c = hex[i];
+
+    uint8_t n;
+    if ((c >= '0') && (c <= '9')) {
+      n = c - '0';
+    } else if ((c >= 'A') && (c <= 'F')) {
+      n = c - 'A' + 10;
+    } else if ((c >= 'a') && (c <= 'f')) {
+      n = c - 'a' + 10;
+    } else {
+      return false;
+    }
+
+    if ((i % 2) == 0) {
+      digest[i / 2] = n << 4;
+    } else {
+      digest[i / 2] |= n;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,449 @@
+#!/usr/bin/env python3
+# Generate the fixtures of the tests (run from this directory):
+#   - pe32.exe, pe32plus.exe: unsigned PE32 and PE32+ images (their size is
+#     not a multiple of 8, so they are padded when hashed).
+#   - pe32_short_directory.exe: PE32 image whose data directory has only 4
+#     entries (no certificate table entry).
+#   - pe32_signed.exe: pe32.exe signed by "SRP Test Signer".
+#   - pe32plus_signed.exe: pe32plus.exe signed by two signers, one with a
+#     non-ASCII common name (UTF8String) and one with only an organizational
+#     unit and an organization (PrintableString).
+#   - not_pe.bin: a file which is not a PE image.
+#   - catalogs/test.cat: a catalog file (certificate trust list) whose members
+#     are the SHA-1 digest of pe32.exe and the SHA-256 digest of
+#     pe32plus.exe (SpcIndirectDataContent attribute), the SHA-1 digest of
+#     pe32_short_directory.exe and the SHA-256 digest of not_pe.bin (tag
+#     only). It is not signed: the index of the catalogs doesn't look at the
+#     signers.
+#
+# The keys and the certificates are created with openssl, so the signatures
+# differ every time the fixtures are generated, but the digests and the
+# names don't. The expected digests are printed: they are calculated the way
+# the Authenticode specification describes them (headers, then the sections
+# sorted by file offset, then the rest of the file), independently of the
+# client.
+
+import hashlib
+import os
+import struct
+import subprocess
+import tempfile
+
+# Object identifiers.
+OID_SHA1 = '1.3.14.3.2.26'
+OID_SHA256 = '2.16.840.1.101.3.4.2.1'
+OID_RSA_ENCRYPTION = '1.2.840.113549.1.1.1'
+OID_SIGNED_DATA = '1.2.840.113549.1.7.2'
+OID_CONTENT_TYPE = '1.2.840.113549.1.9.3'
+OID_MESSAGE_DIGEST = '1.2.840.113549.1.9.4'
+OID_SPC_INDIRECT_DATA = '1.3.6.1.4.1.311.2.1.4'
+OID_SPC_SP_OPUS_INFO = '1.3.6.1.4.1.311.2.1.12'
+OID_SPC_PE_IMAGE_DATA = '1.3.6.1.4.1.311.2.1.15'
+OID_CTL = '1.3.6.1.4.1.311.10.1'
+OID_CATALOG_LIST = '1.3.6.1.4.1.311.12.1.1'
+OID_CATALOG_LIST_MEMBER = '1.3.6.1.4.1.311.12.1.2'
+OID_CAT_MEMBERINFO = '1.3.6.1.4.1.311.12.2.2'
+
+
+# DER.
+def der(tag, content):
+  n = len(content)
+  if n < 0x80:
+    length = bytes([n])
+  else:
+    b = n.to_bytes((n.bit_length() + 7) // 8, 'big')
+    length = bytes([0x80 | len(b)]) + b
+
+  return bytes([tag]) + length + content
+
+
+def sequence(*items):
+  return der(0x30, b''.join(items))
+
+
+def set_of(*items):
+  # The elements of a SET OF are sorted by their encoding.
+  return der(0x31, b''.join(sorted(items)))
+
+
+def integer(n):
+  return der(0x02, n.to_bytes((n.bit_length() + 8) // 8, 'big', signed=True))
+
+
+def octet_string(b):
+  return der(0x04, b)
+
+
+def null():
+  return der(0x05, b'')
+
+
+def oid(s):
+  parts = [int(p) for p in s.split('.')]
+  body = bytes([parts[0] * 40 + parts[1]])
+  for p in parts[2:]:
+    b = [p & 0x7f]
+    p >>= 7
+    while p:
+      b.insert(0, 0x80 | (p & 0x7f))
+      p >>= 7
+    body += bytes(b)
+
+  return der(0x06, body)
+
+
+def algorithm(s):
+  return sequence(oid(s), null())
+
+
+def context(n, content, constructed=True):
+  return der((0xa0 if constructed else 0x80) | n, content)
+
+
+# Split an element into (tag, content, encoding length).
+def parse(b, off=0):
+  tag = b[off]
+  n = b[off + 1]
+  hdr = 2
+  if n & 0x80:
+    nbytes = n & 0x7f
+    n = int.from_bytes(b[off + 2:off + 2 + nbytes], 'big')
+    hdr += nbytes
+
+  return tag, b[off + hdr:off + hdr + n], hdr + n
+
+
+# Elements of a constructed element.
+def children(content):
+  off = 0
+  while off < len(content):
+    tag, body, n = parse(content, off)
+    yield content[off:off + n]
+    off += n
+
+
+# Issuer (encoded) and serial number (encoded) of a certificate.
+def issuer_and_serial(cert):
+  _, body, _ = parse(cert)
+  tbs = next(children(body))
+  _, tbsbody, _ = parse(tbs)
+  fields = list(children(tbsbody))
+  if fields[0][0] == 0xa0:
+    fields = fields[1:]
+
+  return fields[2], fields[0]
+
+
+# openssl.
+def openssl(*args, stdin=None):
+  return subprocess.run(['openssl'] + list(args),
+                        input=stdin,
+                        stdout=subprocess.PIPE,
+                        check=True).stdout
+
+
+def certificate(tmp, name, subject, serial, issuer=None, mask='default'):
+  key = os.path.join(tmp, name + '.key')
+  pem = os.path.join(tmp, name + '.pem')
+  conf = os.path.join(tmp, name + '.cnf')
+  with open(conf, 'w', encoding='utf-8') as f:
+    f.write('[req]\ndistinguished_name = dn\nstring_mask = %s\n'
+            'utf8 = yes\n[dn]\n' % mask)
+
+  openssl('genrsa', '-out', key, '2048')
+  csr = openssl('req', '-new', '-key', key, '-subj', subject, '-utf8',
+                '-config', conf)
+
+  if issuer:
+    openssl('x509', '-req', '-days', '36500', '-set_serial', str(serial),
+            '-CA', issuer[1], '-CAkey', issuer[0], '-out', pem,
+            stdin=csr)
+  else:
+    openssl('x509', '-req', '-days', '36500', '-set_serial', str(serial),
+            '-signkey', key, '-out', pem, stdin=csr)
+
+  return key, pem, openssl('x509', '-in', pem, '-outform', 'DER')
+
+
+# PE images.
+SECTIONS = [
+  # Name, virtual address, contents.
+  (b'.text', 0x1000, b'\x55\x8b\xec\x33\xc0\x5d\xc3' + bytes(range(256))),
+  (b'.rdata', 0x2000, b'SoftwareRestrictionPolicies test fixture\0'),
+]
+
+FILE_ALIGNMENT = 0x200
+HEADERS_SIZE = 0x200
+
+
+def pe_image(plus, nentries=16, checksum=0x0000c0de, overlay=b''):
+  # DOS header and stub.
+  dos = bytearray(0x80)
+  dos[0:2] = b'MZ'
+  struct.pack_into('<I', dos, 0x3c, 0x80)
+  dos[0x4e:0x4e + 39] = b'This program cannot be run in DOS mode.'
+
+  # COFF file header.
+  optsize = (112 if plus else 96) + (nentries * 8)
+  coff = struct.pack('<4sHHIIIHH',
+                     b'PE\0\0',
+                     0x8664 if plus else 0x014c,
+                     len(SECTIONS),
+                     0x5f5e1000,
+                     0,
+                     0,
+                     optsize,
+                     0x0022 if plus else 0x0102)
+
+  # Optional header.
+  size_of_image = 0x1000 * (len(SECTIONS) + 1)
+  if plus:
+    opt = struct.pack('<HBBIIIII',
+                      0x20b, 14, 0, FILE_ALIGNMENT, FILE_ALIGNMENT, 0,
+                      0x1000, 0x1000)
+    opt += struct.pack('<QII', 0x140000000, 0x1000, FILE_ALIGNMENT)
+  else:
+    opt = struct.pack('<HBBIIIIII',
+                      0x10b, 14, 0, FILE_ALIGNMENT, FILE_ALIGNMENT, 0,
+                      0x1000, 0x1000, 0x2000)
+    opt += struct.pack('<III', 0x400000, 0x1000, FILE_ALIGNMENT)
+
+  opt += struct.pack('<HHHHHHIIIIHH',
+                     6, 0, 0, 0, 6, 0, 0, size_of_image, HEADERS_SIZE,
+                     checksum, 3, 0x8140)
+  if plus:
+    opt += struct.pack('<QQQQII', 0x100000, 0x1000, 0x100000, 0x1000, 0,
+                       nentries)
+  else:
+    opt += struct.pack('<IIIIII', 0x100000, 0x1000, 0x100000, 0x1000, 0,
+                       nentries)
+
+  opt += bytes(nentries * 8)
+  assert len(opt) == optsize
+
+  # Section table and sections.
+  table = b''
+  raw = b''
+  for i, (name, va, contents) in enumerate(SECTIONS):
+    table += struct.pack('<8sIIIIIIHHI',
+                         name,
+                         len(contents),
+                         va,
+                         FILE_ALIGNMENT,
+                         HEADERS_SIZE + (i * FILE_ALIGNMENT),
+                         0, 0, 0, 0,
+                         0x60000020 if i == 0 else 0x40000040)
+    raw += contents.ljust(FILE_ALIGNMENT, b'\0')
+
+  headers = bytes(dos) + coff + opt + table
+  assert len(headers) <= HEADERS_SIZE
+
+  return bytearray(headers.ljust(HEADERS_SIZE, b'\0') + raw + overlay)
+
+
+def pe_fields(image):
+  pe = struct.unpack_from('<I', image, 0x3c)[0]
+  nsections, optsize = struct.unpack_from('<HxxxxxxxxxxxxH', image, pe + 6)
+  optional = pe + 24
+  plus = struct.unpack_from('<H', image, optional)[0] == 0x20b
+  directory = optional + (112 if plus else 96)
+  nentries = struct.unpack_from('<I', image, directory - 4)[0]
+  return optional, directory, nentries, optional + optsize, nsections
+
+
+# SpcIndirectDataContent of a PE image.
+def indirect_data(digest_algorithm, digest):
+  return sequence(
+    sequence(oid(OID_SPC_PE_IMAGE_DATA),
+             sequence(der(0x03, b'\0'),
+                      context(0,
+                              context(2,
+                                      context(0,
+                                              '<<<Obsolete>>>'.encode(
+                                                'utf-16-be'
+                                              ),
+                                              False))))),
+    sequence(algorithm(digest_algorithm), octet_string(digest)))
+
+
+# Sign an image: append the certificate table (aligned on 8 bytes).
+def sign(image, signers, certificates):
+  image = bytearray(image)
+  image += bytes((8 - (len(image) % 8)) % 8)
+  optional, directory, _, _, _ = pe_fields(image)
+
+  # The checksum of a signed image usually changes (it isn't hashed).
+  struct.pack_into('<I', image, optional + 64, 0x0001beef)
+
+  sha256 = authenticode(bytes(image))[1]
+
+  # SpcIndirectDataContent.
+  indirect = indirect_data(OID_SHA256, sha256)
+
+  _, indirect_content, _ = parse(indirect)
+
+  signer_infos = []
+  for key, cert in signers:
+    attributes = [
+      sequence(oid(OID_CONTENT_TYPE), set_of(oid(OID_SPC_INDIRECT_DATA))),
+      sequence(oid(OID_SPC_SP_OPUS_INFO), set_of(sequence())),
+      sequence(oid(OID_MESSAGE_DIGEST),
+               set_of(octet_string(
+                 hashlib.sha256(indirect_content).digest()
+               ))),
+    ]
+
+    # The signature is calculated over the attributes encoded as a SET OF,
+    # but they are stored as [0] IMPLICIT.
+    signed = set_of(*attributes)
+    signature = openssl('dgst', '-sha256', '-sign', key, stdin=signed)
+
+    issuer, serial = issuer_and_serial(cert)
+    signer_infos.append(
+      sequence(integer(1),
+               sequence(issuer, serial),
+               algorithm(OID_SHA256),
+               context(0, parse(signed)[1]),
+               algorithm(OID_RSA_ENCRYPTION),
+               octet_string(signature)))
+
+  signed_data = sequence(
+    integer(1),
+    set_of(algorithm(OID_SHA256)),
+    sequence(oid(OID_SPC_INDIRECT_DATA), context(0, indirect)),
+    context(0, b''.join(certificates)),
+    # The signers are kept in the given order.
+    der(0x31, b''.join(signer_infos)))
+
+  pkcs7 = sequence(oid(OID_SIGNED_DATA), context(0, signed_data))
+
+  # WIN_CERTIFICATE.
+  entry = struct.pack('<IHH', 8 + len(pkcs7), 0x0200, 0x0002) + pkcs7
+  entry += bytes((8 - (len(entry) % 8)) % 8)
+
+  struct.pack_into('<II', image, directory + (4 * 8), len(image), len(entry))
+
+  return bytes(image + entry)
+
+
+# Authenticode digests (SHA-1, SHA-256), as in the specification.
+def authenticode(image):
+  if (image[0:2] != b'MZ') or (len(image) < 64):
+    return hashlib.sha1(image).digest(), hashlib.sha256(image).digest()
+
+  optional, directory, nentries, table, nsections = pe_fields(image)
+  checksum = optional + 64
+  headers_size = struct.unpack_from('<I', image, optional + 60)[0]
+
+  # Headers, without the checksum and the certificate table entry.
+  data = image[:checksum]
+  certoff = certlen = 0
+  if nentries > 4:
+    entry = directory + (4 * 8)
+    certoff, certlen = struct.unpack_from('<II', image, entry)
+    data += image[checksum + 4:entry] + image[entry + 8:headers_size]
+  else:
+    data += image[checksum + 4:headers_size]
+
+  # Sections, sorted by file offset.
+  sections = []
+  for i in range(nsections):
+    s = table + (i * 40)
+    size, offset = struct.unpack_from('<II', image, s + 16)
+    if size > 0:
+      sections.append((offset, size))
+
+  hashed = headers_size
+  for offset, size in sorted(sections):
+    data += image[offset:offset + size]
+    hashed += size
+
+  # Rest of the file (without the certificate table).
+  data += image[hashed:len(image) - certlen]
+
+  # An unsigned image is padded to a multiple of 8 bytes.
+  if certlen == 0:
+    data += bytes((8 - (len(image) % 8)) % 8)
+
+  return hashlib.sha1(data).digest(), hashlib.sha256(data).digest()
+
+
+# Catalog file: members are (digest, digest algorithm, attribute): with the
+# attribute, the digest is in the SpcIndirectDataContent; without it, only
+# in the tag (the digest in hexadecimal, UTF-16LE).
+def catalog(members):
+  subjects = []
+  for digest, digest_algorithm, attribute in members:
+    tag = octet_string(digest.hex().upper().encode('utf-16-le'))
+    if attribute:
+      value = indirect_data(digest_algorithm, digest)
+      attributes = set_of(sequence(oid(OID_SPC_INDIRECT_DATA), set_of(value)))
+    else:
+      # CAT_MEMBERINFO: subject GUID and version.
+      guid = '{C689AAB8-8E78-11D0-8C47-00C04FC295EE}'.encode('utf-16-be')
+      value = sequence(der(0x1e, guid), integer(512))
+      attributes = set_of(sequence(oid(OID_CAT_MEMBERINFO), set_of(value)))
+
+    subjects.append(sequence(tag, attributes))
+
+  ctl = sequence(
+    sequence(oid(OID_CATALOG_LIST)),
+    octet_string(bytes(range(16))),
+    der(0x17, b'251017000000Z'),
+    algorithm(OID_CATALOG_LIST_MEMBER),
+    sequence(*subjects))
+
+  signed_data = sequence(
+    integer(1),
+    set_of(algorithm(OID_SHA1)),
+    sequence(oid(OID_CTL), context(0, ctl)),
+    der(0x31, b''))
+
+  return sequence(oid(OID_SIGNED_DATA), context(0, signed_data))
+
+
+def main():
+  images = {
+    'pe32.exe': pe_image(False, overlay=b'extra'),
+    'pe32plus.exe': pe_image(True, overlay=b'overlay data'),
+    'pe32_short_directory.exe': pe_image(False, nentries=4, overlay=b'x'),
+    'not_pe.bin': b'#!/bin/sh\necho This is not a PE image.\n',
+  }
+
+  with tempfile.TemporaryDirectory() as tmp:
+    ca = certificate(tmp, 'ca', '/CN=SRP Test Root', 1)
+    signer = certificate(tmp, 'signer', '/O=SRP Fixtures/CN=SRP Test Signer',
+                         0x80a1b2c3d4, ca[0:2])
+    unicode = certificate(tmp, 'unicode', '/CN=Tëst Sïgner Ω', 2,
+                          mask='utf8only')
+    unit = certificate(tmp, 'unit', '/O=SRP Fixtures/OU=SRP Test Unit',
+                       3, ca[0:2])
+
+    images['pe32_signed.exe'] = sign(images['pe32.exe'],
+                                     [(signer[0], signer[2])],
+                                     [ca[2], signer[2]])
+
+    images['pe32plus_signed.exe'] = sign(images['pe32plus.exe'],
+                                         [(unicode[0], unicode[2]),
+                                          (unit[0], unit[2])],
+                                         [ca[2], unicode[2], unit[2]])
+
+  for name in sorted(images):
+    with open(name, 'wb') as f:
+      f.write(images[name])
+
+    sha1, sha256 = authenticode(bytes(images[name]))
+    print('%-26s %s %s' % (name, sha1.hex().upper(), sha256.hex().upper()))
+
+  os.makedirs('catalogs', exist_ok=True)
+  with open(os.path.join('catalogs', 'test.cat'), 'wb') as f:
+    f.write(catalog([
+      (authenticode(images['pe32.exe'])[0], OID_SHA1, True),
+      (authenticode(images['pe32plus.exe'])[1], OID_SHA256, True),
+      (authenticode(images['pe32_short_directory.exe'])[0], OID_SHA1, False),
+      (authenticode(images['not_pe.bin'])[1], OID_SHA256, False),
+    ]))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <locale.h>
+#include "tests.h"
+
+// Test.
+struct test {
+  const char* name;
+  bool (*run)(const char* directory);
+};
+
+static const test tests[] = {
+  {"authenticode", test_authenticode},
+  {"pkcs7", test_pkcs7},
+  {"catalog_index", test_catalog_index},
+  {"fast_path", test_fast_path}
+};
+
+static void usage(const char* program);
+
+int main(int argc, char** argv)
+{
+#ifndef _WIN32
+  // The paths are converted from UTF-8.
+  setlocale(LC_ALL, "C.UTF-8");
+#endif
+
+  const char* directory = "fixtures";
+  const char* name = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "--fixtures") == 0) && (i + 1 < argc)) {
+      directory = argv[++i];
+    } else if ((strcmp(argv[i], "--test") == 0) && (i + 1 < argc)) {
+      name = argv[++i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  size_t nrun = 0;
+  size_t nfailed = 0;
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    if ((!name) || (strcmp(name, tests[i].name) == 0)) {
+      bool passed = tests[i].run(directory);
+      printf("%-28s %s\n", tests[i].name, passed ? "passed" : "FAILED");
+
+      nrun++;
+
+      if (!passed) {
+        nfailed++;
+      }
+    }
+  }
+
+  if (nrun == 0) {
+    fprintf(stderr, "Unknown test '%s'.\n", name);
+    return -1;
+  }
+
+  if (nfailed > 0) {
+    printf("\n%llu of %llu test(s) failed.\n",
+           static_cast<unsigned long long>(nfailed),
+           static_cast<unsigned long long>(nrun));
+
+    return 1;
+  }
+
+  return 0;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr, "Usage: %s [OPTIONS]\n", program);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr,
+          "  --fixtures <dir>        Directory of the fixtures "
+          "(default: fixtures).\n");
+  fprintf(stderr,
+          "  --test <name>           Run only this test.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Tests:\n");
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    fprintf(stderr, "  %s\n", tests[i].name);
+  }
+}
@@ -0,0 +1,215 @@
+#include <string.h>
+#include <wchar.h>
+#include "tests.h"
+#include "pkcs7.h"
+#include "image_context.h"
+
+static const size_t PATH_MAX_LEN = 1024;
+static const size_t NAME_MAX_LEN = 256;
+
+// Signer of a fixture (see fixtures/make_fixtures.py).
+struct expected_signer {
+  const char* filename;
+
+  // Display names of the subject and of the issuer of the certificate.
+  const wchar_t* subject;
+  const wchar_t* issuer;
+
+  // Serial number (contents of the INTEGER, hexadecimal, upper case).
+  const char* serial;
+};
+
+// Signers, in the order of the SignerInfos.
+static const expected_signer signers[] = {
+  {
+    "pe32_signed.exe",
+    L"SRP Test Signer",
+    L"SRP Test Root",
+    "0080A1B2C3D4"
+  },
+
+  // Self-signed, the common name is a UTF8String.
+  {
+    "pe32plus_signed.exe",
+    L"T\u00ebst S\u00efgner \u03a9",
+    L"T\u00ebst S\u00efgner \u03a9",
+    "02"
+  },
+
+  // Without common name: the organizational unit is displayed.
+  {
+    "pe32plus_signed.exe",
+    L"SRP Test Unit",
+    L"SRP Test Root",
+    "03"
+  }
+};
+
+static const size_t nsigners = sizeof(signers) / sizeof(signers[0]);
+
+// Compare the display name of a Name with the expected one.
+static bool check_name(const char* filename,
+                       const char* what,
+                       const der_element& name,
+                       const wchar_t* expected)
+{
+  wchar_t buf[NAME_MAX_LEN];
+  size_t len;
+  if (!check(pkcs7::name(name, buf, NAME_MAX_LEN, len),
+             "%s: the name of the %s could not be decoded",
+             filename,
+             what)) {
+    return false;
+  }
+
+  return check((len == wcslen(expected)) && (wcscmp(buf, expected) == 0),
+               "%s: %s '%ls', expected '%ls'",
+               filename,
+               what,
+               buf,
+               expected);
+}
+
+// Signers of a signed fixture.
+static bool test_signers(const char* directory, const char* filename)
+{
+  wchar_t path[PATH_MAX_LEN];
+  image_context image;
+  if (!check((fixture_path(directory, filename, path, PATH_MAX_LEN)) &&
+             (image.open(path)),
+             "%s: the image could not be opened",
+             filename)) {
+    return false;
+  }
+
+  size_t len;
+  const uint8_t* data;
+  pkcs7 signature;
+  if ((!check((data = image.signature(len)) != nullptr,
+              "%s: the signature was not found",
+              filename)) ||
+      (!check(signature.parse(data, len),
+              "%s: the signature could not be parsed",
+              filename))) {
+    return false;
+  }
+
+  // Expected signers of this fixture.
+  size_t first = nsigners;
+  size_t count = 0;
+  for (size_t i = 0; i < nsigners; i++) {
+    if (strcmp(signers[i].filename, filename) == 0) {
+      if (first == nsigners) {
+        first = i;
+      }
+
+      count++;
+    }
+  }
+
+  if (!check(signature.count() == count,
+             "%s: %llu signer(s), expected %llu",
+             filename,
+             static_cast<unsigned long long>(signature.count()),
+             static_cast<unsigned long long>(count))) {
+    return false;
+  }
+
+  bool ok = true;
+
+  for (size_t i = 0; i < count; i++) {
+    const expected_signer& expected = signers[first + i];
+
+    pkcs7::signer signer;
+    if (!check(signature.get(i, signer),
+               "%s: signer %llu not found",
+               filename,
+               static_cast<unsigned long long>(i))) {
+      ok = false;
+      continue;
+    }
+
+    ok = check_name(filename, "subject", signer.subject, expected.subject) &&
+         ok;
+
+    ok = check_name(filename, "issuer", signer.issuer, expected.issuer) && ok;
+
+    char serial[(NAME_MAX_LEN * 2) + 1];
+    if (check(signer.serial.len < NAME_MAX_LEN,
+              "%s: serial number too long",
+              filename)) {
+      to_hex(signer.serial.data, signer.serial.len, serial);
+      ok = check(strcmp(serial, expected.serial) == 0,
+                 "%s: serial number %s, expected %s",
+                 filename,
+                 serial,
+                 expected.serial) && ok;
+    } else {
+      ok = false;
+    }
+
+    // The identity is the one of the certificate found.
+    pkcs7::signer identity;
+    ok = check((signature.identity(i, identity)) &&
+               (identity.issuer.len == signer.issuer.len) &&
+               (memcmp(identity.issuer.data,
+                       signer.issuer.data,
+                       signer.issuer.len) == 0) &&
+               (identity.serial.len == signer.serial.len) &&
+               (memcmp(identity.serial.data,
+                       signer.serial.data,
+                       signer.serial.len) == 0),
+               "%s: the identity of signer %llu differs",
+               filename,
+               static_cast<unsigned long long>(i)) && ok;
+
+    // The buffer is too small for the name.
+    wchar_t buf[4];
+    size_t namelen;
+    ok = check(!pkcs7::name(signer.subject, buf, 4, namelen),
+               "%s: name decoded into a buffer which is too small",
+               filename) && ok;
+  }
+
+  // There is no signer after the last one.
+  pkcs7::signer signer;
+  ok = check((!signature.get(count, signer)) &&
+             (!signature.identity(count, signer)),
+             "%s: signer found after the last one",
+             filename) && ok;
+
+  // Truncated signature.
+  pkcs7 truncated;
+  ok = check((!truncated.parse(data, len - 1)) &&
+             (!truncated.parse(data, len / 2)) &&
+             (!truncated.parse(data, 0)),
+             "%s: truncated signature parsed",
+             filename) && ok;
+
+  return ok;
+}
+
+bool test_pkcs7(const char* directory)
+{
+  bool ok = true;
+
+  for (size_t i = 0; i < nfixtures; i++) {
+    const fixture& f = fixtures[i];
+
+    if (f.signed_image) {
+      ok = test_signers(directory, f.filename) && ok;
+    } else {
+      // An unsigned image has no signature.
+      wchar_t path[PATH_MAX_LEN];
+      image_context image;
+      size_t len;
+      ok = check((fixture_path(directory, f.filename, path, PATH_MAX_LEN)) &&
+                 (image.open(path)) &&
+                 (image.signature(len) == nullptr),
+                 "%s: signature found",
+                 f.filename) && ok;
+    }
+  }
+
+  return ok;
+}
@@ -0,0 +1,74 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <wchar.h>
+
+// Fixture (see fixtures/make_fixtures.py).
+struct fixture {
+  const char* filename;
+
+  // Is the file a PE image?
+  bool pe;
+
+  // Is the image signed?
+  bool signed_image;
+
+  // Authenticode digests (hexadecimal, upper case).
+  const char* sha1;
+  const char* sha256;
+};
+
+// Fixtures.
+extern const fixture fixtures[];
+extern const size_t nfixtures;
+
+// Print a message if the condition doesn't hold (returns the condition).
+bool check(bool condition, const char* format, ...);
+
+// Path of a fixture.
+bool fixture_path(const char* directory,
+                  const char* filename,
+                  wchar_t* path,
+                  size_t size);
+
+// Read a fixture (the data must be freed with free()).
+uint8_t* read_fixture(const char* directory,
+                      const char* filename,
+                      size_t& len);
+
+// Write a file (used for the files the tests derive from the fixtures).
+bool write_fixture(const char* directory,
+                   const char* filename,
+                   const void* data,
+                   size_t len);
+
+// Convert a digest to hexadecimal (upper case, `hex` must have room for
+// `len * 2 + 1` characters).
+void to_hex(const uint8_t* digest, size_t len, char* hex);
+
+// Convert a digest from hexadecimal.
+bool from_hex(const char* hex, uint8_t* digest, size_t len);
+
+// Authenticode digests of the fixtures (in memory and from the file), of
+// images larger than the bytes read when they are opened, and malformed
+// images.
+bool test_authenticode(const char* directory);
+
+// Signers of the signatures of the fixtures (names, issuers and serial
+// numbers) and truncated signatures.
+bool test_pkcs7(const char* directory);
+
+// Members of the catalog file of the fixtures, in memory and in the index of
+// the catalog files (built, rebuilt from the previous index, saved and
+// loaded).
+bool test_catalog_index(const char* directory);
+
+// The fast path of the driver compiled from a list of allowed paths finds
+// the paths the list finds (files, directories, prefixes, case-folded,
+// trailing separators and over-long components), malformed blobs are
+// rejected and mutated blobs are rejected or walked safely.
+bool test_fast_path(const char* directory);
+
+#endif // TESTS_H
@@ -3,4 +3,19 @@
 
 #define COMMUNICATION_PORT L"\\SoftwareRestrictionPoliciesPort"
 
+/* Time the driver waits for the verdict of the client (milliseconds), the
+ * executable is allowed afterwards.
+ */
+#define REQUEST_TIMEOUT 250
+
+/* Request sent by the driver: this header, followed by the file name (not
+ * null-terminated).
+ */
+typedef struct {
+  /* When the request was sent (performance counter, the one
+   * QueryPerformanceCounter() reads).
+   */
+  long long sent;
+} request_header;
+
 #endif /* COMMUNICATION_PORT_H */
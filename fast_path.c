@@ -0,0 +1,187 @@
+#include "fast_path.h"
+
+#define NODES(hdr) ((const fast_path_node*) ((hdr) + 1))
+#define NAMES(hdr) ((const unsigned short*) (NODES(hdr) + (hdr)->nnodes))
+
+
+/******************************************************************************
+ ******************************************************************************
+ **                                                                          **
+ ** Function: compare                                                        **
+ **                                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+/* Compare component with a name in upper case (the component is converted
+ * as it is compared).
+ */
+static int compare(const wchar_t* s,
+                   size_t len,
+                   const unsigned short* upper,
+                   unsigned int upperlen,
+                   fast_path_upcase upcase)
+{
+  unsigned long c;
+  size_t n;
+  size_t i;
+
+  n = (len < upperlen) ? len : upperlen;
+
+  for (i = 0; i < n; i++) {
+    /* ASCII is converted here, the rest by `upcase`. */
+    if ((unsigned long) s[i] < 0x80) {
+      c = ((s[i] >= L'a') && (s[i] <= L'z')) ? s[i] - (L'a' - L'A') : s[i];
+    } else {
+      c = (unsigned long) upcase(s[i]);
+    }
+
+    if (c != upper[i]) {
+      return (c < upper[i]) ? -1 : 1;
+    }
+  }
+
+  return (len < upperlen) ? -1 : (len > upperlen);
+}
+
+
+/******************************************************************************
+ ******************************************************************************
+ **                                                                          **
+ ** Function: fast_path_validate                                             **
+ **                                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+int fast_path_validate(const void* blob, size_t len)
+{
+  const fast_path_header* hdr;
+  const fast_path_node* nodes;
+  const fast_path_node* node;
+  unsigned int i;
+
+  if ((len < sizeof(fast_path_header)) || (len > FAST_PATH_MAX_SIZE)) {
+    return 0;
+  }
+
+  hdr = (const fast_path_header*) blob;
+
+  if ((hdr->magic != FAST_PATH_MAGIC) ||
+      (hdr->version != FAST_PATH_VERSION) ||
+      (hdr->size != len) ||
+      (hdr->nnodes == 0)) {
+    return 0;
+  }
+
+  /* The counts are checked against the size first, so the size of the blob
+   * computed from them doesn't overflow.
+   */
+  len -= sizeof(fast_path_header);
+
+  if ((hdr->nnodes > len / sizeof(fast_path_node)) ||
+      (hdr->nunits > len / sizeof(unsigned short)) ||
+      ((hdr->nnodes * sizeof(fast_path_node)) +
+       (hdr->nunits * sizeof(unsigned short)) != len)) {
+    return 0;
+  }
+
+  nodes = NODES(hdr);
+
+  for (i = 0; i < hdr->nnodes; i++) {
+    node = &nodes[i];
+
+    /* The name must be in the blob and the children must come after the
+     * node (the walks go forward).
+     */
+    if ((node->len > hdr->nunits) ||
+        (node->name > hdr->nunits - node->len) ||
+        ((node->nchildren > 0) &&
+         ((node->children <= i) ||
+          (node->children > hdr->nnodes) ||
+          (node->nchildren > hdr->nnodes - node->children))) ||
+        ((node->flags & ~(FAST_PATH_FILE | FAST_PATH_DIRECTORY)) != 0)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/******************************************************************************
+ ******************************************************************************
+ **                                                                          **
+ ** Function: fast_path_find                                                 **
+ **                                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+int fast_path_find(const void* blob,
+                   const wchar_t* path,
+                   size_t pathlen,
+                   fast_path_upcase upcase)
+{
+  const fast_path_header* hdr;
+  const fast_path_node* nodes;
+  const unsigned short* names;
+  const fast_path_node* node;
+  const fast_path_node* child;
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
+  size_t pos;
+  size_t end;
+  int cmp;
+
+  if (pathlen == 0) {
+    return 0;
+  }
+
+  hdr = (const fast_path_header*) blob;
+  nodes = NODES(hdr);
+  names = NAMES(hdr);
+
+  /* For each component... */
+  node = nodes;
+  pos = 0;
+
+  do {
+    for (end = pos; (end < pathlen) && (path[end] != L'\\'); end++);
+
+    /* Look for the component among the children of the node. */
+    lo = node->children;
+    hi = lo + node->nchildren;
+    child = NULL;
+
+    while (lo < hi) {
+      mid = lo + ((hi - lo) / 2);
+
+      if ((cmp = compare(path + pos,
+                         end - pos,
+                         names + nodes[mid].name,
+                         nodes[mid].len,
+                         upcase)) < 0) {
+        hi = mid;
+      } else if (cmp > 0) {
+        lo = mid + 1;
+      } else {
+        child = &nodes[mid];
+        break;
+      }
+    }
+
+    if (!child) {
+      return 0;
+    }
+
+    node = child;
+
+    /* Last component? */
+    if (end == pathlen) {
+      return ((node->flags & FAST_PATH_FILE) != 0);
+    }
+
+    /* If the directory is allowed... */
+    if (node->flags & FAST_PATH_DIRECTORY) {
+      return 1;
+    }
+
+    pos = end + 1;
+  } while (1);
+}
@@ -0,0 +1,88 @@
+#ifndef FAST_PATH_H
+#define FAST_PATH_H
+
+/* Fast path of the policy: the allowed paths, compiled by the client into a
+ * position-independent blob which is pushed to the driver (see
+ * communication_port.h), so the driver allows them without asking the
+ * client.
+ *
+ * The blob is the trie of path components of the client, laid out in
+ * breadth-first order: the children of a node are consecutive nodes, sorted
+ * by name (code unit by code unit, a name goes before the longer names it
+ * is a prefix of), so each component is found with a binary search. The
+ * names are in upper case (UTF-16).
+ *
+ * Layout: header, nodes (the root is the first node), names.
+ *
+ * This file is shared by the driver and the client, it doesn't depend on
+ * either of them.
+ */
+
+#ifdef _KERNEL_MODE
+  #include <ntdef.h>
+#else
+  #include <stddef.h>
+  #include <wchar.h>
+#endif /* _KERNEL_MODE */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FAST_PATH_MAGIC   0x50545346 /* "FSTP". */
+#define FAST_PATH_VERSION 1
+
+/* Maximum size of a blob (bytes). */
+#define FAST_PATH_MAX_SIZE (64 * 1024 * 1024)
+
+/* Flags of a node. */
+#define FAST_PATH_FILE      0x01 /* Allowed file. */
+#define FAST_PATH_DIRECTORY 0x02 /* Allowed directory (and its files). */
+
+/* The fields are 32-bit (the drivers have no <stdint.h>). */
+typedef struct {
+  unsigned int magic;
+  unsigned int version;
+
+  /* Size of the blob (including the header). */
+  unsigned int size;
+
+  unsigned int nnodes;
+
+  /* Number of code units of the names. */
+  unsigned int nunits;
+} fast_path_header;
+
+typedef struct {
+  /* Name of the component (offset and length in code units). */
+  unsigned int name;
+  unsigned int len;
+
+  /* First child and number of children. */
+  unsigned int children;
+  unsigned int nchildren;
+
+  unsigned int flags;
+} fast_path_node;
+
+/* Convert code unit to upper case. */
+typedef wchar_t (*fast_path_upcase)(wchar_t c);
+
+/* Validate blob (it doesn't trust the sender): returns 1 if the blob can be
+ * passed to fast_path_find(), 0 otherwise.
+ */
+int fast_path_validate(const void* blob, size_t len);
+
+/* Is the path allowed? The path has no prefix (e.g. "C:\Windows\..."),
+ * `upcase` converts its code units to upper case.
+ */
+int fast_path_find(const void* blob,
+                   const wchar_t* path,
+                   size_t pathlen,
+                   fast_path_upcase upcase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FAST_PATH_H */